@@ -0,0 +1,109 @@
+#include "VkApi.h"
+
+/*
+* Headless frame loop.
+*
+* Usage: headless [<frames>] [<output>] [<meshes>]
+*
+* Runs a small falling body sandbox for a fixed number of frames against the
+* offscreen renderer and logs the timings gathered by VkHeadless. Balls and
+* boulders come out of a mesh file written by the mesh tool from drop.obj, the
+* few boulders in front of the eye draw meshlet by meshlet while the balls
+* move through their levels as they fall away. With an output path the final
+* frame is read back and written as binary PPM, two runs of the same build
+* produce the same image. The run fails if that frame holds nothing but the
+* clear color. Needs no window system, any Vulkan device works including
+* software ones like lavapipe.
+*/
+
+constexpr u32       WIDTH { 1280 };
+constexpr u32       HEIGHT{ 720 };
+constexpr u32       FRAMES{ 600 };
+constexpr s8 const* MESHES{ "drop.vkm" };
+
+// Set before the runner constructs the sandbox
+static s8 const* spMeshes{ MESHES };
+
+struct Eye : VkAcs::Actor {};
+struct Ball : VkAcs::Actor {};
+struct Boulder : VkAcs::Actor {};
+
+struct Drop : Sandbox
+{
+  void OnCreate(VkRenderer& renderer) override
+  {
+    // Ball first, boulder second, in the order of drop.obj
+    std::vector<VkMesh const*> const meshes{ renderer.LoadMeshes(spMeshes) };
+    if (meshes.size() < 2)
+    {
+      VK_LOG("Mesh file %s has to hold a ball and a boulder\n", spMeshes);
+      std::exit(1);
+    }
+    void* const pProgram{ (void*)renderer.Program(VK_SHADER_LAMBERT_INSTANCED) };
+    VkAcs::Handle const eye{ VkAcs::Create<Eye>() };
+    VkAcs::Attach<acs::Transform>(eye, r32v3{ 0, 5, 30 }, r32v3{}, r32v3{ 1 });
+    VkAcs::Attach<acs::Camera>(eye, 60.0f, 0.1f, 100.0f);
+    // Rows of balls thrown sideways at different heights
+    for (u32 i{}; i < 256; ++i)
+    {
+      r32v3 const position{ (r32)(i % 16) - 8.0f, 10.0f + (r32)(i / 16), 0.0f };
+      VkAcs::Handle const ball{ VkAcs::Create<Ball>() };
+      VkAcs::Attach<acs::Transform>(ball, position, r32v3{}, r32v3{ 1 });
+      VkAcs::Attach<acs::Rigidbody>(ball, r32v3{ (r32)(i % 3) - 1.0f, 0, 0 }, 9.81f);
+      VkAcs::Attach<acs::Bounds>(ball, 0.5f);
+      VkAcs::Attach<acs::Model>(ball);
+      VkAcs::Attach<acs::Renderable>(ball, (void*)meshes[0], pProgram);
+    }
+    // Close enough to keep their full level, few enough to be culled per meshlet
+    for (u32 i{}; i < 2; ++i)
+    {
+      VkAcs::Handle const boulder{ VkAcs::Create<Boulder>() };
+      VkAcs::Attach<acs::Transform>(boulder, r32v3{ i ? 4.0f : -4.0f, 2.0f, 20.0f }, r32v3{}, r32v3{ 1 });
+      VkAcs::Attach<acs::Bounds>(boulder, 2.0f);
+      VkAcs::Attach<acs::Model>(boulder);
+      VkAcs::Attach<acs::Renderable>(boulder, (void*)meshes[1], pProgram);
+    }
+  }
+};
+
+int main(int argc, char* argv[])
+{
+  u32 const frames{ argc > 1 ? (u32)std::max(std::atoi(argv[1]), 1) : FRAMES };
+  s8 const* pOutput{ argc > 2 ? argv[2] : nullptr };
+  spMeshes = argc > 3 ? argv[3] : MESHES;
+  VkHeadless<Drop> headless{ WIDTH, HEIGHT, frames, 60, 0, VK_FRAMES_IN_FLIGHT, pOutput != nullptr };
+  if (!pOutput)
+  {
+    return 0;
+  }
+  std::vector<u8> const& pixels{ headless.Pixels() };
+  if (pixels.size() != (u64)WIDTH * HEIGHT * 4)
+  {
+    VK_LOG("Failed to read back the final %ux%u frame\n", WIDTH, HEIGHT);
+    return 1;
+  }
+  // The clear color is black, anything else got drawn
+  u64 drawn{};
+  for (u64 i{}; i < pixels.size(); i += 4)
+  {
+    drawn += pixels[i] || pixels[i + 1] || pixels[i + 2];
+  }
+  if (!drawn)
+  {
+    VK_LOG("Frame %u holds nothing but the clear color\n", frames);
+    return 1;
+  }
+  // PPM carries no alpha
+  std::ofstream stream{ pOutput, std::ios::binary | std::ios::trunc };
+  stream << "P6\n" << WIDTH << " " << HEIGHT << "\n255\n";
+  for (u64 i{}; i < pixels.size(); i += 4)
+  {
+    stream.write((s8 const*)pixels.data() + i, 3);
+  }
+  if (!stream)
+  {
+    VK_LOG("Failed to write %s\n", pOutput);
+    return 1;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,1076 @@
+#include <charconv>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+#include "VkMeshFile.h"
+#include "VkMeshOptimizer.h"
+
+/*
+* Offline mesh conversion.
+*
+* Usage: mesh <output> <input> [<input> ...]
+*
+* Reads Wavefront OBJ, glTF 2.0 with external or embedded buffers and binary
+* glTF. Every OBJ object and every glTF triangle primitive becomes one mesh of
+* the output, named after its object or its mesh and primitive index. Polygons
+* are triangulated as fans and OBJ corners which share all of their attributes
+* are merged into one vertex. Missing normals get accumulated from the faces
+* around their vertex, missing colors default to white and OBJ uvs are flipped
+* into the top left origin of glTF and Vulkan. Node transforms are not applied,
+* meshes keep the space they were authored in.
+*
+* Every mesh runs through the passes of VkMeshOptimizer.h, triangles get
+* reordered for the vertex cache and for overdraw, vertices by first use, and
+* the final index order gets cut into meshlets. Meshlets of closed meshes carry
+* back face cones. A chain of simplified levels of detail is appended behind
+* the full mesh, every level indexing the same vertices. The average cache miss
+* ratio of the full meshes before and after is reported.
+*
+* Vertices are quantized into VertexLambertCompact and written together with
+* their u32 indices, meshlets and levels into the container described in
+* VkMeshFile.h.
+* The output is written next to its destination first and renamed over it.
+*/
+
+namespace fs = std::filesystem;
+
+struct Mesh
+{
+  std::string                mName    {};
+  std::vector<VertexLambert> mVertices{};
+  std::vector<u32>           mIndices {};
+  std::vector<VkMeshlet>     mMeshlets{};
+  std::vector<VkMeshLod>     mLods    {};
+};
+
+/*
+* File routines.
+*/
+
+static u32 ReadFile(fs::path const& path, std::string& data)
+{
+  std::ifstream stream{ path, std::ios::binary };
+  if (!stream)
+  {
+    return 0;
+  }
+  std::ostringstream oss{};
+  oss << stream.rdbuf();
+  data = oss.str();
+  return 1;
+}
+
+/*
+* Geometry routines.
+*/
+
+// Area weighted face normals get summed into every vertex which came without a normal
+static void GenerateNormals(Mesh& mesh)
+{
+  std::vector<u8> missing(mesh.mVertices.size());
+  u32 any{};
+  for (u64 i{}; i < mesh.mVertices.size(); ++i)
+  {
+    r32 const* pNormal{ mesh.mVertices[i].mNormal };
+    missing[i] = pNormal[0] == 0.f && pNormal[1] == 0.f && pNormal[2] == 0.f;
+    any |= missing[i];
+  }
+  if (!any)
+  {
+    return;
+  }
+  for (u64 i{}; i + 2 < mesh.mIndices.size(); i += 3)
+  {
+    VertexLambert* pCorners[3]{ &mesh.mVertices[mesh.mIndices[i]], &mesh.mVertices[mesh.mIndices[i + 1]], &mesh.mVertices[mesh.mIndices[i + 2]] };
+    r32v3 const a{ pCorners[0]->mPosition[0], pCorners[0]->mPosition[1], pCorners[0]->mPosition[2] };
+    r32v3 const b{ pCorners[1]->mPosition[0], pCorners[1]->mPosition[1], pCorners[1]->mPosition[2] };
+    r32v3 const c{ pCorners[2]->mPosition[0], pCorners[2]->mPosition[1], pCorners[2]->mPosition[2] };
+    r32v3 const normal{ glm::cross(b - a, c - a) };
+    for (u32 j{}; j < 3; ++j)
+    {
+      if (missing[mesh.mIndices[i + j]])
+      {
+        pCorners[j]->mNormal[0] += normal.x;
+        pCorners[j]->mNormal[1] += normal.y;
+        pCorners[j]->mNormal[2] += normal.z;
+      }
+    }
+  }
+  for (u64 i{}; i < mesh.mVertices.size(); ++i)
+  {
+    r32* pNormal{ mesh.mVertices[i].mNormal };
+    r32 const length{ std::sqrt(pNormal[0] * pNormal[0] + pNormal[1] * pNormal[1] + pNormal[2] * pNormal[2]) };
+    if (missing[i] && length > 0.f)
+    {
+      pNormal[0] /= length;
+      pNormal[1] /= length;
+      pNormal[2] /= length;
+    }
+  }
+}
+
+// Reorders triangles and vertices and builds the meshlets and levels, returns the cache misses of the full mesh before and after
+static std::pair<r64, r64> Optimize(Mesh& mesh)
+{
+  u32 const vertexCount{ (u32)mesh.mVertices.size() };
+  u32 const indexCount{ (u32)mesh.mIndices.size() };
+  r64 const triangles{ (r64)(indexCount / 3) };
+  r32 const* const pPositions{ mesh.mVertices.empty() ? nullptr : mesh.mVertices[0].mPosition };
+  u32 const stride{ (u32)sizeof(VertexLambert) };
+  r64 const before{ VkMeshOptimizer::AnalyzeVertexCache(mesh.mIndices.data(), indexCount, vertexCount).mAcmr * triangles };
+  VkMeshOptimizer::OptimizeVertexCache(mesh.mIndices.data(), indexCount, vertexCount);
+  VkMeshOptimizer::OptimizeOverdraw(mesh.mIndices.data(), indexCount, pPositions, stride, vertexCount);
+  u32 const closed{ VkMeshOptimizer::Closed(mesh.mIndices.data(), indexCount, pPositions, stride, vertexCount) };
+  VkMeshOptimizer::BuildMeshlets(mesh.mIndices.data(), indexCount, pPositions, stride, vertexCount, closed, mesh.mMeshlets);
+  VkMeshOptimizer::BuildLods(mesh.mIndices, pPositions, stride, vertexCount, mesh.mLods);
+  // Coarser levels only use vertices of the full mesh, renumbering all of them keeps the full mesh first
+  std::vector<u32> remap(vertexCount);
+  u32 const referenced{ VkMeshOptimizer::OptimizeVertexFetch(mesh.mIndices.data(), (u32)mesh.mIndices.size(), vertexCount, remap.data()) };
+  std::vector<VertexLambert> vertices(referenced);
+  for (u32 i{}; i < vertexCount; ++i)
+  {
+    if (remap[i] != ~0u)
+    {
+      vertices[remap[i]] = mesh.mVertices[i];
+    }
+  }
+  mesh.mVertices = std::move(vertices);
+  r64 const after{ VkMeshOptimizer::AnalyzeVertexCache(mesh.mIndices.data(), indexCount, referenced).mAcmr * triangles };
+  return { before, after };
+}
+
+/*
+* Wavefront OBJ.
+*/
+
+static void SkipSpace(std::string_view& line)
+{
+  while (!line.empty() && (line.front() == ' ' || line.front() == '\t'))
+  {
+    line.remove_prefix(1);
+  }
+}
+static u32 ParseFloat(std::string_view& line, r32& value)
+{
+  SkipSpace(line);
+  // from_chars rejects the explicit plus some exporters write
+  if (!line.empty() && line.front() == '+')
+  {
+    line.remove_prefix(1);
+  }
+  auto const [pEnd, error] { std::from_chars(line.data(), line.data() + line.size(), value) };
+  if (error != std::errc{})
+  {
+    return 0;
+  }
+  line.remove_prefix(pEnd - line.data());
+  return 1;
+}
+static u32 ParseIndex(std::string_view& line, s64& value)
+{
+  auto const [pEnd, error] { std::from_chars(line.data(), line.data() + line.size(), value) };
+  if (error != std::errc{})
+  {
+    return 0;
+  }
+  line.remove_prefix(pEnd - line.data());
+  return 1;
+}
+// Resolves one based and negative relative indices, zero stands for an absent attribute
+static u32 Resolve(s64 index, u64 count, s64& resolved)
+{
+  resolved = (index < 0) ? (s64)count + index : index - 1;
+  return resolved >= 0 && resolved < (s64)count;
+}
+
+static u32 ReadObj(fs::path const& path, std::vector<Mesh>& meshes)
+{
+  std::string data{};
+  if (!ReadFile(path, data))
+  {
+    std::cerr << "Can not read " << path.string() << "\n";
+    return 0;
+  }
+
+  struct Corner
+  {
+    s64 mPosition{};
+    s64 mUv      { -1 };
+    s64 mNormal  { -1 };
+
+    __forceinline u32 operator == (Corner const& other) const noexcept { return mPosition == other.mPosition && mUv == other.mUv && mNormal == other.mNormal; }
+  };
+  struct CornerHash
+  {
+    __forceinline u64 operator () (Corner const& corner) const noexcept { return VkUtils::Hash(&corner, sizeof(Corner)); }
+  };
+
+  std::vector<std::array<r32, 7>> positions{};
+  std::vector<std::array<r32, 2>> uvs{};
+  std::vector<std::array<r32, 3>> normals{};
+  std::unordered_map<Corner, u32, CornerHash> merged{};
+  std::vector<u32> polygon{};
+  Mesh mesh{ path.stem().string() };
+
+  auto const finish{ [&]()
+  {
+    if (!mesh.mIndices.empty())
+    {
+      meshes.emplace_back(std::move(mesh));
+    }
+    mesh = Mesh{};
+    merged.clear();
+  } };
+
+  u64 lineNumber{};
+  std::string_view text{ data };
+  while (!text.empty())
+  {
+    u64 const end{ std::min<u64>(text.find('\n'), text.size()) };
+    std::string_view line{ text.substr(0, end) };
+    text.remove_prefix(std::min<u64>(end + 1, text.size()));
+    lineNumber++;
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.remove_suffix(1);
+    }
+    SkipSpace(line);
+    u64 const keyEnd{ std::min<u64>(line.find_first_of(" \t"), line.size()) };
+    std::string_view const key{ line.substr(0, keyEnd) };
+    line.remove_prefix(keyEnd);
+    u32 valid{ 1 };
+    if (key == "v")
+    {
+      // Positions may carry the common rgb extension
+      std::array<r32, 7> position{ 0.f, 0.f, 0.f, 1.f, 1.f, 1.f, 1.f };
+      valid = ParseFloat(line, position[0]) && ParseFloat(line, position[1]) && ParseFloat(line, position[2]);
+      r32 extra[4]{};
+      u32 count{};
+      while (valid && count < 4 && ParseFloat(line, extra[count]))
+      {
+        count++;
+      }
+      if (count >= 3)
+      {
+        std::copy(extra + count - 3, extra + count, position.begin() + 3);
+      }
+      positions.emplace_back(position);
+    }
+    else if (key == "vt")
+    {
+      std::array<r32, 2> uv{};
+      valid = ParseFloat(line, uv[0]);
+      ParseFloat(line, uv[1]);
+      uv[1] = 1.f - uv[1];
+      uvs.emplace_back(uv);
+    }
+    else if (key == "vn")
+    {
+      std::array<r32, 3> normal{};
+      valid = ParseFloat(line, normal[0]) && ParseFloat(line, normal[1]) && ParseFloat(line, normal[2]);
+      normals.emplace_back(normal);
+    }
+    else if (key == "o")
+    {
+      finish();
+      SkipSpace(line);
+      mesh.mName = line.empty() ? path.stem().string() : std::string{ line };
+    }
+    else if (key == "f")
+    {
+      polygon.clear();
+      SkipSpace(line);
+      while (valid && !line.empty())
+      {
+        // Corners are v, v/vt, v//vn or v/vt/vn
+        s64 indices[3]{};
+        valid = ParseIndex(line, indices[0]);
+        for (u32 i{ 1 }; valid && i < 3 && !line.empty() && line.front() == '/'; ++i)
+        {
+          line.remove_prefix(1);
+          if (line.empty() || line.front() != '/')
+          {
+            valid = ParseIndex(line, indices[i]);
+          }
+        }
+        Corner corner{};
+        valid = valid && Resolve(indices[0], positions.size(), corner.mPosition);
+        valid = valid && (!indices[1] || Resolve(indices[1], uvs.size(), corner.mUv));
+        valid = valid && (!indices[2] || Resolve(indices[2], normals.size(), corner.mNormal));
+        if (!valid)
+        {
+          break;
+        }
+        auto const [it, inserted] { merged.emplace(corner, (u32)mesh.mVertices.size()) };
+        if (inserted)
+        {
+          std::array<r32, 7> const& position{ positions[corner.mPosition] };
+          VertexLambert vertex{ { position[0], position[1], position[2] }, {}, {}, { position[3], position[4], position[5], position[6] } };
+          if (corner.mUv >= 0)
+          {
+            std::copy(uvs[corner.mUv].begin(), uvs[corner.mUv].end(), vertex.mUv);
+          }
+          if (corner.mNormal >= 0)
+          {
+            std::copy(normals[corner.mNormal].begin(), normals[corner.mNormal].end(), vertex.mNormal);
+          }
+          mesh.mVertices.emplace_back(vertex);
+        }
+        polygon.emplace_back(it->second);
+        SkipSpace(line);
+      }
+      valid = valid && polygon.size() >= 3;
+      for (u64 i{ 1 }; valid && i + 1 < polygon.size(); ++i)
+      {
+        mesh.mIndices.insert(mesh.mIndices.end(), { polygon[0], polygon[i], polygon[i + 1] });
+      }
+    }
+    if (!valid)
+    {
+      std::cerr << path.string() << ":" << lineNumber << ": malformed " << key << "\n";
+      return 0;
+    }
+  }
+  finish();
+  return 1;
+}
+
+/*
+* JSON.
+*/
+
+struct Json
+{
+  enum Type
+  {
+    JSON_NULL,
+    JSON_BOOLEAN,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+  };
+
+  Type                                      mType  {};
+  r64                                       mNumber{};
+  std::string                               mString{};
+  std::vector<Json>                         mArray {};
+  std::vector<std::pair<std::string, Json>> mObject{};
+
+  Json const* Find(s8 const* pKey) const
+  {
+    for (auto const& [key, value] : mObject)
+    {
+      if (key == pKey)
+      {
+        return &value;
+      }
+    }
+    return nullptr;
+  }
+  r64 Number(s8 const* pKey, r64 fallback) const
+  {
+    Json const* pValue{ Find(pKey) };
+    return (pValue && pValue->mType == JSON_NUMBER) ? pValue->mNumber : fallback;
+  }
+  s64 Index(s8 const* pKey) const
+  {
+    return (s64)Number(pKey, -1.0);
+  }
+};
+
+static void AppendUtf8(std::string& string, u32 code)
+{
+  if (code < 0x80)
+  {
+    string += (s8)code;
+  }
+  else if (code < 0x800)
+  {
+    string += (s8)(0xC0 | (code >> 6));
+    string += (s8)(0x80 | (code & 0x3F));
+  }
+  else if (code < 0x10000)
+  {
+    string += (s8)(0xE0 | (code >> 12));
+    string += (s8)(0x80 | ((code >> 6) & 0x3F));
+    string += (s8)(0x80 | (code & 0x3F));
+  }
+  else
+  {
+    string += (s8)(0xF0 | (code >> 18));
+    string += (s8)(0x80 | ((code >> 12) & 0x3F));
+    string += (s8)(0x80 | ((code >> 6) & 0x3F));
+    string += (s8)(0x80 | (code & 0x3F));
+  }
+}
+static u32 ParseHex(std::string_view& text, u32& code)
+{
+  if (text.size() < 4)
+  {
+    return 0;
+  }
+  auto const [pEnd, error] { std::from_chars(text.data(), text.data() + 4, code, 16) };
+  if (error != std::errc{} || pEnd != text.data() + 4)
+  {
+    return 0;
+  }
+  text.remove_prefix(4);
+  return 1;
+}
+static u32 ParseString(std::string_view& text, std::string& string)
+{
+  text.remove_prefix(1);
+  while (!text.empty() && text.front() != '"')
+  {
+    s8 const c{ text.front() };
+    text.remove_prefix(1);
+    if (c != '\\')
+    {
+      string += c;
+      continue;
+    }
+    if (text.empty())
+    {
+      return 0;
+    }
+    s8 const escape{ text.front() };
+    text.remove_prefix(1);
+    switch (escape)
+    {
+      case '"': string += '"'; break;
+      case '\\': string += '\\'; break;
+      case '/': string += '/'; break;
+      case 'b': string += '\b'; break;
+      case 'f': string += '\f'; break;
+      case 'n': string += '\n'; break;
+      case 'r': string += '\r'; break;
+      case 't': string += '\t'; break;
+      case 'u':
+      {
+        u32 code{};
+        if (!ParseHex(text, code))
+        {
+          return 0;
+        }
+        // Surrogate pairs combine into one code point
+        if (code >= 0xD800 && code < 0xDC00 && text.size() >= 2 && text[0] == '\\' && text[1] == 'u')
+        {
+          text.remove_prefix(2);
+          u32 low{};
+          if (!ParseHex(text, low))
+          {
+            return 0;
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        AppendUtf8(string, code);
+        break;
+      }
+      default: return 0;
+    }
+  }
+  if (text.empty())
+  {
+    return 0;
+  }
+  text.remove_prefix(1);
+  return 1;
+}
+static u32 ParseJson(std::string_view& text, Json& value, u32 depth = 0)
+{
+  auto const skip{ [&]()
+  {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t' || text.front() == '\n' || text.front() == '\r'))
+    {
+      text.remove_prefix(1);
+    }
+  } };
+  skip();
+  if (text.empty() || depth > 256)
+  {
+    return 0;
+  }
+  s8 const c{ text.front() };
+  if (c == '{' || c == '[')
+  {
+    value.mType = (c == '{') ? Json::JSON_OBJECT : Json::JSON_ARRAY;
+    s8 const close{ (c == '{') ? '}' : ']' };
+    text.remove_prefix(1);
+    skip();
+    if (!text.empty() && text.front() == close)
+    {
+      text.remove_prefix(1);
+      return 1;
+    }
+    while (1)
+    {
+      skip();
+      if (value.mType == Json::JSON_OBJECT)
+      {
+        std::string key{};
+        if (text.empty() || text.front() != '"' || !ParseString(text, key))
+        {
+          return 0;
+        }
+        skip();
+        if (text.empty() || text.front() != ':')
+        {
+          return 0;
+        }
+        text.remove_prefix(1);
+        value.mObject.emplace_back(std::move(key), Json{});
+        if (!ParseJson(text, value.mObject.back().second, depth + 1))
+        {
+          return 0;
+        }
+      }
+      else if (!ParseJson(text, value.mArray.emplace_back(), depth + 1))
+      {
+        return 0;
+      }
+      skip();
+      if (text.empty())
+      {
+        return 0;
+      }
+      s8 const next{ text.front() };
+      text.remove_prefix(1);
+      if (next == close)
+      {
+        return 1;
+      }
+      if (next != ',')
+      {
+        return 0;
+      }
+    }
+  }
+  if (c == '"')
+  {
+    value.mType = Json::JSON_STRING;
+    return ParseString(text, value.mString);
+  }
+  for (auto const& [pWord, type, number] : { std::tuple{ "true", Json::JSON_BOOLEAN, 1.0 }, std::tuple{ "false", Json::JSON_BOOLEAN, 0.0 }, std::tuple{ "null", Json::JSON_NULL, 0.0 } })
+  {
+    if (text.starts_with(pWord))
+    {
+      text.remove_prefix(std::strlen(pWord));
+      value.mType = type;
+      value.mNumber = number;
+      return 1;
+    }
+  }
+  value.mType = Json::JSON_NUMBER;
+  auto const [pEnd, error] { std::from_chars(text.data(), text.data() + text.size(), value.mNumber) };
+  if (error != std::errc{})
+  {
+    return 0;
+  }
+  text.remove_prefix(pEnd - text.data());
+  return 1;
+}
+
+/*
+* glTF.
+*/
+
+constexpr u32 GLTF_BYTE          { 5120 };
+constexpr u32 GLTF_UNSIGNED_BYTE { 5121 };
+constexpr u32 GLTF_SHORT         { 5122 };
+constexpr u32 GLTF_UNSIGNED_SHORT{ 5123 };
+constexpr u32 GLTF_UNSIGNED_INT  { 5125 };
+constexpr u32 GLTF_FLOAT         { 5126 };
+constexpr u32 GLTF_TRIANGLES     { 4 };
+
+// Typed view of one accessor, already checked against its buffer
+struct Accessor
+{
+  u8 const* pData      {};
+  u64       mStride    {};
+  u32       mCount     {};
+  u32       mComponents{};
+  u32       mType      {};
+  u32       mNormalized{};
+
+  r32 Float(u32 element, u32 component) const
+  {
+    u8 const* pValue{ pData + mStride * element };
+    switch (mType)
+    {
+      case GLTF_BYTE:           { s8 value;  std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return mNormalized ? std::max(value / 127.f, -1.f) : (r32)value; }
+      case GLTF_UNSIGNED_BYTE:  { u8 value;  std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return mNormalized ? value / 255.f : (r32)value; }
+      case GLTF_SHORT:          { s16 value; std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return mNormalized ? std::max(value / 32767.f, -1.f) : (r32)value; }
+      case GLTF_UNSIGNED_SHORT: { u16 value; std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return mNormalized ? value / 65535.f : (r32)value; }
+      case GLTF_UNSIGNED_INT:   { u32 value; std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return (r32)value; }
+      default:                  { r32 value; std::memcpy(&value, pValue + component * sizeof(value), sizeof(value)); return value; }
+    }
+  }
+  u32 Index(u32 element) const
+  {
+    u8 const* pValue{ pData + mStride * element };
+    switch (mType)
+    {
+      case GLTF_UNSIGNED_BYTE:  return *pValue;
+      case GLTF_UNSIGNED_SHORT: { u16 value; std::memcpy(&value, pValue, sizeof(value)); return value; }
+      default:                  { u32 value; std::memcpy(&value, pValue, sizeof(value)); return value; }
+    }
+  }
+};
+
+static u32 DecodeBase64(std::string_view text, std::string& bytes)
+{
+  u32 bits{};
+  u32 count{};
+  for (s8 const c : text)
+  {
+    u32 value{};
+    if (c >= 'A' && c <= 'Z') value = c - 'A';
+    else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') value = c - '0' + 52;
+    else if (c == '+') value = 62;
+    else if (c == '/') value = 63;
+    else if (c == '=') break;
+    else return 0;
+    bits = (bits << 6) | value;
+    count += 6;
+    if (count >= 8)
+    {
+      count -= 8;
+      bytes += (s8)((bits >> count) & 0xFF);
+    }
+  }
+  return 1;
+}
+
+// Relative references are percent encoded utf-8
+static fs::path DecodeUri(std::string_view uri)
+{
+  std::u8string decoded{};
+  while (!uri.empty())
+  {
+    u32 code{};
+    if (uri.size() >= 3 && uri[0] == '%' && std::from_chars(uri.data() + 1, uri.data() + 3, code, 16).ptr == uri.data() + 3)
+    {
+      decoded += (char8_t)code;
+      uri.remove_prefix(3);
+      continue;
+    }
+    decoded += (char8_t)uri.front();
+    uri.remove_prefix(1);
+  }
+  return fs::path{ decoded };
+}
+
+static u32 ReadAccessor(Json const& root, std::vector<std::string> const& buffers, s64 index, Accessor& accessor)
+{
+  Json const* pAccessors{ root.Find("accessors") };
+  Json const* pViews{ root.Find("bufferViews") };
+  if (!pAccessors || index < 0 || index >= (s64)pAccessors->mArray.size() || !pViews)
+  {
+    return 0;
+  }
+  Json const& json{ pAccessors->mArray[index] };
+  s64 const viewIndex{ json.Index("bufferView") };
+  Json const* pType{ json.Find("type") };
+  if (json.Find("sparse") || viewIndex < 0 || viewIndex >= (s64)pViews->mArray.size() || !pType)
+  {
+    return 0;
+  }
+  Json const& view{ pViews->mArray[viewIndex] };
+  s64 const bufferIndex{ view.Index("buffer") };
+  if (bufferIndex < 0 || bufferIndex >= (s64)buffers.size())
+  {
+    return 0;
+  }
+  static std::map<std::string, u32> const sComponents{ { "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 } };
+  auto const it{ sComponents.find(pType->mString) };
+  if (it == sComponents.end())
+  {
+    return 0;
+  }
+  accessor.mComponents = it->second;
+  accessor.mType = (u32)json.Number("componentType", 0.0);
+  accessor.mCount = (u32)json.Number("count", 0.0);
+  Json const* pNormalized{ json.Find("normalized") };
+  accessor.mNormalized = pNormalized && pNormalized->mNumber != 0.0;
+  u64 componentSize{};
+  switch (accessor.mType)
+  {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE: componentSize = 1; break;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT: componentSize = 2; break;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT: componentSize = 4; break;
+    default: return 0;
+  }
+  u64 const elementSize{ componentSize * accessor.mComponents };
+  u64 const viewOffset{ (u64)view.Number("byteOffset", 0.0) };
+  u64 const viewLength{ (u64)view.Number("byteLength", 0.0) };
+  u64 const offset{ (u64)json.Number("byteOffset", 0.0) };
+  accessor.mStride = (u64)view.Number("byteStride", (r64)elementSize);
+  // The last element has to end inside the view and the view inside its buffer
+  std::string const& buffer{ buffers[bufferIndex] };
+  if (viewOffset > buffer.size() || viewLength > buffer.size() - viewOffset || !accessor.mCount ||
+      offset + accessor.mStride * (accessor.mCount - 1) + elementSize > viewLength)
+  {
+    return 0;
+  }
+  accessor.pData = (u8 const*)buffer.data() + viewOffset + offset;
+  return 1;
+}
+
+static u32 ReadGltf(fs::path const& path, std::vector<Mesh>& meshes)
+{
+  std::string data{};
+  if (!ReadFile(path, data))
+  {
+    std::cerr << "Can not read " << path.string() << "\n";
+    return 0;
+  }
+  auto const fail{ [&](s8 const* pReason)
+  {
+    std::cerr << path.string() << ": " << pReason << "\n";
+    return 0;
+  } };
+  // Binary containers carry the json and the first buffer as chunks
+  std::string_view text{ data };
+  std::string binary{};
+  u32 glb{};
+  if (data.size() >= 12 && data.compare(0, 4, "glTF") == 0)
+  {
+    glb = 1;
+    u64 position{ 12 };
+    text = {};
+    while (position + 8 <= data.size())
+    {
+      u32 chunk[2]{};
+      std::memcpy(chunk, data.data() + position, sizeof(chunk));
+      position += 8;
+      if (chunk[0] > data.size() - position)
+      {
+        return fail("holds a truncated chunk");
+      }
+      if (chunk[1] == 0x4E4F534A && text.empty())
+      {
+        text = std::string_view{ data }.substr(position, chunk[0]);
+      }
+      else if (chunk[1] == 0x004E4942 && binary.empty())
+      {
+        binary = data.substr(position, chunk[0]);
+      }
+      position += (chunk[0] + 3) & ~3ull;
+    }
+  }
+  Json root{};
+  if (!ParseJson(text, root) || root.mType != Json::JSON_OBJECT)
+  {
+    return fail("holds no valid json");
+  }
+  std::vector<std::string> buffers{};
+  if (Json const* pBuffers{ root.Find("buffers") })
+  {
+    for (auto const& json : pBuffers->mArray)
+    {
+      std::string& buffer{ buffers.emplace_back() };
+      Json const* pUri{ json.Find("uri") };
+      if (!pUri)
+      {
+        if (!glb || buffers.size() > 1)
+        {
+          return fail("references a buffer without uri");
+        }
+        buffer = binary;
+      }
+      else if (pUri->mString.starts_with("data:"))
+      {
+        u64 const comma{ pUri->mString.find(";base64,") };
+        if (comma == std::string::npos || !DecodeBase64(std::string_view{ pUri->mString }.substr(comma + 8), buffer))
+        {
+          return fail("embeds a buffer which is not base64");
+        }
+      }
+      else if (!ReadFile(path.parent_path() / DecodeUri(pUri->mString), buffer))
+      {
+        return fail("references a buffer which can not be read");
+      }
+      if (json.Number("byteLength", 0.0) > (r64)buffer.size())
+      {
+        return fail("references a buffer shorter than declared");
+      }
+    }
+  }
+  Json const* pMeshes{ root.Find("meshes") };
+  if (!pMeshes)
+  {
+    return 1;
+  }
+  for (u64 i{}; i < pMeshes->mArray.size(); ++i)
+  {
+    Json const& json{ pMeshes->mArray[i] };
+    Json const* pName{ json.Find("name") };
+    Json const* pPrimitives{ json.Find("primitives") };
+    if (!pPrimitives)
+    {
+      continue;
+    }
+    for (u64 j{}; j < pPrimitives->mArray.size(); ++j)
+    {
+      Json const& primitive{ pPrimitives->mArray[j] };
+      Json const* pAttributes{ primitive.Find("attributes") };
+      std::string name{ (pName && !pName->mString.empty()) ? pName->mString : "mesh" + std::to_string(i) };
+      if (pPrimitives->mArray.size() > 1)
+      {
+        name.append(".").append(std::to_string(j));
+      }
+      if ((u32)primitive.Number("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES || !pAttributes)
+      {
+        std::cerr << path.string() << ": skipping " << name << ", only triangle lists are supported\n";
+        continue;
+      }
+      Accessor positions{};
+      if (!ReadAccessor(root, buffers, pAttributes->Index("POSITION"), positions) || positions.mComponents != 3)
+      {
+        return fail("holds a primitive without valid positions");
+      }
+      // Optional attributes must match the vertex count, absent ones keep their defaults
+      Accessor attributes[3]{};
+      s8 const* const pKeys[3]{ "NORMAL", "TEXCOORD_0", "COLOR_0" };
+      u32 present[3]{};
+      for (u32 k{}; k < 3; ++k)
+      {
+        s64 const index{ pAttributes->Index(pKeys[k]) };
+        if (index < 0)
+        {
+          continue;
+        }
+        if (!ReadAccessor(root, buffers, index, attributes[k]) || attributes[k].mCount != positions.mCount)
+        {
+          return fail("holds a primitive with invalid attributes");
+        }
+        present[k] = 1;
+      }
+      Mesh& mesh{ meshes.emplace_back(Mesh{ name }) };
+      mesh.mVertices.resize(positions.mCount, VertexLambert{ {}, {}, {}, { 1.f, 1.f, 1.f, 1.f } });
+      for (u32 v{}; v < positions.mCount; ++v)
+      {
+        VertexLambert& vertex{ mesh.mVertices[v] };
+        for (u32 c{}; c < 3; ++c)
+        {
+          vertex.mPosition[c] = positions.Float(v, c);
+        }
+        for (u32 c{}; present[0] && c < 3; ++c)
+        {
+          vertex.mNormal[c] = attributes[0].Float(v, c);
+        }
+        for (u32 c{}; present[1] && c < 2; ++c)
+        {
+          vertex.mUv[c] = attributes[1].Float(v, c);
+        }
+        for (u32 c{}; present[2] && c < attributes[2].mComponents; ++c)
+        {
+          vertex.mColor[c] = attributes[2].Float(v, c);
+        }
+      }
+      Accessor indices{};
+      s64 const indexAccessor{ primitive.Index("indices") };
+      if (indexAccessor < 0)
+      {
+        mesh.mIndices.resize(positions.mCount - positions.mCount % 3);
+        std::iota(mesh.mIndices.begin(), mesh.mIndices.end(), 0u);
+      }
+      else if (ReadAccessor(root, buffers, indexAccessor, indices) && indices.mComponents == 1 && indices.mType != GLTF_BYTE && indices.mType != GLTF_SHORT && indices.mType != GLTF_FLOAT)
+      {
+        mesh.mIndices.resize(indices.mCount - indices.mCount % 3);
+        for (u32 k{}; k < (u32)mesh.mIndices.size(); ++k)
+        {
+          mesh.mIndices[k] = indices.Index(k);
+          if (mesh.mIndices[k] >= positions.mCount)
+          {
+            return fail("holds indices beyond its vertices");
+          }
+        }
+      }
+      else
+      {
+        return fail("holds a primitive with invalid indices");
+      }
+    }
+  }
+  return 1;
+}
+
+/*
+* Container output.
+*/
+
+static u32 WriteMeshes(fs::path const& path, std::vector<Mesh> const& meshes, u64& size)
+{
+  VkMeshFormat::Header header{ VK_MESH_FILE_MAGIC, VK_MESH_FILE_VERSION, VkMeshFormat::Layout<VertexLambertCompact>(), (u32)sizeof(VertexLambertCompact), (u32)meshes.size() };
+  std::vector<VkMeshFormat::Record> records(meshes.size());
+  for (u64 i{}; i < meshes.size(); ++i)
+  {
+    Mesh const& mesh{ meshes[i] };
+    VkMeshFormat::Record& record{ records[i] };
+    if (mesh.mVertices.size() > UINT32_MAX || mesh.mIndices.size() > UINT32_MAX)
+    {
+      std::cerr << "Mesh " << mesh.mName << " exceeds 2^32 vertices or indices\n";
+      return 0;
+    }
+    std::memcpy(record.mName, mesh.mName.data(), std::min<u64>(mesh.mName.size(), VK_MESH_FILE_NAME - 1));
+    record.mFirstVertex = header.mVertexCount;
+    record.mFirstIndex = header.mIndexCount;
+    record.mVertexCount = (u32)mesh.mVertices.size();
+    record.mIndexCount = (u32)mesh.mIndices.size();
+    record.mFirstMeshlet = (u32)header.mMeshletCount;
+    record.mMeshletCount = (u32)mesh.mMeshlets.size();
+    record.mFirstLod = (u32)header.mLodCount;
+    record.mLodCount = (u32)mesh.mLods.size();
+    std::fill(record.mMin, record.mMin + 3, std::numeric_limits<r32>::max());
+    std::fill(record.mMax, record.mMax + 3, std::numeric_limits<r32>::lowest());
+    for (auto const& vertex : mesh.mVertices)
+    {
+      for (u32 c{}; c < 3; ++c)
+      {
+        record.mMin[c] = std::min(record.mMin[c], vertex.mPosition[c]);
+        record.mMax[c] = std::max(record.mMax[c], vertex.mPosition[c]);
+      }
+    }
+    header.mVertexCount += record.mVertexCount;
+    header.mIndexCount += record.mIndexCount;
+    header.mMeshletCount += record.mMeshletCount;
+    header.mLodCount += record.mLodCount;
+  }
+  if (header.mMeshletCount > UINT32_MAX || header.mLodCount > UINT32_MAX)
+  {
+    std::cerr << "Meshes exceed 2^32 meshlets or levels\n";
+    return 0;
+  }
+  std::vector<VkMeshlet> meshlets{};
+  std::vector<VkMeshLod> lods{};
+  meshlets.reserve(header.mMeshletCount);
+  lods.reserve(header.mLodCount);
+  for (auto const& mesh : meshes)
+  {
+    meshlets.insert(meshlets.end(), mesh.mMeshlets.begin(), mesh.mMeshlets.end());
+    lods.insert(lods.end(), mesh.mLods.begin(), mesh.mLods.end());
+  }
+  header.mMeshletOffset = sizeof(VkMeshFormat::Header) + sizeof(VkMeshFormat::Record) * records.size();
+  header.mLodOffset = header.mMeshletOffset + sizeof(VkMeshlet) * meshlets.size();
+  header.mVertexOffset = VkMeshFormat::Align(header.mLodOffset + sizeof(VkMeshLod) * lods.size());
+  header.mIndexOffset = VkMeshFormat::Align(header.mVertexOffset + header.mVertexCount * header.mStride);
+  header.mSize = header.mIndexOffset + header.mIndexCount * sizeof(u32);
+  header.mChecksum = VkMeshFormat::Checksum(header, records.data(), meshlets.data(), lods.data());
+
+  fs::path const temporary{ path.string() + ".tmp" };
+  {
+    std::ofstream stream{ temporary, std::ios::binary | std::ios::trunc };
+    std::vector<s8> const padding(VK_MESH_FILE_ALIGNMENT);
+    auto const pad{ [&]()
+    {
+      u64 const position{ (u64)stream.tellp() };
+      stream.write(padding.data(), (std::streamsize)(VkMeshFormat::Align(position) - position));
+    } };
+    stream.write((s8 const*)&header, sizeof(header));
+    stream.write((s8 const*)records.data(), (std::streamsize)(sizeof(VkMeshFormat::Record) * records.size()));
+    stream.write((s8 const*)meshlets.data(), (std::streamsize)(sizeof(VkMeshlet) * meshlets.size()));
+    stream.write((s8 const*)lods.data(), (std::streamsize)(sizeof(VkMeshLod) * lods.size()));
+    pad();
+    std::vector<VertexLambertCompact> compact{};
+    for (auto const& mesh : meshes)
+    {
+      compact.resize(mesh.mVertices.size());
+      VkVertex::Compact(mesh.mVertices.data(), compact.data(), (u32)compact.size());
+      stream.write((s8 const*)compact.data(), (std::streamsize)(sizeof(VertexLambertCompact) * compact.size()));
+    }
+    pad();
+    for (auto const& mesh : meshes)
+    {
+      stream.write((s8 const*)mesh.mIndices.data(), (std::streamsize)(sizeof(u32) * mesh.mIndices.size()));
+    }
+    if (!stream || (u64)stream.tellp() != header.mSize)
+    {
+      std::cerr << "Can not write " << temporary.string() << "\n";
+      return 0;
+    }
+  }
+  std::error_code error{};
+  fs::rename(temporary, path, error);
+  if (error)
+  {
+    std::cerr << "Can not replace " << path.string() << ": " << error.message() << "\n";
+    fs::remove(temporary, error);
+    return 0;
+  }
+  size = header.mSize;
+  return 1;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3)
+  {
+    std::cerr << "Usage: mesh <output> <input> [<input> ...]\n";
+    return 1;
+  }
+
+  std::vector<Mesh> meshes{};
+  for (int i{ 2 }; i < argc; ++i)
+  {
+    fs::path const input{ argv[i] };
+    std::string extension{ input.extension().string() };
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](s8 c) { return (s8)std::tolower((unsigned char)c); });
+    u32 read{};
+    if (extension == ".obj")
+    {
+      read = ReadObj(input, meshes);
+    }
+    else if (extension == ".gltf" || extension == ".glb")
+    {
+      read = ReadGltf(input, meshes);
+    }
+    else
+    {
+      std::cerr << "Unknown input format " << input.string() << "\n";
+    }
+    if (!read)
+    {
+      return 1;
+    }
+  }
+
+  u64 vertices{};
+  u64 indices{};
+  u64 meshlets{};
+  u64 levels{};
+  u64 levelIndices{};
+  r64 missesBefore{};
+  r64 missesAfter{};
+  for (auto& mesh : meshes)
+  {
+    GenerateNormals(mesh);
+    auto const [before, after] { Optimize(mesh) };
+    missesBefore += before;
+    missesAfter += after;
+    vertices += mesh.mVertices.size();
+    // The full mesh is the first level, meshes without levels are nothing but it
+    u64 const full{ mesh.mLods.empty() ? mesh.mIndices.size() : mesh.mLods[0].mIndexCount };
+    indices += full;
+    meshlets += mesh.mMeshlets.size();
+    levels += std::max<u64>(mesh.mLods.size(), 1);
+    levelIndices += mesh.mIndices.size() - full;
+  }
+
+  u64 size{};
+  if (!WriteMeshes(argv[1], meshes, size))
+  {
+    return 1;
+  }
+  r64 const triangles{ (r64)std::max<u64>(indices / 3, 1) };
+  std::cout << "Meshes " << meshes.size() << ", vertices " << vertices << ", indices " << indices << ", meshlets " << meshlets << ", bytes " << size << std::endl;
+  std::cout << "Cache misses per triangle " << missesBefore / triangles << " -> " << missesAfter / triangles << std::endl;
+  std::cout << "Levels " << levels << ", coarser indices " << levelIndices << std::endl;
+  return 0;
+}
\ No newline at end of file
@@ -5,38 +5,65 @@
 * Actor component system.
 *
 * Actor structure:
-* ---A-----------------------------
-*    |
-*    Transform
-*    |
-*    Renderable
+* ---Handle--------A---------------
+*    |             |
+*    Slot, Gen --> Archetype, Row
 *
-* Transaction structure:
+* Archetype structure:
 * ---C0-----------C0C1-------------
 *    |            |
+*    [C0, ...]    [C0, ...]
+*                 [C1, ...]
 *    [Actor, ...] [Actor, ...]
+*
+* Actors sharing the same set of components live in the same archetype.
+* Every component type of an archetype is stored in its own contiguous column
+* and the row of an actor is the same across all columns of its archetype.
+*
+* Columns keep one change version per chunk of CHUNK_ROWS rows. Dispatching
+* a non-const component stamps the visited chunks, dispatching through a
+* Changed filter skips chunks that were not stamped since a given version.
 */
 
 #include "VkCore.h"
+#include "VkComponents.h"
+#include "VkJobs.h"
+#include "VkPool.h"
+#include "VkSlotMap.h"
 
 namespace VkAcs
 {
   /*
   * Global parameters.
   */
-  
-  constexpr u32 MAX_ACTORS{ 100000 };
-  
+
+  constexpr u32 MAX_ACTORS    { 100000 };
+  constexpr u32 MAX_COMPONENTS{ 64 };
+  constexpr u32 MIN_ROWS      { 64 };
+  constexpr u32 CHUNK_ROWS    { 1024 };
+  constexpr u32 ACTOR_SLAB    { MAX_ACTORS / 64 };
+  constexpr u64 COLUMN_BLOCK  { (u64)MAX_ACTORS * 64 };
+  constexpr u64 PAYLOAD_BLOCK { 1024 * 1024 };
+  constexpr u8  NO_COLUMN     { 0xFF };
+
   /*
   * Forward decls.
   */
-  
+
   struct Actor;
-  
+  struct Archetype;
+
+  /*
+  * Component storage.
+  */
+
+  inline VkHeap sColumnHeap{ COLUMN_BLOCK };
+  inline u64    sVersion   { 1 };
+
   /*
   * Type deduction utilities.
   */
-  
+
   template<typename T>
   struct Proxy
 {
@@ -45,98 +72,834 @@ namespace VkAcs
   using Ptr  = T*;
   using CPtr = T const*;
 };
-  
+
   template<typename T>
   concept Actorable = std::is_base_of_v<Actor, T>;
-  
+
+  template<typename T, typename L>
+  struct IndexOf;
+  template<typename T>
+  struct IndexOf<T, std::tuple<>> : std::integral_constant<u32, MAX_COMPONENTS> {};
+  template<typename T, typename ... Ts>
+  struct IndexOf<T, std::tuple<T, Ts ...>> : std::integral_constant<u32, 0> {};
+  template<typename T, typename U, typename ... Ts>
+  struct IndexOf<T, std::tuple<U, Ts ...>> : std::integral_constant<u32, std::min(IndexOf<T, std::tuple<Ts ...>>::value + 1, MAX_COMPONENTS)> {};
+
   /*
   * Primitives.
   */
-  
-  using Actors       = std::map<std::string, Actor*>;
-  using Components   = std::map<u64, void*>;
-  using Transactions = std::map<u64, std::multiset<Actor*>>;
-  
+
+  using Handle     = VkHandle64;
+  using Signature  = std::bitset<MAX_COMPONENTS>;
+  using Actors     = VkSlotMap<Actor*, Handle>;
+  using Names      = std::unordered_map<std::string, Handle>;
+  using Archetypes = std::unordered_map<Signature, Archetype*>;
+
   /*
-  * Interfaces for actors and components.
+  * Dense component identifiers.
+  *
+  * Default components resolve to their constexpr index in acs::Defaults,
+  * every other component type draws the next free id once on first use. More
+  * than MAX_COMPONENTS types end the process instead of overrunning the tables.
   */
-  
+
+  inline std::atomic<u32> sComponentCount{ std::tuple_size_v<acs::Defaults> };
+
+  template<typename C>
+  __forceinline u32 ComponentId() noexcept
+  {
+    using T = std::remove_cv_t<C>;
+    if constexpr (IndexOf<T, acs::Defaults>::value < MAX_COMPONENTS)
+    {
+      return IndexOf<T, acs::Defaults>::value;
+    }
+    else
+    {
+      // Signatures, column maps and layouts hold MAX_COMPONENTS entries
+      static u32 const sId{ []()
+      {
+        u32 const id{ sComponentCount++ };
+        VK_ASSERT(id < MAX_COMPONENTS);
+        return id;
+      }() };
+      return sId;
+    }
+  }
+  template<typename ... Cs>
+  __forceinline Signature SignatureOf() noexcept
+  {
+    Signature signature{};
+    (signature.set(ComponentId<Cs>()), ...);
+    return signature;
+  }
+
+  /*
+  * Type erased component description.
+  */
+
+  struct Layout
+  {
+    u32 mId   {};
+    u64 mSize {};
+    u64 mAlign{};
+    void(*mpRelocate)(void* pDst, void* pSrc) {};
+    void(*mpDestroy)(void* pInstance)         {};
+  };
+
+  template<typename C>
+  __forceinline Layout LayoutOf() noexcept
+  {
+    static_assert(alignof(C) <= VkArena::ALIGNMENT);
+    return Layout
+    {
+      ComponentId<C>(),
+      sizeof(C),
+      alignof(C),
+      [](void* pDst, void* pSrc) { new (pDst) C{ std::move(*(C*)pSrc) }; ((C*)pSrc)->~C(); },
+      [](void* pInstance) { ((C*)pInstance)->~C(); },
+    };
+  }
+
+  /*
+  * Contiguous storage for one component type.
+  */
+
+  struct Column
+  {
+    Layout           mLayout  {};
+    u8*              mpData   {};
+    std::vector<u64> mVersions{};
+
+    __forceinline void* At(u32 row) const noexcept
+    {
+      return mpData + mLayout.mSize * row;
+    }
+  };
+
+  /*
+  * Interfaces for actors and archetypes.
+  */
+
   struct Actor
   {
-    u64         mComponentMask{};
-    Components* mpComponents  {};
+    Handle      mHandle    {};
+    Archetype*  mpArchetype{};
+    u32         mRow       {};
+    VkPoolBase* mpPool     {};
+    void(*mpDestruct)(Actor* pActor) {};
   };
-  
+
+  struct Archetype
+  {
+    Signature                        mSignature{};
+    std::vector<Column>              mColumns  {};
+    std::array<u8, MAX_COMPONENTS>   mColumnOf {};
+    std::vector<Actor*>              mActors   {};
+    u32                              mCapacity {};
+
+    __forceinline Column* Find(u32 id) noexcept
+    {
+      return mColumnOf[id] == NO_COLUMN ? nullptr : &mColumns[mColumnOf[id]];
+    }
+    __forceinline void Reserve(u32 capacity) noexcept
+    {
+      if (capacity <= mCapacity) return;
+      capacity = std::max(std::max(capacity, mCapacity * 2), MIN_ROWS);
+      for (auto& column : mColumns)
+      {
+        u8* pData{ (u8*)sColumnHeap.Allocate(column.mLayout.mSize * capacity) };
+        for (u32 i{}; i < (u32)mActors.size(); ++i)
+        {
+          column.mLayout.mpRelocate(pData + column.mLayout.mSize * i, column.At(i));
+        }
+        sColumnHeap.Free(column.mpData, column.mLayout.mSize * mCapacity);
+        column.mpData = pData;
+        column.mVersions.resize((capacity + CHUNK_ROWS - 1) / CHUNK_ROWS);
+      }
+      mCapacity = capacity;
+    }
+    __forceinline u32 Push(Actor* pActor) noexcept
+    {
+      Reserve((u32)mActors.size() + 1);
+      mActors.emplace_back(pActor);
+      Touch((u32)mActors.size() - 1);
+      return (u32)mActors.size() - 1;
+    }
+    __forceinline void Touch(u32 row) noexcept
+    {
+      u64 const version{ ++sVersion };
+      for (auto& column : mColumns)
+      {
+        column.mVersions[row / CHUNK_ROWS] = version;
+      }
+    }
+    // Expects every component of the row to be relocated or destroyed already
+    __forceinline void Erase(u32 row) noexcept
+    {
+      u32 const last{ (u32)mActors.size() - 1 };
+      if (row != last)
+      {
+        for (auto& column : mColumns)
+        {
+          column.mLayout.mpRelocate(column.At(row), column.At(last));
+        }
+        mActors[row] = mActors[last];
+        mActors[row]->mRow = row;
+        Touch(row);
+      }
+      mActors.pop_back();
+    }
+  };
+
   /*
   * Global state.
   */
-  
-  Actors       sActors      {};
-  Transactions sTransactions{};
-  
+
+  inline Actors                              sActors       { MAX_ACTORS };
+  inline Names                               sNames        {};
+  inline Archetypes                          sArchetypes   {};
+  inline std::vector<Archetype*>             sArchetypeList{};
+  inline std::array<Layout, MAX_COMPONENTS>  sLayouts      {};
+  inline std::vector<VkPoolBase*>            sActorPools   {};
+
   /*
-  * Actor specific routines.
+  * Archetype specific routines.
   */
-  
-  template<Actorable A, typename ... Args>
-  __forceinline A* Create(std::string const& name, Args&& ... args) noexcept
+
+  __forceinline void Register(Layout const& layout) noexcept
+  {
+    if (!sLayouts[layout.mId].mpDestroy)
+    {
+      sLayouts[layout.mId] = layout;
+    }
+  }
+  __forceinline Archetype* Acquire(Signature const& signature) noexcept
+  {
+    auto& pArchetype{ sArchetypes[signature] };
+    if (!pArchetype)
+    {
+      pArchetype = new Archetype;
+      pArchetype->mSignature = signature;
+      pArchetype->mColumnOf.fill(NO_COLUMN);
+      for (u32 i{}; i < MAX_COMPONENTS; ++i)
+      {
+        if (signature.test(i))
+        {
+          pArchetype->mColumnOf[i] = (u8)pArchetype->mColumns.size();
+          pArchetype->mColumns.emplace_back(Column{ sLayouts[i] });
+        }
+      }
+      sArchetypeList.emplace_back(pArchetype);
+    }
+    return pArchetype;
+  }
+  __forceinline void Move(Actor* pActor, Archetype* pArchetype) noexcept
   {
-    auto& pActor{ sActors[name] };
-    if (!pActor)
+    Archetype* pSource{ pActor->mpArchetype };
+    u32 const row{ pArchetype->Push(pActor) };
+    if (pSource)
     {
-      pActor = new A{ std::forward<Args>(args) ... };
+      for (auto& column : pSource->mColumns)
+      {
+        if (Column* pColumn{ pArchetype->Find(column.mLayout.mId) })
+        {
+          column.mLayout.mpRelocate(pColumn->At(row), column.At(pActor->mRow));
+        }
+        else
+        {
+          column.mLayout.mpDestroy(column.At(pActor->mRow));
+        }
+      }
+      pSource->Erase(pActor->mRow);
     }
-    return (A*)pActor;
+    pActor->mpArchetype = pArchetype;
+    pActor->mRow = row;
+  }
+
+  /*
+  * Actor specific routines.
+  */
+
+  template<Actorable A>
+  __forceinline VkPool<A>& Pool() noexcept
+  {
+    // Registered once on first use so the pools can be iterated without knowing their actor types
+    static VkPool<A>& sPool{ []() -> VkPool<A>&
+    {
+      VkPool<A>& pool{ VkPool<A>::Get(ACTOR_SLAB) };
+      sActorPools.emplace_back(&pool);
+      return pool;
+    }() };
+    return sPool;
+  }
+  template<Actorable A, typename ... Args>
+  __forceinline Handle Create(Args&& ... args) noexcept
+  {
+    VkPool<A>& pool{ Pool<A>() };
+    A* pActor{ pool.Create(std::forward<Args>(args) ...) };
+    pActor->mpPool = &pool;
+    pActor->mpDestruct = [](Actor* pActor) { ((A*)pActor)->~A(); };
+    pActor->mHandle = sActors.Insert(pActor);
+    return pActor->mHandle;
   }
   template<Actorable A>
-  __forceinline A* Find(std::string const& name) noexcept
+  __forceinline A* Find(Handle handle) noexcept
   {
-    return {};
+    Actor** ppActor{ sActors.Find(handle) };
+    return ppActor ? (A*)*ppActor : nullptr;
   }
   template<Actorable A>
-  __forceinline A* Destroy(std::string const& name) noexcept
+  __forceinline A* Find(std::string const& name) noexcept
+  {
+    auto const it{ sNames.find(name) };
+    return it == sNames.end() ? nullptr : Find<A>(it->second);
+  }
+  __forceinline u32 Destroy(Handle handle) noexcept
+  {
+    Actor** ppActor{ sActors.Find(handle) };
+    if (!ppActor)
+    {
+      return 0;
+    }
+    Actor* pActor{ *ppActor };
+    if (Archetype* pArchetype{ pActor->mpArchetype })
+    {
+      for (auto& column : pArchetype->mColumns)
+      {
+        column.mLayout.mpDestroy(column.At(pActor->mRow));
+      }
+      pArchetype->Erase(pActor->mRow);
+    }
+    sActors.Erase(handle);
+    VkPoolBase* pPool{ pActor->mpPool };
+    pActor->mpDestruct(pActor);
+    pPool->Free(pActor);
+    return 1;
+  }
+  // Tears down every actor and component and rewinds their allocators in bulk
+  __forceinline void Reset() noexcept
   {
-    return {};
+    for (auto const& pArchetype : sArchetypeList)
+    {
+      for (auto& column : pArchetype->mColumns)
+      {
+        for (u32 i{}; i < (u32)pArchetype->mActors.size(); ++i)
+        {
+          column.mLayout.mpDestroy(column.At(i));
+        }
+        column.mpData = nullptr;
+        column.mVersions.clear();
+      }
+      pArchetype->mActors.clear();
+      pArchetype->mCapacity = 0;
+    }
+    for (auto const& pActor : sActors)
+    {
+      pActor->mpDestruct(pActor);
+    }
+    sActors.Clear();
+    sNames.clear();
+    for (auto const& pPool : sActorPools)
+    {
+      pPool->Reset();
+    }
+    sColumnHeap.Reset();
   }
-  
+  __forceinline void PrintStatistics() noexcept
+  {
+    auto const print{ [](s8 const* pName, VkAllocatorStats const& stats)
+    {
+      std::printf("%s: reserved %llu used %llu peak %llu allocations %llu frees %llu blocks %llu\n", pName, stats.mReserved, stats.mUsed, stats.mPeak, stats.mAllocations, stats.mFrees, stats.mBlocks);
+    } };
+    for (auto const& pPool : sActorPools)
+    {
+      print(pPool->Name(), pPool->Stats());
+    }
+    print("Columns", sColumnHeap.Stats());
+  }
+
+  /*
+  * Optional name index.
+  */
+
+  __forceinline void Name(Handle handle, std::string const& name) noexcept
+  {
+    sNames[name] = handle;
+  }
+  __forceinline void Unname(std::string const& name) noexcept
+  {
+    sNames.erase(name);
+  }
+
   /*
   * Component specific routines.
+  *
+  * Component pointers stay valid until the next structural change of the
+  * archetype the actor lives in.
   */
-  
+
   template<typename C, typename ... Args>
   __forceinline C* Attach(Actor* pActor, Args&& ... args) noexcept
   {
-    if (!pActor->mpComponents)
+    u32 const id{ ComponentId<C>() };
+    Signature signature{};
+    if (pActor->mpArchetype)
     {
-      pActor->mpComponents = new Components;
+      if (Column* pColumn{ pActor->mpArchetype->Find(id) })
+      {
+        return (C*)pColumn->At(pActor->mRow);
+      }
+      signature = pActor->mpArchetype->mSignature;
     }
-    auto& pComponent{ (*pActor->mpComponents)[typeid(C).hash_code()] };
-    if (!pComponent)
+    Register(LayoutOf<C>());
+    Move(pActor, Acquire(signature.set(id)));
+    return new (pActor->mpArchetype->Find(id)->At(pActor->mRow)) C{ std::forward<Args>(args) ... };
+  }
+  template<typename C, typename ... Args>
+  __forceinline C* Attach(Handle handle, Args&& ... args) noexcept
+  {
+    Actor** ppActor{ sActors.Find(handle) };
+    return ppActor ? Attach<C>(*ppActor, std::forward<Args>(args) ...) : nullptr;
+  }
+  template<typename C>
+  __forceinline void Detach(Actor* pActor) noexcept
+  {
+    u32 const id{ ComponentId<C>() };
+    if (!pActor->mpArchetype || !pActor->mpArchetype->Find(id))
     {
-      pComponent = new C{ std::forward<Args>(args) ... };
-      pActor->mComponentMask |= ~typeid(C).hash_code();
-      sTransactions[typeid(C).hash_code()].emplace(pActor);
-      sTransactions[pActor->mComponentMask].emplace(pActor);
+      return;
     }
-    return (C*)pComponent;
+    Move(pActor, Acquire(Signature{ pActor->mpArchetype->mSignature }.reset(id)));
   }
   template<typename C>
-  __forceinline C* Detach() noexcept
+  __forceinline void Detach(Handle handle) noexcept
   {
-    return {};
+    if (Actor** ppActor{ sActors.Find(handle) })
+    {
+      Detach<C>(*ppActor);
+    }
   }
-  
+
+  /*
+  * Query cache.
+  *
+  * Every component pack remembers the archetypes matching its signature
+  * together with their column indices. Archetypes are never released, so
+  * matching only has to look at archetypes created since the last query.
+  */
+
+  template<typename ... Cs>
+  struct Query
+  {
+    struct Match
+    {
+      Archetype*                      mpArchetype{};
+      std::array<u8, sizeof...(Cs)>   mColumns   {};
+    };
+
+    static inline std::vector<Match> sMatches{};
+    static inline u32                sVisited{};
+
+    static __forceinline std::vector<Match> const& Matches() noexcept
+    {
+      static Signature const sSignature{ SignatureOf<Cs ...>() };
+      for (; sVisited < (u32)sArchetypeList.size(); ++sVisited)
+      {
+        Archetype* pArchetype{ sArchetypeList[sVisited] };
+        if ((pArchetype->mSignature & sSignature) == sSignature)
+        {
+          sMatches.emplace_back(Match{ pArchetype, { pArchetype->mColumnOf[ComponentId<Cs>()] ... } });
+        }
+      }
+      return sMatches;
+    }
+  };
+
   /*
   * Dispatch specific routines.
   */
-  
+
+  // Current change version, systems remember it to filter their next dispatch
+  __forceinline u64 Version() noexcept
+  {
+    return sVersion;
+  }
+  template<typename C>
+  __forceinline void Touch(Actor* pActor) noexcept
+  {
+    if (pActor->mpArchetype)
+    {
+      if (Column* pColumn{ pActor->mpArchetype->Find(ComponentId<C>()) })
+      {
+        pColumn->mVersions[pActor->mRow / CHUNK_ROWS] = ++sVersion;
+      }
+    }
+  }
+
+  // Restricts a dispatch to chunks in which any of Fs changed after mSince
+  template<typename ... Fs>
+  struct Changed
+  {
+    u64 mSince{};
+  };
+
+  template<typename ... Cs>
+  struct Chunk
+  {
+    std::tuple<typename Proxy<Cs>::Ptr ...> mColumns {};
+    Actor* const*                           mppActors{};
+    u32                                     mCount   {};
+  };
+
+  // Collects the chunks to visit and stamps the columns that get written
+  template<typename ... Cs, typename ... Fs>
+  __forceinline std::vector<Chunk<Cs ...>> Gather(Changed<Fs ...> const& changed) noexcept
+  {
+    std::vector<Chunk<Cs ...>> chunks{};
+    u64 const version{ ++sVersion };
+    [&]<auto ... Is>(std::index_sequence<Is ...>)
+    {
+      for (auto const& match : Query<Cs ...>::Matches())
+      {
+        Archetype* pArchetype{ match.mpArchetype };
+        u32 const count{ (u32)pArchetype->mActors.size() };
+        for (u32 i{}; i < count; i += CHUNK_ROWS)
+        {
+          u32 const chunk{ i / CHUNK_ROWS };
+          if constexpr (sizeof...(Fs) > 0)
+          {
+            u32 changes{};
+            ((changes |= pArchetype->Find(ComponentId<Fs>()) && pArchetype->Find(ComponentId<Fs>())->mVersions[chunk] > changed.mSince), ...);
+            if (!changes) continue;
+          }
+          ((std::is_const_v<Cs> ? 0 : pArchetype->mColumns[match.mColumns[Is]].mVersions[chunk] = version), ...);
+          chunks.emplace_back(Chunk<Cs ...>{ { (typename Proxy<Cs>::Ptr)pArchetype->mColumns[match.mColumns[Is]].At(i) ... }, pArchetype->mActors.data() + i, std::min(CHUNK_ROWS, count - i) });
+        }
+      }
+    }(std::index_sequence_for<Cs ...>{});
+    return chunks;
+  }
+
+  template<typename ... Cs, typename ... Fs>
+  __forceinline void Dispatch(Changed<Fs ...> const& changed, std::function<void(typename Proxy<Cs>::Ptr ...)>&& predicate) noexcept
+  {
+    for (auto const& chunk : Gather<Cs ...>(changed))
+    {
+      [&]<auto ... Is>(std::index_sequence<Is ...>)
+      {
+        for (u32 i{}; i < chunk.mCount; ++i)
+        {
+          predicate((std::get<Is>(chunk.mColumns) + i) ...);
+        }
+      }(std::index_sequence_for<Cs ...>{});
+    }
+  }
   template<typename ... Cs>
   __forceinline void Dispatch(std::function<void(typename Proxy<Cs>::Ptr ...)>&& predicate) noexcept
   {
-    u64 const componentHash{ ((u64)0u | ... | ~typeid(Cs).hash_code()) };
-    for (auto const& pActor : sTransactions[componentHash])
+    Dispatch<Cs ...>(Changed<>{}, std::move(predicate));
+  }
+  // Splits matching rows into chunks of CHUNK_ROWS and spreads them across the job pool,
+  // predicates taking a leading Handle get the actor of the row passed along
+  template<typename ... Cs, typename ... Fs, typename P>
+  __forceinline void ParallelDispatch(Changed<Fs ...> const& changed, P&& predicate) noexcept
+  {
+    std::vector<Chunk<Cs ...>> const chunks{ Gather<Cs ...>(changed) };
+    VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+    {
+      Chunk<Cs ...> const& chunk{ chunks[index] };
+      [&]<auto ... Is>(std::index_sequence<Is ...>)
+      {
+        for (u32 i{}; i < chunk.mCount; ++i)
+        {
+          if constexpr (std::is_invocable_v<P, Handle, typename Proxy<Cs>::Ptr ...>)
+          {
+            predicate(chunk.mppActors[i]->mHandle, (std::get<Is>(chunk.mColumns) + i) ...);
+          }
+          else
+          {
+            predicate((std::get<Is>(chunk.mColumns) + i) ...);
+          }
+        }
+      }(std::index_sequence_for<Cs ...>{});
+    });
+  }
+  template<typename ... Cs, typename P>
+  __forceinline void ParallelDispatch(P&& predicate) noexcept
+  {
+    ParallelDispatch<Cs ...>(Changed<>{}, std::forward<P>(predicate));
+  }
+  // Hands whole chunks to the predicate as row count and column pointers so batched kernels
+  // can run over them
+  template<typename ... Cs, typename ... Fs, typename P>
+  __forceinline void ParallelBatch(Changed<Fs ...> const& changed, P&& predicate) noexcept
+  {
+    std::vector<Chunk<Cs ...>> const chunks{ Gather<Cs ...>(changed) };
+    VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+    {
+      std::apply([&](auto ... pColumns) { predicate(chunks[index].mCount, pColumns ...); }, chunks[index].mColumns);
+    });
+  }
+  template<typename ... Cs, typename P>
+  __forceinline void ParallelBatch(P&& predicate) noexcept
+  {
+    ParallelBatch<Cs ...>(Changed<>{}, std::forward<P>(predicate));
+  }
+
+  /*
+  * Deferred structural changes.
+  *
+  * Command buffer structure:
+  * ---T0-----------T1-----------T2--
+  *    |            |            |
+  *    [Cmd, ...]   [Cmd, ...]   [Cmd, ...]
+  *    Payloads     Payloads     Payloads
+  *
+  * Every thread records into its own buffer so predicates of Dispatch and
+  * ParallelDispatch can spawn, attach, detach and destroy without touching
+  * archetypes while they are iterated. Flush applies all buffers at a sync
+  * point: the creates of every buffer first, then the remaining commands sorted
+  * per actor, so each actor moves at most once and destination archetypes grow
+  * once. Deferred handles may be handed to other threads and recorded into
+  * their buffers, they resolve no matter which buffer created them.
+  */
+
+  struct Command
+  {
+    enum Type : u8
+    {
+      CREATE,
+      DESTROY,
+      ATTACH,
+      DETACH,
+    };
+
+    Type   mType     {};
+    Handle mHandle   {};
+    u64    mSequence {};
+    Layout mLayout   {};
+    void*  mpPayload {};
+    Handle(*mpCreate)(void* pPayload) {};
+  };
+
+  class CommandBuffer
+  {
+  public:
+    // Deferred handles carry the buffer and command index until the flush resolves them
+    static constexpr u32 DEFERRED    { Handle::GENERATION_MASK };
+    static constexpr u32 LOCAL_BITS  { 20 };
+    static constexpr u32 LOCAL_MASK  { (1u << LOCAL_BITS) - 1 };
+
+    CommandBuffer(u32 index) : mIndex{ index } {}
+
+  public:
+    template<Actorable A, typename ... Args>
+    __forceinline Handle Create(Args&& ... args) noexcept
+    {
+      using Arguments = std::tuple<std::decay_t<Args> ...>;
+      // The command index has to fit next to the buffer index of the deferred handle
+      VK_ASSERT(mCreates.size() <= LOCAL_MASK);
+      Handle const handle{ (mIndex << LOCAL_BITS) | ((u32)mCreates.size() & LOCAL_MASK), DEFERRED };
+      Command command{ Command::CREATE, handle };
+      command.mpPayload = new (mPayloads.Allocate(sizeof(Arguments))) Arguments{ std::forward<Args>(args) ... };
+      command.mpCreate = [](void* pPayload)
+      {
+        Arguments& arguments{ *(Arguments*)pPayload };
+        Handle const handle{ std::apply([](auto&& ... args) { return VkAcs::Create<A>(std::move(args) ...); }, arguments) };
+        arguments.~Arguments();
+        return handle;
+      };
+      mCreates.emplace_back(command);
+      return handle;
+    }
+    __forceinline void Destroy(Handle handle) noexcept
+    {
+      mCommands.emplace_back(Command{ Command::DESTROY, handle, mCommands.size() });
+    }
+    template<typename C, typename ... Args>
+    __forceinline void Attach(Handle handle, Args&& ... args) noexcept
+    {
+      Command command{ Command::ATTACH, handle, mCommands.size(), LayoutOf<C>() };
+      command.mpPayload = new (mPayloads.Allocate(sizeof(C))) C{ std::forward<Args>(args) ... };
+      mCommands.emplace_back(command);
+    }
+    template<typename C>
+    __forceinline void Detach(Handle handle) noexcept
+    {
+      mCommands.emplace_back(Command{ Command::DETACH, handle, mCommands.size(), LayoutOf<C>() });
+    }
+
+  private:
+    friend void Flush() noexcept;
+
+    u32                  mIndex   {};
+    std::vector<Command> mCreates {};
+    std::vector<Command> mCommands{};
+    VkArena              mPayloads{ PAYLOAD_BLOCK };
+  };
+
+  /*
+  * Per thread command buffers.
+  */
+
+  inline std::mutex                                  sCommandMutex  {};
+  inline std::vector<std::unique_ptr<CommandBuffer>> sCommandBuffers{};
+
+  __forceinline CommandBuffer& Deferred() noexcept
+  {
+    thread_local CommandBuffer* tpCommandBuffer{};
+    if (!tpCommandBuffer)
+    {
+      std::lock_guard<std::mutex> lock{ sCommandMutex };
+      tpCommandBuffer = sCommandBuffers.emplace_back(std::make_unique<CommandBuffer>((u32)sCommandBuffers.size())).get();
+    }
+    return *tpCommandBuffer;
+  }
+
+  // Applies all recorded commands, must not run while a dispatch is in flight
+  __forceinline void Flush() noexcept
+  {
+    std::lock_guard<std::mutex> lock{ sCommandMutex };
+    // Every buffer creates first, deferred handles may travel between threads and be used by any buffer
+    std::vector<std::vector<Handle>> created{ sCommandBuffers.size() };
+    for (auto const& pCommandBuffer : sCommandBuffers)
+    {
+      for (auto const& command : pCommandBuffer->mCreates)
+      {
+        created[pCommandBuffer->mIndex].emplace_back(command.mpCreate(command.mpPayload));
+      }
+      pCommandBuffer->mCreates.clear();
+    }
+    // Resolve deferred handles and collect commands in recording order
+    std::vector<Command> commands{};
+    for (auto const& pCommandBuffer : sCommandBuffers)
+    {
+      u64 const base{ commands.size() };
+      for (auto& command : pCommandBuffer->mCommands)
+      {
+        command.mSequence += base;
+        if (command.mHandle.Generation() == CommandBuffer::DEFERRED)
+        {
+          u32 const index{ command.mHandle.Index() };
+          command.mHandle = created[index >> CommandBuffer::LOCAL_BITS][index & CommandBuffer::LOCAL_MASK];
+        }
+        commands.emplace_back(command);
+      }
+      pCommandBuffer->mCommands.clear();
+    }
+    // Group commands per actor while keeping their recording order
+    std::sort(commands.begin(), commands.end(), [](Command const& a, Command const& b)
+    {
+      return a.mHandle != b.mHandle ? a.mHandle < b.mHandle : a.mSequence < b.mSequence;
+    });
+    struct Group
+    {
+      Actor*                              mpActor     {};
+      u32                                 mBegin      {};
+      u32                                 mEnd        {};
+      u32                                 mDestroy    {};
+      Signature                           mSignature  {};
+      Signature                           mReplaced   {};
+      std::array<void*, MAX_COMPONENTS>   mpPayloads  {};
+      Archetype*                          mpArchetype {};
+    };
+    std::vector<Group> groups{};
+    for (u32 i{}; i < (u32)commands.size();)
+    {
+      Group group{ nullptr, i };
+      while (i < (u32)commands.size() && commands[i].mHandle == commands[group.mBegin].mHandle) i++;
+      group.mEnd = i;
+      Actor** ppActor{ sActors.Find(commands[group.mBegin].mHandle) };
+      group.mpActor = ppActor ? *ppActor : nullptr;
+      if (group.mpActor && group.mpActor->mpArchetype)
+      {
+        group.mSignature = group.mpActor->mpArchetype->mSignature;
+      }
+      Signature const present{ group.mSignature };
+      // Fold the commands of one actor into its final signature and payloads
+      for (u32 j{ group.mBegin }; j < group.mEnd; ++j)
+      {
+        Command const& command{ commands[j] };
+        u32 const id{ command.mLayout.mId };
+        switch (command.mType)
+        {
+          case Command::DESTROY:
+          {
+            group.mDestroy = 1;
+            break;
+          }
+          case Command::ATTACH:
+          {
+            Register(command.mLayout);
+            // Same as Attach, an already attached component keeps its value
+            if (group.mSignature.test(id))
+            {
+              command.mLayout.mpDestroy(command.mpPayload);
+              break;
+            }
+            group.mpPayloads[id] = command.mpPayload;
+            group.mSignature.set(id);
+            group.mReplaced.set(id, present.test(id));
+            break;
+          }
+          case Command::DETACH:
+          {
+            if (group.mpPayloads[id])
+            {
+              command.mLayout.mpDestroy(group.mpPayloads[id]);
+              group.mpPayloads[id] = nullptr;
+            }
+            group.mSignature.reset(id);
+            break;
+          }
+          default: break;
+        }
+      }
+      if (!group.mpActor || group.mDestroy)
+      {
+        for (u32 id{}; id < MAX_COMPONENTS; ++id)
+        {
+          if (group.mpPayloads[id]) sLayouts[id].mpDestroy(group.mpPayloads[id]);
+        }
+        if (group.mpActor) Destroy(group.mpActor->mHandle);
+        continue;
+      }
+      group.mpArchetype = Acquire(group.mSignature);
+      groups.emplace_back(group);
+    }
+    // Move actors archetype by archetype and grow each destination once
+    std::sort(groups.begin(), groups.end(), [](Group const& a, Group const& b)
+    {
+      return a.mpArchetype != b.mpArchetype ? a.mpArchetype < b.mpArchetype : a.mpActor->mpArchetype < b.mpActor->mpArchetype;
+    });
+    for (u32 i{}; i < (u32)groups.size();)
+    {
+      u32 j{ i };
+      while (j < (u32)groups.size() && groups[j].mpArchetype == groups[i].mpArchetype) j++;
+      groups[i].mpArchetype->Reserve((u32)groups[i].mpArchetype->mActors.size() + (j - i));
+      for (; i < j; ++i)
+      {
+        Group const& group{ groups[i] };
+        if (group.mpActor->mpArchetype != group.mpArchetype)
+        {
+          Move(group.mpActor, group.mpArchetype);
+        }
+        for (u32 id{}; id < MAX_COMPONENTS; ++id)
+        {
+          if (!group.mpPayloads[id]) continue;
+          void* pComponent{ group.mpArchetype->Find(id)->At(group.mpActor->mRow) };
+          if (group.mReplaced.test(id))
+          {
+            sLayouts[id].mpDestroy(pComponent);
+            group.mpArchetype->Touch(group.mpActor->mRow);
+          }
+          sLayouts[id].mpRelocate(pComponent, group.mpPayloads[id]);
+        }
+      }
+    }
+    for (auto const& pCommandBuffer : sCommandBuffers)
     {
-      predicate(((typename Proxy<Cs>::Ptr)(*pActor->mpComponents)[typeid(Cs).hash_code()]) ...);
+      pCommandBuffer->mPayloads.Reset();
     }
   }
 }
@@ -0,0 +1,371 @@
+#include "VkAllocator.h"
+
+VkAllocator::VkAllocator(VkPhysicalDevice vkPhysicalDevice, VkDevice vkDevice, u64 blockSize)
+  : mVkPhysicalDevice{ vkPhysicalDevice }
+  , mVkDevice{ vkDevice }
+  , mBlockSize{ std::bit_floor(std::max(blockSize, VK_ALLOCATOR_MIN_NODE_SIZE)) }
+{
+  VkPhysicalDeviceProperties vkPhysicalDeviceProperties{};
+  vkGetPhysicalDeviceProperties(mVkPhysicalDevice, &vkPhysicalDeviceProperties);
+  vkGetPhysicalDeviceMemoryProperties(mVkPhysicalDevice, &mVkPhysicalDeviceMemoryProperties);
+  mVkPhysicalDeviceLimits = vkPhysicalDeviceProperties.limits;
+}
+VkAllocator::~VkAllocator()
+{
+  for (auto& pool : mPools)
+  {
+    for (Block* pBlock : pool.mpBlocks)
+    {
+      if (pBlock)
+      {
+        DestroyBlock(pBlock);
+      }
+    }
+  }
+}
+
+VkAllocation VkAllocator::Allocate(VkMemoryRequirements const& vkMemoryRequirements, VkMemoryPropertyFlags properties, u32 linear, void* pOwner)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  u32 const memoryType{ FindMemoryType(vkMemoryRequirements.memoryTypeBits, properties) };
+  u32 poolIndex{};
+  Pool& pool{ FindPool(memoryType, linear, poolIndex) };
+  u32 const order{ OrderOf(vkMemoryRequirements.size, vkMemoryRequirements.alignment) };
+  // Oversized requests bypass the buddy nodes
+  if ((VK_ALLOCATOR_MIN_NODE_SIZE << order) > BlockSizeOf(memoryType) / 2)
+  {
+    Block* pBlock{ CreateBlock(memoryType, vkMemoryRequirements.size, 1) };
+    pBlock->mNodes[0] = Node{ VK_ALLOCATOR_DEDICATED, pBlock->mSize, pOwner };
+    pBlock->mUsed = pBlock->mSize;
+    return VkAllocation{ pBlock->mVkDeviceMemory, 0, pBlock->mSize, pBlock->mpMapped, pOwner, poolIndex, Insert(pool, pBlock), VK_ALLOCATOR_DEDICATED };
+  }
+  return Place(poolIndex, order, vkMemoryRequirements.size, pOwner);
+}
+void VkAllocator::Free(VkAllocation& allocation)
+{
+  if (!allocation.mVkDeviceMemory)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{ mMutex };
+  Pool& pool{ mPools[allocation.mPool] };
+  Block*& pBlock{ pool.mpBlocks[allocation.mBlock] };
+  if (allocation.mOrder == VK_ALLOCATOR_DEDICATED)
+  {
+    DestroyBlock(pBlock);
+    pBlock = nullptr;
+  }
+  else
+  {
+    Release(*pBlock, allocation.mOffset, allocation.mOrder);
+    // Keep a single empty block around per pool
+    if (!pBlock->mUsed)
+    {
+      for (Block* pOther : pool.mpBlocks)
+      {
+        if (pOther && pOther != pBlock && !pOther->mDedicated && !pOther->mUsed)
+        {
+          DestroyBlock(pBlock);
+          pBlock = nullptr;
+          break;
+        }
+      }
+    }
+  }
+  allocation = VkAllocation{};
+}
+
+void VkAllocator::CreateBuffer(VkBufferCreateInfo const& vkBufferCreateInfo, VkMemoryPropertyFlags properties, VkBuffer& vkBuffer, VkAllocation& allocation)
+{
+  VK_VALIDATE(vkCreateBuffer(mVkDevice, &vkBufferCreateInfo, nullptr, &vkBuffer));
+  VkMemoryRequirements vkMemoryRequirements{};
+  vkGetBufferMemoryRequirements(mVkDevice, vkBuffer, &vkMemoryRequirements);
+  allocation = Allocate(vkMemoryRequirements, properties, 1);
+  VK_VALIDATE(vkBindBufferMemory(mVkDevice, vkBuffer, allocation.mVkDeviceMemory, allocation.mOffset));
+}
+void VkAllocator::DestroyBuffer(VkBuffer& vkBuffer, VkAllocation& allocation)
+{
+  vkDestroyBuffer(mVkDevice, vkBuffer, nullptr);
+  Free(allocation);
+  vkBuffer = VK_NULL_HANDLE;
+}
+void VkAllocator::CreateImage(VkImageCreateInfo const& vkImageCreateInfo, VkMemoryPropertyFlags properties, VkImage& vkImage, VkAllocation& allocation)
+{
+  VK_VALIDATE(vkCreateImage(mVkDevice, &vkImageCreateInfo, nullptr, &vkImage));
+  VkMemoryRequirements vkMemoryRequirements{};
+  vkGetImageMemoryRequirements(mVkDevice, vkImage, &vkMemoryRequirements);
+  allocation = Allocate(vkMemoryRequirements, properties, vkImageCreateInfo.tiling == VK_IMAGE_TILING_LINEAR);
+  VK_VALIDATE(vkBindImageMemory(mVkDevice, vkImage, allocation.mVkDeviceMemory, allocation.mOffset));
+}
+void VkAllocator::DestroyImage(VkImage& vkImage, VkAllocation& allocation)
+{
+  vkDestroyImage(mVkDevice, vkImage, nullptr);
+  Free(allocation);
+  vkImage = VK_NULL_HANDLE;
+}
+
+void VkAllocator::Flush(VkAllocation const& allocation, u64 offset, u64 size)
+{
+  u32 const memoryType{ mPools[allocation.mPool].mMemoryType };
+  if (mVkPhysicalDeviceMemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+  {
+    return;
+  }
+  // Ranges have to be aligned to the non coherent atom size
+  u64 const atom{ std::max((u64)mVkPhysicalDeviceLimits.nonCoherentAtomSize, (u64)1) };
+  u64 const begin{ allocation.mOffset + offset };
+  u64 const end{ allocation.mOffset + (size == VK_WHOLE_SIZE ? allocation.mSize : offset + size) };
+  VkMappedMemoryRange vkMappedMemoryRange{};
+  vkMappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  vkMappedMemoryRange.memory = allocation.mVkDeviceMemory;
+  vkMappedMemoryRange.offset = begin / atom * atom;
+  vkMappedMemoryRange.size = std::min((end + atom - 1) / atom * atom, mPools[allocation.mPool].mpBlocks[allocation.mBlock]->mSize) - vkMappedMemoryRange.offset;
+  VK_VALIDATE(vkFlushMappedMemoryRanges(mVkDevice, 1, &vkMappedMemoryRange));
+}
+
+u32 VkAllocator::Defragment(Mover const& mover)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  u32 moved{};
+  for (u32 poolIndex{}; poolIndex < (u32)mPools.size(); ++poolIndex)
+  {
+    Pool& pool{ mPools[poolIndex] };
+    // Drain the emptiest blocks into the fullest ones
+    std::vector<u32> blocks{};
+    for (u32 i{}; i < (u32)pool.mpBlocks.size(); ++i)
+    {
+      if (pool.mpBlocks[i] && !pool.mpBlocks[i]->mDedicated && pool.mpBlocks[i]->mUsed) blocks.emplace_back(i);
+    }
+    std::sort(blocks.begin(), blocks.end(), [&](u32 a, u32 b) { return pool.mpBlocks[a]->mUsed < pool.mpBlocks[b]->mUsed; });
+    // Blocks that received allocations are never drained themselves so nothing moves twice
+    std::vector<u8> received(blocks.size());
+    for (u32 source{}; source + 1 < (u32)blocks.size(); ++source)
+    {
+      if (received[source])
+      {
+        break;
+      }
+      Block& from{ *pool.mpBlocks[blocks[source]] };
+      std::map<u64, Node> const nodes{ from.mNodes };
+      for (auto const& [offset, node] : nodes)
+      {
+        u32 const order{ node.mOrder };
+        for (u32 target{ (u32)blocks.size() - 1 }; target > source; --target)
+        {
+          Block& to{ *pool.mpBlocks[blocks[target]] };
+          u64 placed{};
+          if (!Claim(to, order, placed))
+          {
+            continue;
+          }
+          to.mNodes[placed] = node;
+          VkAllocation const src{ from.mVkDeviceMemory, offset, node.mSize, from.mpMapped ? from.mpMapped + offset : nullptr, node.mpOwner, poolIndex, blocks[source], order };
+          VkAllocation const dst{ to.mVkDeviceMemory, placed, node.mSize, to.mpMapped ? to.mpMapped + placed : nullptr, node.mpOwner, poolIndex, blocks[target], order };
+          if (mover(src, dst))
+          {
+            Release(from, offset, order);
+            received[target] = 1;
+            moved++;
+          }
+          else
+          {
+            Release(to, placed, order);
+          }
+          break;
+        }
+      }
+    }
+    // Release drained blocks but one
+    u32 spare{};
+    for (Block*& pBlock : pool.mpBlocks)
+    {
+      if (pBlock && !pBlock->mDedicated && !pBlock->mUsed && spare++)
+      {
+        DestroyBlock(pBlock);
+        pBlock = nullptr;
+      }
+    }
+  }
+  return moved;
+}
+
+VkHeapStats VkAllocator::Stats(u32 heap)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  VkHeapStats stats{};
+  stats.mBudget = mVkPhysicalDeviceMemoryProperties.memoryHeaps[heap].size;
+  for (auto const& pool : mPools)
+  {
+    if (mVkPhysicalDeviceMemoryProperties.memoryTypes[pool.mMemoryType].heapIndex != heap)
+    {
+      continue;
+    }
+    for (Block const* pBlock : pool.mpBlocks)
+    {
+      if (pBlock)
+      {
+        stats.mBlocks++;
+        stats.mAllocations += (u32)pBlock->mNodes.size();
+        stats.mReserved += pBlock->mSize;
+        stats.mUsed += pBlock->mUsed;
+      }
+    }
+  }
+  return stats;
+}
+void VkAllocator::PrintStats()
+{
+  for (u32 i{}; i < mVkPhysicalDeviceMemoryProperties.memoryHeapCount; ++i)
+  {
+    VkHeapStats const stats{ Stats(i) };
+    VK_LOG("Heap %u: %u blocks, %u allocations, %llu of %llu bytes used, %llu bytes budget\n", i, stats.mBlocks, stats.mAllocations, (unsigned long long)stats.mUsed, (unsigned long long)stats.mReserved, (unsigned long long)stats.mBudget);
+  }
+}
+
+u32 VkAllocator::FindMemoryType(u32 typeBits, VkMemoryPropertyFlags properties) const
+{
+  for (u32 i{}; i < mVkPhysicalDeviceMemoryProperties.memoryTypeCount; ++i)
+  {
+    if ((typeBits & (1u << i)) && (mVkPhysicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+    {
+      return i;
+    }
+  }
+  VK_LOG("No memory type for bits %X with properties %X\n", typeBits, properties);
+  std::exit(1);
+}
+u64 VkAllocator::BlockSizeOf(u32 memoryType) const
+{
+  // Small heaps like host visible device memory get smaller blocks
+  u64 const heapSize{ mVkPhysicalDeviceMemoryProperties.memoryHeaps[mVkPhysicalDeviceMemoryProperties.memoryTypes[memoryType].heapIndex].size };
+  return std::max(std::min(mBlockSize, std::bit_floor(heapSize / 8)), VK_ALLOCATOR_MIN_NODE_SIZE);
+}
+VkAllocator::Pool& VkAllocator::FindPool(u32 memoryType, u32 linear, u32& index)
+{
+  for (index = 0; index < (u32)mPools.size(); ++index)
+  {
+    if (mPools[index].mMemoryType == memoryType && mPools[index].mLinear == linear)
+    {
+      return mPools[index];
+    }
+  }
+  return mPools.emplace_back(Pool{ memoryType, linear });
+}
+VkAllocator::Block* VkAllocator::CreateBlock(u32 memoryType, u64 size, u32 dedicated)
+{
+  // Memory allocate info
+  VkMemoryAllocateInfo vkMemoryAllocateInfo{};
+  vkMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  vkMemoryAllocateInfo.allocationSize = size;
+  vkMemoryAllocateInfo.memoryTypeIndex = memoryType;
+  // Allocate block
+  Block* pBlock{ new Block{} };
+  pBlock->mSize = size;
+  pBlock->mDedicated = dedicated;
+  VK_VALIDATE(vkAllocateMemory(mVkDevice, &vkMemoryAllocateInfo, nullptr, &pBlock->mVkDeviceMemory));
+  // Map once for the lifetime of the block
+  if (mVkPhysicalDeviceMemoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+  {
+    void* pMapped{};
+    VK_VALIDATE(vkMapMemory(mVkDevice, pBlock->mVkDeviceMemory, 0, VK_WHOLE_SIZE, 0, &pMapped));
+    pBlock->mpMapped = (u8*)pMapped;
+  }
+  if (!dedicated)
+  {
+    pBlock->mFree.resize(std::countr_zero(size / VK_ALLOCATOR_MIN_NODE_SIZE) + 1);
+    pBlock->mFree.back().emplace(0);
+  }
+  return pBlock;
+}
+void VkAllocator::DestroyBlock(Block* pBlock)
+{
+  if (pBlock->mpMapped)
+  {
+    vkUnmapMemory(mVkDevice, pBlock->mVkDeviceMemory);
+  }
+  vkFreeMemory(mVkDevice, pBlock->mVkDeviceMemory, nullptr);
+  delete pBlock;
+}
+
+u32 VkAllocator::OrderOf(u64 size, u64 alignment)
+{
+  u64 const node{ std::bit_ceil(std::max(std::max(size, alignment), VK_ALLOCATOR_MIN_NODE_SIZE)) };
+  return (u32)std::countr_zero(node / VK_ALLOCATOR_MIN_NODE_SIZE);
+}
+u32 VkAllocator::Claim(Block& block, u32 order, u64& offset)
+{
+  // Find the smallest free node that fits and split it down
+  u32 level{ order };
+  while (level < (u32)block.mFree.size() && block.mFree[level].empty()) level++;
+  if (level >= (u32)block.mFree.size())
+  {
+    return 0;
+  }
+  offset = *block.mFree[level].begin();
+  block.mFree[level].erase(block.mFree[level].begin());
+  while (level > order)
+  {
+    level--;
+    block.mFree[level].emplace(offset + (VK_ALLOCATOR_MIN_NODE_SIZE << level));
+  }
+  block.mNodes[offset] = Node{ order };
+  block.mUsed += VK_ALLOCATOR_MIN_NODE_SIZE << order;
+  return 1;
+}
+void VkAllocator::Release(Block& block, u64 offset, u32 order)
+{
+  block.mNodes.erase(offset);
+  block.mUsed -= VK_ALLOCATOR_MIN_NODE_SIZE << order;
+  // Merge with free buddies as far up as possible
+  while (order + 1 < (u32)block.mFree.size())
+  {
+    u64 const buddy{ offset ^ (VK_ALLOCATOR_MIN_NODE_SIZE << order) };
+    if (!block.mFree[order].erase(buddy))
+    {
+      break;
+    }
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  block.mFree[order].emplace(offset);
+}
+
+u32 VkAllocator::Insert(Pool& pool, Block* pBlock)
+{
+  // Reuse slots of released blocks so indices of live allocations stay valid
+  auto const slot{ std::find(pool.mpBlocks.begin(), pool.mpBlocks.end(), nullptr) };
+  u32 const index{ (u32)(slot - pool.mpBlocks.begin()) };
+  if (slot == pool.mpBlocks.end())
+  {
+    pool.mpBlocks.emplace_back(pBlock);
+  }
+  else
+  {
+    *slot = pBlock;
+  }
+  return index;
+}
+VkAllocation VkAllocator::Place(u32 poolIndex, u32 order, u64 size, void* pOwner)
+{
+  Pool& pool{ mPools[poolIndex] };
+  u64 offset{};
+  u32 blockIndex{};
+  while (blockIndex < (u32)pool.mpBlocks.size())
+  {
+    Block* pBlock{ pool.mpBlocks[blockIndex] };
+    if (pBlock && !pBlock->mDedicated && Claim(*pBlock, order, offset))
+    {
+      break;
+    }
+    blockIndex++;
+  }
+  // Every block is full, reserve a new one
+  if (blockIndex == (u32)pool.mpBlocks.size() || !pool.mpBlocks[blockIndex])
+  {
+    blockIndex = Insert(pool, CreateBlock(pool.mMemoryType, BlockSizeOf(pool.mMemoryType), 0));
+    Claim(*pool.mpBlocks[blockIndex], order, offset);
+  }
+  Block* pBlock{ pool.mpBlocks[blockIndex] };
+  pBlock->mNodes[offset] = Node{ order, size, pOwner };
+  return VkAllocation{ pBlock->mVkDeviceMemory, offset, size, pBlock->mpMapped ? pBlock->mpMapped + offset : nullptr, pOwner, poolIndex, blockIndex, order };
+}
\ No newline at end of file
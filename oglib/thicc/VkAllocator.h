@@ -0,0 +1,135 @@
+#ifndef VK_ALLOCATOR
+#define VK_ALLOCATOR
+
+/*
+* Device memory sub-allocator.
+*
+* Allocator structure:
+* ---Pools-----------------Blocks------------------Nodes------------
+*    |                     |                       |
+*    [Type, Linear] -----> [Memory, Mapped, ...] --> [2^k * MIN_NODE_SIZE, ...]
+*
+* Memory gets reserved in large blocks per memory type and handed out by a
+* buddy allocator, so the driver sees a handful of vkAllocateMemory calls no
+* matter how many buffers exist. Nodes are aligned to their own size, which
+* covers any alignment up to the node size. Linear and optimal resources live
+* in separate pools so neighbours never violate bufferImageGranularity.
+* Requests larger than half a block get a dedicated block of their own.
+*
+* Host visible blocks stay mapped for their whole lifetime, allocations only
+* carry a pointer into the mapping. Empty blocks are released except for one
+* spare per pool.
+*/
+
+#include "VkCore.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u64 VK_ALLOCATOR_BLOCK_SIZE    { 64ull * 1024 * 1024 };
+constexpr u64 VK_ALLOCATOR_MIN_NODE_SIZE { 256 };
+constexpr u32 VK_ALLOCATOR_DEDICATED     { ~0u };
+
+/*
+* Allocations and statistics.
+*/
+
+struct VkAllocation
+{
+  VkDeviceMemory mVkDeviceMemory{};
+  u64            mOffset        {};
+  u64            mSize          {};
+  void*          mpMapped       {};
+  void*          mpOwner        {};
+  u32            mPool          {};
+  u32            mBlock         {};
+  u32            mOrder         {};
+};
+
+struct VkHeapStats
+{
+  u32 mBlocks     {};
+  u32 mAllocations{};
+  u64 mReserved   {};
+  u64 mUsed       {};
+  u64 mBudget     {};
+};
+
+/*
+* Allocator.
+*/
+
+class VkAllocator
+{
+public:
+  // Receives a live allocation and its new place, copies the contents and rebinds the owner,
+  // returns zero to keep the allocation where it is
+  using Mover = std::function<u32(VkAllocation const& from, VkAllocation const& to)>;
+
+public:
+  VkAllocator(VkPhysicalDevice vkPhysicalDevice, VkDevice vkDevice, u64 blockSize = VK_ALLOCATOR_BLOCK_SIZE);
+  virtual ~VkAllocator();
+
+public:
+  VkAllocation Allocate(VkMemoryRequirements const& vkMemoryRequirements, VkMemoryPropertyFlags properties, u32 linear = 1, void* pOwner = nullptr);
+  void         Free(VkAllocation& allocation);
+
+  void         CreateBuffer(VkBufferCreateInfo const& vkBufferCreateInfo, VkMemoryPropertyFlags properties, VkBuffer& vkBuffer, VkAllocation& allocation);
+  void         DestroyBuffer(VkBuffer& vkBuffer, VkAllocation& allocation);
+  void         CreateImage(VkImageCreateInfo const& vkImageCreateInfo, VkMemoryPropertyFlags properties, VkImage& vkImage, VkAllocation& allocation);
+  void         DestroyImage(VkImage& vkImage, VkAllocation& allocation);
+
+  void         Flush(VkAllocation const& allocation, u64 offset = 0, u64 size = VK_WHOLE_SIZE);
+
+  u32          Defragment(Mover const& mover);
+
+  VkHeapStats  Stats(u32 heap);
+  void         PrintStats();
+
+private:
+  struct Node
+  {
+    u32   mOrder {};
+    u64   mSize  {};
+    void* mpOwner{};
+  };
+  struct Block
+  {
+    VkDeviceMemory             mVkDeviceMemory{};
+    u64                        mSize          {};
+    u64                        mUsed          {};
+    u8*                        mpMapped       {};
+    u32                        mDedicated     {};
+    std::vector<std::set<u64>> mFree          {};
+    std::map<u64, Node>        mNodes         {};
+  };
+  struct Pool
+  {
+    u32                 mMemoryType{};
+    u32                 mLinear    {};
+    std::vector<Block*> mpBlocks   {};
+  };
+
+  static u32  OrderOf(u64 size, u64 alignment);
+  static u32  Claim(Block& block, u32 order, u64& offset);
+  static void Release(Block& block, u64 offset, u32 order);
+
+  u32          FindMemoryType(u32 typeBits, VkMemoryPropertyFlags properties) const;
+  u64          BlockSizeOf(u32 memoryType) const;
+  Pool&        FindPool(u32 memoryType, u32 linear, u32& index);
+  Block*       CreateBlock(u32 memoryType, u64 size, u32 dedicated);
+  void         DestroyBlock(Block* pBlock);
+  u32          Insert(Pool& pool, Block* pBlock);
+  VkAllocation Place(u32 poolIndex, u32 order, u64 size, void* pOwner);
+
+  VkPhysicalDevice                 mVkPhysicalDevice                 {};
+  VkDevice                         mVkDevice                         {};
+  VkPhysicalDeviceMemoryProperties mVkPhysicalDeviceMemoryProperties {};
+  VkPhysicalDeviceLimits           mVkPhysicalDeviceLimits           {};
+  u64                              mBlockSize                        {};
+  std::vector<Pool>                mPools                            {};
+  std::mutex                       mMutex                            {};
+};
+
+#endif
\ No newline at end of file
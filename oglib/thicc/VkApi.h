@@ -2,12 +2,33 @@
 #define VK_API
 
 #include "VkUtils.h"
+#include "VkSandbox.h"
+#ifndef VK_HEADLESS
 #include "VkWindow.h"
+#endif
+#include "VkHeadless.h"
 #include "VkVertices.h"
 #include "VkUniforms.h"
 #include "VkComponents.h"
+#include "VkAllocator.h"
+#include "VkUploader.h"
 #include "VkRenderer.h"
+#include "VkJobs.h"
+#include "VkPool.h"
+#include "VkSlotMap.h"
 #include "VkAcs.h"
+#include "VkSimd.h"
+#include "VkTransform.h"
+#include "VkPhysics.h"
+#include "VkBroadphase.h"
+#include "VkCulling.h"
 #include "VkMesh.h"
+#include "VkMeshFile.h"
+#include "VkMeshOptimizer.h"
+#include "VkLod.h"
+#include "VkInstancer.h"
+#include "VkRecorder.h"
+#include "VkReflection.h"
+#include "VkPipelines.h"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,491 @@
+#ifndef VK_BROADPHASE
+#define VK_BROADPHASE
+
+/*
+* Hierarchical hash grid broadphase.
+*
+* Grid structure:
+* ---Buckets----------------Binned----------------------------------
+*    |                      |
+*    [Start, ...] --------> [Center, Radius, Handle, Level, Cell]
+*
+* Level structure:
+* ---L0-------L1-----------L2-------------------
+*    |        |            |
+*    [][][]   [  ][  ]     [      ]
+*    S        S * 2        S * 4
+*
+* Every actor with a transform and bounds owns a proxy, a sphere around its
+* position whose radius is scaled by the largest scale axis. Proxies are
+* binned by the cell of their center on the finest level whose cells span the
+* diameter of the sphere, so overlaps on the same level only ever reach into
+* neighbouring cells. Cells of all levels are hashed into one bucket table,
+* proxies get counting sorted into it in parallel and stored by value so a
+* bucket is scanned without indirection. Spheres too large for the coarsest
+* level are kept aside and tested against everything.
+*
+* Updates refresh proxies of chunks whose transforms or bounds changed since
+* the last update, proxies staying in their cell are patched in place and
+* the grid only gets rebinned when one crossed a cell, appeared or vanished.
+*
+* Pairs are collected in parallel. Every proxy visits its own cell and the
+* 13 forward neighbours on its level, pairs across two levels are found from
+* whichever side has to visit fewer cells. Each pair is found exactly once.
+*
+* Rays walk the cells they pass on every level. A level on which a ray would
+* cross more than MAX_RAY_CELLS cells is scanned as a whole instead, so rays
+* of any length, infinite ones included, find every hit.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkJobs.h"
+
+namespace VkBroadphase
+{
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 MAX_LEVELS    { 16 };
+  constexpr u32 LARGE         { MAX_LEVELS };
+  constexpr u32 MIN_BUCKETS   { 1024 };
+  constexpr u32 JOBS_PER_CORE { 4 };
+  // Cells a ray walks per level before the level gets scanned as a whole
+  constexpr u32 MAX_RAY_CELLS { 4096 };
+  constexpr u32 MAX_AREA_CELLS{ 4096 };
+
+  /*
+  * Results.
+  */
+
+  struct Pair
+  {
+    VkAcs::Handle mA{};
+    VkAcs::Handle mB{};
+
+    constexpr bool operator == (Pair const& other) const noexcept { return mA == other.mA && mB == other.mB; }
+    constexpr bool operator <  (Pair const& other) const noexcept { return mA != other.mA ? mA < other.mA : mB < other.mB; }
+  };
+  struct Hit
+  {
+    VkAcs::Handle mHandle  {};
+    r32           mDistance{};
+  };
+
+  /*
+  * Proxies.
+  */
+
+  struct Proxy
+  {
+    r32v3         mCenter{};
+    r32           mRadius{};
+    VkAcs::Handle mHandle{};
+    glm::ivec3    mCell  {};
+    u32           mLevel {};
+  };
+
+  /*
+  * Grid.
+  */
+
+  class Grid
+  {
+  public:
+    Grid(r32 cellSize)
+    {
+      for (u32 i{}; i < MAX_LEVELS; ++i)
+      {
+        mCellSizes[i] = cellSize * (r32)(1u << i);
+      }
+    }
+
+  public:
+    __forceinline u32 Count()             const noexcept { return mCount; }
+    __forceinline r32 CellSize(u32 level) const noexcept { return mCellSizes[level]; }
+
+    // Pulls transform and bounds changes since the last update into the grid
+    __forceinline void Update() noexcept
+    {
+      u64 const version{ VkAcs::Version() };
+      mProxies.resize(std::max((u32)mProxies.size(), VkAcs::sActors.Capacity()));
+      mSlots.resize(mProxies.size());
+      std::atomic<u32> dirty{};
+      auto const chunks{ VkAcs::Gather<acs::Transform const, acs::Bounds const>(VkAcs::Changed<acs::Transform, acs::Bounds>{ mVersion }) };
+      VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+      {
+        auto const& chunk{ chunks[index] };
+        auto const [pTransforms, pBounds] { chunk.mColumns };
+        u32 moved{};
+        for (u32 i{}; i < chunk.mCount; ++i)
+        {
+          VkAcs::Handle const handle{ chunk.mppActors[i]->mHandle };
+          Proxy& proxy{ mProxies[handle.Index()] };
+          r32v3 const scale{ glm::abs(pTransforms[i].mScale) };
+          r32 const radius{ pBounds[i].mRadius * std::max(scale.x, std::max(scale.y, scale.z)) };
+          u32 const level{ LevelOf(radius) };
+          glm::ivec3 const cell{ level == LARGE ? glm::ivec3{} : CellOf(pTransforms[i].mPosition, level) };
+          u32 const same{ proxy.mHandle == handle && proxy.mCell == cell && proxy.mLevel == level };
+          proxy = Proxy{ pTransforms[i].mPosition, radius, handle, cell, level };
+          if (same)
+          {
+            (level == LARGE ? mLarge : mBinned)[mSlots[handle.Index()]] = proxy;
+          }
+          moved |= !same;
+        }
+        if (moved) dirty.store(1, std::memory_order_relaxed);
+      });
+      u32 count{};
+      for (auto const& match : VkAcs::Query<acs::Transform const, acs::Bounds const>::Matches())
+      {
+        count += (u32)match.mpArchetype->mActors.size();
+      }
+      if (dirty.load() || count != mCount)
+      {
+        Rebuild(count);
+      }
+      mVersion = version;
+    }
+
+    // Collects all overlapping pairs, sorted by handle
+    __forceinline std::vector<Pair> const& Pairs() noexcept
+    {
+      u32 const ranges{ std::max(VkJobs::Get().Concurrency() * JOBS_PER_CORE, 1u) };
+      u32 const binned{ (u32)mBinned.size() };
+      u32 const share{ (binned + ranges - 1) / ranges };
+      std::vector<std::vector<Pair>> pairs(ranges + mLarge.size());
+      VkJobs::Get().ForEach(ranges + (u32)mLarge.size(), [&](u32 index)
+      {
+        std::vector<Pair>& out{ pairs[index] };
+        auto const test{ [&](Proxy const& a, Proxy const& b)
+        {
+          if (Overlaps(a, b)) out.emplace_back(a.mHandle < b.mHandle ? Pair{ a.mHandle, b.mHandle } : Pair{ b.mHandle, a.mHandle });
+        } };
+        if (index < ranges)
+        {
+          for (u32 i{ index * share }; i < std::min((index + 1) * share, binned); ++i)
+          {
+            Proxy const& proxy{ mBinned[i] };
+            auto const visit{ [&](Proxy const& other) { test(proxy, other); } };
+            ForEachForward(proxy, i, visit);
+            for (u32 level{}; level < MAX_LEVELS; ++level)
+            {
+              if (level > proxy.mLevel && (mLevels & (1u << level)) && !mCoarseDriven[proxy.mLevel][level])
+              {
+                ForEachAround(CellOf(proxy.mCenter, level), level, visit);
+              }
+              if (level < proxy.mLevel && (mLevels & (1u << level)) && mCoarseDriven[level][proxy.mLevel])
+              {
+                r32 const reach{ proxy.mRadius + mCellSizes[level] * 0.5f };
+                ForEachInBox(proxy.mCenter - reach, proxy.mCenter + reach, level, visit);
+              }
+            }
+          }
+        }
+        else
+        {
+          // Large proxies test every binned one and all large ones after them
+          u32 const large{ index - ranges };
+          Proxy const& proxy{ mLarge[large] };
+          for (u32 i{}; i < binned; ++i)
+          {
+            test(proxy, mBinned[i]);
+          }
+          for (u32 i{ large + 1 }; i < (u32)mLarge.size(); ++i)
+          {
+            test(proxy, mLarge[i]);
+          }
+        }
+      });
+      mPairs.clear();
+      for (auto const& out : pairs)
+      {
+        mPairs.insert(mPairs.end(), out.begin(), out.end());
+      }
+      std::sort(mPairs.begin(), mPairs.end());
+      return mPairs;
+    }
+
+    // Appends every actor whose sphere touches the box spanned by min and max
+    __forceinline void Query(r32v3 const& min, r32v3 const& max, std::vector<VkAcs::Handle>& handles) const noexcept
+    {
+      auto const test{ [&](Proxy const& proxy)
+      {
+        r32v3 const delta{ proxy.mCenter - glm::clamp(proxy.mCenter, min, max) };
+        if (glm::dot(delta, delta) <= proxy.mRadius * proxy.mRadius) handles.emplace_back(proxy.mHandle);
+      } };
+      for (u32 level{}; level < MAX_LEVELS; ++level)
+      {
+        if (mLevels & (1u << level))
+        {
+          r32 const reach{ mCellSizes[level] * 0.5f };
+          ForEachInBox(min - reach, max + reach, level, test);
+        }
+      }
+      for (auto const& proxy : mLarge)
+      {
+        test(proxy);
+      }
+    }
+    // Appends every actor whose sphere touches the given sphere
+    __forceinline void Query(r32v3 const& center, r32 radius, std::vector<VkAcs::Handle>& handles) const noexcept
+    {
+      u64 const first{ handles.size() };
+      Query(center - radius, center + radius, handles);
+      handles.erase(std::remove_if(handles.begin() + first, handles.end(), [&](VkAcs::Handle const& handle)
+      {
+        Proxy const& proxy{ mProxies[handle.Index()] };
+        r32v3 const delta{ proxy.mCenter - center };
+        return glm::dot(delta, delta) > (proxy.mRadius + radius) * (proxy.mRadius + radius);
+      }), handles.end());
+    }
+
+    // Appends every actor hit within distance along a normalized direction, nearest first
+    __forceinline void Raycast(r32v3 const& origin, r32v3 const& direction, r32 distance, std::vector<Hit>& hits) const noexcept
+    {
+      u64 const first{ hits.size() };
+      auto const test{ [&](Proxy const& proxy)
+      {
+        r32v3 const offset{ origin - proxy.mCenter };
+        r32 const b{ glm::dot(offset, direction) };
+        r32 const c{ glm::dot(offset, offset) - proxy.mRadius * proxy.mRadius };
+        r32 const discriminant{ b * b - c };
+        if (discriminant < 0.f || (c > 0.f && b > 0.f)) return;
+        r32 const t{ std::max(-b - std::sqrt(discriminant), 0.f) };
+        if (t <= distance) hits.emplace_back(Hit{ proxy.mHandle, t });
+      } };
+      for (u32 level{}; level < MAX_LEVELS; ++level)
+      {
+        if (mLevels & (1u << level)) Walk(origin, direction, distance, level, test);
+      }
+      for (auto const& proxy : mLarge)
+      {
+        test(proxy);
+      }
+      std::sort(hits.begin() + first, hits.end(), [](Hit const& a, Hit const& b) { return a.mDistance < b.mDistance; });
+    }
+
+  private:
+    __forceinline u32 LevelOf(r32 radius) const noexcept
+    {
+      u32 level{};
+      while (level < MAX_LEVELS && radius * 2.f > mCellSizes[level]) level++;
+      return level;
+    }
+    __forceinline glm::ivec3 CellOf(r32v3 const& position, u32 level) const noexcept
+    {
+      return glm::ivec3{ glm::floor(position / mCellSizes[level]) };
+    }
+    __forceinline u32 BucketOf(glm::ivec3 const& cell, u32 level) const noexcept
+    {
+      return (((u32)cell.x * 73856093u) ^ ((u32)cell.y * 19349663u) ^ ((u32)cell.z * 83492791u) ^ (level * 2654435761u)) & (mBucketCount - 1);
+    }
+    static __forceinline u32 Overlaps(Proxy const& a, Proxy const& b) noexcept
+    {
+      r32v3 const delta{ a.mCenter - b.mCenter };
+      return glm::dot(delta, delta) <= (a.mRadius + b.mRadius) * (a.mRadius + b.mRadius);
+    }
+
+    template<typename P>
+    __forceinline void ForEachInCell(glm::ivec3 const& cell, u32 level, P&& predicate) const noexcept
+    {
+      u32 const bucket{ BucketOf(cell, level) };
+      for (u32 i{ mStarts[bucket] }; i < mStarts[bucket + 1]; ++i)
+      {
+        if (mBinned[i].mLevel == level && mBinned[i].mCell == cell) predicate(mBinned[i]);
+      }
+    }
+    template<typename P>
+    __forceinline void ForEachAround(glm::ivec3 const& cell, u32 level, P&& predicate) const noexcept
+    {
+      for (s32 z{ -1 }; z <= 1; ++z)
+      for (s32 y{ -1 }; y <= 1; ++y)
+      for (s32 x{ -1 }; x <= 1; ++x)
+      {
+        ForEachInCell(cell + glm::ivec3{ x, y, z }, level, predicate);
+      }
+    }
+    // Visits every proxy of a level whose center lies in a cell touched by the box
+    template<typename P>
+    __forceinline void ForEachInBox(r32v3 const& min, r32v3 const& max, u32 level, P&& predicate) const noexcept
+    {
+      glm::ivec3 const first{ CellOf(min, level) };
+      glm::ivec3 const last{ CellOf(max, level) };
+      s64 const cells{ ((s64)last.x - first.x + 1) * ((s64)last.y - first.y + 1) * ((s64)last.z - first.z + 1) };
+      if (cells > (s64)MAX_AREA_CELLS)
+      {
+        for (auto const& proxy : mBinned)
+        {
+          if (proxy.mLevel == level && glm::all(glm::greaterThanEqual(proxy.mCell, first)) && glm::all(glm::lessThanEqual(proxy.mCell, last))) predicate(proxy);
+        }
+        return;
+      }
+      for (s32 z{ first.z }; z <= last.z; ++z)
+      for (s32 y{ first.y }; y <= last.y; ++y)
+      for (s32 x{ first.x }; x <= last.x; ++x)
+      {
+        ForEachInCell(glm::ivec3{ x, y, z }, level, predicate);
+      }
+    }
+    // Visits proxies after position in the own cell and all proxies of the 13 forward neighbours
+    template<typename P>
+    __forceinline void ForEachForward(Proxy const& proxy, u32 position, P&& predicate) const noexcept
+    {
+      u32 const bucket{ BucketOf(proxy.mCell, proxy.mLevel) };
+      for (u32 i{ position + 1 }; i < mStarts[bucket + 1]; ++i)
+      {
+        if (mBinned[i].mLevel == proxy.mLevel && mBinned[i].mCell == proxy.mCell) predicate(mBinned[i]);
+      }
+      for (s32 z{}; z <= 1; ++z)
+      for (s32 y{ z ? -1 : 0 }; y <= 1; ++y)
+      for (s32 x{ (z || y) ? -1 : 1 }; x <= 1; ++x)
+      {
+        ForEachInCell(proxy.mCell + glm::ivec3{ x, y, z }, proxy.mLevel, predicate);
+      }
+    }
+    // Walks the cells of a level along a ray, every cell within one step of the ray is visited once
+    template<typename P>
+    __forceinline void Walk(r32v3 const& origin, r32v3 const& direction, r32 distance, u32 level, P&& predicate) const noexcept
+    {
+      r32 const size{ mCellSizes[level] };
+      // Every axis crosses at most one boundary per cell size it advances, one more for a partial cell
+      r32v3 const advance{ glm::abs(direction) * (distance / size) };
+      if (!(advance.x + advance.y + advance.z + 4.f <= (r32)MAX_RAY_CELLS))
+      {
+        for (auto const& proxy : mBinned)
+        {
+          if (proxy.mLevel == level) predicate(proxy);
+        }
+        return;
+      }
+      glm::ivec3 cell{ CellOf(origin, level) };
+      glm::ivec3 const step{ glm::sign(direction) };
+      r32v3 const delta{ glm::abs(size / direction) };
+      r32v3 next{};
+      for (u32 axis{}; axis < 3; ++axis)
+      {
+        r32 const boundary{ (r32)(cell[axis] + (step[axis] > 0)) * size };
+        next[axis] = step[axis] ? (boundary - origin[axis]) / direction[axis] : INFINITY;
+      }
+      // The walk is monotonic per axis, so skipping the block around the previous cell avoids every revisit
+      glm::ivec3 prev{ cell };
+      u32 first{ 1 };
+      for (u32 i{}; i < MAX_RAY_CELLS; ++i)
+      {
+        for (s32 z{ -1 }; z <= 1; ++z)
+        for (s32 y{ -1 }; y <= 1; ++y)
+        for (s32 x{ -1 }; x <= 1; ++x)
+        {
+          glm::ivec3 const neighbour{ cell + glm::ivec3{ x, y, z } };
+          if (!first && glm::all(glm::lessThanEqual(glm::abs(neighbour - prev), glm::ivec3{ 1 }))) continue;
+          ForEachInCell(neighbour, level, predicate);
+        }
+        u32 const axis{ next.x < next.y ? (next.x < next.z ? 0u : 2u) : (next.y < next.z ? 1u : 2u) };
+        if (next[axis] > distance) break;
+        prev = cell;
+        first = 0;
+        cell[axis] += step[axis];
+        next[axis] += delta[axis];
+      }
+    }
+
+    // Counting sort of all binned proxies by bucket
+    __forceinline void Rebuild(u32 count) noexcept
+    {
+      auto const chunks{ VkAcs::Gather<acs::Transform const, acs::Bounds const>(VkAcs::Changed<>{}) };
+      std::vector<u32> offsets(chunks.size() + 1);
+      for (u32 i{}; i < (u32)chunks.size(); ++i)
+      {
+        offsets[i + 1] = offsets[i] + chunks[i].mCount;
+      }
+      // Forget proxies of the previous build, live ones get claimed again below
+      for (u32 proxy : mLive)
+      {
+        mProxies[proxy].mHandle = VkAcs::Handle{};
+      }
+      mCount = count;
+      mBucketCount = MIN_BUCKETS;
+      while (mBucketCount < count * 2) mBucketCount *= 2;
+      mLive.resize(count);
+      mStarts.assign(mBucketCount + 1, 0);
+      mpCursors.reset(new std::atomic<u32>[mBucketCount]{});
+      std::array<std::atomic<u32>, MAX_LEVELS + 1> levelCounts{};
+      VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+      {
+        std::array<u32, MAX_LEVELS + 1> counts{};
+        for (u32 i{}; i < chunks[index].mCount; ++i)
+        {
+          VkAcs::Handle const handle{ chunks[index].mppActors[i]->mHandle };
+          Proxy& proxy{ mProxies[handle.Index()] };
+          proxy.mHandle = handle;
+          mLive[offsets[index] + i] = handle.Index();
+          counts[proxy.mLevel]++;
+          if (proxy.mLevel != LARGE)
+          {
+            mpCursors[BucketOf(proxy.mCell, proxy.mLevel)].fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        for (u32 level{}; level <= MAX_LEVELS; ++level)
+        {
+          if (counts[level]) levelCounts[level].fetch_add(counts[level], std::memory_order_relaxed);
+        }
+      });
+      // Pick the side of every level pair that visits fewer cells
+      mLevels = 0;
+      for (u32 fine{}; fine < MAX_LEVELS; ++fine)
+      {
+        if (levelCounts[fine].load()) mLevels |= 1u << fine;
+        for (u32 coarse{ fine + 1 }; coarse < MAX_LEVELS; ++coarse)
+        {
+          r64 const span{ (r64)(1u << (coarse - fine)) + 3.0 };
+          mCoarseDriven[fine][coarse] = (r64)levelCounts[coarse].load() * span * span * span < (r64)levelCounts[fine].load() * 27.0;
+        }
+      }
+      for (u32 i{}; i < mBucketCount; ++i)
+      {
+        mStarts[i + 1] = mStarts[i] + mpCursors[i].load(std::memory_order_relaxed);
+        mpCursors[i].store(mStarts[i], std::memory_order_relaxed);
+      }
+      mBinned.resize(mStarts[mBucketCount]);
+      mLarge.clear();
+      for (u32 proxy : mLive)
+      {
+        if (mProxies[proxy].mLevel != LARGE) continue;
+        mSlots[proxy] = (u32)mLarge.size();
+        mLarge.emplace_back(mProxies[proxy]);
+      }
+      u32 const ranges{ std::max(VkJobs::Get().Concurrency() * JOBS_PER_CORE, 1u) };
+      u32 const share{ (count + ranges - 1) / ranges };
+      VkJobs::Get().ForEach(ranges, [&](u32 index)
+      {
+        for (u32 i{ index * share }; i < std::min((index + 1) * share, count); ++i)
+        {
+          Proxy const& proxy{ mProxies[mLive[i]] };
+          if (proxy.mLevel == LARGE) continue;
+          u32 const slot{ mpCursors[BucketOf(proxy.mCell, proxy.mLevel)].fetch_add(1, std::memory_order_relaxed) };
+          mSlots[mLive[i]] = slot;
+          mBinned[slot] = proxy;
+        }
+      });
+    }
+
+    std::array<r32, MAX_LEVELS>                        mCellSizes   {};
+    std::array<std::array<u8, MAX_LEVELS>, MAX_LEVELS> mCoarseDriven{};
+    u64                                                mVersion     {};
+    u32                                                mCount       {};
+    u32                                                mLevels      {};
+    u32                                                mBucketCount { 1 };
+    std::vector<Proxy>                                 mProxies     {};
+    std::vector<u32>                                   mSlots       {};
+    std::vector<u32>                                   mLive        {};
+    std::vector<u32>                                   mStarts      { 0, 0 };
+    std::vector<Proxy>                                 mBinned      {};
+    std::vector<Proxy>                                 mLarge       {};
+    std::unique_ptr<std::atomic<u32>[]>                mpCursors    {};
+    std::vector<Pair>                                  mPairs       {};
+  };
+}
+
+#endif
\ No newline at end of file
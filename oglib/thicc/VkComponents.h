@@ -32,6 +32,8 @@ namespace acs
   {
     void* mpMeshLayout;
     void* mpShaderLayout;
+    // Level of detail drawn last, only the instancer moves it
+    u32   mLevel{};
 
     Renderable(void* meshLayout, void* shaderLayout) : mpMeshLayout{ meshLayout }, mpShaderLayout{ shaderLayout } {}
   };
@@ -39,9 +41,34 @@ namespace acs
   {
     r32v3 mVelocity;
     r32   mGravity;
+    r32v3 mPositionPrev;
 
-    Rigidbody(r32v3 const& velocity, r32 gravity) : mVelocity{ velocity }, mGravity{ gravity } {}
+    // Quiet NaN bits, the first step replaces them with the position of the Transform
+    static constexpr s32 UNSTEPPED{ 0x7FC00000 };
+
+    Rigidbody(r32v3 const& velocity, r32 gravity)
+      : mVelocity{ velocity }
+      , mGravity{ gravity }
+      , mPositionPrev{ std::bit_cast<r32>(UNSTEPPED) } {}
   };
+  struct Bounds
+  {
+    r32 mRadius;
+
+    Bounds(r32 radius) : mRadius{ radius } {}
+  };
+  struct Model
+  {
+    r32m4 mMatrix;
+
+    Model(r32m4 const& matrix = r32m4{ 1.0f }) : mMatrix{ matrix } {}
+  };
+
+  /*
+  * Components with compile-time identifiers.
+  */
+
+  using Defaults = std::tuple<Transform, Camera, Renderable, Rigidbody, Model, Bounds>;
 }
 
 #endif
\ No newline at end of file
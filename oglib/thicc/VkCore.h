@@ -2,6 +2,7 @@
 #define VK_CORE
 
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <string_view>
 #include <fstream>
@@ -9,24 +10,53 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <unordered_map>
 #include <set>
+#include <bitset>
 #include <iterator>
 #include <cmath>
 #include <optional>
 #include <type_traits>
 #include <functional>
+#include <algorithm>
+#include <tuple>
+#include <utility>
+#include <new>
+#include <typeinfo>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <bit>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <filesystem>
+
+// MSVC spells forced inlining as a keyword, GCC and Clang as an attribute
+#ifndef _MSC_VER
+#define __forceinline inline __attribute__((always_inline))
+#endif
 
 #include "VkTypes.h"
 #include "VkRegistry.h"
 
 //#define VULKAN_HPP_NO_EXCEPTIONS
 //#define VULKAN_HPP_TYPESAFE_CONVERSION
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 //#include <vulkan/vulkan.hpp>
 
+// Headless builds render offscreen only and do not depend on GLFW
+#ifdef VK_HEADLESS
+#include <vulkan/vulkan.h>
+struct GLFWwindow;
+#else
 #define GLFW_INCLUDE_VULKAN
 #include <glfw3.h>
 #undef GLFW_INCLUDE_VULKAN
+#endif
 
 #define _STR(VALUE) #VALUE
 #define STR(VALUE) _STR(VALUE)
@@ -41,6 +71,14 @@ if (VkResult result{ EXPRESSION }; result != VK_SUCCESS)   \
   std::exit(1);                                            \
 }
 
+// Invariants which must hold in every build, a violation ends the process
+#define VK_ASSERT(EXPRESSION)                                      \
+if (!(EXPRESSION))                                                 \
+{                                                                  \
+  std::printf("%s:%d: " STR(EXPRESSION) "\n", __FILE__, __LINE__); \
+  std::exit(1);                                                    \
+}
+
 #define VK_LOG(FORMAT, ...)       \
 std::printf(FORMAT, __VA_ARGS__);
 
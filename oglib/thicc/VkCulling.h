@@ -0,0 +1,259 @@
+#ifndef VK_CULLING
+#define VK_CULLING
+
+/*
+* Batched frustum culling.
+*
+* Culling structure:
+* ---Chunks------------------------Scratch------------------Visible--------
+*    |                             |                        |
+*    [P, S, Radius] x W --> Test --> [H, H, ., ., H, .] --> Compact --> [H, H, H, ...]
+*
+* Renderable actors carrying bounds are tested as spheres against the six
+* planes of the camera frustum, W at a time. The sphere sits at the actor
+* position and its radius is scaled by the largest scale axis, the same sphere
+* the broadphase uses. Every chunk writes its survivors into a private range of
+* the scratch list in parallel, the ranges are compacted afterwards so the
+* renderer receives one dense list of handles in chunk order.
+*
+* Meshlets of a mesh are tested in mesh space, the planes and the eye are moved
+* there instead of every sphere being moved out. Affine maps keep half spaces
+* and the side of a plane a point lies on, so the test stays exact under non
+* uniform scale. A meshlet whose sphere lies entirely within its cone of back
+* faces as seen from the eye gets culled as well.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkSimd.h"
+#include "VkTransform.h"
+#include "VkMesh.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace VkCulling
+{
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 BOUNDS_STRIDE { sizeof(acs::Bounds) / sizeof(r32) };
+  constexpr u32 MESHLET_STRIDE{ sizeof(VkMeshlet) / sizeof(r32) };
+
+  static_assert(sizeof(acs::Bounds) == sizeof(r32), "Bounds has to consist of a single packed float");
+
+  /*
+  * View.
+  */
+
+  struct View
+  {
+    r32m4 mProjection{};
+    r32m4 mView      {};
+
+    // Camera fov is vertical and in degrees, scale of the camera transform is ignored
+    static __forceinline View From(acs::Transform const& transform, acs::Camera const& camera, r32 aspect) noexcept
+    {
+      View view{};
+      view.mProjection = glm::perspective(glm::radians(camera.mFov), aspect, camera.mNear, camera.mFar);
+      view.mView = glm::inverse(glm::translate(r32m4{ 1.0f }, transform.mPosition) * glm::mat4_cast(glm::quat{ transform.mRotationEuler }));
+      return view;
+    }
+  };
+
+  /*
+  * Frustum.
+  */
+
+  struct Frustum
+  {
+    // Normals point inwards, a point is inside if dot(normal, point) + w >= 0 for every plane
+    std::array<r32v4, 6> mPlanes{};
+
+    // Extracts the planes from the rows of a view projection matrix
+    static __forceinline Frustum From(r32m4 const& viewProjection) noexcept
+    {
+      r32m4 const rows{ glm::transpose(viewProjection) };
+      Frustum frustum{};
+      frustum.mPlanes[0] = rows[3] + rows[0];
+      frustum.mPlanes[1] = rows[3] - rows[0];
+      frustum.mPlanes[2] = rows[3] + rows[1];
+      frustum.mPlanes[3] = rows[3] - rows[1];
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+      frustum.mPlanes[4] = rows[2];
+#else
+      frustum.mPlanes[4] = rows[3] + rows[2];
+#endif
+      frustum.mPlanes[5] = rows[3] - rows[2];
+      for (auto& plane : frustum.mPlanes)
+      {
+        plane /= glm::length(r32v3{ plane });
+      }
+      return frustum;
+    }
+    static __forceinline Frustum From(View const& view) noexcept
+    {
+      return From(view.mProjection * view.mView);
+    }
+    static __forceinline Frustum From(acs::Transform const& transform, acs::Camera const& camera, r32 aspect) noexcept
+    {
+      return From(View::From(transform, camera, aspect));
+    }
+  };
+
+  /*
+  * Kernels.
+  */
+
+  // Returns one bit per lane for spheres touching the frustum
+  template<typename V>
+  __forceinline u32 TestSpheres(acs::Transform const* pTransforms, acs::Bounds const* pBounds, Frustum const& frustum) noexcept
+  {
+    r32 const* pData{ &pTransforms->mPosition.x };
+    V const sign{ V::Set(-0.0f) };
+    V const zero{ V::Set(0.0f) };
+    V const x{ V::Load(pData, VkTransform::TRANSFORM_STRIDE) };
+    V const y{ V::Load(pData + 1, VkTransform::TRANSFORM_STRIDE) };
+    V const z{ V::Load(pData + 2, VkTransform::TRANSFORM_STRIDE) };
+    V const scaleX{ V::AndNot(sign, V::Load(pData + 6, VkTransform::TRANSFORM_STRIDE)) };
+    V const scaleY{ V::AndNot(sign, V::Load(pData + 7, VkTransform::TRANSFORM_STRIDE)) };
+    V const scaleZ{ V::AndNot(sign, V::Load(pData + 8, VkTransform::TRANSFORM_STRIDE)) };
+    V const radius{ V::Load(&pBounds->mRadius, BOUNDS_STRIDE) * V::Max(scaleX, V::Max(scaleY, scaleZ)) };
+    V outside{ zero };
+    for (auto const& plane : frustum.mPlanes)
+    {
+      V const distance{ x * V::Set(plane.x) + y * V::Set(plane.y) + z * V::Set(plane.z) + V::Set(plane.w) };
+      outside = outside | V::Less(distance + radius, zero);
+    }
+    return V::Mask(outside) ^ ((1u << V::WIDTH) - 1);
+  }
+
+  // Returns one bit per lane for meshlets touching the frustum with at least one triangle facing the eye, both given in mesh space
+  template<typename V>
+  __forceinline u32 TestMeshlets(VkMeshlet const* pMeshlets, Frustum const& frustum, r32v3 const& eye) noexcept
+  {
+    r32 const* pData{ pMeshlets->mCenter };
+    V const zero{ V::Set(0.0f) };
+    V const x{ V::Load(pData, MESHLET_STRIDE) };
+    V const y{ V::Load(pData + 1, MESHLET_STRIDE) };
+    V const z{ V::Load(pData + 2, MESHLET_STRIDE) };
+    V const radius{ V::Load(pData + 3, MESHLET_STRIDE) };
+    V outside{ zero };
+    for (auto const& plane : frustum.mPlanes)
+    {
+      V const distance{ x * V::Set(plane.x) + y * V::Set(plane.y) + z * V::Set(plane.z) + V::Set(plane.w) };
+      outside = outside | V::Less(distance + radius, zero);
+    }
+    // Back facing if dot(d, axis) - radius >= cutoff * |d|, squared to stay clear of the root
+    V const dx{ x - V::Set(eye.x) };
+    V const dy{ y - V::Set(eye.y) };
+    V const dz{ z - V::Set(eye.z) };
+    V const cutoff{ V::Load(pData + 7, MESHLET_STRIDE) };
+    V const facing{ dx * V::Load(pData + 4, MESHLET_STRIDE) + dy * V::Load(pData + 5, MESHLET_STRIDE) + dz * V::Load(pData + 6, MESHLET_STRIDE) - radius };
+    V const back{ V::Less(zero, facing) & V::Less(cutoff * cutoff * (dx * dx + dy * dy + dz * dz), facing * facing) };
+    return V::Mask(outside | back) ^ ((1u << V::WIDTH) - 1);
+  }
+
+  /*
+  * Batch specific routines.
+  */
+
+  // Writes the rows of visible spheres and returns their count
+  __forceinline u32 Cull(acs::Transform const* pTransforms, acs::Bounds const* pBounds, u32 count, Frustum const& frustum, u32* pRows) noexcept
+  {
+    u32 visible{};
+    VkSimd::Batch(count, [&]<typename V>(u32 i)
+    {
+      for (u32 mask{ TestSpheres<V>(pTransforms + i, pBounds + i, frustum) }; mask; mask &= mask - 1)
+      {
+        pRows[visible++] = i + (u32)std::countr_zero(mask);
+      }
+    });
+    return visible;
+  }
+
+  // Writes the indices of meshlets which may be visible through an instance of their mesh and returns their count
+  __forceinline u32 CullMeshlets(VkMeshlet const* pMeshlets, u32 count, r32m4 const& model, Frustum const& frustum, r32v3 const& eye, u32* pVisible) noexcept
+  {
+    Frustum local{};
+    r32m4 const transposed{ glm::transpose(model) };
+    for (u32 i{}; i < 6; ++i)
+    {
+      local.mPlanes[i] = transposed * frustum.mPlanes[i];
+      local.mPlanes[i] /= glm::length(r32v3{ local.mPlanes[i] });
+    }
+    r32v3 const localEye{ glm::inverse(model) * r32v4{ eye, 1.0f } };
+    u32 visible{};
+    VkSimd::Batch(count, [&]<typename V>(u32 i)
+    {
+      for (u32 mask{ TestMeshlets<V>(pMeshlets + i, local, localEye) }; mask; mask &= mask - 1)
+      {
+        pVisible[visible++] = i + (u32)std::countr_zero(mask);
+      }
+    });
+    return visible;
+  }
+
+  /*
+  * Actor specific routines.
+  */
+
+  // View of the first camera actor, none if the scene has no camera
+  __forceinline std::optional<View> FindView(r32 aspect) noexcept
+  {
+    for (auto const& chunk : VkAcs::Gather<acs::Transform const, acs::Camera const>(VkAcs::Changed<>{}))
+    {
+      auto const [pTransforms, pCameras] { chunk.mColumns };
+      return View::From(*pTransforms, *pCameras, aspect);
+    }
+    return std::nullopt;
+  }
+  __forceinline std::optional<Frustum> FindFrustum(r32 aspect) noexcept
+  {
+    if (std::optional<View> const view{ FindView(aspect) })
+    {
+      return Frustum::From(*view);
+    }
+    return std::nullopt;
+  }
+
+  class Culler
+  {
+  public:
+    // Collects the handles of all renderables with bounds touching the frustum
+    __forceinline std::vector<VkAcs::Handle> const& Cull(Frustum const& frustum) noexcept
+    {
+      auto const chunks{ VkAcs::Gather<acs::Transform const, acs::Bounds const, acs::Renderable const>(VkAcs::Changed<>{}) };
+      mCounts.resize(chunks.size());
+      mScratch.resize(chunks.size() * VkAcs::CHUNK_ROWS);
+      VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+      {
+        auto const& chunk{ chunks[index] };
+        auto const [pTransforms, pBounds, pRenderables] { chunk.mColumns };
+        std::array<u32, VkAcs::CHUNK_ROWS> rows;
+        u32 const count{ VkCulling::Cull(pTransforms, pBounds, chunk.mCount, frustum, rows.data()) };
+        for (u32 i{}; i < count; ++i)
+        {
+          mScratch[index * VkAcs::CHUNK_ROWS + i] = chunk.mppActors[rows[i]]->mHandle;
+        }
+        mCounts[index] = count;
+      });
+      mVisible.clear();
+      for (u32 i{}; i < (u32)chunks.size(); ++i)
+      {
+        mVisible.insert(mVisible.end(), mScratch.begin() + i * VkAcs::CHUNK_ROWS, mScratch.begin() + i * VkAcs::CHUNK_ROWS + mCounts[i]);
+      }
+      return mVisible;
+    }
+    __forceinline std::vector<VkAcs::Handle> const& Visible() const noexcept { return mVisible; }
+
+  private:
+    std::vector<u32>           mCounts {};
+    std::vector<VkAcs::Handle> mScratch{};
+    std::vector<VkAcs::Handle> mVisible{};
+  };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef VK_HEADLESS_RUNNER
+#define VK_HEADLESS_RUNNER
+
+/*
+* Windowless frame loop.
+*
+* Runs a sandbox for a fixed number of frames against an offscreen renderer.
+* Simulation time advances by exactly one step per frame so two runs of the
+* same sandbox produce the same images, independent of how fast the device is.
+* Host timings cover every frame, device timings only frames whose slot got
+* reused, the last frames in flight are never resolved. The final frame can be
+* read back for comparisons against reference images.
+*/
+
+#include "VkCore.h"
+#include "VkRenderer.h"
+#include "VkAcs.h"
+#include "VkTransform.h"
+#include "VkPhysics.h"
+#include "VkCulling.h"
+#include "VkSandbox.h"
+
+template<Sandboxable S>
+class VkHeadless
+{
+public:
+  struct Report
+  {
+    u32 mFrames   {};
+    u32 mGpuFrames{};
+    r64 mTotal    {};
+    r64 mWait     {};
+    r64 mRecord   {};
+    r64 mRecordMax{};
+    r64 mGpu      {};
+    r64 mGpuMax   {};
+  };
+
+public:
+  VkHeadless(u32 width, u32 height, u32 frameCount, u32 fps = 60, u32 debug = 0, u32 frames = VK_FRAMES_IN_FLIGHT, u32 readback = 0)
+  {
+    // Engine core
+    u64 version{};
+    VkPhysics::Clock clock{ 1.f / fps };
+    mpVkRenderer = new VkRenderer{ width, height, nullptr, debug, frames };
+    mpSandbox = new S;
+    mpSandbox->OnCreate(*mpVkRenderer);
+    auto const start{ std::chrono::high_resolution_clock::now() };
+    for (u32 frame{}; frame < frameCount; ++frame)
+    {
+      r32 const time{ (r32)frame / fps };
+      mpSandbox->OnUpdate(time);
+      VkAcs::Flush();
+      clock.Advance(1.f / fps);
+      while (clock.Consume())
+      {
+        mpSandbox->OnPhysic(clock.Time());
+        VkPhysics::Step(clock.Step());
+        VkAcs::Flush();
+      }
+      u64 const versionNext{ VkAcs::Version() };
+      VkTransform::Update(version);
+      VkPhysics::Interpolate(clock.Alpha());
+      version = versionNext;
+      std::optional<VkCulling::View> const view{ VkCulling::FindView(mpVkRenderer->Aspect()) };
+      mpVkRenderer->SetReadback(readback && frame + 1 == frameCount);
+      mpVkRenderer->Render(view ? &*view : nullptr);
+      // Gather timings
+      VkRenderer::Timings const& timings{ mpVkRenderer->Timing() };
+      mReport.mWait += timings.mWait;
+      mReport.mRecord += timings.mRecord;
+      mReport.mRecordMax = std::max(mReport.mRecordMax, timings.mRecord);
+      if (frame >= mpVkRenderer->Frames())
+      {
+        mReport.mGpu += timings.mGpu;
+        mReport.mGpuMax = std::max(mReport.mGpuMax, timings.mGpu);
+        mReport.mGpuFrames++;
+      }
+    }
+    mPixels = mpVkRenderer->Readback();
+    auto const end{ std::chrono::high_resolution_clock::now() };
+    mReport.mFrames = frameCount;
+    mReport.mTotal = std::chrono::duration<r64, std::milli>(end - start).count();
+    VK_LOG("Frames %u in %.2fms, %.1f fps\n", mReport.mFrames, mReport.mTotal, mReport.mFrames * 1e3 / std::max(mReport.mTotal, 1e-3));
+    VK_LOG("Wait avg %.3fms\n", mReport.mWait / std::max(mReport.mFrames, 1u));
+    VK_LOG("Record avg %.3fms max %.3fms\n", mReport.mRecord / std::max(mReport.mFrames, 1u), mReport.mRecordMax);
+    VK_LOG("Gpu avg %.3fms max %.3fms\n", mReport.mGpu / std::max(mReport.mGpuFrames, 1u), mReport.mGpuMax);
+  }
+  virtual ~VkHeadless()
+  {
+    delete mpSandbox;
+    delete mpVkRenderer;
+  }
+
+public:
+  __forceinline Report const&          Result() const noexcept { return mReport; }
+  // Tightly packed rgba8 pixels of the final frame, empty unless read back
+  __forceinline std::vector<u8> const& Pixels() const noexcept { return mPixels; }
+
+private:
+  Sandbox*        mpSandbox   {};
+  VkRenderer*     mpVkRenderer{};
+  Report          mReport     {};
+  std::vector<u8> mPixels     {};
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "VkInstancer.h"
+
+VkInstancer::VkInstancer(VkAllocator* pVkAllocator, VkPhysicalDeviceFeatures const& vkPhysicalDeviceFeatures, u32 frames, u32 capacity)
+  : mpVkAllocator{ pVkAllocator }
+  , mCapacity{ capacity }
+  , mMultiDraw{ vkPhysicalDeviceFeatures.multiDrawIndirect && vkPhysicalDeviceFeatures.drawIndirectFirstInstance }
+  , mFirstInstance{ vkPhysicalDeviceFeatures.drawIndirectFirstInstance }
+  , mVkInstanceBuffers{ frames }
+  , mVkIndirectBuffers{ frames }
+  , mInstanceAllocations{ frames }
+  , mIndirectAllocations{ frames }
+{
+  // Instance buffer create info, stays mapped and gets rewritten every build
+  VkBufferCreateInfo vkInstanceBufferCreateInfo{};
+  vkInstanceBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vkInstanceBufferCreateInfo.size = sizeof(r32m4) * (u64)mCapacity;
+  vkInstanceBufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  // Indirect buffer create info
+  VkBufferCreateInfo vkIndirectBufferCreateInfo{};
+  vkIndirectBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vkIndirectBufferCreateInfo.size = sizeof(VkDrawIndexedIndirectCommand) * (u64)VK_INSTANCER_COMMANDS;
+  vkIndirectBufferCreateInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+  for (u32 i{}; i < frames; ++i)
+  {
+    mpVkAllocator->CreateBuffer(vkInstanceBufferCreateInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mVkInstanceBuffers[i], mInstanceAllocations[i]);
+    mpVkAllocator->CreateBuffer(vkIndirectBufferCreateInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mVkIndirectBuffers[i], mIndirectAllocations[i]);
+  }
+}
+VkInstancer::~VkInstancer()
+{
+  for (u32 i{}; i < (u32)mVkInstanceBuffers.size(); ++i)
+  {
+    mpVkAllocator->DestroyBuffer(mVkIndirectBuffers[i], mIndirectAllocations[i]);
+    mpVkAllocator->DestroyBuffer(mVkInstanceBuffers[i], mInstanceAllocations[i]);
+  }
+}
+
+std::vector<VkInstancer::Batch> const& VkInstancer::Build(VkCulling::View const& view, u32 frame, VkMeshBuffer const& meshBuffer)
+{
+  mFrame = frame;
+  VkCulling::Frustum const frustum{ VkCulling::Frustum::From(view) };
+  VkLod::Projection const projection{ VkLod::Projection::From(view) };
+  r32v3 const eye{ projection.mEye };
+  auto const chunks{ VkAcs::Gather<acs::Transform const, acs::Bounds const, acs::Renderable, acs::Model const>(VkAcs::Changed<>{}) };
+  // Cull every chunk into its own range of rows, the survivors step their levels right away
+  mCounts.resize(chunks.size());
+  mRows.resize(chunks.size() * VkAcs::CHUNK_ROWS);
+  VkJobs::Get().ForEach((u32)chunks.size(), [&](u32 index)
+  {
+    auto const& chunk{ chunks[index] };
+    auto const [pTransforms, pBounds, pRenderables, pModels] { chunk.mColumns };
+    mCounts[index] = VkCulling::Cull(pTransforms, pBounds, chunk.mCount, frustum, mRows.data() + index * VkAcs::CHUNK_ROWS);
+    VkLod::Select(pTransforms, pBounds, pRenderables, mRows.data() + index * VkAcs::CHUNK_ROWS, mCounts[index], projection);
+  });
+  // Count survivors per shader, mesh and level, neighbouring rows mostly share their group
+  mGroups.clear();
+  mGroupIds.clear();
+  mGroupOf.clear();
+  for (u32 index{}; index < (u32)chunks.size(); ++index)
+  {
+    auto const [pTransforms, pBounds, pRenderables, pModels] { chunks[index].mColumns };
+    std::tuple<void*, void*, u32> keyPrev{};
+    u32 groupPrev{ ~0u };
+    for (u32 i{}; i < mCounts[index]; ++i)
+    {
+      acs::Renderable const& renderable{ pRenderables[mRows[index * VkAcs::CHUNK_ROWS + i]] };
+      std::tuple<void*, void*, u32> const key{ renderable.mpShaderLayout, renderable.mpMeshLayout, renderable.mLevel };
+      if (groupPrev == ~0u || key != keyPrev)
+      {
+        auto const [it, inserted] { mGroupIds.emplace(key, (u32)mGroups.size()) };
+        if (inserted)
+        {
+          mGroups.emplace_back(Group{ renderable.mpShaderLayout, renderable.mpMeshLayout, renderable.mLevel });
+        }
+        keyPrev = key;
+        groupPrev = it->second;
+      }
+      mGroups[groupPrev].mCount++;
+      mGroupOf.emplace_back(groupPrev);
+    }
+  }
+  // Shader major order keeps the commands of one pipeline contiguous
+  mOrder.resize(mGroups.size());
+  for (u32 i{}; i < (u32)mGroups.size(); ++i)
+  {
+    mOrder[i] = i;
+  }
+  std::sort(mOrder.begin(), mOrder.end(), [&](u32 a, u32 b)
+  {
+    return std::make_tuple(mGroups[a].mpShaderLayout, mGroups[a].mpMeshLayout, mGroups[a].mLevel) < std::make_tuple(mGroups[b].mpShaderLayout, mGroups[b].mpMeshLayout, mGroups[b].mLevel);
+  });
+  // Meshes still in flight on the transfer queue take no instances until their upload completed
+  u32 first{};
+  for (u32 const index : mOrder)
+  {
+    Group& group{ mGroups[index] };
+    VkMesh const* pMesh{ (VkMesh const*)group.mpMeshLayout };
+    group.mFirst = first;
+    group.mCount = (pMesh && meshBuffer.Ready(*pMesh)) ? std::min(group.mCount, mCapacity - first) : 0;
+    first += group.mCount;
+  }
+  mInstances = first;
+  // Scatter matrices into their group ranges, clustered groups read them back so the mapping only sees one sequential copy
+  mMatrices.resize(mInstances);
+  std::vector<u32> cursors(mGroups.size());
+  u32 visible{};
+  for (u32 index{}; index < (u32)chunks.size(); ++index)
+  {
+    auto const [pTransforms, pBounds, pRenderables, pModels] { chunks[index].mColumns };
+    for (u32 i{}; i < mCounts[index]; ++i, ++visible)
+    {
+      Group const& group{ mGroups[mGroupOf[visible]] };
+      u32& cursor{ cursors[mGroupOf[visible]] };
+      if (cursor < group.mCount)
+      {
+        mMatrices[group.mFirst + cursor++] = pModels[mRows[index * VkAcs::CHUNK_ROWS + i]].mMatrix;
+      }
+    }
+  }
+  std::memcpy(mInstanceAllocations[mFrame].mpMapped, mMatrices.data(), sizeof(r32m4) * mMatrices.size());
+  // One command per group or per run of visible meshlets, one batch per shader, meshlets only cover the full level
+  mCommands.clear();
+  mBatches.clear();
+  auto const emit{ [&](void* pShaderLayout, VkDrawIndexedIndirectCommand const& command)
+  {
+    if (mBatches.empty() || mBatches.back().mpShaderLayout != pShaderLayout)
+    {
+      mBatches.emplace_back(Batch{ pShaderLayout, (u32)mCommands.size() });
+    }
+    mCommands.emplace_back(command);
+    mBatches.back().mCommandCount++;
+  } };
+  for (u32 const index : mOrder)
+  {
+    Group const& group{ mGroups[index] };
+    VkMesh const* pMesh{ (VkMesh const*)group.mpMeshLayout };
+    if (!group.mCount || mCommands.size() == VK_INSTANCER_COMMANDS)
+    {
+      continue;
+    }
+    VkMeshLod const lod{ pMesh->Level(group.mLevel) };
+    if (!pMesh->mMeshletCount || group.mLevel || group.mCount > VK_INSTANCER_CLUSTERED)
+    {
+      emit(group.mpShaderLayout, VkDrawIndexedIndirectCommand{ lod.mIndexCount, group.mCount, pMesh->mIndexOffset + lod.mFirstIndex, (s32)pMesh->mVertexOffset, group.mFirst });
+      continue;
+    }
+    mVisibleMeshlets.resize(pMesh->mMeshletCount);
+    auto const adjacent{ [&](u32 i)
+    {
+      VkMeshlet const& previous{ pMesh->mpMeshlets[mVisibleMeshlets[i - 1]] };
+      return pMesh->mpMeshlets[mVisibleMeshlets[i]].mFirstIndex == previous.mFirstIndex + previous.mIndexCount;
+    } };
+    for (u32 instance{ group.mFirst }; instance < group.mFirst + group.mCount; ++instance)
+    {
+      u32 const visible{ VkCulling::CullMeshlets(pMesh->mpMeshlets, pMesh->mMeshletCount, mMatrices[instance], frustum, eye, mVisibleMeshlets.data()) };
+      // Neighbouring meshlets share one command, an instance which does not fit falls back to its whole range
+      u32 runs{};
+      for (u32 i{}; i < visible; ++i)
+      {
+        runs += !i || !adjacent(i);
+      }
+      if (mCommands.size() + runs > VK_INSTANCER_COMMANDS)
+      {
+        if (mCommands.size() < VK_INSTANCER_COMMANDS)
+        {
+          emit(group.mpShaderLayout, VkDrawIndexedIndirectCommand{ lod.mIndexCount, 1, pMesh->mIndexOffset + lod.mFirstIndex, (s32)pMesh->mVertexOffset, instance });
+        }
+        continue;
+      }
+      for (u32 i{}; i < visible; ++i)
+      {
+        VkMeshlet const& meshlet{ pMesh->mpMeshlets[mVisibleMeshlets[i]] };
+        if (i && adjacent(i))
+        {
+          mCommands.back().indexCount += meshlet.mIndexCount;
+          continue;
+        }
+        emit(group.mpShaderLayout, VkDrawIndexedIndirectCommand{ meshlet.mIndexCount, 1, pMesh->mIndexOffset + meshlet.mFirstIndex, (s32)pMesh->mVertexOffset, instance });
+      }
+    }
+  }
+  std::memcpy(mIndirectAllocations[mFrame].mpMapped, mCommands.data(), sizeof(VkDrawIndexedIndirectCommand) * mCommands.size());
+  return mBatches;
+}
+void VkInstancer::Draw(VkCommandBuffer vkCommandBuffer, Batch const& batch) const
+{
+  u64 const offset{ sizeof(VkDrawIndexedIndirectCommand) * batch.mFirstCommand };
+  if (mMultiDraw)
+  {
+    vkCmdDrawIndexedIndirect(vkCommandBuffer, mVkIndirectBuffers[mFrame], offset, batch.mCommandCount, sizeof(VkDrawIndexedIndirectCommand));
+    return;
+  }
+  for (u32 i{}; i < batch.mCommandCount; ++i)
+  {
+    if (mFirstInstance)
+    {
+      vkCmdDrawIndexedIndirect(vkCommandBuffer, mVkIndirectBuffers[mFrame], offset + sizeof(VkDrawIndexedIndirectCommand) * i, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+    {
+      VkDrawIndexedIndirectCommand const& command{ mCommands[batch.mFirstCommand + i] };
+      vkCmdDrawIndexed(vkCommandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+    }
+  }
+}
\ No newline at end of file
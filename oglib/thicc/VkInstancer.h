@@ -0,0 +1,136 @@
+#ifndef VK_INSTANCER
+#define VK_INSTANCER
+
+/*
+* Instanced indirect drawing.
+*
+* Instancing structure:
+* ---Chunks--------------------Groups----------------------------Instances-----------Commands------
+*    |                         |                                 |                   |
+*    [Cull, Level] x W --> [S0 M0 L0, S0 M0 L2, S1 M0 L0] --> [M M M | M | M M] --> [C0, C1 | C2]
+*                                                                                    ^Batch per shader
+*
+* Renderables with bounds and a model matrix get culled chunk by chunk in
+* parallel and the survivors pick their level of detail as described in
+* VkLod.h. They are grouped by shader, mesh and level, groups are ordered by
+* shader first so every shader owns one contiguous run of indirect commands.
+* Model matrices of a group are packed next to each other in a storage buffer,
+* the first instance of its command points at the first matrix so the vertex
+* shader fetches its matrix through gl_InstanceIndex.
+*
+* Meshes carrying meshlets are drawn cluster by cluster while their group holds
+* no more than VK_INSTANCER_CLUSTERED instances at the full level. Every instance of such a group
+* culls the meshlets of its mesh against the frustum and its back face cones
+* and issues one command per run of neighbouring survivors, larger groups draw
+* the index range of their level once for all of their instances.
+*
+* Every frame in flight owns its own instance and indirect buffer, a build only
+* writes the buffers of the frame it is given. The mesh layout of a renderable
+* is the VkMesh it draws, the shader layout is the VkProgram it is drawn with.
+* Groups whose mesh is still in flight on the transfer queue are skipped until
+* the mesh buffer reports it ready, draws never read half uploaded meshes.
+* Instances and commands beyond the capacity are dropped. Devices lacking multi
+* draw indirect issue one indirect draw per command, devices lacking first
+* instance support fall back to direct draws.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkCulling.h"
+#include "VkLod.h"
+#include "VkAllocator.h"
+#include "VkMesh.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u32 VK_INSTANCER_CAPACITY { 1u << 17 };
+constexpr u32 VK_INSTANCER_COMMANDS { 1u << 12 };
+constexpr u32 VK_INSTANCER_CLUSTERED{ 4 };
+
+/*
+* Instancer.
+*/
+
+class VkInstancer
+{
+public:
+  struct Batch
+  {
+    void* mpShaderLayout{};
+    u32   mFirstCommand {};
+    u32   mCommandCount {};
+  };
+
+public:
+  VkInstancer(VkAllocator* pVkAllocator, VkPhysicalDeviceFeatures const& vkPhysicalDeviceFeatures, u32 frames, u32 capacity = VK_INSTANCER_CAPACITY);
+  virtual ~VkInstancer();
+
+public:
+  // Culls renderables, selects their levels, groups the survivors of ready meshes and writes their matrices and commands into the buffers of a frame
+  std::vector<Batch> const& Build(VkCulling::View const& view, u32 frame, VkMeshBuffer const& meshBuffer);
+  // Issues the commands of one batch of the last build, the pipeline of its shader has to be bound already
+  void                      Draw(VkCommandBuffer vkCommandBuffer, Batch const& batch) const;
+  // Invokes task(batch) for the parts of every batch which overlap the given range of commands
+  template<typename T>
+  void                      Slice(u32 first, u32 count, T&& task) const;
+
+  __forceinline VkBuffer                  InstanceBuffer(u32 frame) const noexcept { return mVkInstanceBuffers[frame]; }
+  __forceinline VkBuffer                  IndirectBuffer(u32 frame) const noexcept { return mVkIndirectBuffers[frame]; }
+  __forceinline std::vector<Batch> const& Batches()        const noexcept { return mBatches; }
+  __forceinline u32                       Instances()      const noexcept { return mInstances; }
+  __forceinline u32                       Commands()       const noexcept { return (u32)mCommands.size(); }
+
+private:
+  struct Group
+  {
+    void* mpShaderLayout{};
+    void* mpMeshLayout  {};
+    u32   mLevel        {};
+    u32   mCount        {};
+    u32   mFirst        {};
+  };
+
+  VkAllocator*                                 mpVkAllocator        {};
+  u32                                          mCapacity            {};
+  u32                                          mMultiDraw           {};
+  u32                                          mFirstInstance       {};
+  std::vector<VkBuffer>                        mVkInstanceBuffers   {};
+  std::vector<VkBuffer>                        mVkIndirectBuffers   {};
+  std::vector<VkAllocation>                    mInstanceAllocations {};
+  std::vector<VkAllocation>                    mIndirectAllocations {};
+  u32                                          mFrame               {};
+  u32                                          mInstances           {};
+  std::vector<u32>                             mCounts              {};
+  std::vector<u32>                             mRows                {};
+  std::vector<u32>                             mGroupOf             {};
+  std::vector<Group>                           mGroups              {};
+  std::vector<u32>                             mOrder               {};
+  std::map<std::tuple<void*, void*, u32>, u32> mGroupIds            {};
+  std::vector<r32m4>                           mMatrices            {};
+  std::vector<u32>                             mVisibleMeshlets     {};
+  std::vector<VkDrawIndexedIndirectCommand>    mCommands            {};
+  std::vector<Batch>                           mBatches             {};
+};
+
+/*
+* Instancer implementation.
+*/
+
+template<typename T>
+void VkInstancer::Slice(u32 first, u32 count, T&& task) const
+{
+  for (auto const& batch : mBatches)
+  {
+    u32 const begin{ std::max(batch.mFirstCommand, first) };
+    u32 const end{ std::min(batch.mFirstCommand + batch.mCommandCount, first + count) };
+    if (begin < end)
+    {
+      task(Batch{ batch.mpShaderLayout, begin, end - begin });
+    }
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+#ifndef VK_JOBS
+#define VK_JOBS
+
+/*
+* Work stealing job pool.
+*
+* Pool structure:
+* ---W0-----------W1-----------C---
+*    |            |            |
+*    [Job, ...]   [Job, ...]   [Job, ...]
+*
+* Every worker owns a queue and pops jobs from its back, idle workers steal
+* from the front of foreign queues. The calling thread owns the last queue
+* and helps out until all jobs of its batch are done.
+*/
+
+#include "VkCore.h"
+
+namespace VkJobs
+{
+  /*
+  * Primitives.
+  */
+
+  struct Job
+  {
+    void(*mpTask)(void const* pContext, u32 index) {};
+    void const*       mpContext                    {};
+    u32               mIndex                       {};
+    std::atomic<u32>* mpPending                    {};
+  };
+
+  struct Queue
+  {
+    std::mutex      mMutex{};
+    std::deque<Job> mJobs {};
+  };
+
+  /*
+  * Thread pool.
+  */
+
+  class Pool
+  {
+  public:
+    Pool(u32 workers = std::max(std::thread::hardware_concurrency(), 1u) - 1)
+      : mpQueues{ new Queue[workers + 1] }
+      , mQueueCount{ workers + 1 }
+    {
+      for (u32 i{}; i < workers; ++i)
+      {
+        mThreads.emplace_back([this, i] { Work(i); });
+      }
+    }
+    virtual ~Pool()
+    {
+      {
+        std::lock_guard<std::mutex> lock{ mSleepMutex };
+        mRunning = 0;
+      }
+      mWake.notify_all();
+      for (auto& thread : mThreads)
+      {
+        thread.join();
+      }
+    }
+
+  public:
+    __forceinline u32 Concurrency() const noexcept { return mQueueCount; }
+
+    // Invokes task(i) for every i in [0, count) and returns once all are done
+    template<typename T>
+    __forceinline void ForEach(u32 count, T&& task) noexcept
+    {
+      if (count == 0) return;
+      if (count == 1 || mQueueCount == 1)
+      {
+        for (u32 i{}; i < count; ++i) task(i);
+        return;
+      }
+      std::atomic<u32> pending{ count };
+      auto const pTask{ [](void const* pContext, u32 index) { (*(std::remove_reference_t<T>*)pContext)(index); } };
+      {
+        std::lock_guard<std::mutex> lock{ mSleepMutex };
+        mQueued += count;
+      }
+      // Hand out contiguous ranges so neighbouring chunks stay on one core
+      u32 const share{ (count + mQueueCount - 1) / mQueueCount };
+      for (u32 i{}; i < mQueueCount; ++i)
+      {
+        std::lock_guard<std::mutex> lock{ mpQueues[i].mMutex };
+        for (u32 j{ i * share }; j < std::min((i + 1) * share, count); ++j)
+        {
+          mpQueues[i].mJobs.emplace_back(Job{ pTask, &task, j, &pending });
+        }
+      }
+      mWake.notify_all();
+      // Help out until our batch is drained
+      u32 const self{ sWorker < mQueueCount ? sWorker : mQueueCount - 1 };
+      Job job{};
+      while (pending.load(std::memory_order_acquire))
+      {
+        if (Pop(self, job) || Steal(self, job))
+        {
+          Run(job);
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+  private:
+    __forceinline u32 Pop(u32 queue, Job& job) noexcept
+    {
+      std::lock_guard<std::mutex> lock{ mpQueues[queue].mMutex };
+      if (mpQueues[queue].mJobs.empty()) return 0;
+      job = mpQueues[queue].mJobs.back();
+      mpQueues[queue].mJobs.pop_back();
+      mQueued--;
+      return 1;
+    }
+    __forceinline u32 Steal(u32 thief, Job& job) noexcept
+    {
+      for (u32 i{ 1 }; i < mQueueCount; ++i)
+      {
+        Queue& victim{ mpQueues[(thief + i) % mQueueCount] };
+        std::lock_guard<std::mutex> lock{ victim.mMutex };
+        if (victim.mJobs.empty()) continue;
+        job = victim.mJobs.front();
+        victim.mJobs.pop_front();
+        mQueued--;
+        return 1;
+      }
+      return 0;
+    }
+    __forceinline void Run(Job const& job) noexcept
+    {
+      job.mpTask(job.mpContext, job.mIndex);
+      job.mpPending->fetch_sub(1, std::memory_order_release);
+    }
+    void Work(u32 index) noexcept
+    {
+      sWorker = index;
+      Job job{};
+      while (1)
+      {
+        if (Pop(index, job) || Steal(index, job))
+        {
+          Run(job);
+          continue;
+        }
+        std::unique_lock<std::mutex> lock{ mSleepMutex };
+        mWake.wait(lock, [this] { return !mRunning || mQueued.load(); });
+        if (!mRunning) return;
+      }
+    }
+
+    static inline thread_local u32 sWorker{ (u32)-1 };
+
+    std::vector<std::thread> mThreads    {};
+    std::unique_ptr<Queue[]> mpQueues    {};
+    u32                      mQueueCount {};
+    std::mutex               mSleepMutex {};
+    std::condition_variable  mWake       {};
+    std::atomic<u32>         mQueued     {};
+    u32                      mRunning    { 1 };
+  };
+
+  /*
+  * Global state.
+  */
+
+  __forceinline Pool& Get() noexcept
+  {
+    static Pool sPool{};
+    return sPool;
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,147 @@
+#ifndef VK_LOD
+#define VK_LOD
+
+/*
+* Screen space error level selection.
+*
+* Selection structure:
+* ---Visible rows-----------Lanes--------------------------------Levels-----------------
+*    |                      |                                    |
+*    [P, S, Radius] --> Pack --> Budget = T * d / (s * c) x W --> e[L] vs Budget -/+ H
+*
+* Every level of a mesh carries the distance it deviates from the full mesh in
+* mesh units. At distance d from the eye and under its largest scale axis s an
+* error e covers e * s * c / d of the view height, c is half the cotangent of
+* the vertical field of view and comes straight out of the camera projection.
+* The distance is taken to the near side of the bounding sphere, renderables
+* around the eye always draw their full mesh. Solving for e turns the threshold
+* T into the largest error a renderable affords, these budgets are computed W
+* visible rows at a time once the rows are packed into lanes.
+*
+* The coarsest level within budget gets drawn. The level last drawn is kept in
+* the renderable, it only moves coarser once the new level fits into the budget
+* shrunk by the hysteresis H and only moves finer once the current level exceeds
+* the budget grown by it. Renderables resting at a boundary keep their level
+* instead of flickering between two of them.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkSimd.h"
+#include "VkCulling.h"
+#include "VkMesh.h"
+
+namespace VkLod
+{
+  /*
+  * Global parameters.
+  */
+
+  // Fraction of the view height, about a pixel at 1080 lines
+  constexpr r32 THRESHOLD { 1.0f / 1080.0f };
+  constexpr r32 HYSTERESIS{ 0.25f };
+
+  /*
+  * Projection.
+  */
+
+  struct Projection
+  {
+    r32v3 mEye  {};
+    // Half the cotangent of the vertical field of view
+    r32   mScale{};
+
+    static __forceinline Projection From(VkCulling::View const& view) noexcept
+    {
+      return Projection{ r32v3{ glm::inverse(view.mView)[3] }, std::abs(view.mProjection[1][1]) * 0.5f };
+    }
+  };
+
+  /*
+  * Kernels.
+  */
+
+  // Largest error in mesh units for W packed renderables
+  template<typename V>
+  __forceinline V Budgets(r32 const* pX, r32 const* pY, r32 const* pZ, r32 const* pScales, r32 const* pRadii, Projection const& projection) noexcept
+  {
+    V const x{ V::Load(pX, 1) - V::Set(projection.mEye.x) };
+    V const y{ V::Load(pY, 1) - V::Set(projection.mEye.y) };
+    V const z{ V::Load(pZ, 1) - V::Set(projection.mEye.z) };
+    V const scale{ V::Load(pScales, 1) };
+    V const distance{ V::Max(V::Sqrt(x * x + y * y + z * z) - V::Load(pRadii, 1) * scale, V::Set(0.0f)) };
+    return V::Set(THRESHOLD / projection.mScale) * distance / scale;
+  }
+
+  /*
+  * Batch specific routines.
+  */
+
+  // Moves a level towards the coarsest one within budget, errors grow with the level
+  __forceinline u32 Step(VkMesh const& mesh, u32 level, r32 budget) noexcept
+  {
+    if (mesh.mLodCount < 2)
+    {
+      return 0;
+    }
+    level = std::min(level, mesh.mLodCount - 1);
+    u32 coarser{ level };
+    while (coarser + 1 < mesh.mLodCount && mesh.mpLods[coarser + 1].mError <= budget * (1.0f - HYSTERESIS))
+    {
+      coarser++;
+    }
+    if (coarser != level)
+    {
+      return coarser;
+    }
+    while (level && mesh.mpLods[level].mError > budget * (1.0f + HYSTERESIS))
+    {
+      level--;
+    }
+    return level;
+  }
+
+  // Steps the level of every visible renderable of one chunk, rows come out of the culling pass
+  __forceinline void Select(acs::Transform const* pTransforms, acs::Bounds const* pBounds, acs::Renderable* pRenderables, u32 const* pRows, u32 count, Projection const& projection) noexcept
+  {
+    std::array<u32, VkAcs::CHUNK_ROWS> rows;
+    std::array<r32, VkAcs::CHUNK_ROWS> x;
+    std::array<r32, VkAcs::CHUNK_ROWS> y;
+    std::array<r32, VkAcs::CHUNK_ROWS> z;
+    std::array<r32, VkAcs::CHUNK_ROWS> scales;
+    std::array<r32, VkAcs::CHUNK_ROWS> radii;
+    std::array<r32, VkAcs::CHUNK_ROWS> budgets;
+    // Only renderables with a choice occupy lanes
+    u32 packed{};
+    for (u32 i{}; i < count; ++i)
+    {
+      u32 const row{ pRows[i] };
+      VkMesh const* pMesh{ (VkMesh const*)pRenderables[row].mpMeshLayout };
+      if (!pMesh || pMesh->mLodCount < 2)
+      {
+        pRenderables[row].mLevel = 0;
+        continue;
+      }
+      acs::Transform const& transform{ pTransforms[row] };
+      rows[packed] = row;
+      x[packed] = transform.mPosition.x;
+      y[packed] = transform.mPosition.y;
+      z[packed] = transform.mPosition.z;
+      scales[packed] = std::max(std::abs(transform.mScale.x), std::max(std::abs(transform.mScale.y), std::abs(transform.mScale.z)));
+      radii[packed] = pBounds[row].mRadius;
+      packed++;
+    }
+    VkSimd::Batch(packed, [&]<typename V>(u32 i)
+    {
+      V::StoreFloat(budgets.data() + i, Budgets<V>(x.data() + i, y.data() + i, z.data() + i, scales.data() + i, radii.data() + i, projection));
+    });
+    for (u32 i{}; i < packed; ++i)
+    {
+      acs::Renderable& renderable{ pRenderables[rows[i]] };
+      renderable.mLevel = Step(*(VkMesh const*)renderable.mpMeshLayout, renderable.mLevel, budgets[i]);
+    }
+  }
+}
+
+#endif
\ No newline at end of file
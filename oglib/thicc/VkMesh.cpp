@@ -1,10 +1,90 @@
 #include "VkMesh.h"
 
-VkMesh::VkMesh()
+VkMeshBuffer::VkMeshBuffer(VkAllocator* pVkAllocator, VkUploader* pVkUploader, u32 vertexStride, u32 vertexCapacity, u32 indexCapacity)
+  : mpVkAllocator{ pVkAllocator }
+  , mpVkUploader{ pVkUploader }
+  , mVertexStride{ vertexStride }
+  , mVertices{ vertexCapacity }
+  , mIndices{ indexCapacity }
 {
+  // Vertex buffer create info
+  VkBufferCreateInfo vkVertexBufferCreateInfo{};
+  vkVertexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vkVertexBufferCreateInfo.size = (u64)vertexStride * vertexCapacity;
+  vkVertexBufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  mpVkUploader->ShareWithGraphics(vkVertexBufferCreateInfo);
+  mpVkAllocator->CreateBuffer(vkVertexBufferCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVkVertexBuffer, mVertexAllocation);
+  // Index buffer create info
+  VkBufferCreateInfo vkIndexBufferCreateInfo{};
+  vkIndexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vkIndexBufferCreateInfo.size = sizeof(u32) * (u64)indexCapacity;
+  vkIndexBufferCreateInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  mpVkUploader->ShareWithGraphics(vkIndexBufferCreateInfo);
+  mpVkAllocator->CreateBuffer(vkIndexBufferCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVkIndexBuffer, mIndexAllocation);
+}
+VkMeshBuffer::~VkMeshBuffer()
+{
+  mpVkAllocator->DestroyBuffer(mVkIndexBuffer, mIndexAllocation);
+  mpVkAllocator->DestroyBuffer(mVkVertexBuffer, mVertexAllocation);
+}
 
+VkMesh VkMeshBuffer::Create(void const* pVertices, u32 vertexCount, u32 const* pIndices, u32 indexCount)
+{
+  VkMesh mesh{ Reserve(vertexCount, indexCount) };
+  if (mesh.Valid())
+  {
+    WriteVertices(mesh, 0, pVertices, vertexCount);
+    WriteIndices(mesh, 0, pIndices, indexCount);
+  }
+  return mesh;
 }
-VkMesh::~VkMesh()
+VkMesh VkMeshBuffer::Reserve(u32 vertexCount, u32 indexCount)
 {
+  std::lock_guard<std::mutex> lock{ mMutex };
+  u64 const vertexOffset{ mVertices.Allocate(vertexCount) };
+  u64 const indexOffset{ mIndices.Allocate(indexCount) };
+  if (vertexOffset == VkRanges::INVALID || indexOffset == VkRanges::INVALID)
+  {
+    VK_LOG("Mesh buffer exhausted for %u vertices and %u indices\n", vertexCount, indexCount);
+    mVertices.Free(vertexOffset, vertexCount);
+    mIndices.Free(indexOffset, indexCount);
+    return VkMesh{};
+  }
+  return VkMesh{ (u32)vertexOffset, vertexCount, (u32)indexOffset, indexCount };
+}
+void VkMeshBuffer::WriteVertices(VkMesh& mesh, u32 firstVertex, void const* pVertices, u32 vertexCount)
+{
+  mesh.mTicket = mpVkUploader->Upload(mVkVertexBuffer, ((u64)mesh.mVertexOffset + firstVertex) * mVertexStride, pVertices, (u64)vertexCount * mVertexStride);
+}
+void VkMeshBuffer::WriteIndices(VkMesh& mesh, u32 firstIndex, u32 const* pIndices, u32 indexCount)
+{
+  mesh.mTicket = mpVkUploader->Upload(mVkIndexBuffer, ((u64)mesh.mIndexOffset + firstIndex) * sizeof(u32), pIndices, (u64)indexCount * sizeof(u32));
+}
+void VkMeshBuffer::Destroy(VkMesh& mesh)
+{
+  if (!mesh.Valid())
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{ mMutex };
+  mVertices.Free(mesh.mVertexOffset, mesh.mVertexCount);
+  mIndices.Free(mesh.mIndexOffset, mesh.mIndexCount);
+  mesh = VkMesh{};
+}
+
+u32 VkMeshBuffer::Ready(VkMesh const& mesh) const
+{
+  return mesh.Valid() && mpVkUploader->Completed(mesh.mTicket);
+}
 
+void VkMeshBuffer::Bind(VkCommandBuffer vkCommandBuffer) const
+{
+  VkDeviceSize const offset{};
+  vkCmdBindVertexBuffers(vkCommandBuffer, 0, 1, &mVkVertexBuffer, &offset);
+  vkCmdBindIndexBuffer(vkCommandBuffer, mVkIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+void VkMeshBuffer::Draw(VkCommandBuffer vkCommandBuffer, VkMesh const& mesh, u32 instanceCount, u32 firstInstance) const
+{
+  VkMeshLod const lod{ mesh.Level(0) };
+  vkCmdDrawIndexed(vkCommandBuffer, lod.mIndexCount, instanceCount, mesh.mIndexOffset + lod.mFirstIndex, (s32)mesh.mVertexOffset, firstInstance);
 }
\ No newline at end of file
@@ -1,13 +1,143 @@
 #ifndef VK_MESH
 #define VK_MESH
 
+/*
+* Meshes as ranges of shared buffers.
+*
+* Buffer structure:
+* ---Vertices-------------------------Indices-----------------------
+*    |                                |
+*    [M0 ---- | M1 -- | .... | M2 --] [M0 ------ | M1 ---- | M2 ---]
+*
+* Every mesh lives in one device local vertex buffer and one index buffer
+* which are shared by all meshes, a mesh is only the offset and count of its
+* two ranges. Both buffers get bound once and any number of meshes is drawn
+* without rebinding. Indices stay relative to the first vertex of their mesh,
+* the vertex offset is applied by the draw.
+*
+* Contents arrive through the uploader, a mesh may only be drawn after its
+* ticket completed. Reserved meshes may be written in pieces, every write
+* advances the ticket so it always covers all contents written so far.
+* Destroying a mesh returns its ranges immediately, the device must no longer
+* read them.
+*
+* Meshes coming out of the asset pipeline may carry meshlets, contiguous runs of
+* at most VK_MESHLET_TRIANGLES triangles of their index range bounded by a
+* sphere and a cone of triangle normals. The meshlets are owned by whoever
+* loaded the mesh, the mesh only points at them.
+*
+* Such meshes may also carry levels of detail. Their index range then holds
+* the full mesh followed by every coarser level, all of them indexing the same
+* vertices. Each level is a part of the index range and the error it deviates
+* from the full mesh by, level zero is the full mesh and meshlets belong to it.
+* Meshes without levels draw their whole index range at any level.
+*/
+
 #include "VkCore.h"
+#include "VkPool.h"
+#include "VkAllocator.h"
+#include "VkUploader.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u32 VK_MESH_VERTEX_CAPACITY{ 1u << 20 };
+constexpr u32 VK_MESH_INDEX_CAPACITY { 1u << 22 };
+constexpr u32 VK_MESHLET_VERTICES   { 64 };
+constexpr u32 VK_MESHLET_TRIANGLES  { 124 };
+
+/*
+* Meshlet.
+*/
+
+// Bounds are in mesh space, the first index is relative to the index range of the mesh
+struct VkMeshlet
+{
+  r32 mCenter[3] {};
+  r32 mRadius    {};
+  r32 mAxis[3]   {};
+  // Sine of the widest normal angle off the axis, one if the cone never culls
+  r32 mCutoff    {};
+  u32 mFirstIndex{};
+  u32 mIndexCount{};
+};
+
+/*
+* Level of detail.
+*/
+
+// The first index is relative to the index range of the mesh, the error is in mesh units
+struct VkMeshLod
+{
+  u32 mFirstIndex{};
+  u32 mIndexCount{};
+  r32 mError     {};
+};
+
+/*
+* Mesh handle.
+*/
 
-class VkMesh
+struct VkMesh
+{
+  u32              mVertexOffset{};
+  u32              mVertexCount {};
+  u32              mIndexOffset {};
+  u32              mIndexCount  {};
+  u64              mTicket      {};
+  VkMeshlet const* mpMeshlets   {};
+  u32              mMeshletCount{};
+  VkMeshLod const* mpLods       {};
+  u32              mLodCount    {};
+
+  __forceinline u32       Valid()          const noexcept { return mVertexCount && mIndexCount; }
+  // Levels beyond the coarsest one clamp to it
+  __forceinline VkMeshLod Level(u32 level) const noexcept { return mLodCount ? mpLods[std::min(level, mLodCount - 1)] : VkMeshLod{ 0, mIndexCount }; }
+};
+
+/*
+* Shared mesh buffers.
+*/
+
+class VkMeshBuffer
 {
 public:
-  VkMesh();
-  virtual ~VkMesh();
+  VkMeshBuffer(VkAllocator* pVkAllocator, VkUploader* pVkUploader, u32 vertexStride, u32 vertexCapacity = VK_MESH_VERTEX_CAPACITY, u32 indexCapacity = VK_MESH_INDEX_CAPACITY);
+  virtual ~VkMeshBuffer();
+
+public:
+  // Reserves both ranges and uploads the contents, returns an invalid mesh if either buffer is full
+  VkMesh Create(void const* pVertices, u32 vertexCount, u32 const* pIndices, u32 indexCount);
+  // Reserves both ranges without contents, returns an invalid mesh if either buffer is full
+  VkMesh Reserve(u32 vertexCount, u32 indexCount);
+  void   WriteVertices(VkMesh& mesh, u32 firstVertex, void const* pVertices, u32 vertexCount);
+  void   WriteIndices(VkMesh& mesh, u32 firstIndex, u32 const* pIndices, u32 indexCount);
+  void   Destroy(VkMesh& mesh);
+
+  u32    Ready(VkMesh const& mesh) const;
+
+  void   Bind(VkCommandBuffer vkCommandBuffer) const;
+  // Draws level zero, the full mesh
+  void   Draw(VkCommandBuffer vkCommandBuffer, VkMesh const& mesh, u32 instanceCount = 1, u32 firstInstance = 0) const;
+
+  __forceinline u32             Stride()       const noexcept { return mVertexStride; }
+  __forceinline VkBuffer        VertexBuffer() const noexcept { return mVkVertexBuffer; }
+  __forceinline VkBuffer        IndexBuffer()  const noexcept { return mVkIndexBuffer; }
+  __forceinline VkRanges const& Vertices()     const noexcept { return mVertices; }
+  __forceinline VkRanges const& Indices()      const noexcept { return mIndices; }
+
+private:
+  VkAllocator*  mpVkAllocator     {};
+  VkUploader*   mpVkUploader      {};
+  u32           mVertexStride     {};
+  VkRanges      mVertices;
+  VkRanges      mIndices;
+  VkBuffer      mVkVertexBuffer   {};
+  VkBuffer      mVkIndexBuffer    {};
+  VkAllocation  mVertexAllocation {};
+  VkAllocation  mIndexAllocation  {};
+  std::mutex    mMutex            {};
 };
 
 #endif
\ No newline at end of file
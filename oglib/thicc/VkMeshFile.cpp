@@ -0,0 +1,273 @@
+#include "VkMeshFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  /*
+  * Validation routines.
+  */
+
+  // Offsets are compared against remaining sizes so corrupt counts can not overflow
+  s8 const* ValidateHeader(VkMeshFormat::Header const& header, u64 size)
+  {
+    if (size < sizeof(VkMeshFormat::Header) || header.mMagic != VK_MESH_FILE_MAGIC)
+    {
+      return "is no mesh file";
+    }
+    if (header.mVersion != VK_MESH_FILE_VERSION)
+    {
+      return "was written by another version";
+    }
+    if (header.mSize != size)
+    {
+      return "is truncated";
+    }
+    if (!header.mStride || header.mVertexOffset % VK_MESH_FILE_ALIGNMENT || header.mIndexOffset % VK_MESH_FILE_ALIGNMENT)
+    {
+      return "is malformed";
+    }
+    u64 const records{ sizeof(VkMeshFormat::Header) + (u64)header.mMeshCount * sizeof(VkMeshFormat::Record) };
+    if (records > header.mMeshletOffset || header.mMeshletOffset % alignof(VkMeshlet) || header.mMeshletOffset > header.mLodOffset ||
+        header.mMeshletCount > (header.mLodOffset - header.mMeshletOffset) / sizeof(VkMeshlet) ||
+        header.mLodOffset % alignof(VkMeshLod) || header.mLodOffset > header.mVertexOffset ||
+        header.mLodCount > (header.mVertexOffset - header.mLodOffset) / sizeof(VkMeshLod) ||
+        header.mVertexOffset > header.mIndexOffset || header.mIndexOffset > size ||
+        header.mVertexCount > (header.mIndexOffset - header.mVertexOffset) / header.mStride ||
+        header.mIndexCount > (size - header.mIndexOffset) / sizeof(u32))
+    {
+      return "holds ranges outside of the file";
+    }
+    return nullptr;
+  }
+  s8 const* ValidateRecords(VkMeshFormat::Header const& header, VkMeshFormat::Record const* pRecords, VkMeshlet const* pMeshlets, VkMeshLod const* pLods)
+  {
+    if (VkMeshFormat::Checksum(header, pRecords, pMeshlets, pLods) != header.mChecksum)
+    {
+      return "fails its checksum";
+    }
+    for (u32 i{}; i < header.mMeshCount; ++i)
+    {
+      VkMeshFormat::Record const& record{ pRecords[i] };
+      if (record.mFirstVertex > header.mVertexCount || record.mVertexCount > header.mVertexCount - record.mFirstVertex ||
+          record.mFirstIndex > header.mIndexCount || record.mIndexCount > header.mIndexCount - record.mFirstIndex)
+      {
+        return "holds meshes outside of its blobs";
+      }
+      if (record.mFirstMeshlet > header.mMeshletCount || record.mMeshletCount > header.mMeshletCount - record.mFirstMeshlet)
+      {
+        return "holds meshlets outside of its blob";
+      }
+      for (u32 j{}; j < record.mMeshletCount; ++j)
+      {
+        VkMeshlet const& meshlet{ pMeshlets[record.mFirstMeshlet + j] };
+        if (meshlet.mFirstIndex > record.mIndexCount || meshlet.mIndexCount > record.mIndexCount - meshlet.mFirstIndex)
+        {
+          return "holds meshlets outside of their mesh";
+        }
+      }
+      if (record.mFirstLod > header.mLodCount || record.mLodCount > header.mLodCount - record.mFirstLod)
+      {
+        return "holds levels outside of their blob";
+      }
+      for (u32 j{}; j < record.mLodCount; ++j)
+      {
+        VkMeshLod const& lod{ pLods[record.mFirstLod + j] };
+        if (!lod.mIndexCount || lod.mFirstIndex > record.mIndexCount || lod.mIndexCount > record.mIndexCount - lod.mFirstIndex)
+        {
+          return "holds levels outside of their mesh";
+        }
+      }
+    }
+    return nullptr;
+  }
+}
+
+VkMeshFile::VkMeshFile(std::filesystem::path const& path)
+{
+#ifdef _WIN32
+  HANDLE const file{ CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    mpError = "can not be opened";
+    return;
+  }
+  mFile = file;
+  LARGE_INTEGER size{};
+  GetFileSizeEx(file, &size);
+  mSize = (u64)size.QuadPart;
+  if (mSize < sizeof(VkMeshFormat::Header))
+  {
+    mpError = "is no mesh file";
+    return;
+  }
+  if (mSize > SIZE_MAX)
+  {
+    mpError = "does not fit into the address space";
+    return;
+  }
+  mMapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  mpBytes = mMapping ? (u8 const*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+  mFile = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status{};
+  if (mFile < 0 || fstat(mFile, &status))
+  {
+    mpError = "can not be opened";
+    return;
+  }
+  mSize = (u64)status.st_size;
+  if (mSize < sizeof(VkMeshFormat::Header))
+  {
+    mpError = "is no mesh file";
+    return;
+  }
+  void* const pMapped{ mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0) };
+  if (pMapped != MAP_FAILED)
+  {
+    // Blobs are consumed front to back by the uploader
+    madvise(pMapped, mSize, MADV_SEQUENTIAL);
+    mpBytes = (u8 const*)pMapped;
+  }
+#endif
+  if (!mpBytes)
+  {
+    mpError = "can not be mapped";
+    return;
+  }
+  mpHeader = (VkMeshFormat::Header const*)mpBytes;
+  mpRecords = (VkMeshFormat::Record const*)(mpBytes + sizeof(VkMeshFormat::Header));
+  mpError = ValidateHeader(*mpHeader, mSize);
+  if (!mpError)
+  {
+    mpMeshlets = (VkMeshlet const*)(mpBytes + mpHeader->mMeshletOffset);
+    mpLods = (VkMeshLod const*)(mpBytes + mpHeader->mLodOffset);
+    mpError = ValidateRecords(*mpHeader, mpRecords, mpMeshlets, mpLods);
+  }
+}
+VkMeshFile::~VkMeshFile()
+{
+#ifdef _WIN32
+  if (mpBytes)
+  {
+    UnmapViewOfFile(mpBytes);
+  }
+  if (mMapping)
+  {
+    CloseHandle(mMapping);
+  }
+  if (mFile)
+  {
+    CloseHandle(mFile);
+  }
+#else
+  if (mpBytes)
+  {
+    munmap((void*)mpBytes, mSize);
+  }
+  if (mFile >= 0)
+  {
+    close(mFile);
+  }
+#endif
+}
+
+VkMesh VkMeshFile::Load(VkMeshBuffer& meshBuffer, u32 mesh) const
+{
+  if (mpError || mesh >= mpHeader->mMeshCount || meshBuffer.Stride() != mpHeader->mStride)
+  {
+    return VkMesh{};
+  }
+  VkMeshFormat::Record const& record{ mpRecords[mesh] };
+  return meshBuffer.Create(Vertices(mesh), record.mVertexCount, Indices(mesh), record.mIndexCount);
+}
+
+VkMeshStream::VkMeshStream(std::filesystem::path const& path, u64 chunk)
+  : mStream{ path, std::ios::binary | std::ios::ate }
+{
+  if (!mStream)
+  {
+    mpError = "can not be opened";
+    return;
+  }
+  u64 const size{ (u64)mStream.tellg() };
+  mStream.seekg(0);
+  mStream.read((s8*)&mHeader, sizeof(VkMeshFormat::Header));
+  mpError = mStream ? ValidateHeader(mHeader, size) : "is no mesh file";
+  if (mpError)
+  {
+    return;
+  }
+  mRecords.resize(mHeader.mMeshCount);
+  mStream.read((s8*)mRecords.data(), (std::streamsize)(sizeof(VkMeshFormat::Record) * mRecords.size()));
+  mMeshlets.resize(mHeader.mMeshletCount);
+  mStream.seekg((std::streamoff)mHeader.mMeshletOffset);
+  mStream.read((s8*)mMeshlets.data(), (std::streamsize)(sizeof(VkMeshlet) * mMeshlets.size()));
+  mLods.resize(mHeader.mLodCount);
+  mStream.seekg((std::streamoff)mHeader.mLodOffset);
+  mStream.read((s8*)mLods.data(), (std::streamsize)(sizeof(VkMeshLod) * mLods.size()));
+  mpError = mStream ? ValidateRecords(mHeader, mRecords.data(), mMeshlets.data(), mLods.data()) : "is truncated";
+  // A chunk holds at least one vertex
+  mChunk.resize(std::max<u64>(chunk, mHeader.mStride));
+}
+
+VkMesh VkMeshStream::Load(VkMeshBuffer& meshBuffer, u32 mesh)
+{
+  if (mpError || mesh >= mHeader.mMeshCount || meshBuffer.Stride() != mHeader.mStride)
+  {
+    return VkMesh{};
+  }
+  VkMeshFormat::Record const& record{ mRecords[mesh] };
+  VkMesh result{ meshBuffer.Reserve(record.mVertexCount, record.mIndexCount) };
+  if (!result.Valid())
+  {
+    return result;
+  }
+  // Every chunk is staged before the next one is read, the chunk buffer gets reused right away
+  u64 const vertices{ mChunk.size() / mHeader.mStride };
+  for (u64 first{}; first < record.mVertexCount; first += vertices)
+  {
+    u32 const count{ (u32)std::min<u64>(vertices, record.mVertexCount - first) };
+    if (!Read(mHeader.mVertexOffset + (record.mFirstVertex + first) * mHeader.mStride, (u64)count * mHeader.mStride))
+    {
+      meshBuffer.Destroy(result);
+      return result;
+    }
+    meshBuffer.WriteVertices(result, (u32)first, mChunk.data(), count);
+  }
+  u64 const indices{ mChunk.size() / sizeof(u32) };
+  for (u64 first{}; first < record.mIndexCount; first += indices)
+  {
+    u32 const count{ (u32)std::min<u64>(indices, record.mIndexCount - first) };
+    if (!Read(mHeader.mIndexOffset + (record.mFirstIndex + first) * sizeof(u32), (u64)count * sizeof(u32)))
+    {
+      meshBuffer.Destroy(result);
+      return result;
+    }
+    meshBuffer.WriteIndices(result, (u32)first, (u32 const*)mChunk.data(), count);
+  }
+  return result;
+}
+
+u32 VkMeshStream::Read(u64 offset, u64 size)
+{
+  mStream.clear();
+  mStream.seekg((std::streamoff)offset);
+  mStream.read((s8*)mChunk.data(), (std::streamsize)size);
+  if (!mStream)
+  {
+    VK_LOG("Mesh stream failed to read %llu bytes at %llu\n", (unsigned long long)size, (unsigned long long)offset);
+    return 0;
+  }
+  return 1;
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+#ifndef VK_MESH_FILE
+#define VK_MESH_FILE
+
+/*
+* Binary mesh container.
+*
+* File structure:
+* ---Header-----------------------------Records-------------Meshlets----------Levels-----------Vertices--------Indices---------
+*    |                                  |                   |                 |                |               |
+*    [Magic, Version, Layout, Stride,   [Name, Ranges,      [Sphere, Cone,    [Range, Error]   [Page aligned]  [Page aligned]
+*     Counts, Offsets, Size, Checksum]   Bounds] * Meshes    Range] * Total    * Total
+*
+* Vertices are stored in the exact layout the vertex buffer expects and indices
+* as u32 relative to the first vertex of their mesh, both blobs start on page
+* boundaries. Loading a mesh is a copy from the file into the staging ring, no
+* element is ever touched on the host. The layout key is a hash over the
+* attribute formats and offsets of the vertex type, files written for another
+* layout are rejected instead of being misread.
+*
+* VkMeshFile maps the whole file and uploads straight out of the mapping, pages
+* are brought in by the copy and can be dropped again by the system at any
+* time. VkMeshStream keeps only the header, records, meshlets and levels
+* resident and reads the blobs in chunks of bounded size, it serves files which
+* do not fit into the address space. Header, records, meshlets and levels are
+* checked against the size of the file and their checksum, index contents are
+* trusted to stay within their mesh.
+*
+* Meshlets and levels of detail are written by the optimizing converter and
+* stay on the host, they are stored in the layout of VkMeshlet and VkMeshLod
+* right behind the records. The index range of a record spans all of its
+* levels. Loading a mesh does not attach them, their memory belongs to the
+* reader.
+*/
+
+#include "VkCore.h"
+#include "VkUtils.h"
+#include "VkVertices.h"
+#include "VkMesh.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u32 VK_MESH_FILE_MAGIC    { 0x464D4B56 }; // VKMF
+constexpr u32 VK_MESH_FILE_VERSION  { 3 };
+constexpr u64 VK_MESH_FILE_ALIGNMENT{ 4096 };
+constexpr u32 VK_MESH_FILE_NAME     { 32 };
+constexpr u64 VK_MESH_STREAM_CHUNK  { VK_UPLOADER_CAPACITY / 4 };
+
+/*
+* File layout.
+*/
+
+namespace VkMeshFormat
+{
+  struct Header
+  {
+    u32 mMagic        {};
+    u32 mVersion      {};
+    u64 mLayout       {};
+    u32 mStride       {};
+    u32 mMeshCount    {};
+    u64 mVertexCount  {};
+    u64 mIndexCount   {};
+    u64 mMeshletCount {};
+    u64 mMeshletOffset{};
+    u64 mLodCount     {};
+    u64 mLodOffset    {};
+    u64 mVertexOffset {};
+    u64 mIndexOffset  {};
+    u64 mSize         {};
+    u64 mChecksum     {};
+  };
+
+  struct Record
+  {
+    s8  mName[VK_MESH_FILE_NAME]{};
+    u64 mFirstVertex            {};
+    u64 mFirstIndex             {};
+    u32 mVertexCount            {};
+    u32 mIndexCount             {};
+    u32 mFirstMeshlet           {};
+    u32 mMeshletCount           {};
+    u32 mFirstLod               {};
+    u32 mLodCount               {};
+    r32 mMin[3]                 {};
+    r32 mMax[3]                 {};
+  };
+
+  static_assert(sizeof(Header) == 104 && sizeof(Record) == 96 && sizeof(VkMeshlet) == 40 && sizeof(VkMeshLod) == 12, "File layout must not depend on the compiler");
+
+  template<typename V>
+  constexpr u64 Layout() noexcept
+  {
+    u64 hash{ 14695981039346656037ull };
+    auto const mix{ [&](u32 value)
+    {
+      for (u32 i{}; i < 4; ++i)
+      {
+        hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 1099511628211ull;
+      }
+    } };
+    for (auto const& vkAttribute : VkVertex::Traits<V>::ATTRIBUTES.mDescriptions)
+    {
+      mix(vkAttribute.location);
+      mix((u32)vkAttribute.format);
+      mix(vkAttribute.offset);
+    }
+    mix((u32)sizeof(V));
+    return hash;
+  }
+
+  // Covers header, records, meshlets and levels, the checksum field itself counts as zero
+  __forceinline u64 Checksum(Header const& header, Record const* pRecords, VkMeshlet const* pMeshlets, VkMeshLod const* pLods) noexcept
+  {
+    Header blank{ header };
+    blank.mChecksum = 0;
+    u64 hash{ VkUtils::Hash(pRecords, sizeof(Record) * header.mMeshCount, VkUtils::Hash(&blank, sizeof(Header))) };
+    hash = VkUtils::Hash(pMeshlets, sizeof(VkMeshlet) * header.mMeshletCount, hash);
+    return VkUtils::Hash(pLods, sizeof(VkMeshLod) * header.mLodCount, hash);
+  }
+
+  __forceinline constexpr u64 Align(u64 offset) noexcept { return (offset + VK_MESH_FILE_ALIGNMENT - 1) & ~(VK_MESH_FILE_ALIGNMENT - 1); }
+}
+
+/*
+* Mapped reader.
+*/
+
+class VkMeshFile
+{
+public:
+  VkMeshFile(std::filesystem::path const& path);
+  virtual ~VkMeshFile();
+
+  VkMeshFile(VkMeshFile const&) = delete;
+  VkMeshFile& operator = (VkMeshFile const&) = delete;
+
+public:
+  // Uploads the mesh straight out of the mapping, returns an invalid mesh if the mesh buffer is full or of another stride
+  VkMesh Load(VkMeshBuffer& meshBuffer, u32 mesh) const;
+
+  template<typename V>
+  __forceinline u32                          Holds()                const noexcept { return !mpError && mpHeader->mLayout == VkMeshFormat::Layout<V>(); }
+  __forceinline u32                          Count()                const noexcept { return mpError ? 0 : mpHeader->mMeshCount; }
+  __forceinline VkMeshFormat::Record const&  Record(u32 mesh)       const noexcept { return mpRecords[mesh]; }
+  __forceinline void const*                  Vertices(u32 mesh)     const noexcept { return mpBytes + mpHeader->mVertexOffset + mpRecords[mesh].mFirstVertex * mpHeader->mStride; }
+  __forceinline u32 const*                   Indices(u32 mesh)      const noexcept { return (u32 const*)(mpBytes + mpHeader->mIndexOffset) + mpRecords[mesh].mFirstIndex; }
+  // Record(mesh).mMeshletCount meshlets, valid as long as the file
+  __forceinline VkMeshlet const*             Meshlets(u32 mesh)     const noexcept { return mpMeshlets + mpRecords[mesh].mFirstMeshlet; }
+  // Record(mesh).mLodCount levels, valid as long as the file
+  __forceinline VkMeshLod const*             Lods(u32 mesh)         const noexcept { return mpLods + mpRecords[mesh].mFirstLod; }
+  // Reason the file could not be mapped or was rejected, null if it is usable
+  __forceinline s8 const*                    Error()                const noexcept { return mpError; }
+
+private:
+  u8 const*                   mpBytes   {};
+  u64                         mSize     {};
+  VkMeshFormat::Header const* mpHeader  {};
+  VkMeshFormat::Record const* mpRecords {};
+  VkMeshlet const*            mpMeshlets{};
+  VkMeshLod const*            mpLods    {};
+  s8 const*                   mpError   {};
+#ifdef _WIN32
+  void*                       mFile     {};
+  void*                       mMapping  {};
+#else
+  s32                         mFile     { -1 };
+#endif
+};
+
+/*
+* Streaming reader.
+*/
+
+class VkMeshStream
+{
+public:
+  VkMeshStream(std::filesystem::path const& path, u64 chunk = VK_MESH_STREAM_CHUNK);
+
+public:
+  // Reserves the mesh and feeds it through the uploader chunk by chunk, returns an invalid mesh on failure
+  VkMesh Load(VkMeshBuffer& meshBuffer, u32 mesh);
+
+  template<typename V>
+  __forceinline u32                          Holds()            const noexcept { return !mpError && mHeader.mLayout == VkMeshFormat::Layout<V>(); }
+  __forceinline u32                          Count()            const noexcept { return mpError ? 0 : mHeader.mMeshCount; }
+  __forceinline VkMeshFormat::Record const&  Record(u32 mesh)   const noexcept { return mRecords[mesh]; }
+  __forceinline VkMeshlet const*             Meshlets(u32 mesh) const noexcept { return mMeshlets.data() + mRecords[mesh].mFirstMeshlet; }
+  __forceinline VkMeshLod const*             Lods(u32 mesh)     const noexcept { return mLods.data() + mRecords[mesh].mFirstLod; }
+  __forceinline s8 const*                    Error()            const noexcept { return mpError; }
+
+private:
+  u32 Read(u64 offset, u64 size);
+
+  std::ifstream                     mStream  {};
+  VkMeshFormat::Header              mHeader  {};
+  std::vector<VkMeshFormat::Record> mRecords {};
+  std::vector<VkMeshlet>            mMeshlets{};
+  std::vector<VkMeshLod>            mLods    {};
+  std::vector<u8>                   mChunk   {};
+  s8 const*                         mpError  {};
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,832 @@
+#include "VkMeshOptimizer.h"
+
+#include <numeric>
+
+namespace
+{
+  /*
+  * Vertex cache scoring.
+  */
+
+  constexpr u32 VALENCE_LIMIT{ 32 };
+
+  struct Scores
+  {
+    r32 mCache[VK_OPTIMIZER_CACHE]{};
+    r32 mValence[VALENCE_LIMIT]   {};
+
+    Scores()
+    {
+      for (u32 i{}; i < VK_OPTIMIZER_CACHE; ++i)
+      {
+        // Vertices of the last triangle score flat, their order within it does not matter
+        mCache[i] = i < 3 ? 0.75f : std::pow(1.0f - (r32)(i - 3) / (r32)(VK_OPTIMIZER_CACHE - 3), 1.5f);
+      }
+      for (u32 i{ 1 }; i < VALENCE_LIMIT; ++i)
+      {
+        // Vertices with few triangles left get finished before they turn into lonely ones
+        mValence[i] = 2.0f / std::sqrt((r32)i);
+      }
+    }
+  };
+
+  r32 VertexScore(s32 position, u32 valence)
+  {
+    static Scores const sScores{};
+    if (!valence)
+    {
+      return 0.0f;
+    }
+    return (position < 0 ? 0.0f : sScores.mCache[position]) + sScores.mValence[std::min(valence, VALENCE_LIMIT - 1)];
+  }
+
+  /*
+  * Geometry routines.
+  */
+
+  __forceinline r32v3 Position(r32 const* pPositions, u32 stride, u32 vertex)
+  {
+    r32 const* pPosition{ (r32 const*)((u8 const*)pPositions + (u64)vertex * stride) };
+    return r32v3{ pPosition[0], pPosition[1], pPosition[2] };
+  }
+
+  // Seams split vertices by their attributes, every position is represented by its first vertex
+  std::vector<u32> Canonical(r32 const* pPositions, u32 stride, u32 vertexCount)
+  {
+    std::vector<u32> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    auto const key{ [&](u32 vertex)
+    {
+      r32v3 const position{ Position(pPositions, stride, vertex) };
+      return std::make_tuple(position.x, position.y, position.z, vertex);
+    } };
+    std::sort(order.begin(), order.end(), [&](u32 a, u32 b) { return key(a) < key(b); });
+    std::vector<u32> canonical(vertexCount);
+    for (u32 i{}; i < vertexCount; ++i)
+    {
+      r32v3 const position{ Position(pPositions, stride, order[i]) };
+      u32 const same{ i && Position(pPositions, stride, order[i - 1]) == position };
+      canonical[order[i]] = same ? canonical[order[i - 1]] : order[i];
+    }
+    return canonical;
+  }
+
+  // Sphere around the bounding box and the cone of unit triangle normals around their mean
+  VkMeshlet Bound(u32 const* pIndices, u32 firstTriangle, u32 endTriangle, r32 const* pPositions, u32 stride, u32 cones)
+  {
+    r32v3 min{ std::numeric_limits<r32>::max() };
+    r32v3 max{ std::numeric_limits<r32>::lowest() };
+    for (u32 i{ firstTriangle * 3 }; i < endTriangle * 3; ++i)
+    {
+      r32v3 const position{ Position(pPositions, stride, pIndices[i]) };
+      min = glm::min(min, position);
+      max = glm::max(max, position);
+    }
+    r32v3 const center{ (min + max) * 0.5f };
+    r32 radius{};
+    std::vector<r32v3> normals{};
+    r32v3 axis{};
+    for (u32 t{ firstTriangle }; t < endTriangle; ++t)
+    {
+      r32v3 const a{ Position(pPositions, stride, pIndices[t * 3]) };
+      r32v3 const b{ Position(pPositions, stride, pIndices[t * 3 + 1]) };
+      r32v3 const c{ Position(pPositions, stride, pIndices[t * 3 + 2]) };
+      radius = std::max({ radius, glm::length(a - center), glm::length(b - center), glm::length(c - center) });
+      r32v3 const normal{ glm::cross(b - a, c - a) };
+      r32 const length{ glm::length(normal) };
+      if (length > 0.0f)
+      {
+        normals.emplace_back(normal / length);
+        axis += normals.back();
+      }
+    }
+    VkMeshlet meshlet{ { center.x, center.y, center.z }, radius };
+    meshlet.mFirstIndex = firstTriangle * 3;
+    meshlet.mIndexCount = (endTriangle - firstTriangle) * 3;
+    meshlet.mCutoff = 1.0f;
+    r32 const length{ glm::length(axis) };
+    if (!cones || length == 0.0f)
+    {
+      return meshlet;
+    }
+    axis /= length;
+    std::memcpy(meshlet.mAxis, &axis.x, sizeof(meshlet.mAxis));
+    r32 spread{ 1.0f };
+    for (auto const& normal : normals)
+    {
+      spread = std::min(spread, glm::dot(axis, normal));
+    }
+    // Cones close to a half space would hardly ever cull
+    if (spread > 0.1f)
+    {
+      meshlet.mCutoff = std::sqrt(1.0f - spread * spread);
+    }
+    return meshlet;
+  }
+
+  /*
+  * Quadrics.
+  */
+
+  // Squared distances to a set of planes weighted by the area they came from
+  struct Quadric
+  {
+    r64 mA[6]  {};
+    r64 mB[3]  {};
+    r64 mC     {};
+    r64 mWeight{};
+
+    // Plane of a triangle, degenerate triangles weigh nothing
+    static Quadric From(r32v3 const& a, r32v3 const& b, r32v3 const& c)
+    {
+      r32v3 const cross{ glm::cross(b - a, c - a) };
+      r64 const length{ glm::length(cross) };
+      Quadric quadric{};
+      if (length <= 0.0)
+      {
+        return quadric;
+      }
+      r64 const x{ cross.x / length };
+      r64 const y{ cross.y / length };
+      r64 const z{ cross.z / length };
+      r64 const d{ -(x * a.x + y * a.y + z * a.z) };
+      r64 const weight{ length * 0.5 };
+      quadric.mA[0] = weight * x * x;
+      quadric.mA[1] = weight * x * y;
+      quadric.mA[2] = weight * x * z;
+      quadric.mA[3] = weight * y * y;
+      quadric.mA[4] = weight * y * z;
+      quadric.mA[5] = weight * z * z;
+      quadric.mB[0] = weight * x * d;
+      quadric.mB[1] = weight * y * d;
+      quadric.mB[2] = weight * z * d;
+      quadric.mC = weight * d * d;
+      quadric.mWeight = weight;
+      return quadric;
+    }
+
+    Quadric& operator += (Quadric const& quadric)
+    {
+      for (u32 i{}; i < 6; ++i) mA[i] += quadric.mA[i];
+      for (u32 i{}; i < 3; ++i) mB[i] += quadric.mB[i];
+      mC += quadric.mC;
+      mWeight += quadric.mWeight;
+      return *this;
+    }
+
+    // Mean squared distance of a point to the planes
+    r64 Evaluate(r32v3 const& point) const
+    {
+      if (mWeight <= 0.0)
+      {
+        return 0.0;
+      }
+      r64 const x{ point.x };
+      r64 const y{ point.y };
+      r64 const z{ point.z };
+      r64 const distance
+      {
+        mA[0] * x * x + mA[3] * y * y + mA[5] * z * z + 2.0 * (mA[1] * x * y + mA[2] * x * z + mA[4] * y * z) +
+        2.0 * (mB[0] * x + mB[1] * y + mB[2] * z) + mC
+      };
+      return std::max(distance, 0.0) / mWeight;
+    }
+  };
+
+  struct Collapse
+  {
+    u32 mSource{};
+    u32 mTarget{};
+    r64 mError {};
+  };
+}
+
+/*
+* Analysis.
+*/
+
+VkMeshOptimizer::Statistics VkMeshOptimizer::AnalyzeVertexCache(u32 const* pIndices, u32 indexCount, u32 vertexCount, u32 cacheSize)
+{
+  // A vertex hits while fewer than cache size misses happened since it was loaded
+  std::vector<u32> stamps(vertexCount);
+  std::vector<u8> referenced(vertexCount);
+  u32 time{ cacheSize + 1 };
+  u64 misses{};
+  for (u32 i{}; i < indexCount; ++i)
+  {
+    u32 const vertex{ pIndices[i] };
+    referenced[vertex] = 1;
+    if (time - stamps[vertex] > cacheSize)
+    {
+      stamps[vertex] = time++;
+      misses++;
+    }
+  }
+  u64 const unique{ (u64)std::count(referenced.begin(), referenced.end(), 1) };
+  Statistics statistics{};
+  statistics.mAcmr = indexCount >= 3 ? (r32)misses / (r32)(indexCount / 3) : 0.0f;
+  statistics.mAtvr = unique ? (r32)misses / (r32)unique : 0.0f;
+  return statistics;
+}
+u32 VkMeshOptimizer::Closed(u32 const* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount)
+{
+  if (indexCount < 3)
+  {
+    return 0;
+  }
+  std::vector<u32> const canonical{ Canonical(pPositions, stride, vertexCount) };
+  // Every directed edge has to be cancelled by an opposing one
+  std::unordered_map<u64, s32> balances{};
+  for (u32 i{}; i + 2 < indexCount; i += 3)
+  {
+    for (u32 j{}; j < 3; ++j)
+    {
+      u32 const a{ canonical[pIndices[i + j]] };
+      u32 const b{ canonical[pIndices[i + (j + 1) % 3]] };
+      if (a != b)
+      {
+        balances[((u64)std::min(a, b) << 32) | std::max(a, b)] += a < b ? 1 : -1;
+      }
+    }
+  }
+  return std::all_of(balances.begin(), balances.end(), [](auto const& balance) { return balance.second == 0; });
+}
+
+/*
+* Passes.
+*/
+
+void VkMeshOptimizer::OptimizeVertexCache(u32* pIndices, u32 indexCount, u32 vertexCount)
+{
+  u32 const triangleCount{ indexCount / 3 };
+  if (!triangleCount)
+  {
+    return;
+  }
+  // Triangles around every vertex, the live ones are kept at the front of each range
+  std::vector<u32> offsets(vertexCount + 1);
+  for (u32 i{}; i < triangleCount * 3; ++i)
+  {
+    offsets[pIndices[i] + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<u32> live(vertexCount);
+  std::vector<u32> adjacency(triangleCount * 3);
+  for (u32 i{}; i < triangleCount * 3; ++i)
+  {
+    adjacency[offsets[pIndices[i]] + live[pIndices[i]]++] = i / 3;
+  }
+  std::vector<s32> positions(vertexCount, -1);
+  std::vector<r32> vertexScores(vertexCount);
+  for (u32 vertex{}; vertex < vertexCount; ++vertex)
+  {
+    vertexScores[vertex] = VertexScore(-1, live[vertex]);
+  }
+  std::vector<r32> triangleScores(triangleCount);
+  for (u32 t{}; t < triangleCount; ++t)
+  {
+    triangleScores[t] = vertexScores[pIndices[t * 3]] + vertexScores[pIndices[t * 3 + 1]] + vertexScores[pIndices[t * 3 + 2]];
+  }
+  std::vector<u8> emitted(triangleCount);
+  std::vector<u32> output(triangleCount * 3);
+  std::array<u32, VK_OPTIMIZER_CACHE + 3> cache{};
+  std::array<u32, VK_OPTIMIZER_CACHE + 3> next{};
+  u32 cacheCount{};
+  u32 best{ (u32)(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin()) };
+  u32 cursor{};
+  for (u32 out{}; out < triangleCount; ++out)
+  {
+    if (best == ~0u)
+    {
+      // Dead end, no cached vertex has triangles left so the walk restarts at the oldest triangle
+      while (emitted[cursor])
+      {
+        cursor++;
+      }
+      best = cursor;
+    }
+    u32 const* pTriangle{ pIndices + best * 3 };
+    std::memcpy(output.data() + out * 3, pTriangle, sizeof(u32) * 3);
+    emitted[best] = 1;
+    // The emitted triangle leaves the live ranges of its vertices
+    for (u32 c{}; c < 3; ++c)
+    {
+      u32* const pBegin{ adjacency.data() + offsets[pTriangle[c]] };
+      u32* const pLast{ pBegin + --live[pTriangle[c]] };
+      *std::find(pBegin, pLast, best) = *pLast;
+    }
+    // Its vertices move to the front of the LRU cache, the others keep their order
+    u32 nextCount{};
+    for (u32 c{}; c < 3; ++c)
+    {
+      if (std::find(next.begin(), next.begin() + nextCount, pTriangle[c]) == next.begin() + nextCount)
+      {
+        next[nextCount++] = pTriangle[c];
+      }
+    }
+    for (u32 i{}; i < cacheCount; ++i)
+    {
+      if (cache[i] != pTriangle[0] && cache[i] != pTriangle[1] && cache[i] != pTriangle[2])
+      {
+        next[nextCount++] = cache[i];
+      }
+    }
+    // Vertices pushed out of the cache get rescored as well, they just lost their cache bonus
+    for (u32 i{}; i < nextCount; ++i)
+    {
+      positions[next[i]] = i < VK_OPTIMIZER_CACHE ? (s32)i : -1;
+      vertexScores[next[i]] = VertexScore(positions[next[i]], live[next[i]]);
+    }
+    best = ~0u;
+    r32 bestScore{ -1.0f };
+    for (u32 i{}; i < nextCount; ++i)
+    {
+      for (u32 j{ offsets[next[i]] }; j < offsets[next[i]] + live[next[i]]; ++j)
+      {
+        u32 const t{ adjacency[j] };
+        triangleScores[t] = vertexScores[pIndices[t * 3]] + vertexScores[pIndices[t * 3 + 1]] + vertexScores[pIndices[t * 3 + 2]];
+        if (triangleScores[t] > bestScore)
+        {
+          bestScore = triangleScores[t];
+          best = t;
+        }
+      }
+    }
+    cacheCount = std::min(nextCount, VK_OPTIMIZER_CACHE);
+    std::copy(next.begin(), next.begin() + cacheCount, cache.begin());
+  }
+  std::copy(output.begin(), output.end(), pIndices);
+}
+void VkMeshOptimizer::OptimizeOverdraw(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, r32 threshold)
+{
+  u32 const triangleCount{ indexCount / 3 };
+  if (triangleCount < 2)
+  {
+    return;
+  }
+  // FIFO cache through timestamps, advancing the time by the cache size flushes it
+  std::vector<u32> stamps(vertexCount);
+  u32 time{ VK_OPTIMIZER_FIFO + 1 };
+  auto const misses{ [&](u32 t)
+  {
+    u32 count{};
+    for (u32 c{}; c < 3; ++c)
+    {
+      u32 const vertex{ pIndices[t * 3 + c] };
+      if (time - stamps[vertex] > VK_OPTIMIZER_FIFO)
+      {
+        stamps[vertex] = time++;
+        count++;
+      }
+    }
+    return count;
+  } };
+  auto const flush{ [&]() { time += VK_OPTIMIZER_FIFO + 1; } };
+  // Hard boundaries sit where the cache optimized order starts over from nothing
+  std::vector<u32> hard{ 0 };
+  for (u32 t{}; t < triangleCount; ++t)
+  {
+    if (misses(t) == 3 && t)
+    {
+      hard.emplace_back(t);
+    }
+  }
+  hard.emplace_back(triangleCount);
+  // Soft boundaries split hard clusters as soon as their miss rate is within the threshold of the whole cluster
+  std::vector<u32> clusters{};
+  for (u32 h{}; h + 1 < (u32)hard.size(); ++h)
+  {
+    flush();
+    u32 total{};
+    for (u32 t{ hard[h] }; t < hard[h + 1]; ++t)
+    {
+      total += misses(t);
+    }
+    r32 const limit{ threshold * (r32)total / (r32)(hard[h + 1] - hard[h]) };
+    flush();
+    clusters.emplace_back(hard[h]);
+    u32 clusterMisses{};
+    u32 clusterSize{};
+    for (u32 t{ hard[h] }; t < hard[h + 1]; ++t)
+    {
+      clusterMisses += misses(t);
+      clusterSize++;
+      if (t + 1 < hard[h + 1] && (r32)clusterMisses <= limit * (r32)clusterSize)
+      {
+        clusters.emplace_back(t + 1);
+        flush();
+        clusterMisses = 0;
+        clusterSize = 0;
+      }
+    }
+  }
+  clusters.emplace_back(triangleCount);
+  // Area weighted centroid and normal of every cluster, sorted by how far they face out of the mesh
+  u32 const clusterCount{ (u32)clusters.size() - 1 };
+  std::vector<r32v3> centroids(clusterCount);
+  std::vector<r32v3> normals(clusterCount);
+  r32v3 meshCentroid{};
+  r32 meshArea{};
+  for (u32 k{}; k < clusterCount; ++k)
+  {
+    r32 area{};
+    for (u32 t{ clusters[k] }; t < clusters[k + 1]; ++t)
+    {
+      r32v3 const a{ Position(pPositions, stride, pIndices[t * 3]) };
+      r32v3 const b{ Position(pPositions, stride, pIndices[t * 3 + 1]) };
+      r32v3 const c{ Position(pPositions, stride, pIndices[t * 3 + 2]) };
+      r32v3 const normal{ glm::cross(b - a, c - a) };
+      r32 const weight{ glm::length(normal) };
+      centroids[k] += (a + b + c) * (weight / 3.0f);
+      normals[k] += normal;
+      area += weight;
+    }
+    meshCentroid += centroids[k];
+    meshArea += area;
+    centroids[k] = area > 0.0f ? centroids[k] / area : r32v3{};
+  }
+  meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : r32v3{};
+  std::vector<r32> keys(clusterCount);
+  for (u32 k{}; k < clusterCount; ++k)
+  {
+    r32 const length{ glm::length(normals[k]) };
+    keys[k] = length > 0.0f ? glm::dot(centroids[k] - meshCentroid, normals[k] / length) : 0.0f;
+  }
+  std::vector<u32> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(), [&](u32 a, u32 b) { return keys[a] > keys[b]; });
+  std::vector<u32> output{};
+  output.reserve(triangleCount * 3);
+  for (u32 const k : order)
+  {
+    output.insert(output.end(), pIndices + clusters[k] * 3, pIndices + clusters[k + 1] * 3);
+  }
+  std::copy(output.begin(), output.end(), pIndices);
+}
+u32 VkMeshOptimizer::OptimizeVertexFetch(u32* pIndices, u32 indexCount, u32 vertexCount, u32* pRemap)
+{
+  std::fill(pRemap, pRemap + vertexCount, ~0u);
+  u32 next{};
+  for (u32 i{}; i < indexCount; ++i)
+  {
+    u32& remap{ pRemap[pIndices[i]] };
+    if (remap == ~0u)
+    {
+      remap = next++;
+    }
+    pIndices[i] = remap;
+  }
+  return next;
+}
+void VkMeshOptimizer::BuildMeshlets(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, u32 cones, std::vector<VkMeshlet>& meshlets)
+{
+  u32 const triangleCount{ indexCount / 3 };
+  if (!triangleCount)
+  {
+    return;
+  }
+  // Triangles around every vertex, the unit normal and the centroid of every triangle
+  std::vector<u32> offsets(vertexCount + 1);
+  for (u32 i{}; i < triangleCount * 3; ++i)
+  {
+    offsets[pIndices[i] + 1]++;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<u32> fill(offsets.begin(), offsets.end() - 1);
+  std::vector<u32> adjacency(triangleCount * 3);
+  std::vector<r32v3> normals(triangleCount);
+  std::vector<r32v3> centroids(triangleCount);
+  for (u32 t{}; t < triangleCount; ++t)
+  {
+    for (u32 c{}; c < 3; ++c)
+    {
+      adjacency[fill[pIndices[t * 3 + c]]++] = t;
+    }
+    r32v3 const a{ Position(pPositions, stride, pIndices[t * 3]) };
+    r32v3 const normal{ glm::cross(Position(pPositions, stride, pIndices[t * 3 + 1]) - a, Position(pPositions, stride, pIndices[t * 3 + 2]) - a) };
+    r32 const length{ glm::length(normal) };
+    normals[t] = length > 0.0f ? normal / length : r32v3{};
+    centroids[t] = (a + Position(pPositions, stride, pIndices[t * 3 + 1]) + Position(pPositions, stride, pIndices[t * 3 + 2])) / 3.0f;
+  }
+  // Meshlets grow from the oldest triangle left over neighbours which add the fewest vertices, bend the cone the least and stay compact
+  std::vector<u32> marks(vertexCount, ~0u);
+  std::vector<u32> live(vertexCount);
+  for (u32 vertex{}; vertex < vertexCount; ++vertex)
+  {
+    live[vertex] = offsets[vertex + 1] - offsets[vertex];
+  }
+  std::vector<u8> emitted(triangleCount);
+  std::vector<u32> output{};
+  output.reserve(triangleCount * 3);
+  std::vector<u32> vertices{};
+  u32 meshlet{};
+  u32 cursor{};
+  auto const fresh{ [&](u32 t)
+  {
+    u32 const* pTriangle{ pIndices + t * 3 };
+    u32 count{};
+    for (u32 c{}; c < 3; ++c)
+    {
+      count += marks[pTriangle[c]] != meshlet && (c < 1 || pTriangle[c] != pTriangle[0]) && (c < 2 || pTriangle[c] != pTriangle[1]);
+    }
+    return count;
+  } };
+  while (output.size() < triangleCount * 3)
+  {
+    while (emitted[cursor])
+    {
+      cursor++;
+    }
+    u32 const first{ (u32)output.size() / 3 };
+    vertices.clear();
+    r32v3 axis{};
+    r32v3 center{};
+    r32 extent{};
+    for (u32 next{ cursor }; next != ~0u;)
+    {
+      u32 const* pTriangle{ pIndices + next * 3 };
+      for (u32 c{}; c < 3; ++c)
+      {
+        if (marks[pTriangle[c]] != meshlet)
+        {
+          marks[pTriangle[c]] = meshlet;
+          vertices.emplace_back(pTriangle[c]);
+        }
+        live[pTriangle[c]]--;
+      }
+      output.insert(output.end(), pTriangle, pTriangle + 3);
+      emitted[next] = 1;
+      axis += normals[next];
+      u32 const triangles{ (u32)output.size() / 3 - first };
+      center += (centroids[next] - center) / (r32)triangles;
+      extent = std::max(extent, glm::length(centroids[next] - center));
+      if (triangles == VK_MESHLET_TRIANGLES)
+      {
+        break;
+      }
+      r32v3 const direction{ glm::length(axis) > 0.0f ? glm::normalize(axis) : axis };
+      next = ~0u;
+      r32 bestScore{ std::numeric_limits<r32>::max() };
+      for (u32 const vertex : vertices)
+      {
+        for (u32 j{ offsets[vertex] }; j < offsets[vertex + 1]; ++j)
+        {
+          u32 const t{ adjacency[j] };
+          u32 const count{ emitted[t] ? 0 : fresh(t) };
+          if (emitted[t] || vertices.size() + count > VK_MESHLET_VERTICES)
+          {
+            continue;
+          }
+          // Triangles which are the last one of a vertex count as free, left behind they would end up in a meshlet of their own
+          u32 const* pCandidate{ pIndices + t * 3 };
+          u32 const last{ live[pCandidate[0]] == 1 || live[pCandidate[1]] == 1 || live[pCandidate[2]] == 1 };
+          r32 const spread{ extent > 0.0f ? glm::length(centroids[t] - center) / extent : 0.0f };
+          r32 const score{ (r32)(last ? 0 : count) + 1.0f - glm::dot(direction, normals[t]) + 0.5f * spread };
+          if (score < bestScore)
+          {
+            bestScore = score;
+            next = t;
+          }
+        }
+      }
+    }
+    // Growing by normals breaks up the cache order, it gets restored within the meshlet on local vertex numbers
+    u32* const pMeshlet{ output.data() + first * 3 };
+    u32 const indices{ (u32)output.size() - first * 3 };
+    for (u32 i{}; i < indices; ++i)
+    {
+      pMeshlet[i] = (u32)(std::find(vertices.begin(), vertices.end(), pMeshlet[i]) - vertices.begin());
+    }
+    OptimizeVertexCache(pMeshlet, indices, (u32)vertices.size());
+    for (u32 i{}; i < indices; ++i)
+    {
+      pMeshlet[i] = vertices[pMeshlet[i]];
+    }
+    meshlets.emplace_back(Bound(output.data(), first, (u32)output.size() / 3, pPositions, stride, cones));
+    meshlet++;
+  }
+  std::copy(output.begin(), output.end(), pIndices);
+}
+
+/*
+* Simplification.
+*/
+
+u32 VkMeshOptimizer::Simplify(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, u32 targetIndexCount, r32 targetError, r32& error)
+{
+  error = 0.0f;
+  u32 count{ indexCount / 3 * 3 };
+  if (count <= targetIndexCount)
+  {
+    return count;
+  }
+  // Seams, borders and non manifold edges stay in place, moving them would open cracks
+  std::vector<u32> const canonical{ Canonical(pPositions, stride, vertexCount) };
+  std::vector<u8> locked(vertexCount);
+  for (u32 vertex{}; vertex < vertexCount; ++vertex)
+  {
+    if (canonical[vertex] != vertex)
+    {
+      locked[vertex] = 1;
+      locked[canonical[vertex]] = 1;
+    }
+  }
+  std::unordered_map<u64, std::pair<s32, u32>> edges{};
+  for (u32 i{}; i < count; i += 3)
+  {
+    for (u32 j{}; j < 3; ++j)
+    {
+      u32 const a{ canonical[pIndices[i + j]] };
+      u32 const b{ canonical[pIndices[i + (j + 1) % 3]] };
+      if (a != b)
+      {
+        auto& edge{ edges[((u64)std::min(a, b) << 32) | std::max(a, b)] };
+        edge.first += a < b ? 1 : -1;
+        edge.second++;
+      }
+    }
+  }
+  for (auto const& [key, edge] : edges)
+  {
+    if (edge.first || edge.second != 2)
+    {
+      locked[(u32)(key >> 32)] = 1;
+      locked[(u32)key] = 1;
+    }
+  }
+  std::vector<Quadric> quadrics(vertexCount);
+  for (u32 i{}; i < count; i += 3)
+  {
+    Quadric const quadric{ Quadric::From(Position(pPositions, stride, pIndices[i]), Position(pPositions, stride, pIndices[i + 1]), Position(pPositions, stride, pIndices[i + 2])) };
+    for (u32 j{}; j < 3; ++j)
+    {
+      quadrics[canonical[pIndices[i + j]]] += quadric;
+    }
+  }
+  // Every pass collapses the cheapest edges whose neighbourhoods do not overlap
+  r64 const limit{ (r64)targetError * targetError };
+  r64 worst{};
+  std::vector<u32> offsets{};
+  std::vector<u32> cursors{};
+  std::vector<u32> adjacency{};
+  std::vector<u32> remap(vertexCount);
+  std::vector<u8> touched(vertexCount);
+  std::vector<Collapse> collapses{};
+  while (count > targetIndexCount)
+  {
+    offsets.assign(vertexCount + 1, 0);
+    for (u32 i{}; i < count; ++i)
+    {
+      offsets[canonical[pIndices[i]] + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    cursors.assign(offsets.begin(), offsets.end() - 1);
+    adjacency.resize(count);
+    for (u32 i{}; i < count; ++i)
+    {
+      adjacency[cursors[canonical[pIndices[i]]]++] = i / 3;
+    }
+    // Interior edges are visited once from the side running up in canonical order
+    collapses.clear();
+    for (u32 i{}; i < count; i += 3)
+    {
+      for (u32 j{}; j < 3; ++j)
+      {
+        u32 const a{ pIndices[i + j] };
+        u32 const b{ pIndices[i + (j + 1) % 3] };
+        if (canonical[a] >= canonical[b] || (locked[a] && locked[b]))
+        {
+          continue;
+        }
+        Quadric quadric{ quadrics[canonical[a]] };
+        quadric += quadrics[canonical[b]];
+        if (!locked[a])
+        {
+          collapses.emplace_back(Collapse{ a, b, quadric.Evaluate(Position(pPositions, stride, b)) });
+        }
+        if (!locked[b])
+        {
+          collapses.emplace_back(Collapse{ b, a, quadric.Evaluate(Position(pPositions, stride, a)) });
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](Collapse const& a, Collapse const& b) { return a.mError < b.mError; });
+    // Moving the source must not turn any of its remaining triangles over
+    auto const flips{ [&](u32 source, u32 target)
+    {
+      r32v3 const to{ Position(pPositions, stride, target) };
+      for (u32 k{ offsets[source] }; k < offsets[source + 1]; ++k)
+      {
+        u32 const* pTriangle{ pIndices + adjacency[k] * 3 };
+        if (canonical[pTriangle[0]] == canonical[target] || canonical[pTriangle[1]] == canonical[target] || canonical[pTriangle[2]] == canonical[target])
+        {
+          continue;
+        }
+        r32v3 before[3]{};
+        r32v3 after[3]{};
+        for (u32 j{}; j < 3; ++j)
+        {
+          before[j] = Position(pPositions, stride, pTriangle[j]);
+          after[j] = pTriangle[j] == source ? to : before[j];
+        }
+        r32v3 const normalBefore{ glm::cross(before[1] - before[0], before[2] - before[0]) };
+        r32v3 const normalAfter{ glm::cross(after[1] - after[0], after[2] - after[0]) };
+        if (glm::dot(normalBefore, normalAfter) <= 0.2f * glm::length(normalBefore) * glm::length(normalAfter))
+        {
+          return 1;
+        }
+      }
+      return 0;
+    } };
+    // Every collapse removes about two triangles, a pass stops short of the target
+    u32 const budget{ (count - targetIndexCount) / 6 + 1 };
+    u32 collapsed{};
+    std::iota(remap.begin(), remap.end(), 0u);
+    std::fill(touched.begin(), touched.end(), 0);
+    for (Collapse const& collapse : collapses)
+    {
+      if (collapsed == budget || collapse.mError > limit)
+      {
+        break;
+      }
+      u32 const source{ collapse.mSource };
+      u32 const target{ canonical[collapse.mTarget] };
+      if (touched[source] || touched[target] || flips(source, collapse.mTarget))
+      {
+        continue;
+      }
+      for (u32 k{ offsets[source] }; k < offsets[source + 1]; ++k)
+      {
+        u32 const* pTriangle{ pIndices + adjacency[k] * 3 };
+        touched[canonical[pTriangle[0]]] = touched[canonical[pTriangle[1]]] = touched[canonical[pTriangle[2]]] = 1;
+      }
+      // Unlocked vertices are their own canonical vertex, the target keeps the attributes it has along the edge
+      remap[source] = collapse.mTarget;
+      quadrics[target] += quadrics[source];
+      worst = std::max(worst, collapse.mError);
+      collapsed++;
+    }
+    if (!collapsed)
+    {
+      break;
+    }
+    // Triangles which lost an edge drop out
+    u32 kept{};
+    for (u32 i{}; i < count; i += 3)
+    {
+      u32 const a{ remap[pIndices[i]] };
+      u32 const b{ remap[pIndices[i + 1]] };
+      u32 const c{ remap[pIndices[i + 2]] };
+      if (canonical[a] != canonical[b] && canonical[b] != canonical[c] && canonical[c] != canonical[a])
+      {
+        pIndices[kept++] = a;
+        pIndices[kept++] = b;
+        pIndices[kept++] = c;
+      }
+    }
+    count = kept;
+  }
+  error = (r32)std::sqrt(worst);
+  return count;
+}
+void VkMeshOptimizer::BuildLods(std::vector<u32>& indices, r32 const* pPositions, u32 stride, u32 vertexCount, std::vector<VkMeshLod>& lods)
+{
+  u32 const indexCount{ (u32)indices.size() / 3 * 3 };
+  if (!indexCount)
+  {
+    return;
+  }
+  r32v3 min{ std::numeric_limits<r32>::max() };
+  r32v3 max{ std::numeric_limits<r32>::lowest() };
+  for (u32 i{}; i < indexCount; ++i)
+  {
+    r32v3 const position{ Position(pPositions, stride, indices[i]) };
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+  }
+  r32 const extent{ glm::length(max - min) * 0.5f };
+  std::vector<VkMeshLod> chain{ VkMeshLod{ 0, indexCount } };
+  std::vector<u32> level(indices.begin(), indices.begin() + indexCount);
+  r32 error{};
+  while (chain.size() < VK_OPTIMIZER_LODS)
+  {
+    u32 const previous{ (u32)level.size() };
+    u32 const target{ (u32)((r32)previous * VK_OPTIMIZER_LOD_RATIO) / 3 * 3 };
+    r32 step{};
+    u32 const count{ Simplify(level.data(), previous, pPositions, stride, vertexCount, target, VK_OPTIMIZER_LOD_ERROR * extent, step) };
+    // Levels which barely shrink are not worth their indices
+    if (!count || (r32)count > (r32)previous * VK_OPTIMIZER_LOD_STALL)
+    {
+      break;
+    }
+    level.resize(count);
+    OptimizeVertexCache(level.data(), count, vertexCount);
+    error += step;
+    chain.emplace_back(VkMeshLod{ (u32)indices.size(), count, error });
+    indices.insert(indices.end(), level.begin(), level.end());
+  }
+  if (chain.size() > 1)
+  {
+    lods.insert(lods.end(), chain.begin(), chain.end());
+  }
+}
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef VK_MESH_OPTIMIZER
+#define VK_MESH_OPTIMIZER
+
+/*
+* Offline mesh optimization.
+*
+* Optimization structure:
+* ---Indices------------------Clusters--------------------Meshlets----------------Vertices---------
+*    |                        |                           |                       |
+*    Vertex cache order --> [C0 | C1 | C2] sorted out --> [T <= 124, V <= 64] --> First use order
+*    (Forsyth)               to in by facing               + sphere + cone         (remap)
+*
+* Triangles are first reordered so the post transform cache of the device hits
+* as often as possible, the greedy scoring of Forsyth walks the mesh along the
+* vertices currently held by a simulated LRU cache. The cache ordered triangles
+* are then cut into clusters wherever the cache gets flushed anyway or the miss
+* rate of a cluster stays within a threshold of the whole, clusters facing away
+* from the center get drawn first so outer surfaces occlude the inner ones
+* early.
+*
+* Meshlets grow from the oldest triangle left in that order over neighbouring
+* triangles which add the fewest vertices, deviate the least from the mean
+* normal and stay close to the center, until a vertex or triangle limit is hit.
+* Triangles which are the last one around a vertex are taken first, left behind
+* they would end up in slivers of their own. Triangles get rewritten in
+* meshlet order so every meshlet is a contiguous run of indices, the cache order
+* is restored within each of them. Every meshlet carries a bounding sphere and
+* a cone holding all of its triangle normals. Cones are only emitted for closed
+* meshes, the back faces of open meshes may be seen and must not be culled.
+* Vertices are renumbered last in the order the indices first touch them, the
+* vertex fetch walks memory front to back and unreferenced vertices drop out.
+*
+* Coarser levels of detail come from collapsing edges of the full mesh into one
+* of their endpoints, so every level reuses the vertices of the mesh and only
+* brings its own indices. Every vertex accumulates the area weighted planes of
+* the triangles it has absorbed, the cheapest collapses by that quadric error
+* go first. Vertices on borders, attribute seams and non manifold edges never
+* move and collapses which would turn a triangle over are skipped. The error
+* of a level is the root of the worst collapse it took, in position units.
+* Chains halve the previous level until VK_OPTIMIZER_LODS levels exist, a step
+* hits VK_OPTIMIZER_LOD_ERROR of the mesh extent or barely shrinks anymore.
+* The errors of the steps add up, every level keeps a bound against the full
+* mesh.
+*/
+
+#include "VkCore.h"
+#include "VkMesh.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u32 VK_OPTIMIZER_CACHE    { 32 };
+constexpr u32 VK_OPTIMIZER_FIFO     { 16 };
+constexpr r32 VK_OPTIMIZER_OVERDRAW { 1.05f };
+constexpr u32 VK_OPTIMIZER_LODS     { 5 };
+constexpr r32 VK_OPTIMIZER_LOD_RATIO{ 0.5f };
+constexpr r32 VK_OPTIMIZER_LOD_STALL{ 0.85f };
+constexpr r32 VK_OPTIMIZER_LOD_ERROR{ 0.1f };
+
+namespace VkMeshOptimizer
+{
+  /*
+  * Analysis.
+  */
+
+  struct Statistics
+  {
+    // Transformed vertices per triangle, 0.5 is ideal for regular grids and 3 the worst
+    r32 mAcmr{};
+    // Transformed vertices per referenced vertex, 1 is ideal
+    r32 mAtvr{};
+  };
+
+  // Simulates a FIFO post transform cache of the given size
+  Statistics AnalyzeVertexCache(u32 const* pIndices, u32 indexCount, u32 vertexCount, u32 cacheSize = VK_OPTIMIZER_FIFO);
+  // Whether every edge is shared by exactly one opposing edge, vertices at the same position count as one
+  u32        Closed(u32 const* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount);
+
+  /*
+  * Passes.
+  */
+
+  // Reorders triangles for vertex locality in place
+  void OptimizeVertexCache(u32* pIndices, u32 indexCount, u32 vertexCount);
+  // Reorders cache optimized clusters front to back in place, the threshold bounds the loss in cache hits
+  void OptimizeOverdraw(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, r32 threshold = VK_OPTIMIZER_OVERDRAW);
+  // Renumbers vertices by first use, fills remap[old] with the new vertex or ~0u and returns the vertex count
+  u32  OptimizeVertexFetch(u32* pIndices, u32 indexCount, u32 vertexCount, u32* pRemap);
+  // Reorders triangles into meshlets in place and appends them, positions are read through the stride in bytes
+  void BuildMeshlets(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, u32 cones, std::vector<VkMeshlet>& meshlets);
+
+  /*
+  * Simplification.
+  */
+
+  // Collapses edges in place until the index target or the error limit is reached, returns the index count and the error taken
+  u32  Simplify(u32* pIndices, u32 indexCount, r32 const* pPositions, u32 stride, u32 vertexCount, u32 targetIndexCount, r32 targetError, r32& error);
+  // Appends the indices of coarser levels behind the full mesh and all levels including the full one, nothing if it does not simplify
+  void BuildLods(std::vector<u32>& indices, r32 const* pPositions, u32 stride, u32 vertexCount, std::vector<VkMeshLod>& lods);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,157 @@
+#ifndef VK_PHYSICS
+#define VK_PHYSICS
+
+/*
+* Fixed step rigidbody simulation.
+*
+* Clock structure:
+* ---F0----------F1----------F2--------
+*    |           |           |
+*    [S, S, S]   [S]         [S, S, ..., MAX_SUBSTEPS] --> Drop
+*             ^Alpha      ^Alpha
+*
+* Frame time feeds an accumulator that is drained in fixed steps, at most
+* MAX_SUBSTEPS per frame so a spike cannot snowball into ever longer frames,
+* surplus time gets dropped instead. Every step integrates velocity under
+* gravity before position (semi-implicit Euler) and remembers the position it
+* started from. Rendering blends both positions by the fraction of a step that
+* remains in the accumulator. Bodies have no previous position until their
+* first step seeds it from the Transform, frames before that render them in
+* place.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkSimd.h"
+#include "VkTransform.h"
+
+namespace VkPhysics
+{
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 MAX_SUBSTEPS    { 8 };
+  constexpr u32 RIGIDBODY_STRIDE{ sizeof(acs::Rigidbody) / sizeof(r32) };
+
+  static_assert(sizeof(acs::Rigidbody) == sizeof(r32) * 7, "Rigidbody has to consist of seven packed floats");
+
+  /*
+  * Fixed step clock.
+  */
+
+  class Clock
+  {
+  public:
+    Clock(r32 step, u32 maxSubsteps = MAX_SUBSTEPS) : mStep{ step }, mMaxSubsteps{ maxSubsteps } {}
+
+  public:
+    __forceinline void Advance(r32 delta) noexcept
+    {
+      mAccumulator += delta;
+      mSubsteps = 0;
+    }
+    // Takes one step out of the accumulator, drops the surplus once the cap is hit
+    __forceinline u32 Consume() noexcept
+    {
+      if (mAccumulator < mStep) return 0;
+      if (mSubsteps == mMaxSubsteps)
+      {
+        mDropped += mAccumulator - std::fmod(mAccumulator, mStep);
+        mAccumulator = std::fmod(mAccumulator, mStep);
+        return 0;
+      }
+      mAccumulator -= mStep;
+      mTime += mStep;
+      mSubsteps++;
+      return 1;
+    }
+    __forceinline r32 Step()    const noexcept { return mStep; }
+    __forceinline r32 Time()    const noexcept { return mTime; }
+    __forceinline r32 Dropped() const noexcept { return mDropped; }
+    __forceinline r32 Alpha()   const noexcept { return mAccumulator / mStep; }
+
+  private:
+    r32 mStep       {};
+    u32 mMaxSubsteps{};
+    u32 mSubsteps   {};
+    r32 mAccumulator{};
+    r32 mTime       {};
+    r32 mDropped    {};
+  };
+
+  /*
+  * Kernels.
+  */
+
+  template<typename V>
+  __forceinline void IntegrateEuler(acs::Transform* pTransforms, acs::Rigidbody* pRigidbodies, V step) noexcept
+  {
+    r32* pPosition{ &pTransforms->mPosition.x };
+    r32* pBody{ &pRigidbodies->mVelocity.x };
+    V const px{ V::Load(pPosition, VkTransform::TRANSFORM_STRIDE) };
+    V const py{ V::Load(pPosition + 1, VkTransform::TRANSFORM_STRIDE) };
+    V const pz{ V::Load(pPosition + 2, VkTransform::TRANSFORM_STRIDE) };
+    V const vx{ V::Load(pBody, RIGIDBODY_STRIDE) };
+    V const vy{ V::Load(pBody + 1, RIGIDBODY_STRIDE) - V::Load(pBody + 3, RIGIDBODY_STRIDE) * step };
+    V const vz{ V::Load(pBody + 2, RIGIDBODY_STRIDE) };
+    V::Store(pBody, RIGIDBODY_STRIDE, vx, vy, vz);
+    V::Store(pBody + 4, RIGIDBODY_STRIDE, px, py, pz);
+    V::Store(pPosition, VkTransform::TRANSFORM_STRIDE, px + vx * step, py + vy * step, pz + vz * step);
+  }
+  template<typename V>
+  __forceinline void InterpolatePosition(acs::Transform const* pTransforms, acs::Rigidbody const* pRigidbodies, acs::Model* pModels, V alpha) noexcept
+  {
+    r32 const* pPosition{ &pTransforms->mPosition.x };
+    r32 const* pPrev{ &pRigidbodies->mPositionPrev.x };
+    V const prevX{ V::Load(pPrev, RIGIDBODY_STRIDE) };
+    V const prevY{ V::Load(pPrev + 1, RIGIDBODY_STRIDE) };
+    V const prevZ{ V::Load(pPrev + 2, RIGIDBODY_STRIDE) };
+    V const px{ V::Load(pPosition, VkTransform::TRANSFORM_STRIDE) };
+    V const py{ V::Load(pPosition + 1, VkTransform::TRANSFORM_STRIDE) };
+    V const pz{ V::Load(pPosition + 2, VkTransform::TRANSFORM_STRIDE) };
+    // Lanes which did not step yet keep their position
+    V const unstepped{ V::AsFloat(V::IEqual(V::AsInt(prevX), V::ISet(acs::Rigidbody::UNSTEPPED))) };
+    V const x{ (unstepped & px) | V::AndNot(unstepped, prevX + (px - prevX) * alpha) };
+    V const y{ (unstepped & py) | V::AndNot(unstepped, prevY + (py - prevY) * alpha) };
+    V const z{ (unstepped & pz) | V::AndNot(unstepped, prevZ + (pz - prevZ) * alpha) };
+    V::Store(&pModels->mMatrix[3][0], VkTransform::MATRIX_STRIDE, x, y, z);
+  }
+
+  /*
+  * Batch specific routines.
+  */
+
+  __forceinline void Integrate(acs::Transform* pTransforms, acs::Rigidbody* pRigidbodies, u32 count, r32 step) noexcept
+  {
+    VkSimd::Batch(count, [&]<typename V>(u32 i) { IntegrateEuler<V>(pTransforms + i, pRigidbodies + i, V::Set(step)); });
+  }
+  // Overwrites the translation of already composed model matrices
+  __forceinline void Interpolate(acs::Transform const* pTransforms, acs::Rigidbody const* pRigidbodies, acs::Model* pModels, u32 count, r32 alpha) noexcept
+  {
+    VkSimd::Batch(count, [&]<typename V>(u32 i) { InterpolatePosition<V>(pTransforms + i, pRigidbodies + i, pModels + i, V::Set(alpha)); });
+  }
+
+  /*
+  * Actor specific routines.
+  */
+
+  __forceinline void Step(r32 step) noexcept
+  {
+    VkAcs::ParallelBatch<acs::Transform, acs::Rigidbody>([step](u32 count, acs::Transform* pTransforms, acs::Rigidbody* pRigidbodies)
+    {
+      Integrate(pTransforms, pRigidbodies, count, step);
+    });
+  }
+  // Has to run after model matrices were composed for the frame
+  __forceinline void Interpolate(r32 alpha) noexcept
+  {
+    VkAcs::ParallelBatch<acs::Transform const, acs::Rigidbody const, acs::Model>([alpha](u32 count, acs::Transform const* pTransforms, acs::Rigidbody const* pRigidbodies, acs::Model* pModels)
+    {
+      Interpolate(pTransforms, pRigidbodies, pModels, count, alpha);
+    });
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include "VkPipelines.h"
+
+namespace
+{
+  /*
+  * Program descriptions.
+  */
+
+  struct Description
+  {
+    s8 const*           mpName   {};
+    VkPrimitiveTopology mTopology{};
+    VkVertex::Layout    mLayout  {};
+  };
+
+  // Layouts come from reflection, only what the shaders can not tell is described here
+  Description const& Describe(VkShader shader)
+  {
+    static Description const sDescriptions[VK_SHADER_COUNT]
+    {
+      Description{ "lambert", VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VkVertex::Of<VertexLambertCompact>() },
+      Description{ "lambert_instanced", VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VkVertex::Of<VertexLambertCompact>() },
+      Description{ "gizmo", VK_PRIMITIVE_TOPOLOGY_LINE_LIST, VkVertex::Of<VertexGizmo>() },
+    };
+    return sDescriptions[shader];
+  }
+
+  /*
+  * Format classes.
+  */
+
+  enum Numeric
+  {
+    NUMERIC_FLOAT,
+    NUMERIC_SINT,
+    NUMERIC_UINT,
+  };
+
+  // Normalized formats read as floats, an attribute may only feed an input of its own class
+  Numeric NumericOf(VkFormat vkFormat)
+  {
+    switch (vkFormat)
+    {
+      case VK_FORMAT_R32_SINT:
+      case VK_FORMAT_R32G32_SINT:
+      case VK_FORMAT_R32G32B32_SINT:
+      case VK_FORMAT_R32G32B32A32_SINT: return NUMERIC_SINT;
+      case VK_FORMAT_R8G8B8A8_UINT:
+      case VK_FORMAT_R32_UINT:
+      case VK_FORMAT_R32G32_UINT:
+      case VK_FORMAT_R32G32B32_UINT:
+      case VK_FORMAT_R32G32B32A32_UINT: return NUMERIC_UINT;
+      default: return NUMERIC_FLOAT;
+    }
+  }
+}
+
+VkPipelines::VkPipelines(VkDevice vkDevice, VkPhysicalDeviceProperties const& vkPhysicalDeviceProperties, VkRenderPass vkRenderPass, std::string const& cacheFile)
+  : mVkDevice{ vkDevice }
+  , mVkPhysicalDeviceProperties{ vkPhysicalDeviceProperties }
+  , mVkRenderPass{ vkRenderPass }
+  , mCacheFile{ cacheFile }
+{
+  auto const start{ std::chrono::high_resolution_clock::now() };
+  ReflectShaders();
+  LoadCache();
+  CreateLayouts();
+  CreatePrograms();
+  auto const end{ std::chrono::high_resolution_clock::now() };
+  VK_LOG("Pipelines created in %.2fms from a %s cache\n", std::chrono::duration<r64, std::milli>(end - start).count(), mWarm ? "warm" : "cold");
+}
+VkPipelines::~VkPipelines()
+{
+  Save();
+  for (auto const& program : mPrograms)
+  {
+    vkDestroyPipeline(mVkDevice, program.mVkPipeline, nullptr);
+    vkDestroyPipelineLayout(mVkDevice, program.mVkPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(mVkDevice, program.mVkDescriptorSetLayout, nullptr);
+  }
+  vkDestroyPipelineCache(mVkDevice, mVkPipelineCache, nullptr);
+}
+
+void VkPipelines::Save()
+{
+  // Gather cache data
+  size_t dataSize{};
+  VK_VALIDATE(vkGetPipelineCacheData(mVkDevice, mVkPipelineCache, &dataSize, nullptr));
+  std::vector<u8> data(dataSize);
+  VK_VALIDATE(vkGetPipelineCacheData(mVkDevice, mVkPipelineCache, &dataSize, data.data()));
+  data.resize(dataSize);
+  // Nothing got added since the cache was loaded or saved last
+  u64 const dataHash{ VkUtils::Hash(data.data(), data.size()) };
+  if (dataHash == mDataHash)
+  {
+    return;
+  }
+  // Key the blob by device, driver and shaders
+  Header header{};
+  header.mMagic = VK_PIPELINE_CACHE_MAGIC;
+  header.mVersion = VK_PIPELINE_CACHE_VERSION;
+  header.mVendorId = mVkPhysicalDeviceProperties.vendorID;
+  header.mDeviceId = mVkPhysicalDeviceProperties.deviceID;
+  header.mDriverVersion = mVkPhysicalDeviceProperties.driverVersion;
+  std::memcpy(header.mUuid, mVkPhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.mShaderHash = mShaderHash;
+  header.mDataSize = data.size();
+  header.mDataHash = dataHash;
+  // Write next to the destination and swap it in
+  std::filesystem::path const temporary{ mCacheFile.string() + ".tmp" };
+  {
+    std::ofstream stream{ temporary, std::ios::binary | std::ios::trunc };
+    stream.write((s8 const*)&header, sizeof(Header));
+    stream.write((s8 const*)data.data(), (std::streamsize)data.size());
+    if (!stream)
+    {
+      VK_LOG("Pipeline cache %s not writable\n", temporary.string().c_str());
+      return;
+    }
+  }
+  std::error_code error{};
+  std::filesystem::rename(temporary, mCacheFile, error);
+  if (error)
+  {
+    VK_LOG("Pipeline cache %s not replaceable: %s\n", mCacheFile.string().c_str(), error.message().c_str());
+    std::filesystem::remove(temporary, error);
+    return;
+  }
+  mDataHash = dataHash;
+}
+
+std::vector<u8> VkPipelines::Read(std::filesystem::path const& path)
+{
+  std::ifstream stream{ path, std::ios::binary | std::ios::ate };
+  if (!stream)
+  {
+    return {};
+  }
+  std::vector<u8> bytes((u64)stream.tellg());
+  stream.seekg(0);
+  stream.read((s8*)bytes.data(), (std::streamsize)bytes.size());
+  return bytes;
+}
+
+void VkPipelines::ReflectShaders()
+{
+  u64 hash{ VkUtils::Hash(nullptr, 0) };
+  for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+  {
+    Description const& description{ Describe((VkShader)i) };
+    Stages& stages{ mStages[i] };
+    Layout& layout{ mLayouts[i] };
+    stages.mpVertex = VkShaderCode::Find((std::string{ description.mpName } + ".vert").c_str());
+    stages.mpFragment = VkShaderCode::Find((std::string{ description.mpName } + ".frag").c_str());
+    if (!stages.mpVertex || !stages.mpFragment)
+    {
+      VK_LOG("Shader %s is not embedded, rerun the spirv tool\n", description.mpName);
+      std::exit(1);
+    }
+    VkShaderCode::Entry const* pEntries[2]{ stages.mpVertex, stages.mpFragment };
+    VkShaderStageFlagBits const vkStages[2]{ VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    for (u32 j{}; j < 2; ++j)
+    {
+      VkReflection const reflection{ pEntries[j]->mpCode, pEntries[j]->mSize };
+      if (reflection.Error() || reflection.Stage() != vkStages[j])
+      {
+        VK_LOG("Shader %s %s\n", pEntries[j]->mpName, reflection.Error() ? reflection.Error() : "is of another stage");
+        std::exit(1);
+      }
+      // Stages which share a binding have to agree on it
+      for (auto const& binding : reflection.Bindings())
+      {
+        if (binding.mSet)
+        {
+          VK_LOG("Shader %s binds set %u, programs own a single set\n", pEntries[j]->mpName, binding.mSet);
+          std::exit(1);
+        }
+        auto const it{ std::find_if(layout.mBindings.begin(), layout.mBindings.end(), [&](VkDescriptorSetLayoutBinding const& vkBinding) { return vkBinding.binding == binding.mBinding; }) };
+        if (it == layout.mBindings.end())
+        {
+          VkDescriptorSetLayoutBinding vkDescriptorSetLayoutBinding{};
+          vkDescriptorSetLayoutBinding.binding = binding.mBinding;
+          vkDescriptorSetLayoutBinding.descriptorType = binding.mType;
+          vkDescriptorSetLayoutBinding.descriptorCount = binding.mCount;
+          vkDescriptorSetLayoutBinding.stageFlags = vkStages[j];
+          layout.mBindings.emplace_back(vkDescriptorSetLayoutBinding);
+        }
+        else if (it->descriptorType != binding.mType || it->descriptorCount != binding.mCount)
+        {
+          VK_LOG("Shader %s disagrees with its other stage on binding %u\n", pEntries[j]->mpName, binding.mBinding);
+          std::exit(1);
+        }
+        else
+        {
+          it->stageFlags |= vkStages[j];
+        }
+      }
+      if (reflection.PushConstants())
+      {
+        layout.mPushConstants.emplace_back(VkPushConstantRange{ (VkShaderStageFlags)vkStages[j], 0, reflection.PushConstants() });
+      }
+      // Formats and offsets come from the vertex type, every input has to find its attribute there
+      for (auto const& input : reflection.Inputs())
+      {
+        VkVertex::Layout const& vertex{ description.mLayout };
+        auto const it{ std::find_if(vertex.mpDescriptions, vertex.mpDescriptions + vertex.mCount, [&](VkVertexInputAttributeDescription const& vkAttribute) { return vkAttribute.location == input.mLocation; }) };
+        if (it == vertex.mpDescriptions + vertex.mCount)
+        {
+          VK_LOG("Shader %s reads location %u which its vertex type lacks\n", pEntries[j]->mpName, input.mLocation);
+          std::exit(1);
+        }
+        if (NumericOf(it->format) != NumericOf(input.mFormat))
+        {
+          VK_LOG("Shader %s reads location %u as another numeric type than its vertex type provides\n", pEntries[j]->mpName, input.mLocation);
+          std::exit(1);
+        }
+        layout.mAttributes.emplace_back(*it);
+      }
+    }
+    std::sort(layout.mBindings.begin(), layout.mBindings.end(), [](VkDescriptorSetLayoutBinding const& a, VkDescriptorSetLayoutBinding const& b) { return a.binding < b.binding; });
+    // Sizes take part so neighbouring stages can not shift into each other
+    u64 const sizes[2]{ stages.mpVertex->mSize, stages.mpFragment->mSize };
+    hash = VkUtils::Hash(sizes, sizeof(sizes), hash);
+    hash = VkUtils::Hash(stages.mpVertex->mpCode, stages.mpVertex->mSize, hash);
+    hash = VkUtils::Hash(stages.mpFragment->mpCode, stages.mpFragment->mSize, hash);
+  }
+  mShaderHash = hash;
+}
+void VkPipelines::LoadCache()
+{
+  std::vector<u8> const file{ Read(mCacheFile) };
+  mWarm = Validate(file);
+  // Pipeline cache create info
+  VkPipelineCacheCreateInfo vkPipelineCacheCreateInfo{};
+  vkPipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  if (mWarm)
+  {
+    vkPipelineCacheCreateInfo.initialDataSize = file.size() - sizeof(Header);
+    vkPipelineCacheCreateInfo.pInitialData = file.data() + sizeof(Header);
+    mDataHash = VkUtils::Hash(file.data() + sizeof(Header), file.size() - sizeof(Header));
+  }
+  VK_VALIDATE(vkCreatePipelineCache(mVkDevice, &vkPipelineCacheCreateInfo, nullptr, &mVkPipelineCache));
+}
+void VkPipelines::CreateLayouts()
+{
+  for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+  {
+    Layout const& layout{ mLayouts[i] };
+    VkProgram& program{ mPrograms[i] };
+    program.mShader = (VkShader)i;
+    // Descriptor set layout create info
+    VkDescriptorSetLayoutCreateInfo vkDescriptorSetLayoutCreateInfo{};
+    vkDescriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    vkDescriptorSetLayoutCreateInfo.bindingCount = (u32)layout.mBindings.size();
+    vkDescriptorSetLayoutCreateInfo.pBindings = layout.mBindings.data();
+    VK_VALIDATE(vkCreateDescriptorSetLayout(mVkDevice, &vkDescriptorSetLayoutCreateInfo, nullptr, &program.mVkDescriptorSetLayout));
+    // Pipeline layout create info
+    VkPipelineLayoutCreateInfo vkPipelineLayoutCreateInfo{};
+    vkPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    vkPipelineLayoutCreateInfo.setLayoutCount = 1;
+    vkPipelineLayoutCreateInfo.pSetLayouts = &program.mVkDescriptorSetLayout;
+    vkPipelineLayoutCreateInfo.pushConstantRangeCount = (u32)layout.mPushConstants.size();
+    vkPipelineLayoutCreateInfo.pPushConstantRanges = layout.mPushConstants.data();
+    VK_VALIDATE(vkCreatePipelineLayout(mVkDevice, &vkPipelineLayoutCreateInfo, nullptr, &program.mVkPipelineLayout));
+  }
+}
+void VkPipelines::CreatePrograms()
+{
+  // Shader modules only live until their pipelines exist
+  VkShaderModule vkShaderModules[VK_SHADER_COUNT][2]{};
+  VkPipelineShaderStageCreateInfo vkShaderStageCreateInfos[VK_SHADER_COUNT][2]{};
+  VkVertexInputBindingDescription vkVertexInputBindingDescriptions[VK_SHADER_COUNT]{};
+  VkPipelineVertexInputStateCreateInfo vkVertexInputStateCreateInfos[VK_SHADER_COUNT]{};
+  VkPipelineInputAssemblyStateCreateInfo vkInputAssemblyStateCreateInfos[VK_SHADER_COUNT]{};
+  VkGraphicsPipelineCreateInfo vkGraphicsPipelineCreateInfos[VK_SHADER_COUNT]{};
+  // Viewport state create info, the extent is set while recording
+  VkPipelineViewportStateCreateInfo vkViewportStateCreateInfo{};
+  vkViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  vkViewportStateCreateInfo.viewportCount = 1;
+  vkViewportStateCreateInfo.scissorCount = 1;
+  VkDynamicState const vkDynamicStates[]{ VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  VkPipelineDynamicStateCreateInfo vkDynamicStateCreateInfo{};
+  vkDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  vkDynamicStateCreateInfo.dynamicStateCount = 2;
+  vkDynamicStateCreateInfo.pDynamicStates = vkDynamicStates;
+  // Rasterization state create info
+  VkPipelineRasterizationStateCreateInfo vkRasterizationStateCreateInfo{};
+  vkRasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  vkRasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
+  vkRasterizationStateCreateInfo.cullMode = VK_CULL_MODE_NONE;
+  vkRasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  vkRasterizationStateCreateInfo.lineWidth = 1.f;
+  // Multisample state create info
+  VkPipelineMultisampleStateCreateInfo vkMultisampleStateCreateInfo{};
+  vkMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  vkMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  // Color blend state create info
+  VkPipelineColorBlendAttachmentState vkColorBlendAttachmentState{};
+  vkColorBlendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  VkPipelineColorBlendStateCreateInfo vkColorBlendStateCreateInfo{};
+  vkColorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  vkColorBlendStateCreateInfo.attachmentCount = 1;
+  vkColorBlendStateCreateInfo.pAttachments = &vkColorBlendAttachmentState;
+  for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+  {
+    Description const& description{ Describe((VkShader)i) };
+    Layout const& layout{ mLayouts[i] };
+    VkShaderCode::Entry const* pEntries[2]{ mStages[i].mpVertex, mStages[i].mpFragment };
+    VkShaderStageFlagBits const vkStages[2]{ VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT };
+    for (u32 j{}; j < 2; ++j)
+    {
+      // Shader module create info
+      VkShaderModuleCreateInfo vkShaderModuleCreateInfo{};
+      vkShaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+      vkShaderModuleCreateInfo.codeSize = pEntries[j]->mSize;
+      vkShaderModuleCreateInfo.pCode = pEntries[j]->mpCode;
+      VK_VALIDATE(vkCreateShaderModule(mVkDevice, &vkShaderModuleCreateInfo, nullptr, &vkShaderModules[i][j]));
+      // Shader stage create info
+      vkShaderStageCreateInfos[i][j].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      vkShaderStageCreateInfos[i][j].stage = vkStages[j];
+      vkShaderStageCreateInfos[i][j].module = vkShaderModules[i][j];
+      vkShaderStageCreateInfos[i][j].pName = "main";
+    }
+    // Vertex input state create info
+    vkVertexInputBindingDescriptions[i].binding = 0;
+    vkVertexInputBindingDescriptions[i].stride = description.mLayout.mStride;
+    vkVertexInputBindingDescriptions[i].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    vkVertexInputStateCreateInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vkVertexInputStateCreateInfos[i].vertexBindingDescriptionCount = 1;
+    vkVertexInputStateCreateInfos[i].pVertexBindingDescriptions = &vkVertexInputBindingDescriptions[i];
+    vkVertexInputStateCreateInfos[i].vertexAttributeDescriptionCount = (u32)layout.mAttributes.size();
+    vkVertexInputStateCreateInfos[i].pVertexAttributeDescriptions = layout.mAttributes.data();
+    // Input assembly state create info
+    vkInputAssemblyStateCreateInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    vkInputAssemblyStateCreateInfos[i].topology = description.mTopology;
+    // Graphics pipeline create info
+    vkGraphicsPipelineCreateInfos[i].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    vkGraphicsPipelineCreateInfos[i].stageCount = 2;
+    vkGraphicsPipelineCreateInfos[i].pStages = vkShaderStageCreateInfos[i];
+    vkGraphicsPipelineCreateInfos[i].pVertexInputState = &vkVertexInputStateCreateInfos[i];
+    vkGraphicsPipelineCreateInfos[i].pInputAssemblyState = &vkInputAssemblyStateCreateInfos[i];
+    vkGraphicsPipelineCreateInfos[i].pViewportState = &vkViewportStateCreateInfo;
+    vkGraphicsPipelineCreateInfos[i].pRasterizationState = &vkRasterizationStateCreateInfo;
+    vkGraphicsPipelineCreateInfos[i].pMultisampleState = &vkMultisampleStateCreateInfo;
+    vkGraphicsPipelineCreateInfos[i].pColorBlendState = &vkColorBlendStateCreateInfo;
+    vkGraphicsPipelineCreateInfos[i].pDynamicState = &vkDynamicStateCreateInfo;
+    vkGraphicsPipelineCreateInfos[i].layout = mPrograms[i].mVkPipelineLayout;
+    vkGraphicsPipelineCreateInfos[i].renderPass = mVkRenderPass;
+    vkGraphicsPipelineCreateInfos[i].subpass = 0;
+  }
+  // Create all pipelines at once, the driver may compile them in parallel
+  VkPipeline vkPipelines[VK_SHADER_COUNT]{};
+  VK_VALIDATE(vkCreateGraphicsPipelines(mVkDevice, mVkPipelineCache, VK_SHADER_COUNT, vkGraphicsPipelineCreateInfos, nullptr, vkPipelines));
+  for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+  {
+    mPrograms[i].mVkPipeline = vkPipelines[i];
+    vkDestroyShaderModule(mVkDevice, vkShaderModules[i][0], nullptr);
+    vkDestroyShaderModule(mVkDevice, vkShaderModules[i][1], nullptr);
+  }
+}
+
+u32 VkPipelines::Validate(std::vector<u8> const& file) const
+{
+  auto const reject{ [&](s8 const* pReason)
+  {
+    VK_LOG("Pipeline cache %s %s, starting cold\n", mCacheFile.string().c_str(), pReason);
+    return 0u;
+  } };
+  if (file.empty())
+  {
+    return reject("missing");
+  }
+  if (file.size() < sizeof(Header))
+  {
+    return reject("truncated");
+  }
+  Header header{};
+  std::memcpy(&header, file.data(), sizeof(Header));
+  if (header.mMagic != VK_PIPELINE_CACHE_MAGIC || header.mVersion != VK_PIPELINE_CACHE_VERSION)
+  {
+    return reject("has an unknown format");
+  }
+  if (header.mVendorId != mVkPhysicalDeviceProperties.vendorID || header.mDeviceId != mVkPhysicalDeviceProperties.deviceID || header.mDriverVersion != mVkPhysicalDeviceProperties.driverVersion || std::memcmp(header.mUuid, mVkPhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE))
+  {
+    return reject("belongs to another device or driver");
+  }
+  if (header.mShaderHash != mShaderHash)
+  {
+    return reject("was built from other shaders");
+  }
+  if (header.mDataSize != file.size() - sizeof(Header) || header.mDataHash != VkUtils::Hash(file.data() + sizeof(Header), header.mDataSize))
+  {
+    return reject("is corrupted");
+  }
+  // Drivers prefix their blob with a header of their own
+  VkPipelineCacheHeaderVersionOne vkHeader{};
+  if (header.mDataSize < sizeof(VkPipelineCacheHeaderVersionOne))
+  {
+    return reject("holds no driver header");
+  }
+  std::memcpy(&vkHeader, file.data() + sizeof(Header), sizeof(VkPipelineCacheHeaderVersionOne));
+  if (vkHeader.headerSize < sizeof(VkPipelineCacheHeaderVersionOne) || vkHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || vkHeader.vendorID != mVkPhysicalDeviceProperties.vendorID || vkHeader.deviceID != mVkPhysicalDeviceProperties.deviceID || std::memcmp(vkHeader.pipelineCacheUUID, mVkPhysicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE))
+  {
+    return reject("holds a foreign driver header");
+  }
+  return 1;
+}
\ No newline at end of file
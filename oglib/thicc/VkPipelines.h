@@ -0,0 +1,141 @@
+#ifndef VK_PIPELINES
+#define VK_PIPELINES
+
+/*
+* Graphics pipelines through a persistent cache.
+*
+* Cache file structure:
+* ---Header-----------------------------------------------------------Blob---------
+*    |                                                                |
+*    [Magic, Version, Vendor, Device, Driver, Uuid, Shaders, Size, Hash] [Driver data]
+*
+* Every program gets created in a single call through one VkPipelineCache which
+* is seeded from disk. The header keys the blob by vendor, device, driver
+* version, pipeline cache UUID and a hash over the SPIR-V of all shaders. The
+* blob only reaches the driver if the whole key matches, its own hash is intact
+* and the header the driver wrote into it agrees with the device as well, any
+* mismatch logs its reason and the cache starts out empty.
+*
+* Shader code is embedded into the binary by the spirv tool, nothing but the
+* cache touches the disk. Descriptor set layouts, push constant ranges and
+* vertex input state come from reflecting the SPIR-V of both stages, a program
+* only declares its topology and the vertex type it is fed with. Attribute
+* formats and offsets are taken from the compile time layout of that vertex
+* type, the shader only selects which locations get consumed. Stages which
+* disagree on a binding, or inputs which find no attribute of their numeric
+* class at their location, stop the renderer before any pipeline gets created.
+*
+* On destruction the cache is written back if the driver added anything. The
+* file is written next to its destination first and renamed over it, a crash
+* never leaves a torn cache behind. Pipelines keep viewport and scissor dynamic
+* and only depend on the render pass, swapchain recreation leaves them intact.
+*/
+
+#include "VkCore.h"
+#include "VkUtils.h"
+#include "VkVertices.h"
+#include "VkReflection.h"
+#include "VkShaderCode.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr s8 const* VK_PIPELINE_CACHE_FILE   { "pipelines.cache" };
+constexpr u32       VK_PIPELINE_CACHE_MAGIC  { 0x4350564B };
+constexpr u32       VK_PIPELINE_CACHE_VERSION{ 1 };
+
+/*
+* Programs.
+*/
+
+enum VkShader : u32
+{
+  VK_SHADER_LAMBERT,
+  VK_SHADER_LAMBERT_INSTANCED,
+  VK_SHADER_GIZMO,
+  VK_SHADER_COUNT,
+};
+
+struct VkProgram
+{
+  VkShader              mShader               {};
+  VkPipeline            mVkPipeline           {};
+  VkPipelineLayout      mVkPipelineLayout     {};
+  VkDescriptorSetLayout mVkDescriptorSetLayout{};
+};
+
+/*
+* Pipelines.
+*/
+
+class VkPipelines
+{
+public:
+  VkPipelines(VkDevice vkDevice, VkPhysicalDeviceProperties const& vkPhysicalDeviceProperties, VkRenderPass vkRenderPass, std::string const& cacheFile = VK_PIPELINE_CACHE_FILE);
+  virtual ~VkPipelines();
+
+public:
+  // Writes the cache back to disk if the driver added anything since it got loaded
+  void                                             Save();
+
+  __forceinline VkProgram const&                                 Program(VkShader shader)       const noexcept { return mPrograms[shader]; }
+  // Reflected descriptor bindings of a program, uniform buffers hold the frame uniforms and storage buffers the instances
+  __forceinline std::vector<VkDescriptorSetLayoutBinding> const& Bindings(VkShader shader)      const noexcept { return mLayouts[shader].mBindings; }
+  // Reflected push constant ranges of a program, one per stage which declares a block
+  __forceinline std::vector<VkPushConstantRange> const&          PushConstants(VkShader shader) const noexcept { return mLayouts[shader].mPushConstants; }
+  __forceinline VkPipelineCache                                  Cache()                        const noexcept { return mVkPipelineCache; }
+  __forceinline u32                                              Warm()                         const noexcept { return mWarm; }
+
+private:
+  struct Header
+  {
+    u32 mMagic              {};
+    u32 mVersion            {};
+    u32 mVendorId           {};
+    u32 mDeviceId           {};
+    u32 mDriverVersion      {};
+    u32 mReserved           {};
+    u8  mUuid[VK_UUID_SIZE] {};
+    u64 mShaderHash         {};
+    u64 mDataSize           {};
+    u64 mDataHash           {};
+  };
+
+  struct Stages
+  {
+    VkShaderCode::Entry const* mpVertex  {};
+    VkShaderCode::Entry const* mpFragment{};
+  };
+
+  struct Layout
+  {
+    std::vector<VkDescriptorSetLayoutBinding>      mBindings     {};
+    std::vector<VkPushConstantRange>               mPushConstants{};
+    std::vector<VkVertexInputAttributeDescription> mAttributes   {};
+  };
+
+private:
+  static std::vector<u8> Read(std::filesystem::path const& path);
+
+  void ReflectShaders();
+  void LoadCache();
+  void CreateLayouts();
+  void CreatePrograms();
+
+  u32  Validate(std::vector<u8> const& file) const;
+
+  VkDevice                   mVkDevice                  {};
+  VkPhysicalDeviceProperties mVkPhysicalDeviceProperties{};
+  VkRenderPass               mVkRenderPass              {};
+  std::filesystem::path      mCacheFile                 {};
+  VkPipelineCache            mVkPipelineCache           {};
+  u64                        mShaderHash                {};
+  u64                        mDataHash                  {};
+  u32                        mWarm                      {};
+  Stages                     mStages[VK_SHADER_COUNT]   {};
+  Layout                     mLayouts[VK_SHADER_COUNT]  {};
+  VkProgram                  mPrograms[VK_SHADER_COUNT] {};
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,403 @@
+#ifndef VK_POOL
+#define VK_POOL
+
+/*
+* Pool and arena allocators.
+*
+* Arena structure:
+* ---B0-----------B1-----------B2--
+*    |            |            |
+*    [####----]   [--------]   [--------]
+*         ^Offset
+*
+* Heap structure:
+* ---64-----128----256----...------
+*    |      |      |
+*    Free   Free   Free --> Arena
+*
+* Pool structure:
+* ---S0-----------S1---------------
+*    |            |
+*    [T, T, ...]  [T, T, ...] <-- Free
+*
+* Range structure:
+* ---0------------------------Capacity
+*    |
+*    [####----##------####---]
+*         ^Free   ^Free
+*
+* Arenas bump allocate out of large blocks and rewind all at once. Heaps put
+* power of two free lists on top of an arena so storage of grown containers
+* gets recycled. Pools hand out fixed size slots of a single type. Ranges own
+* no memory at all, they hand out best fitting spans of a fixed capacity and
+* merge neighbouring spans on free, used for sub-ranges of device buffers.
+*/
+
+#include "VkCore.h"
+
+/*
+* Allocator statistics.
+*/
+
+struct VkAllocatorStats
+{
+  u64 mReserved   {};
+  u64 mUsed       {};
+  u64 mPeak       {};
+  u64 mAllocations{};
+  u64 mFrees      {};
+  u64 mBlocks     {};
+};
+
+/*
+* Bump allocator.
+*/
+
+class VkArena
+{
+public:
+  static constexpr u64 ALIGNMENT{ 64 };
+
+  VkArena(u64 blockSize) : mBlockSize{ blockSize } {}
+  virtual ~VkArena()
+  {
+    Release();
+  }
+
+public:
+  __forceinline void* Allocate(u64 size) noexcept
+  {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    while (mBlock < (u32)mBlocks.size() && mOffset + size > mBlocks[mBlock].mSize)
+    {
+      mBlock++;
+      mOffset = 0;
+    }
+    if (mBlock == (u32)mBlocks.size())
+    {
+      u64 const blockSize{ std::max(size, mBlockSize) };
+      mBlocks.emplace_back(Block{ (u8*)::operator new(blockSize, std::align_val_t{ ALIGNMENT }), blockSize });
+      mStats.mReserved += blockSize;
+      mStats.mBlocks++;
+    }
+    void* pMemory{ mBlocks[mBlock].mpData + mOffset };
+    mOffset += size;
+    mStats.mUsed += size;
+    mStats.mPeak = std::max(mStats.mPeak, mStats.mUsed);
+    mStats.mAllocations++;
+    return pMemory;
+  }
+  // Rewinds every block but keeps them for the next scene
+  __forceinline void Reset() noexcept
+  {
+    mBlock = 0;
+    mOffset = 0;
+    mStats.mFrees += mStats.mAllocations;
+    mStats.mAllocations = 0;
+    mStats.mUsed = 0;
+  }
+  __forceinline void Release() noexcept
+  {
+    for (auto const& block : mBlocks)
+    {
+      ::operator delete(block.mpData, std::align_val_t{ ALIGNMENT });
+    }
+    mBlocks.clear();
+    Reset();
+    mStats.mReserved = 0;
+    mStats.mBlocks = 0;
+  }
+  __forceinline VkAllocatorStats const& Stats() const noexcept { return mStats; }
+
+private:
+  struct Block
+  {
+    u8* mpData{};
+    u64 mSize {};
+  };
+
+  std::vector<Block> mBlocks   {};
+  u32                mBlock    {};
+  u64                mOffset   {};
+  u64                mBlockSize{};
+  VkAllocatorStats   mStats    {};
+};
+
+/*
+* Size class allocator.
+*/
+
+class VkHeap
+{
+public:
+  static constexpr u32 MIN_CLASS{ 6 };
+  static constexpr u32 MAX_CLASS{ 48 };
+
+  VkHeap(u64 blockSize) : mArena{ blockSize } {}
+
+public:
+  __forceinline void* Allocate(u64 size) noexcept
+  {
+    u32 const sizeClass{ ClassOf(size) };
+    void* pMemory{ mpFree[sizeClass] };
+    if (pMemory)
+    {
+      mpFree[sizeClass] = *(void**)pMemory;
+    }
+    else
+    {
+      pMemory = mArena.Allocate((u64)1 << sizeClass);
+    }
+    mStats.mUsed += (u64)1 << sizeClass;
+    mStats.mPeak = std::max(mStats.mPeak, mStats.mUsed);
+    mStats.mAllocations++;
+    return pMemory;
+  }
+  __forceinline void Free(void* pMemory, u64 size) noexcept
+  {
+    if (!pMemory) return;
+    u32 const sizeClass{ ClassOf(size) };
+    *(void**)pMemory = mpFree[sizeClass];
+    mpFree[sizeClass] = pMemory;
+    mStats.mUsed -= (u64)1 << sizeClass;
+    mStats.mFrees++;
+  }
+  __forceinline void Reset() noexcept
+  {
+    mpFree.fill(nullptr);
+    mArena.Reset();
+    mStats.mFrees += mStats.mAllocations - mStats.mFrees;
+    mStats.mUsed = 0;
+  }
+  __forceinline VkAllocatorStats Stats() const noexcept
+  {
+    VkAllocatorStats stats{ mStats };
+    stats.mReserved = mArena.Stats().mReserved;
+    stats.mBlocks = mArena.Stats().mBlocks;
+    return stats;
+  }
+
+private:
+  static __forceinline u32 ClassOf(u64 size) noexcept
+  {
+    u32 sizeClass{ MIN_CLASS };
+    while (((u64)1 << sizeClass) < size) sizeClass++;
+    return sizeClass;
+  }
+
+  VkArena                        mArena;
+  std::array<void*, MAX_CLASS>   mpFree{};
+  VkAllocatorStats               mStats{};
+};
+
+/*
+* Type segregated object pools.
+*/
+
+class VkPoolBase
+{
+public:
+  VkPoolBase(s8 const* pName) : mpName{ pName }
+  {
+    Pools().emplace_back(this);
+  }
+  virtual ~VkPoolBase()
+  {
+    std::erase(Pools(), this);
+  }
+
+public:
+  static __forceinline std::vector<VkPoolBase*>& Pools() noexcept
+  {
+    static std::vector<VkPoolBase*> sPools{};
+    return sPools;
+  }
+
+  virtual void Free(void* pObject) noexcept = 0;
+  virtual void Reset() noexcept = 0;
+
+  __forceinline s8 const*                Name()  const noexcept { return mpName; }
+  __forceinline VkAllocatorStats const&  Stats() const noexcept { return mStats; }
+
+protected:
+  s8 const*        mpName{};
+  VkAllocatorStats mStats{};
+};
+
+template<typename T>
+class VkPool : public VkPoolBase
+{
+public:
+  VkPool(u32 slabCount) : VkPoolBase{ typeid(T).name() }, mSlabCount{ std::max(slabCount, 1u) } {}
+  virtual ~VkPool()
+  {
+    for (auto const& pSlab : mSlabs)
+    {
+      ::operator delete(pSlab, std::align_val_t{ alignof(Slot) });
+    }
+  }
+
+public:
+  // Returns uninitialized storage for one T
+  __forceinline void* Allocate() noexcept
+  {
+    if (!mpFree)
+    {
+      Slot* pSlab{ (Slot*)::operator new(sizeof(Slot) * mSlabCount, std::align_val_t{ alignof(Slot) }) };
+      mSlabs.emplace_back(pSlab);
+      for (u32 i{}; i < mSlabCount; ++i)
+      {
+        pSlab[i].mpNext = (i + 1 < mSlabCount) ? &pSlab[i + 1] : nullptr;
+      }
+      mpFree = pSlab;
+      mStats.mReserved += sizeof(Slot) * mSlabCount;
+      mStats.mBlocks++;
+    }
+    Slot* pSlot{ mpFree };
+    mpFree = pSlot->mpNext;
+    mStats.mUsed += sizeof(Slot);
+    mStats.mPeak = std::max(mStats.mPeak, mStats.mUsed);
+    mStats.mAllocations++;
+    return pSlot;
+  }
+  template<typename ... Args>
+  __forceinline T* Create(Args&& ... args) noexcept
+  {
+    return new (Allocate()) T{ std::forward<Args>(args) ... };
+  }
+  // Returns storage of an already destructed T
+  void Free(void* pObject) noexcept override
+  {
+    Slot* pSlot{ (Slot*)pObject };
+    pSlot->mpNext = mpFree;
+    mpFree = pSlot;
+    mStats.mUsed -= sizeof(Slot);
+    mStats.mFrees++;
+  }
+  // Hands every slot back at once, live objects have to be destructed already
+  void Reset() noexcept override
+  {
+    mpFree = nullptr;
+    for (auto const& pSlab : mSlabs)
+    {
+      for (u32 i{}; i < mSlabCount; ++i)
+      {
+        pSlab[i].mpNext = (i + 1 < mSlabCount) ? &pSlab[i + 1] : mpFree;
+      }
+      mpFree = pSlab;
+    }
+    mStats.mFrees += mStats.mAllocations - mStats.mFrees;
+    mStats.mUsed = 0;
+  }
+
+  static __forceinline VkPool& Get(u32 slabCount = 256) noexcept
+  {
+    static VkPool sPool{ slabCount };
+    return sPool;
+  }
+
+private:
+  union Slot
+  {
+    Slot* mpNext;
+    alignas(T) u8 mStorage[sizeof(T)];
+  };
+
+  std::vector<Slot*> mSlabs    {};
+  Slot*              mpFree    {};
+  u32                mSlabCount{};
+};
+
+/*
+* Best fit range allocator.
+*/
+
+class VkRanges
+{
+public:
+  static constexpr u64 INVALID{ ~0ull };
+
+  VkRanges(u64 capacity) : mCapacity{ capacity }
+  {
+    Insert(0, capacity);
+    mStats.mReserved = capacity;
+    mStats.mBlocks = 1;
+  }
+
+public:
+  // Returns the offset of count free units, INVALID if no span is large enough
+  __forceinline u64 Allocate(u64 count) noexcept
+  {
+    auto const it{ mSizes.lower_bound({ count, 0 }) };
+    if (!count || it == mSizes.end())
+    {
+      return INVALID;
+    }
+    auto const [size, offset] { *it };
+    Erase(offset, size);
+    if (size > count)
+    {
+      Insert(offset + count, size - count);
+    }
+    mStats.mUsed += count;
+    mStats.mPeak = std::max(mStats.mPeak, mStats.mUsed);
+    mStats.mAllocations++;
+    return offset;
+  }
+  __forceinline void Free(u64 offset, u64 count) noexcept
+  {
+    if (offset == INVALID || !count) return;
+    mStats.mUsed -= count;
+    mStats.mFrees++;
+    // Merge with the following and preceding span
+    auto next{ mSpans.lower_bound(offset) };
+    if (next != mSpans.end() && next->first == offset + count)
+    {
+      count += next->second;
+      Erase(next->first, next->second);
+      next = mSpans.lower_bound(offset);
+    }
+    if (next != mSpans.begin())
+    {
+      auto const prev{ std::prev(next) };
+      if (prev->first + prev->second == offset)
+      {
+        offset = prev->first;
+        count += prev->second;
+        Erase(prev->first, prev->second);
+      }
+    }
+    Insert(offset, count);
+  }
+  __forceinline void Reset() noexcept
+  {
+    mSpans.clear();
+    mSizes.clear();
+    Insert(0, mCapacity);
+    mStats.mFrees += mStats.mAllocations - mStats.mFrees;
+    mStats.mUsed = 0;
+  }
+
+  __forceinline u64                     Capacity() const noexcept { return mCapacity; }
+  __forceinline u64                     Largest()  const noexcept { return mSizes.empty() ? 0 : mSizes.rbegin()->first; }
+  __forceinline VkAllocatorStats const& Stats()    const noexcept { return mStats; }
+
+private:
+  __forceinline void Insert(u64 offset, u64 size) noexcept
+  {
+    mSpans.emplace(offset, size);
+    mSizes.emplace(size, offset);
+  }
+  __forceinline void Erase(u64 offset, u64 size) noexcept
+  {
+    mSpans.erase(offset);
+    mSizes.erase({ size, offset });
+  }
+
+  std::map<u64, u64>            mSpans   {};
+  std::set<std::pair<u64, u64>> mSizes   {};
+  u64                           mCapacity{};
+  VkAllocatorStats              mStats   {};
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+#include "VkRecorder.h"
+
+VkRecorder::VkRecorder(VkDevice vkDevice, u32 queueFamily, u32 frames, u32 threads)
+  : mVkDevice{ vkDevice }
+  , mThreads{ std::max(threads, 1u) }
+  , mVkCommandPools{ frames * mThreads }
+  , mVkCommandBuffers{ frames * mThreads }
+{
+  for (u32 i{}; i < (u32)mVkCommandPools.size(); ++i)
+  {
+    // Command pool create info, reset as a whole once the frame retired
+    VkCommandPoolCreateInfo vkCommandPoolCreateInfo{};
+    vkCommandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    vkCommandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    vkCommandPoolCreateInfo.queueFamilyIndex = queueFamily;
+    VK_VALIDATE(vkCreateCommandPool(mVkDevice, &vkCommandPoolCreateInfo, nullptr, &mVkCommandPools[i]));
+    // Command buffer allocate info
+    VkCommandBufferAllocateInfo vkCommandBufferAllocateInfo{};
+    vkCommandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    vkCommandBufferAllocateInfo.commandPool = mVkCommandPools[i];
+    vkCommandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    vkCommandBufferAllocateInfo.commandBufferCount = 1;
+    VK_VALIDATE(vkAllocateCommandBuffers(mVkDevice, &vkCommandBufferAllocateInfo, &mVkCommandBuffers[i]));
+  }
+}
+VkRecorder::~VkRecorder()
+{
+  for (auto const& vkCommandPool : mVkCommandPools)
+  {
+    vkDestroyCommandPool(mVkDevice, vkCommandPool, nullptr);
+  }
+}
+
+void VkRecorder::Reset(u32 frame)
+{
+  for (u32 i{}; i < mThreads; ++i)
+  {
+    VK_VALIDATE(vkResetCommandPool(mVkDevice, mVkCommandPools[frame * mThreads + i], 0));
+  }
+}
+void VkRecorder::Execute(u32 frame, VkCommandBuffer vkPrimaryCommandBuffer) const
+{
+  vkCmdExecuteCommands(vkPrimaryCommandBuffer, mChunks, mVkCommandBuffers.data() + frame * mThreads);
+}
\ No newline at end of file
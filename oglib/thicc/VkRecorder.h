@@ -0,0 +1,89 @@
+#ifndef VK_RECORDER
+#define VK_RECORDER
+
+/*
+* Parallel command recording.
+*
+* Recorder structure:
+* ---Frame F-------------------------------------------Primary-----------------
+*    |                                                 |
+*    [Pool 0: S0 | Pool 1: S1 | ... | Pool T: ST] --> [Begin, S0, S1, ..., End]
+*
+* Every frame in flight owns one command pool per recording thread, each pool
+* holds a single secondary command buffer. A range of work items is split into
+* contiguous chunks, every chunk gets recorded into its own secondary buffer on
+* the job pool and the primary executes them in chunk order, so the submission
+* order matches the order of the items regardless of which thread finished
+* first. A pool is only ever touched by the one job recording its chunk, no
+* locking is required.
+*
+* Pools get reset as a whole once their frame retired, the secondaries are
+* recorded for one time submission inside the render pass they inherit. Small
+* ranges stay on fewer threads, a chunk never holds fewer items than the grain.
+*/
+
+#include "VkCore.h"
+#include "VkJobs.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u32 VK_RECORDER_GRAIN{ 64 };
+
+/*
+* Recorder.
+*/
+
+class VkRecorder
+{
+public:
+  VkRecorder(VkDevice vkDevice, u32 queueFamily, u32 frames, u32 threads = VkJobs::Get().Concurrency());
+  virtual ~VkRecorder();
+
+public:
+  // Resets every pool of a frame, the device must be done with its previous commands
+  void Reset(u32 frame);
+  // Records task(commandBuffer, first, count) for contiguous chunks of [0, count) in parallel, returns the number of chunks
+  template<typename T>
+  u32  Record(u32 frame, VkCommandBufferInheritanceInfo const& vkInheritanceInfo, u32 count, T&& task);
+  // Executes the chunks of the last record of a frame in order
+  void Execute(u32 frame, VkCommandBuffer vkPrimaryCommandBuffer) const;
+
+  __forceinline u32 Threads() const noexcept { return mThreads; }
+  __forceinline u32 Chunks()  const noexcept { return mChunks; }
+
+private:
+  VkDevice                     mVkDevice          {};
+  u32                          mThreads           {};
+  u32                          mChunks            {};
+  std::vector<VkCommandPool>   mVkCommandPools    {};
+  std::vector<VkCommandBuffer> mVkCommandBuffers  {};
+};
+
+/*
+* Recorder implementation.
+*/
+
+template<typename T>
+u32 VkRecorder::Record(u32 frame, VkCommandBufferInheritanceInfo const& vkInheritanceInfo, u32 count, T&& task)
+{
+  mChunks = std::clamp((count + VK_RECORDER_GRAIN - 1) / VK_RECORDER_GRAIN, 1u, mThreads);
+  u32 const share{ (count + mChunks - 1) / mChunks };
+  VkCommandBuffer const* pVkCommandBuffers{ mVkCommandBuffers.data() + frame * mThreads };
+  VkJobs::Get().ForEach(mChunks, [&](u32 chunk)
+  {
+    // Command buffer begin info, secondaries continue the render pass of the primary
+    VkCommandBufferBeginInfo vkCommandBufferBeginInfo{};
+    vkCommandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    vkCommandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    vkCommandBufferBeginInfo.pInheritanceInfo = &vkInheritanceInfo;
+    VK_VALIDATE(vkBeginCommandBuffer(pVkCommandBuffers[chunk], &vkCommandBufferBeginInfo));
+    u32 const first{ std::min(chunk * share, count) };
+    task(pVkCommandBuffers[chunk], first, std::min(first + share, count) - first);
+    VK_VALIDATE(vkEndCommandBuffer(pVkCommandBuffers[chunk]));
+  });
+  return mChunks;
+}
+
+#endif
\ No newline at end of file
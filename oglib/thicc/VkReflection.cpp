@@ -0,0 +1,513 @@
+#include "VkReflection.h"
+
+namespace
+{
+  /*
+  * SPIR-V enumerants.
+  */
+
+  constexpr u32 SPV_MAGIC{ 0x07230203 };
+
+  // Types of real modules nest a handful of levels, anything deeper is treated as a cycle
+  constexpr u32 MAX_TYPE_DEPTH { 64 };
+  // Members sharing deep types multiply the walk, the budget covers every variable of a module
+  constexpr u32 MAX_TYPE_VISITS{ 1 << 20 };
+
+  enum : u32
+  {
+    SPV_OP_ENTRY_POINT        = 15,
+    SPV_OP_TYPE_INT           = 21,
+    SPV_OP_TYPE_FLOAT         = 22,
+    SPV_OP_TYPE_VECTOR        = 23,
+    SPV_OP_TYPE_MATRIX        = 24,
+    SPV_OP_TYPE_IMAGE         = 25,
+    SPV_OP_TYPE_SAMPLER       = 26,
+    SPV_OP_TYPE_SAMPLED_IMAGE = 27,
+    SPV_OP_TYPE_ARRAY         = 28,
+    SPV_OP_TYPE_RUNTIME_ARRAY = 29,
+    SPV_OP_TYPE_STRUCT        = 30,
+    SPV_OP_TYPE_POINTER       = 32,
+    SPV_OP_CONSTANT           = 43,
+    SPV_OP_SPEC_CONSTANT      = 50,
+    SPV_OP_VARIABLE           = 59,
+    SPV_OP_DECORATE           = 71,
+    SPV_OP_MEMBER_DECORATE    = 72,
+  };
+
+  enum : u32
+  {
+    SPV_DECORATION_BLOCK         = 2,
+    SPV_DECORATION_BUFFER_BLOCK  = 3,
+    SPV_DECORATION_ARRAY_STRIDE  = 6,
+    SPV_DECORATION_MATRIX_STRIDE = 7,
+    SPV_DECORATION_BUILTIN       = 11,
+    SPV_DECORATION_LOCATION      = 30,
+    SPV_DECORATION_BINDING       = 33,
+    SPV_DECORATION_SET           = 34,
+    SPV_DECORATION_OFFSET        = 35,
+  };
+
+  // Builtins of OpenGL semantics, Vulkan modules use VertexIndex and InstanceIndex instead
+  enum : u32
+  {
+    SPV_BUILTIN_VERTEX_ID   = 5,
+    SPV_BUILTIN_INSTANCE_ID = 6,
+  };
+
+  enum : u32
+  {
+    SPV_STORAGE_UNIFORM_CONSTANT = 0,
+    SPV_STORAGE_INPUT            = 1,
+    SPV_STORAGE_UNIFORM          = 2,
+    SPV_STORAGE_PUSH_CONSTANT    = 9,
+    SPV_STORAGE_STORAGE_BUFFER   = 12,
+  };
+
+  enum : u32
+  {
+    SPV_DIM_BUFFER  = 5,
+    SPV_DIM_SUBPASS = 6,
+  };
+
+  // Decorations an id carries, values are kept next to them
+  enum : u32
+  {
+    DECORATED_BLOCK        = 1 << 0,
+    DECORATED_BUFFER_BLOCK = 1 << 1,
+    DECORATED_BUILTIN      = 1 << 2,
+    DECORATED_LOCATION     = 1 << 3,
+    DECORATED_BINDING      = 1 << 4,
+  };
+
+  // Word count including the opcode an instruction needs before its operands may be read, zero for ignored ones
+  u32 MinimumWords(u32 op)
+  {
+    switch (op)
+    {
+      case SPV_OP_TYPE_SAMPLER:       return 2;
+      case SPV_OP_TYPE_STRUCT:        return 2;
+      case SPV_OP_TYPE_FLOAT:         return 3;
+      case SPV_OP_TYPE_SAMPLED_IMAGE: return 3;
+      case SPV_OP_TYPE_RUNTIME_ARRAY: return 3;
+      case SPV_OP_DECORATE:           return 3;
+      case SPV_OP_ENTRY_POINT:        return 4;
+      case SPV_OP_TYPE_INT:           return 4;
+      case SPV_OP_TYPE_VECTOR:        return 4;
+      case SPV_OP_TYPE_MATRIX:        return 4;
+      case SPV_OP_TYPE_ARRAY:         return 4;
+      case SPV_OP_TYPE_POINTER:       return 4;
+      case SPV_OP_CONSTANT:           return 4;
+      case SPV_OP_SPEC_CONSTANT:      return 4;
+      case SPV_OP_VARIABLE:           return 4;
+      case SPV_OP_MEMBER_DECORATE:    return 4;
+      case SPV_OP_TYPE_IMAGE:         return 9;
+    }
+    return 0;
+  }
+  // Decorations whose literal follows them, the others carry none this reflection reads
+  u32 HasValue(u32 decoration)
+  {
+    switch (decoration)
+    {
+      case SPV_DECORATION_ARRAY_STRIDE:
+      case SPV_DECORATION_MATRIX_STRIDE:
+      case SPV_DECORATION_BUILTIN:
+      case SPV_DECORATION_LOCATION:
+      case SPV_DECORATION_BINDING:
+      case SPV_DECORATION_SET:
+      case SPV_DECORATION_OFFSET:
+        return 1;
+    }
+    return 0;
+  }
+
+  VkShaderStageFlagBits StageOf(u32 executionModel)
+  {
+    switch (executionModel)
+    {
+      case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+      case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+      case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+      case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+      case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+      case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    return VK_SHADER_STAGE_ALL;
+  }
+  VkFormat Format(u32 op, u32 width, u32 signedness, u32 components)
+  {
+    static VkFormat const sFloat16[4]{ VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16B16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT };
+    static VkFormat const sFloat32[4]{ VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+    static VkFormat const sFloat64[4]{ VK_FORMAT_R64_SFLOAT, VK_FORMAT_R64G64_SFLOAT, VK_FORMAT_R64G64B64_SFLOAT, VK_FORMAT_R64G64B64A64_SFLOAT };
+    static VkFormat const sSint32[4]{ VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+    static VkFormat const sUint32[4]{ VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+    if (components < 1 || components > 4)
+    {
+      return VK_FORMAT_UNDEFINED;
+    }
+    if (op == SPV_OP_TYPE_FLOAT)
+    {
+      switch (width)
+      {
+        case 16: return sFloat16[components - 1];
+        case 32: return sFloat32[components - 1];
+        case 64: return sFloat64[components - 1];
+      }
+    }
+    if (op == SPV_OP_TYPE_INT && width == 32)
+    {
+      return signedness ? sSint32[components - 1] : sUint32[components - 1];
+    }
+    return VK_FORMAT_UNDEFINED;
+  }
+}
+
+VkReflection::VkReflection(u32 const* pCode, u64 size)
+{
+  u64 const wordCount{ size / sizeof(u32) };
+  if (!pCode || size % sizeof(u32) || wordCount < 5 || pCode[0] != SPV_MAGIC)
+  {
+    mpError = "is no SPIR-V module";
+    return;
+  }
+  // Every id below the bound gets a slot, defining an id takes at least two words
+  if (pCode[3] > wordCount)
+  {
+    mpError = "has a bound beyond its size";
+    return;
+  }
+  mIds.resize(pCode[3]);
+  std::vector<u32> variables{};
+  u32 entryPoints{};
+  u32 opengl{};
+  for (u64 i{ 5 }; i < wordCount;)
+  {
+    u32 const op{ pCode[i] & 0xFFFF };
+    u32 const count{ pCode[i] >> 16 };
+    if (!count || i + count > wordCount)
+    {
+      mpError = "has a malformed instruction";
+      return;
+    }
+    if (count < MinimumWords(op))
+    {
+      mpError = "has an instruction missing operands";
+      return;
+    }
+    u32 const* pWords{ pCode + i };
+    i += count;
+    // Instructions are checked against the bound of the module before touching any id
+    auto const valid{ [&](u32 id) { return id < mIds.size(); } };
+    switch (op)
+    {
+      case SPV_OP_ENTRY_POINT:
+      {
+        mVkStage = StageOf(pWords[1]);
+        entryPoints++;
+        break;
+      }
+      case SPV_OP_TYPE_INT:
+      case SPV_OP_TYPE_FLOAT:
+      case SPV_OP_TYPE_VECTOR:
+      case SPV_OP_TYPE_MATRIX:
+      case SPV_OP_TYPE_IMAGE:
+      case SPV_OP_TYPE_SAMPLER:
+      case SPV_OP_TYPE_SAMPLED_IMAGE:
+      case SPV_OP_TYPE_ARRAY:
+      case SPV_OP_TYPE_RUNTIME_ARRAY:
+      case SPV_OP_TYPE_STRUCT:
+      case SPV_OP_TYPE_POINTER:
+      {
+        if (!valid(pWords[1]))
+        {
+          mpError = "has a type outside of its bound";
+          return;
+        }
+        Id& id{ mIds[pWords[1]] };
+        id.mOp = op;
+        id.mOperands.assign(pWords + 2, pWords + count);
+        break;
+      }
+      case SPV_OP_CONSTANT:
+      case SPV_OP_SPEC_CONSTANT:
+      case SPV_OP_VARIABLE:
+      {
+        if (!valid(pWords[2]))
+        {
+          mpError = "has a value outside of its bound";
+          return;
+        }
+        Id& id{ mIds[pWords[2]] };
+        id.mOp = op;
+        id.mType = pWords[1];
+        id.mOperands.assign(pWords + 3, pWords + count);
+        if (op == SPV_OP_VARIABLE)
+        {
+          variables.emplace_back(pWords[2]);
+        }
+        break;
+      }
+      case SPV_OP_DECORATE:
+      {
+        if (!valid(pWords[1]))
+        {
+          mpError = "decorates an id outside of its bound";
+          return;
+        }
+        if (HasValue(pWords[2]) && count < 4)
+        {
+          mpError = "has a decoration without value";
+          return;
+        }
+        Id& id{ mIds[pWords[1]] };
+        u32 const value{ count > 3 ? pWords[3] : 0 };
+        switch (pWords[2])
+        {
+          case SPV_DECORATION_BLOCK:        id.mDecorations |= DECORATED_BLOCK; break;
+          case SPV_DECORATION_BUFFER_BLOCK: id.mDecorations |= DECORATED_BUFFER_BLOCK; break;
+          case SPV_DECORATION_BUILTIN:      id.mDecorations |= DECORATED_BUILTIN; opengl |= value == SPV_BUILTIN_VERTEX_ID || value == SPV_BUILTIN_INSTANCE_ID; break;
+          case SPV_DECORATION_LOCATION:     id.mDecorations |= DECORATED_LOCATION; id.mLocation = value; break;
+          case SPV_DECORATION_BINDING:      id.mDecorations |= DECORATED_BINDING; id.mBinding = value; break;
+          case SPV_DECORATION_SET:          id.mSet = value; break;
+          case SPV_DECORATION_ARRAY_STRIDE: id.mArrayStride = value; break;
+        }
+        break;
+      }
+      case SPV_OP_MEMBER_DECORATE:
+      {
+        if (!valid(pWords[1]) || pWords[2] > 0xFFFF)
+        {
+          mpError = "decorates a member outside of its bound";
+          return;
+        }
+        if (HasValue(pWords[3]) && count < 5)
+        {
+          mpError = "has a decoration without value";
+          return;
+        }
+        Id& id{ mIds[pWords[1]] };
+        u32 const member{ pWords[2] };
+        u32 const value{ count > 4 ? pWords[4] : 0 };
+        if (id.mOffsets.size() <= member)
+        {
+          id.mOffsets.resize(member + 1);
+          id.mMatrixStrides.resize(member + 1);
+        }
+        switch (pWords[3])
+        {
+          case SPV_DECORATION_BUILTIN:       id.mDecorations |= DECORATED_BUILTIN; opengl |= value == SPV_BUILTIN_VERTEX_ID || value == SPV_BUILTIN_INSTANCE_ID; break;
+          case SPV_DECORATION_OFFSET:        id.mOffsets[member] = value; break;
+          case SPV_DECORATION_MATRIX_STRIDE: id.mMatrixStrides[member] = value; break;
+        }
+        break;
+      }
+    }
+  }
+  if (entryPoints != 1)
+  {
+    mpError = "needs exactly one entry point";
+    return;
+  }
+  if (opengl)
+  {
+    mpError = "uses OpenGL builtins, it has to be compiled with -V";
+    return;
+  }
+  for (u32 const variable : variables)
+  {
+    Classify(variable);
+    if (mpError)
+    {
+      return;
+    }
+  }
+  std::sort(mBindings.begin(), mBindings.end(), [](Binding const& a, Binding const& b) { return std::make_pair(a.mSet, a.mBinding) < std::make_pair(b.mSet, b.mBinding); });
+  std::sort(mInputs.begin(), mInputs.end(), [](Input const& a, Input const& b) { return a.mLocation < b.mLocation; });
+}
+
+u32 VkReflection::Size(u32 type, u32 matrixStride, u32 depth)
+{
+  if (mpError)
+  {
+    return 0;
+  }
+  if (depth == MAX_TYPE_DEPTH || ++mTypeVisits > MAX_TYPE_VISITS)
+  {
+    mpError = "nests its types too deeply";
+    return 0;
+  }
+  if (type >= mIds.size() || mIds[type].mOperands.empty())
+  {
+    return 0;
+  }
+  Id const& id{ mIds[type] };
+  u32 const count{ id.mOperands.size() > 1 ? id.mOperands[1] : 0 };
+  switch (id.mOp)
+  {
+    case SPV_OP_TYPE_INT:
+    case SPV_OP_TYPE_FLOAT:
+    {
+      return id.mOperands[0] / 8;
+    }
+    case SPV_OP_TYPE_VECTOR:
+    {
+      return count * Size(id.mOperands[0], 0, depth + 1);
+    }
+    case SPV_OP_TYPE_MATRIX:
+    {
+      return count * (matrixStride ? matrixStride : Size(id.mOperands[0], 0, depth + 1));
+    }
+    case SPV_OP_TYPE_ARRAY:
+    {
+      // The length is a constant id, its first operand holds the value
+      u32 const length{ count < mIds.size() && !mIds[count].mOperands.empty() ? mIds[count].mOperands[0] : 0 };
+      return length * (id.mArrayStride ? id.mArrayStride : Size(id.mOperands[0], matrixStride, depth + 1));
+    }
+    case SPV_OP_TYPE_STRUCT:
+    {
+      // Members may be declared out of offset order, the furthest end wins
+      u32 size{};
+      for (u32 i{}; i < (u32)id.mOperands.size(); ++i)
+      {
+        u32 const offset{ i < id.mOffsets.size() ? id.mOffsets[i] : 0 };
+        u32 const stride{ i < id.mMatrixStrides.size() ? id.mMatrixStrides[i] : 0 };
+        size = std::max(size, offset + Size(id.mOperands[i], stride, depth + 1));
+      }
+      return size;
+    }
+  }
+  return 0;
+}
+u32 VkReflection::Count(u32& type)
+{
+  // Unwraps arrays down to their element, runtime arrays count as zero
+  u32 count{ 1 };
+  for (u32 depth{}; type < mIds.size() && (mIds[type].mOp == SPV_OP_TYPE_ARRAY || mIds[type].mOp == SPV_OP_TYPE_RUNTIME_ARRAY); ++depth)
+  {
+    if (depth == MAX_TYPE_DEPTH)
+    {
+      mpError = "nests its types too deeply";
+      return 0;
+    }
+    Id const& id{ mIds[type] };
+    if (id.mOperands.empty())
+    {
+      break;
+    }
+    if (id.mOp == SPV_OP_TYPE_RUNTIME_ARRAY)
+    {
+      count = 0;
+    }
+    else if (id.mOperands.size() > 1 && id.mOperands[1] < mIds.size() && !mIds[id.mOperands[1]].mOperands.empty())
+    {
+      count *= mIds[id.mOperands[1]].mOperands[0];
+    }
+    type = id.mOperands[0];
+  }
+  return count;
+}
+void VkReflection::Classify(u32 variable)
+{
+  Id const& var{ mIds[variable] };
+  if (var.mType >= mIds.size() || mIds[var.mType].mOp != SPV_OP_TYPE_POINTER || mIds[var.mType].mOperands.size() < 2)
+  {
+    mpError = "declares a variable without pointer type";
+    return;
+  }
+  u32 const storageClass{ var.mOperands[0] };
+  u32 type{ mIds[var.mType].mOperands[1] };
+  if (type >= mIds.size() || (var.mDecorations & DECORATED_BUILTIN) || (mIds[type].mDecorations & DECORATED_BUILTIN))
+  {
+    return;
+  }
+  switch (storageClass)
+  {
+    case SPV_STORAGE_INPUT:
+    {
+      if (mVkStage != VK_SHADER_STAGE_VERTEX_BIT || !(var.mDecorations & DECORATED_LOCATION))
+      {
+        return;
+      }
+      Id const& id{ mIds[type] };
+      u32 const vector{ id.mOp == SPV_OP_TYPE_VECTOR && id.mOperands.size() > 1 };
+      u32 const component{ vector ? id.mOperands[0] : type };
+      u32 const components{ vector ? id.mOperands[1] : 1 };
+      Id const& scalar{ mIds[component < mIds.size() ? component : 0] };
+      VkFormat const vkFormat{ scalar.mOperands.empty() ? VK_FORMAT_UNDEFINED : Format(scalar.mOp, scalar.mOperands[0], scalar.mOperands.size() > 1 ? scalar.mOperands[1] : 0, components) };
+      if (vkFormat == VK_FORMAT_UNDEFINED)
+      {
+        mpError = "has a vertex input without attribute format";
+        return;
+      }
+      mInputs.emplace_back(Input{ var.mLocation, vkFormat, Size(type) });
+      return;
+    }
+    case SPV_STORAGE_PUSH_CONSTANT:
+    {
+      mPushConstants = Size(type);
+      return;
+    }
+    case SPV_STORAGE_UNIFORM_CONSTANT:
+    case SPV_STORAGE_UNIFORM:
+    case SPV_STORAGE_STORAGE_BUFFER:
+    {
+      u32 const count{ Count(type) };
+      if (mpError)
+      {
+        return;
+      }
+      Id const& id{ mIds[type] };
+      VkDescriptorType vkType{ VK_DESCRIPTOR_TYPE_MAX_ENUM };
+      if (storageClass == SPV_STORAGE_STORAGE_BUFFER || (storageClass == SPV_STORAGE_UNIFORM && (id.mDecorations & DECORATED_BUFFER_BLOCK)))
+      {
+        vkType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      }
+      else if (storageClass == SPV_STORAGE_UNIFORM)
+      {
+        vkType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      }
+      else if (id.mOp == SPV_OP_TYPE_SAMPLED_IMAGE)
+      {
+        vkType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      }
+      else if (id.mOp == SPV_OP_TYPE_SAMPLER)
+      {
+        vkType = VK_DESCRIPTOR_TYPE_SAMPLER;
+      }
+      else if (id.mOp == SPV_OP_TYPE_IMAGE && id.mOperands.size() > 5)
+      {
+        u32 const dim{ id.mOperands[1] };
+        u32 const storage{ id.mOperands[5] == 2 };
+        if (dim == SPV_DIM_BUFFER)
+        {
+          vkType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+        }
+        else if (dim == SPV_DIM_SUBPASS)
+        {
+          vkType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+        }
+        else
+        {
+          vkType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+      }
+      if (vkType == VK_DESCRIPTOR_TYPE_MAX_ENUM)
+      {
+        mpError = "has a resource without descriptor type";
+        return;
+      }
+      if (!(var.mDecorations & DECORATED_BINDING))
+      {
+        mpError = "has a resource without binding";
+        return;
+      }
+      if (!count)
+      {
+        mpError = "has a descriptor array without size";
+        return;
+      }
+      mBindings.emplace_back(Binding{ var.mSet, var.mBinding, vkType, count });
+      return;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef VK_REFLECTION
+#define VK_REFLECTION
+
+/*
+* SPIR-V reflection.
+*
+* Module structure:
+* ---Header------------Instructions------------------------------------------------
+*    |                 |
+*    [Magic, Bound]    [EntryPoint, Decorate, MemberDecorate, Type*, Constant, Variable]
+*
+* A single pass over the instruction stream records the decorations, types and
+* constants of every id, variables are classified afterwards. Uniform and
+* storage blocks, images and samplers become descriptor bindings, the push
+* constant block becomes a range sized by its member offsets, and the vertex
+* inputs of a vertex stage become attributes packed in location order. Builtins
+* are skipped, modules compiled for OpenGL (gl_VertexID, gl_InstanceID) are
+* refused. Anything the renderer can not express is reported through Error.
+*/
+
+#include "VkCore.h"
+
+/*
+* Reflection.
+*/
+
+class VkReflection
+{
+public:
+  struct Binding
+  {
+    u32              mSet    {};
+    u32              mBinding{};
+    VkDescriptorType mType   {};
+    u32              mCount  {};
+  };
+
+  struct Input
+  {
+    u32      mLocation{};
+    VkFormat mFormat  {};
+    u32      mSize    {};
+  };
+
+public:
+  VkReflection(u32 const* pCode, u64 size);
+
+public:
+  __forceinline VkShaderStageFlagBits       Stage()         const noexcept { return mVkStage; }
+  __forceinline std::vector<Binding> const& Bindings()      const noexcept { return mBindings; }
+  // Vertex inputs ordered by location, empty unless the module is a vertex stage
+  __forceinline std::vector<Input> const&   Inputs()        const noexcept { return mInputs; }
+  // Size of the push constant block, zero if there is none
+  __forceinline u32                         PushConstants() const noexcept { return mPushConstants; }
+  // Reason the module could not be reflected, null if it could
+  __forceinline s8 const*                   Error()         const noexcept { return mpError; }
+
+private:
+  struct Id
+  {
+    u32              mOp           {};
+    u32              mType         {};
+    std::vector<u32> mOperands     {};
+    u32              mDecorations  {};
+    u32              mSet          {};
+    u32              mBinding      {};
+    u32              mLocation     {};
+    u32              mArrayStride  {};
+    std::vector<u32> mOffsets      {};
+    std::vector<u32> mMatrixStrides{};
+  };
+
+private:
+  // Both fail with Error once types nest deeper than any real module would, cyclic ids included
+  u32  Size(u32 type, u32 matrixStride = 0, u32 depth = 0);
+  u32  Count(u32& type);
+  void Classify(u32 variable);
+
+  VkShaderStageFlagBits mVkStage      {};
+  std::vector<Id>       mIds          {};
+  std::vector<Binding>  mBindings     {};
+  std::vector<Input>    mInputs       {};
+  u32                   mPushConstants{};
+  u32                   mTypeVisits   {};
+  s8 const*             mpError       {};
+};
+
+#endif
\ No newline at end of file
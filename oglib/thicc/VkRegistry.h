@@ -2,6 +2,7 @@
 #define VK_REGISTRY
 
 #include "VkCore.h"
+#include "VkPool.h"
 
 /*
 * Instance registry.
@@ -9,6 +10,12 @@
 
 namespace
 {
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 REGISTRY_SLAB{ 16 };
+
   /*
   * Global state.
   */
@@ -25,7 +32,7 @@ namespace
     auto& pInstance{ sRegistry[name] };
     if (!pInstance)
     {
-      pInstance = new T{ std::forward<Args>(args) ... };
+      pInstance = VkPool<T>::Get(REGISTRY_SLAB).Create(std::forward<Args>(args) ...);
     }
     return (T*)pInstance;
   }
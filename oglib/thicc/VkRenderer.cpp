@@ -1,10 +1,12 @@
 #include "VkRenderer.h"
 
-VkRenderer::VkRenderer(u32 width, u32 height, GLFWwindow* pGlfwWindow, u32 debug)
-  : mWidth{ width }
+VkRenderer::VkRenderer(u32 width, u32 height, GLFWwindow* pGlfwWindow, u32 debug, u32 frames)
+  : mDebug{ debug }
+  , mWidth{ width }
   , mHeight{ height }
   , mpGlfwWindow{ pGlfwWindow }
-  , mDebug{ debug }
+  , mHeadless{ !pGlfwWindow }
+  , mFrames{ std::clamp(frames, 1u, VK_FRAMES_MAX) }
 {
   CreateInstance();
   CreateDebugCallback();
@@ -14,38 +16,176 @@ VkRenderer::VkRenderer(u32 width, u32 height, GLFWwindow* pGlfwWindow, u32 debug
   FindQueueFamilies();
 
   CreateLogicalDevice();
-  CreateCommandPool();
-  CreateSwapChain();
+  CreateAllocator();
+  CreateUploader();
+  if (mHeadless)
+  {
+    CreateOffscreenImages();
+  }
+  else
+  {
+    CreateSwapChain();
+  }
+  CreateRenderPass();
+  CreateFramebuffers();
+  CreateFrames();
+  CreateRecorder();
 
-  CreateVertexBuffer();
-  CreateUniformBuffer();
+  CreateMeshBuffer();
+  CreateInstancer();
+  CreatePipelines();
+  CreateDescriptors();
 }
 VkRenderer::~VkRenderer()
 {
-
+  VK_VALIDATE(vkDeviceWaitIdle(mVkLogicalDevice));
+  delete mpVkUploader;
+  delete mpVkPipelines;
+  vkDestroyDescriptorPool(mVkLogicalDevice, mVkDescriptorPool, nullptr);
+  delete mpVkInstancer;
+  delete mpVkRecorder;
+  for (auto& frame : mFrames)
+  {
+    mpVkAllocator->DestroyBuffer(frame.mVkReadbackBuffer, frame.mReadbackAllocation);
+    mpVkAllocator->DestroyBuffer(frame.mVkMvpBuffer, frame.mMvpBufferAllocation);
+    vkDestroyQueryPool(mVkLogicalDevice, frame.mVkQueryPool, nullptr);
+    vkDestroySemaphore(mVkLogicalDevice, frame.mVkImageAvailableSemaphore, nullptr);
+    vkDestroyFence(mVkLogicalDevice, frame.mVkInFlightFence, nullptr);
+    vkDestroyCommandPool(mVkLogicalDevice, frame.mVkCommandPool, nullptr);
+  }
+  DestroyFramebuffers();
+  for (u32 i{}; i < (u32)mOffscreenAllocations.size(); ++i)
+  {
+    mpVkAllocator->DestroyImage(mVkSwapChainImages[i], mOffscreenAllocations[i]);
+  }
+  vkDestroyRenderPass(mVkLogicalDevice, mVkRenderPass, nullptr);
+  mpVkMeshBuffer->Destroy(mTriangle);
+  for (auto& mesh : mMeshes)
+  {
+    mpVkMeshBuffer->Destroy(mesh);
+  }
+  delete mpVkMeshBuffer;
+  delete mpVkAllocator;
 }
 
-u32 VkRenderer::DebugCallback(VkDebugReportFlagsEXT vkFlags, VkDebugReportObjectTypeEXT vkObjType, u64 srcObject, u32 location, u32 msgCode, s8 const* pLayerPrefix, s8 const* pMessage, void* pUserData)
+void VkRenderer::Render(VkCulling::View const* pView)
 {
-  if (vkFlags & (VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT))
+  Frame& frame{ mFrames[mFrame] };
+  // Wait until the device released this slot, the other slots keep the device busy meanwhile
+  auto const waitStart{ std::chrono::high_resolution_clock::now() };
+  VK_VALIDATE(vkWaitForFences(mVkLogicalDevice, 1, &frame.mVkInFlightFence, 1, ~0ull));
+  auto const recordStart{ std::chrono::high_resolution_clock::now() };
+  mpVkUploader->Poll();
+  Resolve(frame);
+  // Acquire next image
+  u32 image{};
+  if (!Acquire(frame, image))
   {
-    VK_LOG("%s\n%u\n%s\n", pLayerPrefix, msgCode, pMessage);
+    return;
   }
-  return 0;
+  // Per frame uniforms and instances, the projection gets flipped into the downward y of vulkan clip space
+  u32 commands{};
+  if (pView)
+  {
+    r32m4 projection{ pView->mProjection };
+    projection[1][1] *= -1.0f;
+    r32m4 const model{ 1.0f };
+    UniformMvp* pUniformMvp{ (UniformMvp*)frame.mMvpBufferAllocation.mpMapped };
+    std::memcpy(pUniformMvp->mProjection, &projection[0][0], sizeof(UniformMvp::mProjection));
+    std::memcpy(pUniformMvp->mView, &pView->mView[0][0], sizeof(UniformMvp::mView));
+    std::memcpy(pUniformMvp->mModel, &model[0][0], sizeof(UniformMvp::mModel));
+    mpVkInstancer->Build(*pView, mFrame, *mpVkMeshBuffer);
+    commands = mpVkInstancer->Commands();
+  }
+  // Record commands
+  VK_VALIDATE(vkResetFences(mVkLogicalDevice, 1, &frame.mVkInFlightFence));
+  VK_VALIDATE(vkResetCommandPool(mVkLogicalDevice, frame.mVkCommandPool, 0));
+  mpVkRecorder->Reset(mFrame);
+  Record(frame, image, commands);
+  // Submit commands, offscreen images have no presentation engine to synchronize with
+  VkPipelineStageFlags const vkWaitStage{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+  VkSubmitInfo vkSubmitInfo{};
+  vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  vkSubmitInfo.commandBufferCount = 1;
+  vkSubmitInfo.pCommandBuffers = &frame.mVkCommandBuffer;
+  if (!mHeadless)
+  {
+    vkSubmitInfo.waitSemaphoreCount = 1;
+    vkSubmitInfo.pWaitSemaphores = &frame.mVkImageAvailableSemaphore;
+    vkSubmitInfo.pWaitDstStageMask = &vkWaitStage;
+    vkSubmitInfo.signalSemaphoreCount = 1;
+    vkSubmitInfo.pSignalSemaphores = &mVkRenderFinishedSemaphores[image];
+  }
+  VK_VALIDATE(vkQueueSubmit(mVkGraphicsQueue, 1, &vkSubmitInfo, frame.mVkInFlightFence));
+  if (!mHeadless)
+  {
+    Present(image);
+  }
+  auto const recordEnd{ std::chrono::high_resolution_clock::now() };
+  mTimings.mWait = std::chrono::duration<r64, std::milli>(recordStart - waitStart).count();
+  mTimings.mRecord = std::chrono::duration<r64, std::milli>(recordEnd - recordStart).count();
+  mFrameLast = mFrame;
+  mFrame = (mFrame + 1) % (u32)mFrames.size();
 }
-u32 VkRenderer::GetMemoryType(VkPhysicalDeviceMemoryProperties vkProperties, u32 typeBits, u32 properties, u32* typeIndex)
+std::vector<u8> VkRenderer::Readback()
 {
-  for (u32 i = 0; i < 32; i++)
+  Frame& frame{ mFrames[mFrameLast] };
+  if (!frame.mReadback)
   {
-    if ((typeBits & 1) == 1)
+    return {};
+  }
+  VK_VALIDATE(vkWaitForFences(mVkLogicalDevice, 1, &frame.mVkInFlightFence, 1, ~0ull));
+  u8 const* pPixels{ (u8 const*)frame.mReadbackAllocation.mpMapped };
+  return std::vector<u8>(pPixels, pPixels + (u64)mVkSwapChainExtend.width * mVkSwapChainExtend.height * 4);
+}
+std::vector<VkMesh const*> VkRenderer::LoadMeshes(std::filesystem::path const& path)
+{
+  std::vector<VkMesh const*> meshes{};
+  auto const load{ [&](auto& reader)
+  {
+    if (!reader.template Holds<VertexLambertCompact>())
     {
-      if ((vkProperties.memoryTypes[i].propertyFlags & properties) == properties)
-      {
-        *typeIndex = i;
-        return 1;
-      }
+      VK_LOG("Mesh file %s holds another vertex layout\n", path.string().c_str());
+      return;
     }
-    typeBits >>= 1;
+    for (u32 i{}; i < reader.Count(); ++i)
+    {
+      // Meshlets and levels outlive the reader, the mesh points at the copies
+      VkMesh& mesh{ mMeshes.emplace_back(reader.Load(*mpVkMeshBuffer, i)) };
+      VkMeshlet const* pMeshlets{ reader.Meshlets(i) };
+      std::vector<VkMeshlet> const& meshlets{ mMeshlets.emplace_back(pMeshlets, pMeshlets + reader.Record(i).mMeshletCount) };
+      mesh.mpMeshlets = meshlets.data();
+      mesh.mMeshletCount = (u32)meshlets.size();
+      VkMeshLod const* pLods{ reader.Lods(i) };
+      std::vector<VkMeshLod> const& lods{ mLods.emplace_back(pLods, pLods + reader.Record(i).mLodCount) };
+      mesh.mpLods = lods.data();
+      mesh.mLodCount = (u32)lods.size();
+      meshes.emplace_back(&mesh);
+    }
+    mpVkUploader->Submit();
+  } };
+  // Mapping fails for files beyond the address space, those get streamed instead
+  VkMeshFile const file{ path };
+  if (!file.Error())
+  {
+    load(file);
+    return meshes;
+  }
+  VkMeshStream stream{ path };
+  if (stream.Error())
+  {
+    VK_LOG("Mesh file %s %s\n", path.string().c_str(), stream.Error());
+    return meshes;
+  }
+  load(stream);
+  return meshes;
+}
+
+u32 VkRenderer::DebugCallback(VkDebugReportFlagsEXT vkFlags, VkDebugReportObjectTypeEXT vkObjType, u64 srcObject, u32 location, u32 msgCode, s8 const* pLayerPrefix, s8 const* pMessage, void* pUserData)
+{
+  if (vkFlags & (VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT))
+  {
+    VK_LOG("%s\n%u\n%s\n", pLayerPrefix, msgCode, pMessage);
   }
   return 0;
 }
@@ -112,7 +252,8 @@ void VkRenderer::CreateInstance()
     }
   }
   // Gather required extensions
-  mVkRequiredExtensionPropertyNames = VkUtils::GetRequiredExtensionNames(mDebug);
+  mVkRequiredExtensionPropertyNames = VkUtils::GetRequiredExtensionNames(mDebug, !mHeadless);
+  mVkRequiredDeviceExtensionNames = VkUtils::GetRequiredDeviceExtensionNames(!mHeadless);
   std::printf("Required extensions:\n");
   for (auto const& pVkRequiredExtensionPropertyName : mVkRequiredExtensionPropertyNames)
   {
@@ -142,6 +283,11 @@ void VkRenderer::CreateInstance()
 }
 void VkRenderer::CreateDebugCallback()
 {
+  // The report extension only gets enabled along with validation
+  if (!mDebug)
+  {
+    return;
+  }
   // Debug report callback create info
   VkDebugReportCallbackCreateInfoEXT vkDebugReportCallbackCreateInfo{};
   vkDebugReportCallbackCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
@@ -154,7 +300,12 @@ void VkRenderer::CreateDebugCallback()
 }
 void VkRenderer::CreateWindowSurface()
 {
-  VK_VALIDATE(glfwCreateWindowSurface(mVkInstance, mpGlfwWindow, nullptr, &mVkWindowSurface));
+#ifndef VK_HEADLESS
+  if (!mHeadless)
+  {
+    VK_VALIDATE(glfwCreateWindowSurface(mVkInstance, mpGlfwWindow, nullptr, &mVkWindowSurface));
+  }
+#endif
 }
 void VkRenderer::CreatePhysicalDevice()
 {
@@ -176,34 +327,38 @@ void VkRenderer::CreatePhysicalDevice()
   {
     std::printf("\t%s\n", pVkSupportedExtensionPropertyName);
   }
+  // Gather supported features and limits
+  vkGetPhysicalDeviceFeatures(mVkPhysicalDevice, &mVkPhysicalDeviceFeatures);
+  vkGetPhysicalDeviceProperties(mVkPhysicalDevice, &mVkPhysicalDeviceProperties);
 }
 void VkRenderer::CreateLogicalDevice()
 {
   r32 queuePriority{ 1.f };
+  // Unique queue families
+  std::set<s32> queueFamilies{ mGraphicsQueueFamily.value(), mPresentQueueFamily.value(), mTransferQueueFamily.value() };
   // Device queue create infos
-  VkDeviceQueueCreateInfo vkDeviceQueueCreateInfos[2]{};
-  vkDeviceQueueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  vkDeviceQueueCreateInfos[0].queueFamilyIndex = mGraphicsQueueFamily.value();
-  vkDeviceQueueCreateInfos[0].queueCount = 1;
-  vkDeviceQueueCreateInfos[0].pQueuePriorities = &queuePriority;
-  vkDeviceQueueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  vkDeviceQueueCreateInfos[1].queueFamilyIndex = mPresentQueueFamily.value();
-  vkDeviceQueueCreateInfos[1].queueCount = 1;
-  vkDeviceQueueCreateInfos[1].pQueuePriorities = &queuePriority;
+  std::vector<VkDeviceQueueCreateInfo> vkDeviceQueueCreateInfos{};
+  for (s32 queueFamily : queueFamilies)
+  {
+    VkDeviceQueueCreateInfo vkDeviceQueueCreateInfo{};
+    vkDeviceQueueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    vkDeviceQueueCreateInfo.queueFamilyIndex = queueFamily;
+    vkDeviceQueueCreateInfo.queueCount = 1;
+    vkDeviceQueueCreateInfo.pQueuePriorities = &queuePriority;
+    vkDeviceQueueCreateInfos.emplace_back(vkDeviceQueueCreateInfo);
+  }
+  // Indirect draws merge instances of all meshes if supported
+  VkPhysicalDeviceFeatures vkPhysicalDeviceFeatures{};
+  vkPhysicalDeviceFeatures.multiDrawIndirect = mVkPhysicalDeviceFeatures.multiDrawIndirect;
+  vkPhysicalDeviceFeatures.drawIndirectFirstInstance = mVkPhysicalDeviceFeatures.drawIndirectFirstInstance;
   // Device create info
   VkDeviceCreateInfo vkDeviceCreateInfo{};
   vkDeviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  vkDeviceCreateInfo.pQueueCreateInfos = vkDeviceQueueCreateInfos;
-  vkDeviceCreateInfo.enabledExtensionCount = (u32)mVkRequiredExtensionPropertyNames.size();
-  vkDeviceCreateInfo.ppEnabledExtensionNames = mVkRequiredExtensionPropertyNames.data();
-  if (mGraphicsQueueFamily.value() == mPresentQueueFamily.value())
-  {
-    vkDeviceCreateInfo.queueCreateInfoCount = 1;
-  }
-  else
-  {
-    vkDeviceCreateInfo.queueCreateInfoCount = 2;
-  }
+  vkDeviceCreateInfo.queueCreateInfoCount = (u32)vkDeviceQueueCreateInfos.size();
+  vkDeviceCreateInfo.pQueueCreateInfos = vkDeviceQueueCreateInfos.data();
+  vkDeviceCreateInfo.enabledExtensionCount = (u32)mVkRequiredDeviceExtensionNames.size();
+  vkDeviceCreateInfo.ppEnabledExtensionNames = mVkRequiredDeviceExtensionNames.data();
+  vkDeviceCreateInfo.pEnabledFeatures = &vkPhysicalDeviceFeatures;
   if (mDebug)
   {
     vkDeviceCreateInfo.enabledLayerCount = 1;
@@ -214,17 +369,17 @@ void VkRenderer::CreateLogicalDevice()
   // Gather queues
   vkGetDeviceQueue(mVkLogicalDevice, mGraphicsQueueFamily.value(), 0, &mVkGraphicsQueue);
   vkGetDeviceQueue(mVkLogicalDevice, mPresentQueueFamily.value(), 0, &mVkPresentQueue);
+  vkGetDeviceQueue(mVkLogicalDevice, mTransferQueueFamily.value(), 0, &mVkTransferQueue);
   // Gather device properties
   vkGetPhysicalDeviceMemoryProperties(mVkPhysicalDevice, &mVkPhysicalDeviceMemoryProperties);
 }
-void VkRenderer::CreateCommandPool()
+void VkRenderer::CreateAllocator()
+{
+  mpVkAllocator = new VkAllocator{ mVkPhysicalDevice, mVkLogicalDevice };
+}
+void VkRenderer::CreateUploader()
 {
-  // Command pool create info
-  VkCommandPoolCreateInfo vkCommandPoolCreateInfo{};
-  vkCommandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  vkCommandPoolCreateInfo.queueFamilyIndex = mGraphicsQueueFamily.value();
-  // Create command pool
-  VK_VALIDATE(vkCreateCommandPool(mVkLogicalDevice, &vkCommandPoolCreateInfo, nullptr, &mVkCommandPool));
+  mpVkUploader = new VkUploader{ mVkLogicalDevice, mpVkAllocator, mVkTransferQueue, (u32)mTransferQueueFamily.value(), (u32)mGraphicsQueueFamily.value() };
 }
 void VkRenderer::CreateSwapChain()
 {
@@ -239,7 +394,7 @@ void VkRenderer::CreateSwapChain()
   // Find supported present modes
   u32 presentModeCount{};
   VK_VALIDATE(vkGetPhysicalDeviceSurfacePresentModesKHR(mVkPhysicalDevice, mVkWindowSurface, &presentModeCount, nullptr));
-  std::vector<VkPresentModeKHR> vkPresentModesKhr{};
+  std::vector<VkPresentModeKHR> vkPresentModesKhr{ presentModeCount };
   VK_VALIDATE(vkGetPhysicalDeviceSurfacePresentModesKHR(mVkPhysicalDevice, mVkWindowSurface, &presentModeCount, vkPresentModesKhr.data()));
   // Gather number of images for swapchain
   u32 requiredImageCount{ vkSurfaceCapabilitiesKhr.minImageCount };
@@ -296,8 +451,174 @@ void VkRenderer::CreateSwapChain()
   VK_VALIDATE(vkGetSwapchainImagesKHR(mVkLogicalDevice, mVkSwapChainKhr, &currentImageCount, mVkSwapChainImages.data()));
   std::printf("Images current for swapchain %u\n", currentImageCount);
 }
+void VkRenderer::CreateOffscreenImages()
+{
+  // One image per frame in flight, frames never wait on each other for an image
+  mVkSwapChainExtend = { mWidth, mHeight };
+  mVkSwapChainFormat = VK_OFFSCREEN_FORMAT;
+  mVkSwapChainImages.resize(mFrames.size());
+  mOffscreenAllocations.resize(mFrames.size());
+  for (u32 i{}; i < (u32)mFrames.size(); ++i)
+  {
+    // Image create info
+    VkImageCreateInfo vkImageCreateInfo{};
+    vkImageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    vkImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    vkImageCreateInfo.format = mVkSwapChainFormat;
+    vkImageCreateInfo.extent = { mWidth, mHeight, 1 };
+    vkImageCreateInfo.mipLevels = 1;
+    vkImageCreateInfo.arrayLayers = 1;
+    vkImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    vkImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    vkImageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    vkImageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    vkImageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    mpVkAllocator->CreateImage(vkImageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mVkSwapChainImages[i], mOffscreenAllocations[i]);
+  }
+  std::printf("Images offscreen %u\n", (u32)mVkSwapChainImages.size());
+}
+void VkRenderer::CreateRenderPass()
+{
+  // Color attachment
+  VkAttachmentDescription vkAttachmentDescription{};
+  vkAttachmentDescription.format = mVkSwapChainFormat;
+  vkAttachmentDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+  vkAttachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  vkAttachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  vkAttachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  vkAttachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  vkAttachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  vkAttachmentDescription.finalLayout = mHeadless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  VkAttachmentReference vkAttachmentReference{};
+  vkAttachmentReference.attachment = 0;
+  vkAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  // Subpass description
+  VkSubpassDescription vkSubpassDescription{};
+  vkSubpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  vkSubpassDescription.colorAttachmentCount = 1;
+  vkSubpassDescription.pColorAttachments = &vkAttachmentReference;
+  // Layout transition waits until the acquired image got released by the presentation engine
+  VkSubpassDependency vkSubpassDependencies[2]{};
+  vkSubpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  vkSubpassDependencies[0].dstSubpass = 0;
+  vkSubpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  vkSubpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  vkSubpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  // Offscreen images get copied out after the pass
+  vkSubpassDependencies[1].srcSubpass = 0;
+  vkSubpassDependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  vkSubpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  vkSubpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  vkSubpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  vkSubpassDependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  // Render pass create info
+  VkRenderPassCreateInfo vkRenderPassCreateInfo{};
+  vkRenderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  vkRenderPassCreateInfo.attachmentCount = 1;
+  vkRenderPassCreateInfo.pAttachments = &vkAttachmentDescription;
+  vkRenderPassCreateInfo.subpassCount = 1;
+  vkRenderPassCreateInfo.pSubpasses = &vkSubpassDescription;
+  vkRenderPassCreateInfo.dependencyCount = mHeadless ? 2 : 1;
+  vkRenderPassCreateInfo.pDependencies = vkSubpassDependencies;
+  VK_VALIDATE(vkCreateRenderPass(mVkLogicalDevice, &vkRenderPassCreateInfo, nullptr, &mVkRenderPass));
+}
+void VkRenderer::CreateFramebuffers()
+{
+  u32 const imageCount{ (u32)mVkSwapChainImages.size() };
+  mVkSwapChainImageViews.resize(imageCount);
+  mVkFramebuffers.resize(imageCount);
+  mVkRenderFinishedSemaphores.resize(imageCount);
+  mVkImagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+  for (u32 i{}; i < imageCount; ++i)
+  {
+    // Image view create info
+    VkImageViewCreateInfo vkImageViewCreateInfo{};
+    vkImageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    vkImageViewCreateInfo.image = mVkSwapChainImages[i];
+    vkImageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    vkImageViewCreateInfo.format = mVkSwapChainFormat;
+    vkImageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    vkImageViewCreateInfo.subresourceRange.levelCount = 1;
+    vkImageViewCreateInfo.subresourceRange.layerCount = 1;
+    VK_VALIDATE(vkCreateImageView(mVkLogicalDevice, &vkImageViewCreateInfo, nullptr, &mVkSwapChainImageViews[i]));
+    // Framebuffer create info
+    VkFramebufferCreateInfo vkFramebufferCreateInfo{};
+    vkFramebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    vkFramebufferCreateInfo.renderPass = mVkRenderPass;
+    vkFramebufferCreateInfo.attachmentCount = 1;
+    vkFramebufferCreateInfo.pAttachments = &mVkSwapChainImageViews[i];
+    vkFramebufferCreateInfo.width = mVkSwapChainExtend.width;
+    vkFramebufferCreateInfo.height = mVkSwapChainExtend.height;
+    vkFramebufferCreateInfo.layers = 1;
+    VK_VALIDATE(vkCreateFramebuffer(mVkLogicalDevice, &vkFramebufferCreateInfo, nullptr, &mVkFramebuffers[i]));
+    if (mHeadless)
+    {
+      continue;
+    }
+    // Presentation waits on the image it was rendered into, one semaphore per image
+    VkSemaphoreCreateInfo vkSemaphoreCreateInfo{};
+    vkSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VK_VALIDATE(vkCreateSemaphore(mVkLogicalDevice, &vkSemaphoreCreateInfo, nullptr, &mVkRenderFinishedSemaphores[i]));
+  }
+}
+void VkRenderer::CreateFrames()
+{
+  for (auto& frame : mFrames)
+  {
+    // Command pool create info, reset as a whole once the frame retired
+    VkCommandPoolCreateInfo vkCommandPoolCreateInfo{};
+    vkCommandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    vkCommandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    vkCommandPoolCreateInfo.queueFamilyIndex = mGraphicsQueueFamily.value();
+    VK_VALIDATE(vkCreateCommandPool(mVkLogicalDevice, &vkCommandPoolCreateInfo, nullptr, &frame.mVkCommandPool));
+    // Command buffer allocate info
+    VkCommandBufferAllocateInfo vkCommandBufferAllocateInfo{};
+    vkCommandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    vkCommandBufferAllocateInfo.commandPool = frame.mVkCommandPool;
+    vkCommandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    vkCommandBufferAllocateInfo.commandBufferCount = 1;
+    VK_VALIDATE(vkAllocateCommandBuffers(mVkLogicalDevice, &vkCommandBufferAllocateInfo, &frame.mVkCommandBuffer));
+    // Fences start signaled so the first wait on every slot passes
+    VkFenceCreateInfo vkFenceCreateInfo{};
+    vkFenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    vkFenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VK_VALIDATE(vkCreateFence(mVkLogicalDevice, &vkFenceCreateInfo, nullptr, &frame.mVkInFlightFence));
+    VkSemaphoreCreateInfo vkSemaphoreCreateInfo{};
+    vkSemaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VK_VALIDATE(vkCreateSemaphore(mVkLogicalDevice, &vkSemaphoreCreateInfo, nullptr, &frame.mVkImageAvailableSemaphore));
+    // Uniform buffer create info, stays mapped and gets written every frame
+    VkBufferCreateInfo vkBufferCreateInfo{};
+    vkBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    vkBufferCreateInfo.size = sizeof(UniformMvp);
+    vkBufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    mpVkAllocator->CreateBuffer(vkBufferCreateInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.mVkMvpBuffer, frame.mMvpBufferAllocation);
+    // Query pool create info, one timestamp at the begin and one at the end of the frame
+    if (mTimestampBits)
+    {
+      VkQueryPoolCreateInfo vkQueryPoolCreateInfo{};
+      vkQueryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      vkQueryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      vkQueryPoolCreateInfo.queryCount = 2;
+      VK_VALIDATE(vkCreateQueryPool(mVkLogicalDevice, &vkQueryPoolCreateInfo, nullptr, &frame.mVkQueryPool));
+    }
+    // Readback buffer create info, offscreen frames get copied into it on request
+    if (mHeadless)
+    {
+      VkBufferCreateInfo vkReadbackBufferCreateInfo{};
+      vkReadbackBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+      vkReadbackBufferCreateInfo.size = (u64)mVkSwapChainExtend.width * mVkSwapChainExtend.height * 4;
+      vkReadbackBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      mpVkAllocator->CreateBuffer(vkReadbackBufferCreateInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.mVkReadbackBuffer, frame.mReadbackAllocation);
+    }
+  }
+}
+
+void VkRenderer::CreateRecorder()
+{
+  mpVkRecorder = new VkRecorder{ mVkLogicalDevice, (u32)mGraphicsQueueFamily.value(), (u32)mFrames.size() };
+}
 
-void VkRenderer::CreateVertexBuffer()
+void VkRenderer::CreateMeshBuffer()
 {
   std::vector<VertexLambert> vertices
   {
@@ -306,156 +627,108 @@ void VkRenderer::CreateVertexBuffer()
     VertexLambert{ {  0.5f,  0.5f, 0.f }, { 0.f, 0.f, 0.f }, { 0.f, 0.f }, { 0.f, 0.f, 1.f, 1.f } },
   };
   std::vector<u32> indices{ 0, 1, 2 };
-  // Command Buffer allocate info
-  VkCommandBufferAllocateInfo vkCommandBufferAllocateInfo{};
-  vkCommandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  vkCommandBufferAllocateInfo.commandPool = mVkCommandPool;
-  vkCommandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  vkCommandBufferAllocateInfo.commandBufferCount = 1;
-  // Copy command buffer
-  VkCommandBuffer vkCommandBufferCopy{};
-  VK_VALIDATE(vkAllocateCommandBuffers(mVkLogicalDevice, &vkCommandBufferAllocateInfo, &vkCommandBufferCopy));
-  // Staging buffers
-  VkDeviceMemory vkVertexDeviceMemory{};
-  VkDeviceMemory vkIndexDeviceMemory{};
-  VkBuffer vkVertexBuffer{};
-  VkBuffer vkIndexBuffer{};
-  // Transfer vertices to GPU
-  {
-    // Vertex buffer create info
-    VkBufferCreateInfo vkVertexBufferCreateInfo{};
-    vkVertexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    vkVertexBufferCreateInfo.size = sizeof(VertexLambert) * vertices.size();
-    vkVertexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    // Host buffer
-    VK_VALIDATE(vkCreateBuffer(mVkLogicalDevice, &vkVertexBufferCreateInfo, nullptr, &vkVertexBuffer));
-    // Gather buffer requirements
-    VkMemoryRequirements vkMemoryRequirements{};
-    vkGetBufferMemoryRequirements(mVkLogicalDevice, vkVertexBuffer, &vkMemoryRequirements);
-    // Memory allocate info
-    VkMemoryAllocateInfo vkMemoryAllocateInfo{};
-    vkMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vkMemoryAllocateInfo.allocationSize = vkMemoryRequirements.size;
-    GetMemoryType(mVkPhysicalDeviceMemoryProperties, vkMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vkMemoryAllocateInfo.memoryTypeIndex);
-    // Device buffer
-    vkAllocateMemory(mVkLogicalDevice, &vkMemoryAllocateInfo, nullptr, &vkVertexDeviceMemory);
-    // Copy memory to mapped buffer
-    void* pMemory{};
-    VK_VALIDATE(vkMapMemory(mVkLogicalDevice, vkVertexDeviceMemory, 0, sizeof(VertexLambert) * vertices.size(), 0, &pMemory));
-    std::memcpy(pMemory, vertices.data(), sizeof(VertexLambert) * vertices.size());
-    vkUnmapMemory(mVkLogicalDevice, vkVertexDeviceMemory);
-    vkBindBufferMemory(mVkLogicalDevice, vkVertexBuffer, vkVertexDeviceMemory, 0);
-    // Allocate GPU only buffer
-    vkVertexBufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VK_VALIDATE(vkCreateBuffer(mVkLogicalDevice, &vkVertexBufferCreateInfo, nullptr, &mVkVertexBuffer));
-    vkGetBufferMemoryRequirements(mVkLogicalDevice, mVkVertexBuffer, &vkMemoryRequirements);
-    vkMemoryAllocateInfo.allocationSize = vkMemoryRequirements.size;
-    GetMemoryType(mVkPhysicalDeviceMemoryProperties, vkMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkMemoryAllocateInfo.memoryTypeIndex);
-    VK_VALIDATE(vkAllocateMemory(mVkLogicalDevice, &vkMemoryAllocateInfo, nullptr, &mVkVertexBufferMemory));
-    VK_VALIDATE(vkBindBufferMemory(mVkLogicalDevice, mVkVertexBuffer, mVkVertexBufferMemory, 0));
-  }
-  // Transfer indices to GPU
-  {
-    // Index buffer create info
-    VkBufferCreateInfo vkIndexBufferCreateInfo{};
-    vkIndexBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    vkIndexBufferCreateInfo.size = sizeof(u32) * indices.size();
-    vkIndexBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    // Host buffer
-    VK_VALIDATE(vkCreateBuffer(mVkLogicalDevice, &vkIndexBufferCreateInfo, nullptr, &vkIndexBuffer));
-    // Gather buffer requirements
-    VkMemoryRequirements vkMemoryRequirements{};
-    vkGetBufferMemoryRequirements(mVkLogicalDevice, vkIndexBuffer, &vkMemoryRequirements);
-    // Memory allocate info
-    VkMemoryAllocateInfo vkMemoryAllocateInfo{};
-    vkMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vkMemoryAllocateInfo.allocationSize = vkMemoryRequirements.size;
-    GetMemoryType(mVkPhysicalDeviceMemoryProperties, vkMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vkMemoryAllocateInfo.memoryTypeIndex);
-    // Device buffer
-    vkAllocateMemory(mVkLogicalDevice, &vkMemoryAllocateInfo, nullptr, &vkIndexDeviceMemory);
-    // Copy memory to mapped buffer
-    void* pMemory{};
-    VK_VALIDATE(vkMapMemory(mVkLogicalDevice, vkIndexDeviceMemory, 0, sizeof(u32) * indices.size(), 0, &pMemory));
-    std::memcpy(pMemory, indices.data(), sizeof(u32) * indices.size());
-    vkUnmapMemory(mVkLogicalDevice, vkIndexDeviceMemory);
-    vkBindBufferMemory(mVkLogicalDevice, vkIndexBuffer, vkIndexDeviceMemory, 0);
-    // Allocate GPU only buffer
-    vkIndexBufferCreateInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-    VK_VALIDATE(vkCreateBuffer(mVkLogicalDevice, &vkIndexBufferCreateInfo, nullptr, &mVkIndexBuffer));
-    vkGetBufferMemoryRequirements(mVkLogicalDevice, mVkIndexBuffer, &vkMemoryRequirements);
-    vkMemoryAllocateInfo.allocationSize = vkMemoryRequirements.size;
-    GetMemoryType(mVkPhysicalDeviceMemoryProperties, vkMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkMemoryAllocateInfo.memoryTypeIndex);
-    VK_VALIDATE(vkAllocateMemory(mVkLogicalDevice, &vkMemoryAllocateInfo, nullptr, &mVkIndexBufferMemory));
-    VK_VALIDATE(vkBindBufferMemory(mVkLogicalDevice, mVkIndexBuffer, mVkIndexBufferMemory, 0));
-  }
-  // Command buffer begin info
-  VkCommandBufferBeginInfo vkCommandBufferBeginInfo{};
-  vkCommandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  vkCommandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-  VK_VALIDATE(vkBeginCommandBuffer(vkCommandBufferCopy, &vkCommandBufferBeginInfo));
-  // Issue commands
-  VkBufferCopy vkBufferCopy{};
-  vkBufferCopy.size = sizeof(VertexLambert) * vertices.size();
-  vkCmdCopyBuffer(vkCommandBufferCopy, vkVertexBuffer, mVkVertexBuffer, 1, &vkBufferCopy);
-  vkBufferCopy.size = sizeof(u32) * indices.size();
-  vkCmdCopyBuffer(vkCommandBufferCopy, vkIndexBuffer, mVkIndexBuffer, 1, &vkBufferCopy);
-  VK_VALIDATE(vkEndCommandBuffer(vkCommandBufferCopy));
-  // Submit commands
-  VkSubmitInfo vkSubmitInfo{};
-  vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  vkSubmitInfo.commandBufferCount = 1;
-  vkSubmitInfo.pCommandBuffers = &vkCommandBufferCopy;
-  VK_VALIDATE(vkQueueSubmit(mVkGraphicsQueue, 1, &vkSubmitInfo, VK_NULL_HANDLE));
-  VK_VALIDATE(vkQueueWaitIdle(mVkGraphicsQueue));
-  vkFreeCommandBuffers(mVkLogicalDevice, mVkCommandPool, 1, &vkCommandBufferCopy);
-  // Cleanup
-  vkDestroyBuffer(mVkLogicalDevice, vkVertexBuffer, nullptr);
-  vkDestroyBuffer(mVkLogicalDevice, vkIndexBuffer, nullptr);
-  vkFreeMemory(mVkLogicalDevice, vkVertexDeviceMemory, nullptr);
-  vkFreeMemory(mVkLogicalDevice, vkIndexDeviceMemory, nullptr);
-
-  mVkVertexInputBindingDescription.binding = 0;
-  mVkVertexInputBindingDescription.stride = sizeof(VertexLambert);
-  mVkVertexInputBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  mVkVertexInputAttributeDescriptions[0].binding = 0;
-  mVkVertexInputAttributeDescriptions[0].location = 0;
-  mVkVertexInputAttributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  mVkVertexInputAttributeDescriptions[0].offset = 0;
-
-  mVkVertexInputAttributeDescriptions[1].binding = 0;
-  mVkVertexInputAttributeDescriptions[1].location = 1;
-  mVkVertexInputAttributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  mVkVertexInputAttributeDescriptions[1].offset = sizeof(r32) * 3;
+  // Meshes are authored in floats and quantized before they are uploaded
+  std::vector<VertexLambertCompact> compact(vertices.size());
+  VkVertex::Compact(vertices.data(), compact.data(), (u32)vertices.size());
+  // Shared buffers for every mesh of this vertex layout
+  mpVkMeshBuffer = new VkMeshBuffer{ mpVkAllocator, mpVkUploader, sizeof(VertexLambertCompact) };
+  mTriangle = mpVkMeshBuffer->Create(compact.data(), (u32)compact.size(), indices.data(), (u32)indices.size());
+  mpVkUploader->Submit();
+}
+void VkRenderer::CreateInstancer()
+{
+  mpVkInstancer = new VkInstancer{ mpVkAllocator, mVkPhysicalDeviceFeatures, (u32)mFrames.size() };
+}
 
-  mVkVertexInputAttributeDescriptions[2].binding = 0;
-  mVkVertexInputAttributeDescriptions[2].location = 2;
-  mVkVertexInputAttributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-  mVkVertexInputAttributeDescriptions[2].offset = (sizeof(r32) * 3) + (sizeof(r32) * 3);
+void VkRenderer::CreatePipelines()
+{
+  mpVkPipelines = new VkPipelines{ mVkLogicalDevice, mVkPhysicalDeviceProperties, mVkRenderPass };
+}
+void VkRenderer::CreateDescriptors()
+{
+  // Descriptor pool sizes, every frame owns one set per program
+  std::map<VkDescriptorType, u32> descriptorCounts{};
+  for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+  {
+    for (auto const& vkBinding : mpVkPipelines->Bindings((VkShader)i))
+    {
+      descriptorCounts[vkBinding.descriptorType] += vkBinding.descriptorCount * (u32)mFrames.size();
+    }
+  }
+  std::vector<VkDescriptorPoolSize> vkDescriptorPoolSizes{};
+  for (auto const& [vkDescriptorType, count] : descriptorCounts)
+  {
+    vkDescriptorPoolSizes.emplace_back(VkDescriptorPoolSize{ vkDescriptorType, count });
+  }
+  // Descriptor pool create info
+  VkDescriptorPoolCreateInfo vkDescriptorPoolCreateInfo{};
+  vkDescriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  vkDescriptorPoolCreateInfo.maxSets = VK_SHADER_COUNT * (u32)mFrames.size();
+  vkDescriptorPoolCreateInfo.poolSizeCount = (u32)vkDescriptorPoolSizes.size();
+  vkDescriptorPoolCreateInfo.pPoolSizes = vkDescriptorPoolSizes.data();
+  VK_VALIDATE(vkCreateDescriptorPool(mVkLogicalDevice, &vkDescriptorPoolCreateInfo, nullptr, &mVkDescriptorPool));
+  for (u32 frameIndex{}; frameIndex < (u32)mFrames.size(); ++frameIndex)
+  {
+    Frame& frame{ mFrames[frameIndex] };
+    for (u32 i{}; i < VK_SHADER_COUNT; ++i)
+    {
+      // Descriptor set allocate info
+      VkDescriptorSetAllocateInfo vkDescriptorSetAllocateInfo{};
+      vkDescriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      vkDescriptorSetAllocateInfo.descriptorPool = mVkDescriptorPool;
+      vkDescriptorSetAllocateInfo.descriptorSetCount = 1;
+      vkDescriptorSetAllocateInfo.pSetLayouts = &mpVkPipelines->Program((VkShader)i).mVkDescriptorSetLayout;
+      VK_VALIDATE(vkAllocateDescriptorSets(mVkLogicalDevice, &vkDescriptorSetAllocateInfo, &frame.mVkDescriptorSets[i]));
+      // Uniform buffers point at the frame uniforms, storage buffers at the instances of the frame
+      std::vector<VkDescriptorBufferInfo> vkDescriptorBufferInfos{};
+      std::vector<VkWriteDescriptorSet> vkWriteDescriptorSets{};
+      auto const& vkBindings{ mpVkPipelines->Bindings((VkShader)i) };
+      vkDescriptorBufferInfos.reserve(vkBindings.size());
+      for (auto const& vkBinding : vkBindings)
+      {
+        u32 const uniform{ vkBinding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER };
+        vkDescriptorBufferInfos.emplace_back(VkDescriptorBufferInfo{ uniform ? frame.mVkMvpBuffer : mpVkInstancer->InstanceBuffer(frameIndex), 0, VK_WHOLE_SIZE });
+        VkWriteDescriptorSet vkWriteDescriptorSet{};
+        vkWriteDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        vkWriteDescriptorSet.dstSet = frame.mVkDescriptorSets[i];
+        vkWriteDescriptorSet.dstBinding = vkBinding.binding;
+        vkWriteDescriptorSet.descriptorCount = 1;
+        vkWriteDescriptorSet.descriptorType = vkBinding.descriptorType;
+        vkWriteDescriptorSet.pBufferInfo = &vkDescriptorBufferInfos.back();
+        vkWriteDescriptorSets.emplace_back(vkWriteDescriptorSet);
+      }
+      vkUpdateDescriptorSets(mVkLogicalDevice, (u32)vkWriteDescriptorSets.size(), vkWriteDescriptorSets.data(), 0, nullptr);
+    }
+  }
+}
 
-  mVkVertexInputAttributeDescriptions[3].binding = 0;
-  mVkVertexInputAttributeDescriptions[3].location = 3;
-  mVkVertexInputAttributeDescriptions[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-  mVkVertexInputAttributeDescriptions[3].offset = (sizeof(r32) * 3) + (sizeof(r32) * 3) + (sizeof(r32) * 2);
-}
-void VkRenderer::CreateUniformBuffer()
-{
-  // Buffer create info.
-  VkBufferCreateInfo vkBufferCreateInfo{};
-  vkBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  vkBufferCreateInfo.size = sizeof(UniformMvp);
-  vkBufferCreateInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-  VK_VALIDATE(vkCreateBuffer(mVkLogicalDevice, &vkBufferCreateInfo, nullptr, &mVkMvpBuffer));
-  VkMemoryRequirements vkMemoryRequirements{};
-  vkGetBufferMemoryRequirements(mVkLogicalDevice, mVkMvpBuffer, &vkMemoryRequirements);
-  VkMemoryAllocateInfo vkMemoryAllocateInfo{};
-  vkMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  vkMemoryAllocateInfo.allocationSize = vkMemoryRequirements.size;
-  GetMemoryType(mVkPhysicalDeviceMemoryProperties, vkMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &vkMemoryRequirements.memoryTypeBits);
-  vkAllocateMemory(mVkLogicalDevice, &vkMemoryAllocateInfo, nullptr, &mVkMvpBufferMemory);
-  vkBindBufferMemory(mVkLogicalDevice, mVkMvpBuffer, mVkMvpBufferMemory, 0);
-  // Update uniform data
-  
+void VkRenderer::DestroyFramebuffers()
+{
+  for (u32 i{}; i < (u32)mVkFramebuffers.size(); ++i)
+  {
+    vkDestroySemaphore(mVkLogicalDevice, mVkRenderFinishedSemaphores[i], nullptr);
+    vkDestroyFramebuffer(mVkLogicalDevice, mVkFramebuffers[i], nullptr);
+    vkDestroyImageView(mVkLogicalDevice, mVkSwapChainImageViews[i], nullptr);
+  }
+  mVkRenderFinishedSemaphores.clear();
+  mVkFramebuffers.clear();
+  mVkSwapChainImageViews.clear();
+  mVkImagesInFlight.clear();
+}
+void VkRenderer::RecreateSwapChain()
+{
+  s32 width{};
+  s32 height{};
+#ifndef VK_HEADLESS
+  glfwGetFramebufferSize(mpGlfwWindow, &width, &height);
+#endif
+  mWidth = (u32)width;
+  mHeight = (u32)height;
+  // Frames in flight still reference the old images
+  VK_VALIDATE(vkDeviceWaitIdle(mVkLogicalDevice));
+  DestroyFramebuffers();
+  CreateSwapChain();
+  CreateFramebuffers();
 }
 
 void VkRenderer::FindQueueFamilies()
@@ -471,10 +744,14 @@ void VkRenderer::FindQueueFamilies()
   // Gather queue families
   std::vector<VkQueueFamilyProperties> queueFamilies{ queueFamilyCount };
   vkGetPhysicalDeviceQueueFamilyProperties(mVkPhysicalDevice, &queueFamilyCount, queueFamilies.data());
-  u32 presentSupport{};
+  // Headless devices present nothing, any graphics family will do
+  u32 presentSupport{ mHeadless };
   for (u32 i{}; i < queueFamilyCount; ++i)
   {
-    VK_VALIDATE(vkGetPhysicalDeviceSurfaceSupportKHR(mVkPhysicalDevice, i, mVkWindowSurface, &presentSupport));
+    if (!mHeadless)
+    {
+      VK_VALIDATE(vkGetPhysicalDeviceSurfaceSupportKHR(mVkPhysicalDevice, i, mVkWindowSurface, &presentSupport));
+    }
     if (queueFamilies[i].queueCount > 0 && queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
     {
       mGraphicsQueueFamily = i;
@@ -485,6 +762,179 @@ void VkRenderer::FindQueueFamilies()
       }
     }
   }
+  // Prefer a family without graphics and compute, usually backed by dedicated copy engines
+  for (u32 i{}; i < queueFamilyCount; ++i)
+  {
+    if (queueFamilies[i].queueCount > 0 && (queueFamilies[i].queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamilies[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+    {
+      mTransferQueueFamily = i;
+      break;
+    }
+  }
+  // Graphics families support transfers implicitly
+  if (!mTransferQueueFamily)
+  {
+    mTransferQueueFamily = mGraphicsQueueFamily;
+  }
+  // Frame timings need timestamps on the graphics queue
+  if (mGraphicsQueueFamily && mVkPhysicalDeviceProperties.limits.timestampPeriod > 0.f)
+  {
+    mTimestampBits = queueFamilies[mGraphicsQueueFamily.value()].timestampValidBits;
+  }
   VK_LOG("Graphics queue family %d\n", mGraphicsQueueFamily.value_or(-1));
   VK_LOG("Present queue family %d\n", mPresentQueueFamily.value_or(-1));
+  VK_LOG("Transfer queue family %d\n", mTransferQueueFamily.value_or(-1));
+}
+
+u32 VkRenderer::Acquire(Frame& frame, u32& image)
+{
+  // Offscreen images belong to their frame
+  if (mHeadless)
+  {
+    image = mFrame;
+    return 1;
+  }
+#ifndef VK_HEADLESS
+  // Minimized windows have nothing to present to
+  s32 width{};
+  s32 height{};
+  glfwGetFramebufferSize(mpGlfwWindow, &width, &height);
+  if (!width || !height)
+  {
+    return 0;
+  }
+  if ((u32)width != mWidth || (u32)height != mHeight)
+  {
+    RecreateSwapChain();
+  }
+#endif
+  VkResult const acquireResult{ vkAcquireNextImageKHR(mVkLogicalDevice, mVkSwapChainKhr, ~0ull, frame.mVkImageAvailableSemaphore, VK_NULL_HANDLE, &image) };
+  if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    RecreateSwapChain();
+    return 0;
+  }
+  // Images can be acquired out of order, the slot which rendered into this one last has to be done
+  if (mVkImagesInFlight[image] && mVkImagesInFlight[image] != frame.mVkInFlightFence)
+  {
+    VK_VALIDATE(vkWaitForFences(mVkLogicalDevice, 1, &mVkImagesInFlight[image], 1, ~0ull));
+  }
+  mVkImagesInFlight[image] = frame.mVkInFlightFence;
+  return 1;
+}
+void VkRenderer::Present(u32 image)
+{
+  // Present info
+  VkPresentInfoKHR vkPresentInfoKhr{};
+  vkPresentInfoKhr.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  vkPresentInfoKhr.waitSemaphoreCount = 1;
+  vkPresentInfoKhr.pWaitSemaphores = &mVkRenderFinishedSemaphores[image];
+  vkPresentInfoKhr.swapchainCount = 1;
+  vkPresentInfoKhr.pSwapchains = &mVkSwapChainKhr;
+  vkPresentInfoKhr.pImageIndices = &image;
+  VkResult const presentResult{ vkQueuePresentKHR(mVkPresentQueue, &vkPresentInfoKhr) };
+  if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+  {
+    RecreateSwapChain();
+  }
+}
+void VkRenderer::Record(Frame& frame, u32 image, u32 commands)
+{
+  // Command buffer begin info
+  VkCommandBufferBeginInfo vkCommandBufferBeginInfo{};
+  vkCommandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  vkCommandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_VALIDATE(vkBeginCommandBuffer(frame.mVkCommandBuffer, &vkCommandBufferBeginInfo));
+  if (mTimestampBits)
+  {
+    vkCmdResetQueryPool(frame.mVkCommandBuffer, frame.mVkQueryPool, 0, 2);
+    vkCmdWriteTimestamp(frame.mVkCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.mVkQueryPool, 0);
+  }
+  // Render pass begin info
+  VkClearValue vkClearValue{};
+  vkClearValue.color = { { 0.f, 0.f, 0.f, 1.f } };
+  VkRenderPassBeginInfo vkRenderPassBeginInfo{};
+  vkRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  vkRenderPassBeginInfo.renderPass = mVkRenderPass;
+  vkRenderPassBeginInfo.framebuffer = mVkFramebuffers[image];
+  vkRenderPassBeginInfo.renderArea.extent = mVkSwapChainExtend;
+  vkRenderPassBeginInfo.clearValueCount = 1;
+  vkRenderPassBeginInfo.pClearValues = &vkClearValue;
+  vkCmdBeginRenderPass(frame.mVkCommandBuffer, &vkRenderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  // Command buffer inheritance info
+  VkCommandBufferInheritanceInfo vkCommandBufferInheritanceInfo{};
+  vkCommandBufferInheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  vkCommandBufferInheritanceInfo.renderPass = mVkRenderPass;
+  vkCommandBufferInheritanceInfo.subpass = 0;
+  vkCommandBufferInheritanceInfo.framebuffer = mVkFramebuffers[image];
+  // Indirect commands get split across threads, batches are cut at chunk borders
+  VkViewport const vkViewport{ 0.f, 0.f, (r32)mVkSwapChainExtend.width, (r32)mVkSwapChainExtend.height, 0.f, 1.f };
+  VkRect2D const vkScissor{ {}, mVkSwapChainExtend };
+  mpVkRecorder->Record(mFrame, vkCommandBufferInheritanceInfo, commands, [&](VkCommandBuffer vkCommandBuffer, u32 first, u32 count)
+  {
+    // Dynamic state does not carry over from the primary
+    vkCmdSetViewport(vkCommandBuffer, 0, 1, &vkViewport);
+    vkCmdSetScissor(vkCommandBuffer, 0, 1, &vkScissor);
+    mpVkMeshBuffer->Bind(vkCommandBuffer);
+    VkProgram const* pBound{};
+    mpVkInstancer->Slice(first, count, [&](VkInstancer::Batch const& batch)
+    {
+      // Instances are fetched from storage, programs without it can not draw batches
+      VkProgram const* pProgram{ (VkProgram const*)batch.mpShaderLayout };
+      if (!pProgram || pProgram->mShader != VK_SHADER_LAMBERT_INSTANCED)
+      {
+        return;
+      }
+      if (pProgram != pBound)
+      {
+        vkCmdBindPipeline(vkCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pProgram->mVkPipeline);
+        vkCmdBindDescriptorSets(vkCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pProgram->mVkPipelineLayout, 0, 1, &frame.mVkDescriptorSets[pProgram->mShader], 0, nullptr);
+        pBound = pProgram;
+      }
+      mpVkInstancer->Draw(vkCommandBuffer, batch);
+    });
+  });
+  mpVkRecorder->Execute(mFrame, frame.mVkCommandBuffer);
+  vkCmdEndRenderPass(frame.mVkCommandBuffer);
+  // Copy the offscreen image out and make it visible to the host once the fence signaled
+  frame.mReadback = mReadback;
+  if (frame.mReadback)
+  {
+    VkBufferImageCopy vkBufferImageCopy{};
+    vkBufferImageCopy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    vkBufferImageCopy.imageSubresource.layerCount = 1;
+    vkBufferImageCopy.imageExtent = { mVkSwapChainExtend.width, mVkSwapChainExtend.height, 1 };
+    vkCmdCopyImageToBuffer(frame.mVkCommandBuffer, mVkSwapChainImages[image], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, frame.mVkReadbackBuffer, 1, &vkBufferImageCopy);
+    VkBufferMemoryBarrier vkBufferMemoryBarrier{};
+    vkBufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    vkBufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkBufferMemoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkBufferMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vkBufferMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vkBufferMemoryBarrier.buffer = frame.mVkReadbackBuffer;
+    vkBufferMemoryBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(frame.mVkCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &vkBufferMemoryBarrier, 0, nullptr);
+  }
+  if (mTimestampBits)
+  {
+    vkCmdWriteTimestamp(frame.mVkCommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.mVkQueryPool, 1);
+    frame.mTimed = 1;
+  }
+  VK_VALIDATE(vkEndCommandBuffer(frame.mVkCommandBuffer));
+}
+void VkRenderer::Resolve(Frame& frame)
+{
+  // The fence of this slot signaled, its timestamps are available without waiting
+  if (!frame.mTimed)
+  {
+    return;
+  }
+  u64 timestamps[2]{};
+  if (vkGetQueryPoolResults(mVkLogicalDevice, frame.mVkQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(u64), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+  {
+    u64 const mask{ mTimestampBits >= 64 ? ~0ull : (1ull << mTimestampBits) - 1 };
+    u64 const ticks{ (timestamps[1] - timestamps[0]) & mask };
+    mTimings.mGpu = (r64)ticks * mVkPhysicalDeviceProperties.limits.timestampPeriod / 1e6;
+  }
+  frame.mTimed = 0;
 }
\ No newline at end of file
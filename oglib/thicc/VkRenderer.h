@@ -5,18 +5,72 @@
 #include "VkUtils.h"
 #include "VkVertices.h"
 #include "VkUniforms.h"
-
-constexpr s8 const* VK_DEBUG_LAYER { "VK_LAYER_KHRONOS_validation" };
+#include "VkAllocator.h"
+#include "VkUploader.h"
+#include "VkMesh.h"
+#include "VkMeshFile.h"
+#include "VkInstancer.h"
+#include "VkRecorder.h"
+#include "VkPipelines.h"
+
+constexpr s8 const* VK_DEBUG_LAYER      { "VK_LAYER_KHRONOS_validation" };
+constexpr u32       VK_FRAMES_IN_FLIGHT { 2 };
+constexpr u32       VK_FRAMES_MAX       { 3 };
+constexpr VkFormat  VK_OFFSCREEN_FORMAT { VK_FORMAT_R8G8B8A8_UNORM };
 
 class VkRenderer
 {
 public:
-  VkRenderer(u32 width, u32 height, GLFWwindow* pGlfwWindow, u32 debug = 0);
+  struct Timings
+  {
+    r64 mWait  {};
+    r64 mRecord{};
+    r64 mGpu   {};
+  };
+
+public:
+  // Without a window the renderer runs headless and renders into one offscreen image per frame in flight
+  VkRenderer(u32 width, u32 height, GLFWwindow* pGlfwWindow, u32 debug = 0, u32 frames = VK_FRAMES_IN_FLIGHT);
   virtual ~VkRenderer();
 
+public:
+  // Records and submits the next frame, blocks only while its slot is still in flight
+  void            Render(VkCulling::View const* pView);
+  // Waits for the last submitted frame and returns its pixels as tightly packed rgba8, empty unless it was read back
+  std::vector<u8> Readback();
+  // Uploads every mesh of a mesh file, mapped if possible and streamed otherwise, the meshes stay owned by the renderer
+  std::vector<VkMesh const*> LoadMeshes(std::filesystem::path const& path);
+
+  __forceinline void           SetReadback(u32 readback) noexcept { mReadback = readback && mHeadless; }
+  __forceinline u32            Headless()          const noexcept { return mHeadless; }
+  __forceinline u32            Frames()            const noexcept { return (u32)mFrames.size(); }
+  __forceinline u32            Width()             const noexcept { return mVkSwapChainExtend.width; }
+  __forceinline u32            Height()            const noexcept { return mVkSwapChainExtend.height; }
+  __forceinline r32            Aspect()            const noexcept { return (r32)mVkSwapChainExtend.width / (r32)std::max(mVkSwapChainExtend.height, 1u); }
+  // Host side timings of the last render, device time belongs to the frame which last retired from the same slot
+  __forceinline Timings const& Timing()            const noexcept { return mTimings; }
+  // Programs serve as shader layout of renderables, only instanced programs draw through the instancer
+  __forceinline VkProgram const* Program(VkShader shader) const noexcept { return &mpVkPipelines->Program(shader); }
+
+private:
+  struct Frame
+  {
+    VkCommandPool   mVkCommandPool            {};
+    VkCommandBuffer mVkCommandBuffer          {};
+    VkFence         mVkInFlightFence          {};
+    VkSemaphore     mVkImageAvailableSemaphore{};
+    VkBuffer        mVkMvpBuffer              {};
+    VkAllocation    mMvpBufferAllocation      {};
+    VkQueryPool     mVkQueryPool              {};
+    VkBuffer        mVkReadbackBuffer         {};
+    VkAllocation    mReadbackAllocation       {};
+    VkDescriptorSet mVkDescriptorSets[VK_SHADER_COUNT]{};
+    u32             mTimed                    {};
+    u32             mReadback                 {};
+  };
+
 private:
   static u32                                DebugCallback(VkDebugReportFlagsEXT vkFlags, VkDebugReportObjectTypeEXT vkObjType, u64 srcObject, u32 location, u32 msgCode, s8 const* pLayerPrefix, s8 const* pMessage, void* pUserData);
-  static u32                                GetMemoryType(VkPhysicalDeviceMemoryProperties vkProperties, u32 typeBits, u32 properties, u32* typeIndex);
   static VkSurfaceFormatKHR                 GetSurfaceFormat(std::vector<VkSurfaceFormatKHR> const& vkFormats);
   static VkExtent2D                         GetSwapExtent(u32 width, u32 height, VkSurfaceCapabilitiesKHR const& vkSurfaceCapabilities);
   static VkPresentModeKHR                   GetPresentMode(std::vector<VkPresentModeKHR> const& vkPresentModes);
@@ -26,18 +80,35 @@ private:
   void CreateWindowSurface();
   void CreatePhysicalDevice();
   void CreateLogicalDevice();
-  void CreateCommandPool();
+  void CreateAllocator();
+  void CreateUploader();
   void CreateSwapChain();
+  void CreateOffscreenImages();
+  void CreateRenderPass();
+  void CreateFramebuffers();
+  void CreateFrames();
+  void CreateRecorder();
+
+  void CreateMeshBuffer();
+  void CreateInstancer();
+  void CreatePipelines();
+  void CreateDescriptors();
 
-  void CreateVertexBuffer();
-  void CreateUniformBuffer();
+  void DestroyFramebuffers();
+  void RecreateSwapChain();
 
   void FindQueueFamilies();
 
+  u32  Acquire(Frame& frame, u32& image);
+  void Present(u32 image);
+  void Record(Frame& frame, u32 image, u32 commands);
+  void Resolve(Frame& frame);
+
   u32                                mDebug                                {};
   u32                                mWidth                                {};
   u32                                mHeight                               {};
   GLFWwindow*                        mpGlfwWindow                          {};
+  u32                                mHeadless                             {};
 
   // TODO: further improvments on required extension validation
 
@@ -47,35 +118,56 @@ private:
   std::vector<s8 const*>             mVkLayerPropertyNames                 {};
   std::vector<s8 const*>             mVkSupportedExtensionPropertyNames    {};
   std::vector<s8 const*>             mVkRequiredExtensionPropertyNames     {};
+  std::vector<s8 const*>             mVkRequiredDeviceExtensionNames       {};
 
   VkDebugReportCallbackEXT           mVkDebugCallback                      {};
   VkInstance                         mVkInstance                           {};
   VkSurfaceKHR                       mVkWindowSurface                      {};
   VkPhysicalDevice                   mVkPhysicalDevice                     {};
   VkPhysicalDeviceMemoryProperties   mVkPhysicalDeviceMemoryProperties     {};
+  VkPhysicalDeviceFeatures           mVkPhysicalDeviceFeatures             {};
+  VkPhysicalDeviceProperties         mVkPhysicalDeviceProperties           {};
+  u32                                mTimestampBits                        {};
   VkDevice                           mVkLogicalDevice                      {};
-  VkCommandPool                      mVkCommandPool                        {};
   VkQueue                            mVkGraphicsQueue                      {};
   VkQueue                            mVkPresentQueue                       {};
+  VkQueue                            mVkTransferQueue                      {};
 
   VkSwapchainKHR                     mVkSwapChainKhr                       {};
   VkSwapchainKHR                     mVkSwapChainKhrOld                    {};
   VkExtent2D                         mVkSwapChainExtend                    {};
   VkFormat                           mVkSwapChainFormat                    {};
   std::vector<VkImage>               mVkSwapChainImages                    {};
-
-  VkDeviceMemory                     mVkVertexBufferMemory                 {};
-  VkDeviceMemory                     mVkIndexBufferMemory                  {};
-  VkDeviceMemory                     mVkMvpBufferMemory                    {};
-  VkBuffer                           mVkVertexBuffer                       {};
-  VkBuffer                           mVkIndexBuffer                        {};
-  VkBuffer                           mVkMvpBuffer                          {};
-  VkVertexInputBindingDescription    mVkVertexInputBindingDescription      {};
-  VkVertexInputAttributeDescription  mVkVertexInputAttributeDescriptions[4]{};
+  std::vector<VkAllocation>          mOffscreenAllocations                 {};
+  std::vector<VkImageView>           mVkSwapChainImageViews                {};
+  std::vector<VkFramebuffer>         mVkFramebuffers                       {};
+  std::vector<VkSemaphore>           mVkRenderFinishedSemaphores           {};
+  std::vector<VkFence>               mVkImagesInFlight                     {};
+  VkRenderPass                       mVkRenderPass                         {};
+
+  std::vector<Frame>                 mFrames                               {};
+  u32                                mFrame                                {};
+  u32                                mFrameLast                            {};
+  u32                                mReadback                             {};
+  Timings                            mTimings                              {};
+
+  VkAllocator*                       mpVkAllocator                         {};
+  VkUploader*                        mpVkUploader                          {};
+  VkRecorder*                        mpVkRecorder                          {};
+
+  VkMeshBuffer*                      mpVkMeshBuffer                        {};
+  VkMesh                             mTriangle                             {};
+  std::deque<VkMesh>                 mMeshes                               {};
+  std::deque<std::vector<VkMeshlet>> mMeshlets                             {};
+  std::deque<std::vector<VkMeshLod>> mLods                                 {};
+  VkInstancer*                       mpVkInstancer                         {};
+  VkPipelines*                       mpVkPipelines                         {};
+  VkDescriptorPool                   mVkDescriptorPool                     {};
 
   // Remove std::optional<>
   std::optional<s32>                 mGraphicsQueueFamily                  {};
   std::optional<s32>                 mPresentQueueFamily                   {};
+  std::optional<s32>                 mTransferQueueFamily                  {};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef VK_SANDBOX
+#define VK_SANDBOX
+
+#include "VkCore.h"
+
+class VkRenderer;
+
+struct Sandbox
+{
+  // Runners own sandboxes through this base
+  virtual ~Sandbox() = default;
+
+  // Runs once after construction, meshes and programs of renderables come from the renderer
+  virtual void OnCreate([[maybe_unused]] VkRenderer& renderer) {};
+  virtual void OnUpdate(r32 time) {};
+  virtual void OnPhysic(r32 time) {};
+  virtual void OnDebug(r32 time) const {};
+};
+
+template<typename T>
+concept Sandboxable = std::is_base_of_v<Sandbox, T>;
+
+#endif
\ No newline at end of file
@@ -0,0 +1,365 @@
+#ifndef VK_SIMD
+#define VK_SIMD
+
+/*
+* Lane types for batched kernels.
+*
+* Kernels are written once against a lane type and instantiated per width,
+* F8 requires AVX2, F4 requires SSE2 and F1 is the scalar fallback which also
+* handles the tail of a batch. Loads gather one field of W strided records,
+* stores transpose W records back into place. Float, integer and half stores
+* write W contiguous values, halves go through F16C where the target has it.
+*/
+
+#include "VkCore.h"
+
+#include <immintrin.h>
+
+#if defined(__AVX2__)
+#define VK_SIMD_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VK_SIMD_SSE
+#endif
+
+// Every AVX2 capable CPU converts halves, MSVC just never tells
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define VK_SIMD_F16C
+#endif
+
+namespace VkSimd
+{
+  /*
+  * Scalar conversions.
+  */
+
+  // IEEE binary16 with round to nearest even, overflow saturates to infinity
+  __forceinline u16 Half(r32 value) noexcept
+  {
+    u32 bits{};
+    std::memcpy(&bits, &value, sizeof(u32));
+    u32 const sign{ (bits >> 16) & 0x8000 };
+    u32 const magnitude{ bits & 0x7FFFFFFF };
+    if (magnitude >= 0x7F800000)
+    {
+      // Infinity stays infinity, NaN stays quiet NaN
+      return (u16)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+    }
+    if (magnitude >= 0x477FF000)
+    {
+      return (u16)(sign | 0x7C00);
+    }
+    if (magnitude < 0x38800000)
+    {
+      // Subnormal halves, the implicit one joins the mantissa before the shift
+      if (magnitude < 0x33000000)
+      {
+        return (u16)sign;
+      }
+      u32 const exponent{ magnitude >> 23 };
+      u32 const mantissa{ (magnitude & 0x7FFFFF) | 0x800000 };
+      u32 const shift{ 126 - exponent };
+      u32 const half{ mantissa >> shift };
+      u32 const rest{ mantissa & ((1u << shift) - 1) };
+      u32 const middle{ 1u << (shift - 1) };
+      return (u16)(sign | (half + (rest > middle || (rest == middle && (half & 1)))));
+    }
+    u32 const rebased{ magnitude - 0x38000000 };
+    u32 const half{ rebased >> 13 };
+    u32 const rest{ rebased & 0x1FFF };
+    return (u16)(sign | (half + (rest > 0x1000 || (rest == 0x1000 && (half & 1)))));
+  }
+
+  /*
+  * Lane types.
+  */
+
+  struct F1
+  {
+    static constexpr u32 WIDTH{ 1 };
+
+    using I = s32;
+
+    r32 m;
+
+    static __forceinline F1 Set(r32 value) noexcept { return { value }; }
+    static __forceinline F1 Load(r32 const* pData, u32) noexcept { return { *pData }; }
+    static __forceinline void Store(r32* pData, u32, F1 x, F1 y, F1 z, F1 w) noexcept
+    {
+      pData[0] = x.m;
+      pData[1] = y.m;
+      pData[2] = z.m;
+      pData[3] = w.m;
+    }
+    static __forceinline void Store(r32* pData, u32, F1 x, F1 y, F1 z) noexcept
+    {
+      pData[0] = x.m;
+      pData[1] = y.m;
+      pData[2] = z.m;
+    }
+
+    static __forceinline void  StoreFloat(r32* pData, F1 a) noexcept { *pData = a.m; }
+    static __forceinline void  StoreInt(s32* pData, I a)    noexcept { *pData = a; }
+    static __forceinline void  StoreHalf(u16* pData, F1 a)  noexcept { *pData = Half(a.m); }
+
+    static __forceinline I     Int(F1 a)                noexcept { return (s32)a.m; }
+    static __forceinline I     Round(F1 a)              noexcept { return (s32)std::nearbyint(a.m); }
+    static __forceinline F1    Float(I a)               noexcept { return { (r32)a }; }
+    static __forceinline I     AsInt(F1 a)              noexcept { I i; std::memcpy(&i, &a.m, sizeof(I)); return i; }
+    static __forceinline F1    AsFloat(I a)             noexcept { F1 f; std::memcpy(&f.m, &a, sizeof(I)); return f; }
+    static __forceinline I     IAdd(I a, I b)           noexcept { return a + b; }
+    static __forceinline I     ISub(I a, I b)           noexcept { return a - b; }
+    static __forceinline I     IAnd(I a, I b)           noexcept { return a & b; }
+    static __forceinline I     IAndNot(I a, I b)        noexcept { return ~a & b; }
+    static __forceinline I     IEqual(I a, I b)         noexcept { return a == b ? -1 : 0; }
+    static __forceinline I     ISet(s32 value)          noexcept { return value; }
+    template<s32 N>
+    static __forceinline I     IShiftLeft(I a)          noexcept { return (s32)((u32)a << N); }
+
+    friend __forceinline F1 operator + (F1 a, F1 b) noexcept { return { a.m + b.m }; }
+    friend __forceinline F1 operator - (F1 a, F1 b) noexcept { return { a.m - b.m }; }
+    friend __forceinline F1 operator * (F1 a, F1 b) noexcept { return { a.m * b.m }; }
+    friend __forceinline F1 operator / (F1 a, F1 b) noexcept { return { a.m / b.m }; }
+    friend __forceinline F1 operator & (F1 a, F1 b) noexcept { return AsFloat(AsInt(a) & AsInt(b)); }
+    friend __forceinline F1 operator | (F1 a, F1 b) noexcept { return AsFloat(AsInt(a) | AsInt(b)); }
+    friend __forceinline F1 operator ^ (F1 a, F1 b) noexcept { return AsFloat(AsInt(a) ^ AsInt(b)); }
+    static __forceinline F1 AndNot(F1 a, F1 b)      noexcept { return AsFloat(~AsInt(a) & AsInt(b)); }
+    static __forceinline F1 Max(F1 a, F1 b)         noexcept { return { std::max(a.m, b.m) }; }
+    static __forceinline F1 Min(F1 a, F1 b)         noexcept { return { std::min(a.m, b.m) }; }
+    static __forceinline F1 Sqrt(F1 a)              noexcept { return { std::sqrt(a.m) }; }
+    static __forceinline F1 Less(F1 a, F1 b)        noexcept { return AsFloat(a.m < b.m ? -1 : 0); }
+    static __forceinline u32 Mask(F1 a)             noexcept { return (u32)AsInt(a) >> 31; }
+  };
+
+#ifdef VK_SIMD_SSE
+  struct F4
+  {
+    static constexpr u32 WIDTH{ 4 };
+
+    using I = __m128i;
+
+    __m128 m;
+
+    static __forceinline F4 Set(r32 value) noexcept { return { _mm_set1_ps(value) }; }
+    static __forceinline F4 Load(r32 const* pData, u32 stride) noexcept
+    {
+      return { _mm_set_ps(pData[stride * 3], pData[stride * 2], pData[stride], pData[0]) };
+    }
+    // Writes the four lanes of x, y, z and w as one vector per lane
+    static __forceinline void Store(r32* pData, u32 stride, F4 x, F4 y, F4 z, F4 w) noexcept
+    {
+      _MM_TRANSPOSE4_PS(x.m, y.m, z.m, w.m);
+      _mm_storeu_ps(pData, x.m);
+      _mm_storeu_ps(pData + stride, y.m);
+      _mm_storeu_ps(pData + stride * 2, z.m);
+      _mm_storeu_ps(pData + stride * 3, w.m);
+    }
+    // Leaves the fourth float of every record untouched
+    static __forceinline void Store(r32* pData, u32 stride, F4 x, F4 y, F4 z) noexcept
+    {
+      __m128 w{ _mm_setzero_ps() };
+      _MM_TRANSPOSE4_PS(x.m, y.m, z.m, w);
+      Store3(pData, x.m);
+      Store3(pData + stride, y.m);
+      Store3(pData + stride * 2, z.m);
+      Store3(pData + stride * 3, w);
+    }
+    static __forceinline void Store3(r32* pData, __m128 xyz) noexcept
+    {
+      _mm_storel_pi((__m64*)pData, xyz);
+      _mm_store_ss(pData + 2, _mm_movehl_ps(xyz, xyz));
+    }
+
+    static __forceinline void  StoreFloat(r32* pData, F4 a) noexcept { _mm_storeu_ps(pData, a.m); }
+    static __forceinline void  StoreInt(s32* pData, I a)    noexcept { _mm_storeu_si128((__m128i*)pData, a); }
+    static __forceinline void  StoreHalf(u16* pData, F4 a)  noexcept
+    {
+#ifdef VK_SIMD_F16C
+      _mm_storel_epi64((__m128i*)pData, _mm_cvtps_ph(a.m, _MM_FROUND_TO_NEAREST_INT));
+#else
+      alignas(16) r32 values[4];
+      _mm_store_ps(values, a.m);
+      for (u32 i{}; i < 4; ++i) pData[i] = Half(values[i]);
+#endif
+    }
+
+    static __forceinline I     Int(F4 a)                noexcept { return _mm_cvttps_epi32(a.m); }
+    static __forceinline I     Round(F4 a)              noexcept { return _mm_cvtps_epi32(a.m); }
+    static __forceinline F4    Float(I a)               noexcept { return { _mm_cvtepi32_ps(a) }; }
+    static __forceinline I     AsInt(F4 a)              noexcept { return _mm_castps_si128(a.m); }
+    static __forceinline F4    AsFloat(I a)             noexcept { return { _mm_castsi128_ps(a) }; }
+    static __forceinline I     IAdd(I a, I b)           noexcept { return _mm_add_epi32(a, b); }
+    static __forceinline I     ISub(I a, I b)           noexcept { return _mm_sub_epi32(a, b); }
+    static __forceinline I     IAnd(I a, I b)           noexcept { return _mm_and_si128(a, b); }
+    static __forceinline I     IAndNot(I a, I b)        noexcept { return _mm_andnot_si128(a, b); }
+    static __forceinline I     IEqual(I a, I b)         noexcept { return _mm_cmpeq_epi32(a, b); }
+    static __forceinline I     ISet(s32 value)          noexcept { return _mm_set1_epi32(value); }
+    template<s32 N>
+    static __forceinline I     IShiftLeft(I a)          noexcept { return _mm_slli_epi32(a, N); }
+
+    friend __forceinline F4 operator + (F4 a, F4 b) noexcept { return { _mm_add_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator - (F4 a, F4 b) noexcept { return { _mm_sub_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator * (F4 a, F4 b) noexcept { return { _mm_mul_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator / (F4 a, F4 b) noexcept { return { _mm_div_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator & (F4 a, F4 b) noexcept { return { _mm_and_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator | (F4 a, F4 b) noexcept { return { _mm_or_ps(a.m, b.m) }; }
+    friend __forceinline F4 operator ^ (F4 a, F4 b) noexcept { return { _mm_xor_ps(a.m, b.m) }; }
+    static __forceinline F4 AndNot(F4 a, F4 b)      noexcept { return { _mm_andnot_ps(a.m, b.m) }; }
+    static __forceinline F4 Max(F4 a, F4 b)         noexcept { return { _mm_max_ps(a.m, b.m) }; }
+    static __forceinline F4 Min(F4 a, F4 b)         noexcept { return { _mm_min_ps(a.m, b.m) }; }
+    static __forceinline F4 Sqrt(F4 a)              noexcept { return { _mm_sqrt_ps(a.m) }; }
+    static __forceinline F4 Less(F4 a, F4 b)        noexcept { return { _mm_cmplt_ps(a.m, b.m) }; }
+    static __forceinline u32 Mask(F4 a)             noexcept { return (u32)_mm_movemask_ps(a.m); }
+  };
+#endif
+
+#ifdef VK_SIMD_AVX2
+  struct F8
+  {
+    static constexpr u32 WIDTH{ 8 };
+
+    using I = __m256i;
+
+    __m256 m;
+
+    static __forceinline F8 Set(r32 value) noexcept { return { _mm256_set1_ps(value) }; }
+    static __forceinline F8 Load(r32 const* pData, u32 stride) noexcept
+    {
+      __m256i const offsets{ _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((s32)stride)) };
+      return { _mm256_i32gather_ps(pData, offsets, sizeof(r32)) };
+    }
+    // Transposes both 128 bit halves at once, lane i and i + 4 share a register afterwards
+    static __forceinline void Store(r32* pData, u32 stride, F8 x, F8 y, F8 z, F8 w) noexcept
+    {
+      __m256 const t0{ _mm256_unpacklo_ps(x.m, y.m) };
+      __m256 const t1{ _mm256_unpackhi_ps(x.m, y.m) };
+      __m256 const t2{ _mm256_unpacklo_ps(z.m, w.m) };
+      __m256 const t3{ _mm256_unpackhi_ps(z.m, w.m) };
+      __m256 const c0{ _mm256_shuffle_ps(t0, t2, 0x44) };
+      __m256 const c1{ _mm256_shuffle_ps(t0, t2, 0xEE) };
+      __m256 const c2{ _mm256_shuffle_ps(t1, t3, 0x44) };
+      __m256 const c3{ _mm256_shuffle_ps(t1, t3, 0xEE) };
+      _mm_storeu_ps(pData, _mm256_castps256_ps128(c0));
+      _mm_storeu_ps(pData + stride, _mm256_castps256_ps128(c1));
+      _mm_storeu_ps(pData + stride * 2, _mm256_castps256_ps128(c2));
+      _mm_storeu_ps(pData + stride * 3, _mm256_castps256_ps128(c3));
+      _mm_storeu_ps(pData + stride * 4, _mm256_extractf128_ps(c0, 1));
+      _mm_storeu_ps(pData + stride * 5, _mm256_extractf128_ps(c1, 1));
+      _mm_storeu_ps(pData + stride * 6, _mm256_extractf128_ps(c2, 1));
+      _mm_storeu_ps(pData + stride * 7, _mm256_extractf128_ps(c3, 1));
+    }
+    // Leaves the fourth float of every record untouched
+    static __forceinline void Store(r32* pData, u32 stride, F8 x, F8 y, F8 z) noexcept
+    {
+      __m256 const t0{ _mm256_unpacklo_ps(x.m, y.m) };
+      __m256 const t1{ _mm256_unpackhi_ps(x.m, y.m) };
+      __m256 const t2{ _mm256_unpacklo_ps(z.m, z.m) };
+      __m256 const t3{ _mm256_unpackhi_ps(z.m, z.m) };
+      __m256 const c0{ _mm256_shuffle_ps(t0, t2, 0x44) };
+      __m256 const c1{ _mm256_shuffle_ps(t0, t2, 0xEE) };
+      __m256 const c2{ _mm256_shuffle_ps(t1, t3, 0x44) };
+      __m256 const c3{ _mm256_shuffle_ps(t1, t3, 0xEE) };
+      F4::Store3(pData, _mm256_castps256_ps128(c0));
+      F4::Store3(pData + stride, _mm256_castps256_ps128(c1));
+      F4::Store3(pData + stride * 2, _mm256_castps256_ps128(c2));
+      F4::Store3(pData + stride * 3, _mm256_castps256_ps128(c3));
+      F4::Store3(pData + stride * 4, _mm256_extractf128_ps(c0, 1));
+      F4::Store3(pData + stride * 5, _mm256_extractf128_ps(c1, 1));
+      F4::Store3(pData + stride * 6, _mm256_extractf128_ps(c2, 1));
+      F4::Store3(pData + stride * 7, _mm256_extractf128_ps(c3, 1));
+    }
+
+    static __forceinline void  StoreFloat(r32* pData, F8 a) noexcept { _mm256_storeu_ps(pData, a.m); }
+    static __forceinline void  StoreInt(s32* pData, I a)    noexcept { _mm256_storeu_si256((__m256i*)pData, a); }
+    static __forceinline void  StoreHalf(u16* pData, F8 a)  noexcept
+    {
+#ifdef VK_SIMD_F16C
+      _mm_storeu_si128((__m128i*)pData, _mm256_cvtps_ph(a.m, _MM_FROUND_TO_NEAREST_INT));
+#else
+      F4::StoreHalf(pData, { _mm256_castps256_ps128(a.m) });
+      F4::StoreHalf(pData + 4, { _mm256_extractf128_ps(a.m, 1) });
+#endif
+    }
+
+    static __forceinline I     Int(F8 a)                noexcept { return _mm256_cvttps_epi32(a.m); }
+    static __forceinline I     Round(F8 a)              noexcept { return _mm256_cvtps_epi32(a.m); }
+    static __forceinline F8    Float(I a)               noexcept { return { _mm256_cvtepi32_ps(a) }; }
+    static __forceinline I     AsInt(F8 a)              noexcept { return _mm256_castps_si256(a.m); }
+    static __forceinline F8    AsFloat(I a)             noexcept { return { _mm256_castsi256_ps(a) }; }
+    static __forceinline I     IAdd(I a, I b)           noexcept { return _mm256_add_epi32(a, b); }
+    static __forceinline I     ISub(I a, I b)           noexcept { return _mm256_sub_epi32(a, b); }
+    static __forceinline I     IAnd(I a, I b)           noexcept { return _mm256_and_si256(a, b); }
+    static __forceinline I     IAndNot(I a, I b)        noexcept { return _mm256_andnot_si256(a, b); }
+    static __forceinline I     IEqual(I a, I b)         noexcept { return _mm256_cmpeq_epi32(a, b); }
+    static __forceinline I     ISet(s32 value)          noexcept { return _mm256_set1_epi32(value); }
+    template<s32 N>
+    static __forceinline I     IShiftLeft(I a)          noexcept { return _mm256_slli_epi32(a, N); }
+
+    friend __forceinline F8 operator + (F8 a, F8 b) noexcept { return { _mm256_add_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator - (F8 a, F8 b) noexcept { return { _mm256_sub_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator * (F8 a, F8 b) noexcept { return { _mm256_mul_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator / (F8 a, F8 b) noexcept { return { _mm256_div_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator & (F8 a, F8 b) noexcept { return { _mm256_and_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator | (F8 a, F8 b) noexcept { return { _mm256_or_ps(a.m, b.m) }; }
+    friend __forceinline F8 operator ^ (F8 a, F8 b) noexcept { return { _mm256_xor_ps(a.m, b.m) }; }
+    static __forceinline F8 AndNot(F8 a, F8 b)      noexcept { return { _mm256_andnot_ps(a.m, b.m) }; }
+    static __forceinline F8 Max(F8 a, F8 b)         noexcept { return { _mm256_max_ps(a.m, b.m) }; }
+    static __forceinline F8 Min(F8 a, F8 b)         noexcept { return { _mm256_min_ps(a.m, b.m) }; }
+    static __forceinline F8 Sqrt(F8 a)              noexcept { return { _mm256_sqrt_ps(a.m) }; }
+    static __forceinline F8 Less(F8 a, F8 b)        noexcept { return { _mm256_cmp_ps(a.m, b.m, _CMP_LT_OQ) }; }
+    static __forceinline u32 Mask(F8 a)             noexcept { return (u32)_mm256_movemask_ps(a.m); }
+  };
+#endif
+
+  /*
+  * Lane math.
+  */
+
+  // Cephes single precision sine and cosine, accurate to a few ulp for |x| < 8192
+  template<typename V>
+  __forceinline void SinCos(V x, V& sin, V& cos) noexcept
+  {
+    using I = typename V::I;
+    V const signMask{ V::Set(-0.0f) };
+    V signSin{ x & signMask };
+    x = V::AndNot(signMask, x);
+    // Reduce into [-pi/4, pi/4] and remember the octant
+    I octant{ V::Int(x * V::Set(1.27323954473516f)) };
+    octant = V::IAnd(V::IAdd(octant, V::ISet(1)), V::ISet(~1));
+    V const y{ V::Float(octant) };
+    signSin = signSin ^ V::AsFloat(V::template IShiftLeft<29>(V::IAnd(octant, V::ISet(4))));
+    V const signCos{ V::AsFloat(V::template IShiftLeft<29>(V::IAndNot(V::ISub(octant, V::ISet(2)), V::ISet(4)))) };
+    V const polynomial{ V::AsFloat(V::IEqual(V::IAnd(octant, V::ISet(2)), V::ISet(0))) };
+    x = x + y * V::Set(-0.78515625f);
+    x = x + y * V::Set(-2.4187564849853515625e-4f);
+    x = x + y * V::Set(-3.77489497744594108e-8f);
+    V const z{ x * x };
+    V cosine{ V::Set(2.443315711809948e-5f) };
+    cosine = cosine * z + V::Set(-1.388731625493765e-3f);
+    cosine = cosine * z + V::Set(4.166664568298827e-2f);
+    cosine = cosine * z * z - z * V::Set(0.5f) + V::Set(1.0f);
+    V sine{ V::Set(-1.9515295891e-4f) };
+    sine = sine * z + V::Set(8.3321608736e-3f);
+    sine = sine * z + V::Set(-1.6666654611e-1f);
+    sine = sine * z * x + x;
+    sin = ((polynomial & sine) | V::AndNot(polynomial, cosine)) ^ signSin;
+    cos = ((polynomial & cosine) | V::AndNot(polynomial, sine)) ^ signCos;
+  }
+
+  // Runs a kernel over the widest lanes available and finishes the tail in scalar
+  template<typename K>
+  __forceinline void Batch(u32 count, K&& kernel) noexcept
+  {
+    u32 i{};
+#ifdef VK_SIMD_AVX2
+    for (; i + F8::WIDTH <= count; i += F8::WIDTH) kernel.template operator () <F8> (i);
+#endif
+#ifdef VK_SIMD_SSE
+    for (; i + F4::WIDTH <= count; i += F4::WIDTH) kernel.template operator () <F4> (i);
+#endif
+    for (; i < count; ++i) kernel.template operator () <F1> (i);
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+#ifndef VK_SLOT_MAP
+#define VK_SLOT_MAP
+
+/*
+* Dense slot map with generational handles.
+*
+* Slot map structure:
+* ---Slots------------------------Dense--------------
+*    |                            |
+*    [Dense/Next, Generation] --> [Value, ...]
+*                             <-- [Slot, ...]
+*
+* Values are packed without holes, slots map handles onto them and double as
+* free list. Every release bumps the generation of a slot so stale handles
+* fail the lookup instead of aliasing a newer value.
+*/
+
+#include "VkCore.h"
+
+/*
+* Generational handles.
+*/
+
+template<typename U>
+struct VkHandle
+{
+  static constexpr u32 INDEX_BITS     { sizeof(U) == sizeof(u32) ? 20 : 32 };
+  static constexpr U   INDEX_MASK     { ((U)1 << INDEX_BITS) - 1 };
+  static constexpr u32 GENERATION_MASK{ (u32)(((U)~(U)0) >> INDEX_BITS) };
+
+  U mValue{ (U)~(U)0 };
+
+  constexpr VkHandle() = default;
+  constexpr VkHandle(u32 index, u32 generation) : mValue{ (U)index | ((U)(generation & GENERATION_MASK) << INDEX_BITS) } {}
+
+  constexpr u32 Index()      const noexcept { return (u32)(mValue & INDEX_MASK); }
+  constexpr u32 Generation() const noexcept { return (u32)(mValue >> INDEX_BITS) & GENERATION_MASK; }
+
+  constexpr bool operator == (VkHandle const& other) const noexcept { return mValue == other.mValue; }
+  constexpr bool operator != (VkHandle const& other) const noexcept { return mValue != other.mValue; }
+  constexpr bool operator <  (VkHandle const& other) const noexcept { return mValue < other.mValue; }
+};
+
+using VkHandle32 = VkHandle<u32>;
+using VkHandle64 = VkHandle<u64>;
+
+/*
+* Slot map.
+*/
+
+template<typename T, typename H = VkHandle64>
+class VkSlotMap
+{
+public:
+  VkSlotMap(u32 capacity = 0)
+  {
+    Reserve(capacity);
+  }
+
+public:
+  __forceinline void Reserve(u32 capacity) noexcept
+  {
+    mSlots.reserve(capacity);
+    mDense.reserve(capacity);
+    mIndices.reserve(capacity);
+  }
+  __forceinline u32 Count()    const noexcept { return (u32)mDense.size(); }
+  // Upper bound of handle indices handed out so far
+  __forceinline u32 Capacity() const noexcept { return (u32)mSlots.size(); }
+
+  __forceinline T*       begin()       noexcept { return mDense.data(); }
+  __forceinline T*       end()         noexcept { return mDense.data() + mDense.size(); }
+  __forceinline T const* begin() const noexcept { return mDense.data(); }
+  __forceinline T const* end()   const noexcept { return mDense.data() + mDense.size(); }
+
+  template<typename ... Args>
+  __forceinline H Insert(Args&& ... args) noexcept
+  {
+    u32 index{ mFree };
+    if (index == INVALID)
+    {
+      index = (u32)mSlots.size();
+      mSlots.emplace_back(Slot{});
+    }
+    else
+    {
+      mFree = mSlots[index].mDense;
+    }
+    mSlots[index].mDense = (u32)mDense.size();
+    mDense.emplace_back(std::forward<Args>(args) ...);
+    mIndices.emplace_back(index);
+    return H{ index, mSlots[index].mGeneration };
+  }
+  __forceinline T* Find(H handle) noexcept
+  {
+    u32 const index{ handle.Index() };
+    if (index >= (u32)mSlots.size() || mSlots[index].mGeneration != handle.Generation())
+    {
+      return nullptr;
+    }
+    return &mDense[mSlots[index].mDense];
+  }
+  __forceinline u32 Erase(H handle) noexcept
+  {
+    if (!Find(handle))
+    {
+      return 0;
+    }
+    u32 const index{ handle.Index() };
+    u32 const dense{ mSlots[index].mDense };
+    // Swap the last value into the hole to keep values packed
+    if (dense != (u32)mDense.size() - 1)
+    {
+      mDense[dense] = std::move(mDense.back());
+      mIndices[dense] = mIndices.back();
+      mSlots[mIndices[dense]].mDense = dense;
+    }
+    mDense.pop_back();
+    mIndices.pop_back();
+    mSlots[index].mGeneration = (mSlots[index].mGeneration + 1) & H::GENERATION_MASK;
+    mSlots[index].mDense = mFree;
+    mFree = index;
+    return 1;
+  }
+  __forceinline void Clear() noexcept
+  {
+    for (u32 i{}; i < (u32)mIndices.size(); ++i)
+    {
+      Slot& slot{ mSlots[mIndices[i]] };
+      slot.mGeneration = (slot.mGeneration + 1) & H::GENERATION_MASK;
+      slot.mDense = mFree;
+      mFree = mIndices[i];
+    }
+    mDense.clear();
+    mIndices.clear();
+  }
+
+private:
+  static constexpr u32 INVALID{ (u32)-1 };
+
+  struct Slot
+  {
+    u32 mDense     {};
+    u32 mGeneration{};
+  };
+
+  std::vector<Slot> mSlots  {};
+  std::vector<T>    mDense  {};
+  std::vector<u32>  mIndices{};
+  u32               mFree   { INVALID };
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,145 @@
+#ifndef VK_TRANSFORM
+#define VK_TRANSFORM
+
+/*
+* Batched model matrix kernels.
+*
+* Lane structure:
+* ---Transforms-------------------Registers------------Matrices--------
+*    |                            |                    |
+*    [P, R, S] x W --> Gather --> [Px, Py, ..., Sz] --> [C0, C1, C2, C3] x W
+*
+* Transform columns get deinterleaved into one register per field so W actors
+* share every instruction, sine and cosine are evaluated by a polynomial on all
+* lanes at once and the composed columns are transposed back into packed
+* r32m4 rows.
+*
+* Rotations follow glm, a matrix equals translate(P) * mat4_cast(quat(R)) * scale(S).
+* Actors whose rotation rarely changes can cache quaternions through Orient and
+* compose from those without evaluating any trigonometry.
+*/
+
+#include "VkCore.h"
+#include "VkComponents.h"
+#include "VkAcs.h"
+#include "VkSimd.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace VkTransform
+{
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 TRANSFORM_STRIDE  { sizeof(acs::Transform) / sizeof(r32) };
+  constexpr u32 ORIENTATION_STRIDE{ sizeof(r32v4) / sizeof(r32) };
+  constexpr u32 MATRIX_STRIDE     { sizeof(r32m4) / sizeof(r32) };
+
+  static_assert(sizeof(acs::Transform) == sizeof(r32) * 9, "Transform has to consist of nine packed floats");
+  static_assert(sizeof(acs::Model) == sizeof(r32m4), "Model has to consist of a single packed matrix");
+
+  /*
+  * Kernels.
+  */
+
+  template<typename V>
+  __forceinline void ComposeEuler(acs::Transform const* pTransforms, r32m4* pMatrices) noexcept
+  {
+    r32 const* pData{ &pTransforms->mPosition.x };
+    r32* pOut{ &(*pMatrices)[0][0] };
+    V sx, cx, sy, cy, sz, cz;
+    VkSimd::SinCos(V::Load(pData + 3, TRANSFORM_STRIDE), sx, cx);
+    VkSimd::SinCos(V::Load(pData + 4, TRANSFORM_STRIDE), sy, cy);
+    VkSimd::SinCos(V::Load(pData + 5, TRANSFORM_STRIDE), sz, cz);
+    V const scaleX{ V::Load(pData + 6, TRANSFORM_STRIDE) };
+    V const scaleY{ V::Load(pData + 7, TRANSFORM_STRIDE) };
+    V const scaleZ{ V::Load(pData + 8, TRANSFORM_STRIDE) };
+    V const zero{ V::Set(0.0f) };
+    // Rz * Ry * Rx scaled per column
+    V const szsy{ sz * sy };
+    V const czsy{ cz * sy };
+    V::Store(pOut, MATRIX_STRIDE, cz * cy * scaleX, sz * cy * scaleX, (zero - sy) * scaleX, zero);
+    V::Store(pOut + 4, MATRIX_STRIDE, (czsy * sx - sz * cx) * scaleY, (cz * cx + szsy * sx) * scaleY, cy * sx * scaleY, zero);
+    V::Store(pOut + 8, MATRIX_STRIDE, (sz * sx + czsy * cx) * scaleZ, (szsy * cx - cz * sx) * scaleZ, cy * cx * scaleZ, zero);
+    V::Store(pOut + 12, MATRIX_STRIDE, V::Load(pData, TRANSFORM_STRIDE), V::Load(pData + 1, TRANSFORM_STRIDE), V::Load(pData + 2, TRANSFORM_STRIDE), V::Set(1.0f));
+  }
+  template<typename V>
+  __forceinline void ComposeQuaternion(acs::Transform const* pTransforms, r32v4 const* pOrientations, r32m4* pMatrices) noexcept
+  {
+    r32 const* pData{ &pTransforms->mPosition.x };
+    r32 const* pRotation{ &pOrientations->x };
+    r32* pOut{ &(*pMatrices)[0][0] };
+    V const x{ V::Load(pRotation, ORIENTATION_STRIDE) };
+    V const y{ V::Load(pRotation + 1, ORIENTATION_STRIDE) };
+    V const z{ V::Load(pRotation + 2, ORIENTATION_STRIDE) };
+    V const w{ V::Load(pRotation + 3, ORIENTATION_STRIDE) };
+    V const scaleX{ V::Load(pData + 6, TRANSFORM_STRIDE) };
+    V const scaleY{ V::Load(pData + 7, TRANSFORM_STRIDE) };
+    V const scaleZ{ V::Load(pData + 8, TRANSFORM_STRIDE) };
+    V const zero{ V::Set(0.0f) };
+    V const one{ V::Set(1.0f) };
+    V const x2{ x + x };
+    V const y2{ y + y };
+    V const z2{ z + z };
+    V const xx{ x * x2 }, yy{ y * y2 }, zz{ z * z2 };
+    V const xy{ x * y2 }, xz{ x * z2 }, yz{ y * z2 };
+    V const wx{ w * x2 }, wy{ w * y2 }, wz{ w * z2 };
+    V::Store(pOut, MATRIX_STRIDE, (one - yy - zz) * scaleX, (xy + wz) * scaleX, (xz - wy) * scaleX, zero);
+    V::Store(pOut + 4, MATRIX_STRIDE, (xy - wz) * scaleY, (one - xx - zz) * scaleY, (yz + wx) * scaleY, zero);
+    V::Store(pOut + 8, MATRIX_STRIDE, (xz + wy) * scaleZ, (yz - wx) * scaleZ, (one - xx - yy) * scaleZ, zero);
+    V::Store(pOut + 12, MATRIX_STRIDE, V::Load(pData, TRANSFORM_STRIDE), V::Load(pData + 1, TRANSFORM_STRIDE), V::Load(pData + 2, TRANSFORM_STRIDE), one);
+  }
+  template<typename V>
+  __forceinline void OrientEuler(acs::Transform const* pTransforms, r32v4* pOrientations) noexcept
+  {
+    r32 const* pData{ &pTransforms->mRotationEuler.x };
+    V const half{ V::Set(0.5f) };
+    V sx, cx, sy, cy, sz, cz;
+    VkSimd::SinCos(V::Load(pData, TRANSFORM_STRIDE) * half, sx, cx);
+    VkSimd::SinCos(V::Load(pData + 1, TRANSFORM_STRIDE) * half, sy, cy);
+    VkSimd::SinCos(V::Load(pData + 2, TRANSFORM_STRIDE) * half, sz, cz);
+    V const cxcy{ cx * cy }, sxsy{ sx * sy };
+    V const sxcy{ sx * cy }, cxsy{ cx * sy };
+    V::Store(&pOrientations->x, ORIENTATION_STRIDE, sxcy * cz - cxsy * sz, cxsy * cz + sxcy * sz, cxcy * sz - sxsy * cz, cxcy * cz + sxsy * sz);
+  }
+
+  /*
+  * Batch specific routines.
+  */
+
+  __forceinline void Compose(acs::Transform const* pTransforms, u32 count, r32m4* pMatrices) noexcept
+  {
+    VkSimd::Batch(count, [&]<typename V>(u32 i) { ComposeEuler<V>(pTransforms + i, pMatrices + i); });
+  }
+  __forceinline void Compose(acs::Transform const* pTransforms, r32v4 const* pOrientations, u32 count, r32m4* pMatrices) noexcept
+  {
+    VkSimd::Batch(count, [&]<typename V>(u32 i) { ComposeQuaternion<V>(pTransforms + i, pOrientations + i, pMatrices + i); });
+  }
+  // Caches rotations as quaternions laid out x, y, z, w
+  __forceinline void Orient(acs::Transform const* pTransforms, u32 count, r32v4* pOrientations) noexcept
+  {
+    VkSimd::Batch(count, [&]<typename V>(u32 i) { OrientEuler<V>(pTransforms + i, pOrientations + i); });
+  }
+  // Reference composition through glm
+  __forceinline r32m4 Compose(acs::Transform const& transform) noexcept
+  {
+    return glm::translate(r32m4{ 1.0f }, transform.mPosition) * glm::mat4_cast(glm::quat{ transform.mRotationEuler }) * glm::scale(r32m4{ 1.0f }, transform.mScale);
+  }
+
+  /*
+  * Actor specific routines.
+  */
+
+  // Recomposes model matrices of all chunks whose transforms changed after since
+  __forceinline void Update(u64 since) noexcept
+  {
+    VkAcs::ParallelBatch<acs::Transform const, acs::Model>(VkAcs::Changed<acs::Transform>{ since }, [](u32 count, acs::Transform const* pTransforms, acs::Model* pModels)
+    {
+      Compose(pTransforms, count, &pModels->mMatrix);
+    });
+  }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "VkUploader.h"
+
+VkUploader::VkUploader(VkDevice vkDevice, VkAllocator* pVkAllocator, VkQueue vkTransferQueue, u32 transferQueueFamily, u32 graphicsQueueFamily, u64 capacity)
+  : mVkDevice{ vkDevice }
+  , mpVkAllocator{ pVkAllocator }
+  , mVkTransferQueue{ vkTransferQueue }
+  , mQueueFamilies{ transferQueueFamily, graphicsQueueFamily }
+  , mCapacity{ std::max(capacity, VK_UPLOADER_ALIGNMENT * 4) }
+{
+  // Command pool create info
+  VkCommandPoolCreateInfo vkCommandPoolCreateInfo{};
+  vkCommandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  vkCommandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  vkCommandPoolCreateInfo.queueFamilyIndex = transferQueueFamily;
+  VK_VALIDATE(vkCreateCommandPool(mVkDevice, &vkCommandPoolCreateInfo, nullptr, &mVkCommandPool));
+  // Command buffer allocate info
+  VkCommandBuffer vkCommandBuffers[VK_UPLOADER_BATCHES]{};
+  VkCommandBufferAllocateInfo vkCommandBufferAllocateInfo{};
+  vkCommandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  vkCommandBufferAllocateInfo.commandPool = mVkCommandPool;
+  vkCommandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  vkCommandBufferAllocateInfo.commandBufferCount = VK_UPLOADER_BATCHES;
+  VK_VALIDATE(vkAllocateCommandBuffers(mVkDevice, &vkCommandBufferAllocateInfo, vkCommandBuffers));
+  // Batch fences
+  VkFenceCreateInfo vkFenceCreateInfo{};
+  vkFenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  for (u32 i{}; i < VK_UPLOADER_BATCHES; ++i)
+  {
+    mBatches[i].mVkCommandBuffer = vkCommandBuffers[i];
+    VK_VALIDATE(vkCreateFence(mVkDevice, &vkFenceCreateInfo, nullptr, &mBatches[i].mVkFence));
+    mFree.emplace_back(VK_UPLOADER_BATCHES - 1 - i);
+  }
+  // Staging ring, stays mapped for the lifetime of the uploader
+  VkBufferCreateInfo vkBufferCreateInfo{};
+  vkBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  vkBufferCreateInfo.size = mCapacity;
+  vkBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  mpVkAllocator->CreateBuffer(vkBufferCreateInfo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, mVkStagingBuffer, mStagingAllocation);
+}
+VkUploader::~VkUploader()
+{
+  WaitIdle();
+  for (auto& batch : mBatches)
+  {
+    vkDestroyFence(mVkDevice, batch.mVkFence, nullptr);
+  }
+  vkDestroyCommandPool(mVkDevice, mVkCommandPool, nullptr);
+  mpVkAllocator->DestroyBuffer(mVkStagingBuffer, mStagingAllocation);
+}
+
+u64 VkUploader::Upload(VkBuffer vkBuffer, u64 offset, void const* pData, u64 size)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  u8 const* pBytes{ (u8 const*)pData };
+  while (size)
+  {
+    // Split large payloads so batches keep cycling through the ring
+    u64 const chunk{ std::min(size, mCapacity / 4) };
+    u64 const position{ Reserve(chunk) % mCapacity };
+    std::memcpy((u8*)mStagingAllocation.mpMapped + position, pBytes, chunk);
+    // Record copy
+    VkBufferCopy vkBufferCopy{};
+    vkBufferCopy.srcOffset = position;
+    vkBufferCopy.dstOffset = offset;
+    vkBufferCopy.size = chunk;
+    vkCmdCopyBuffer(mBatches[Begin()].mVkCommandBuffer, mVkStagingBuffer, vkBuffer, 1, &vkBufferCopy);
+    pBytes += chunk;
+    offset += chunk;
+    size -= chunk;
+  }
+  return (mRecording < VK_UPLOADER_BATCHES) ? mBatches[mRecording].mTicket : mTicket;
+}
+u64 VkUploader::Submit()
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  return Flush();
+}
+void VkUploader::Poll()
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  while (Reclaim(0));
+}
+
+u32 VkUploader::Completed(u64 ticket)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  while (Reclaim(0));
+  return ticket <= mCompleted;
+}
+void VkUploader::Wait(u64 ticket)
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  // Tickets of the recording batch would never complete otherwise
+  if (mRecording < VK_UPLOADER_BATCHES && mBatches[mRecording].mTicket <= ticket)
+  {
+    Flush();
+  }
+  while (mCompleted < ticket && Reclaim(1));
+}
+void VkUploader::WaitIdle()
+{
+  std::lock_guard<std::mutex> lock{ mMutex };
+  Flush();
+  while (Reclaim(1));
+}
+
+void VkUploader::ShareWithGraphics(VkBufferCreateInfo& vkBufferCreateInfo) const
+{
+  if (mQueueFamilies[0] != mQueueFamilies[1])
+  {
+    vkBufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    vkBufferCreateInfo.queueFamilyIndexCount = 2;
+    vkBufferCreateInfo.pQueueFamilyIndices = mQueueFamilies;
+  }
+}
+
+u64 VkUploader::Reserve(u64 size)
+{
+  u64 position{ (mHead + VK_UPLOADER_ALIGNMENT - 1) & ~(VK_UPLOADER_ALIGNMENT - 1) };
+  // Ranges never wrap, the remainder of the ring gets skipped instead
+  if (position % mCapacity + size > mCapacity)
+  {
+    position = (position / mCapacity + 1) * mCapacity;
+  }
+  // Recycle batches until the range is no longer in flight
+  while (position + size - mTail > mCapacity)
+  {
+    if (mInFlight.empty())
+    {
+      if (mRecording == VK_UPLOADER_BATCHES)
+      {
+        mTail = mHead;
+        break;
+      }
+      Flush();
+    }
+    Reclaim(1);
+  }
+  mHead = position + size;
+  return position;
+}
+u32 VkUploader::Begin()
+{
+  if (mRecording < VK_UPLOADER_BATCHES)
+  {
+    return mRecording;
+  }
+  // All batches in flight, wait for the oldest one
+  if (mFree.empty())
+  {
+    Reclaim(1);
+  }
+  mRecording = mFree.back();
+  mFree.pop_back();
+  Batch& batch{ mBatches[mRecording] };
+  batch.mTicket = ++mTicket;
+  // Command buffer begin info
+  VkCommandBufferBeginInfo vkCommandBufferBeginInfo{};
+  vkCommandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  vkCommandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_VALIDATE(vkBeginCommandBuffer(batch.mVkCommandBuffer, &vkCommandBufferBeginInfo));
+  // Order copies after those of earlier batches which may still be executing
+  VkMemoryBarrier vkMemoryBarrier{};
+  vkMemoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  vkMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(batch.mVkCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &vkMemoryBarrier, 0, nullptr, 0, nullptr);
+  return mRecording;
+}
+u64 VkUploader::Flush()
+{
+  if (mRecording == VK_UPLOADER_BATCHES)
+  {
+    return mTicket;
+  }
+  Batch& batch{ mBatches[mRecording] };
+  VK_VALIDATE(vkEndCommandBuffer(batch.mVkCommandBuffer));
+  // Submit commands
+  VkSubmitInfo vkSubmitInfo{};
+  vkSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  vkSubmitInfo.commandBufferCount = 1;
+  vkSubmitInfo.pCommandBuffers = &batch.mVkCommandBuffer;
+  VK_VALIDATE(vkQueueSubmit(mVkTransferQueue, 1, &vkSubmitInfo, batch.mVkFence));
+  batch.mHead = mHead;
+  mInFlight.emplace_back(mRecording);
+  mRecording = VK_UPLOADER_BATCHES;
+  return batch.mTicket;
+}
+u32 VkUploader::Reclaim(u32 wait)
+{
+  if (mInFlight.empty())
+  {
+    return 0;
+  }
+  Batch& batch{ mBatches[mInFlight.front()] };
+  if (wait)
+  {
+    VK_VALIDATE(vkWaitForFences(mVkDevice, 1, &batch.mVkFence, 1, ~0ull));
+  }
+  else if (vkGetFenceStatus(mVkDevice, batch.mVkFence) != VK_SUCCESS)
+  {
+    return 0;
+  }
+  VK_VALIDATE(vkResetFences(mVkDevice, 1, &batch.mVkFence));
+  // Batches retire in submission order, the ring is free up to where this one ended
+  mTail = batch.mHead;
+  mCompleted = batch.mTicket;
+  mFree.emplace_back(mInFlight.front());
+  mInFlight.pop_front();
+  return 1;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef VK_UPLOADER
+#define VK_UPLOADER
+
+/*
+* Asynchronous staging uploads.
+*
+* Ring structure:
+* ---Staging ring-----------------------------------Batches------------------
+*    |                                              |
+*    [Tail ... in flight ... | Head ... free ...] --> [Commands, Fence, Head]
+*
+* Uploads get copied into one persistently mapped staging buffer which is used
+* as a ring, the head advances on every upload and the tail follows the oldest
+* batch the device has finished. Copies are recorded into the current batch
+* and many uploads leave in a single submit on the transfer queue. Every batch
+* carries a fence and a monotonic ticket, callers poll or wait on tickets and
+* the graphics queue never gets stalled.
+*
+* When the transfer queue belongs to its own family, destination buffers have
+* to be shared with the graphics family, see ShareWithGraphics. Payloads larger
+* than a quarter of the ring get split into several copies.
+*/
+
+#include "VkCore.h"
+#include "VkAllocator.h"
+
+/*
+* Global parameters.
+*/
+
+constexpr u64 VK_UPLOADER_CAPACITY { 16ull * 1024 * 1024 };
+constexpr u64 VK_UPLOADER_ALIGNMENT{ 16 };
+constexpr u32 VK_UPLOADER_BATCHES  { 4 };
+
+/*
+* Uploader.
+*/
+
+class VkUploader
+{
+public:
+  VkUploader(VkDevice vkDevice, VkAllocator* pVkAllocator, VkQueue vkTransferQueue, u32 transferQueueFamily, u32 graphicsQueueFamily, u64 capacity = VK_UPLOADER_CAPACITY);
+  virtual ~VkUploader();
+
+public:
+  // Stages data and records its copy, returns the ticket of the batch carrying it
+  u64  Upload(VkBuffer vkBuffer, u64 offset, void const* pData, u64 size);
+  // Submits the recorded batch, returns its ticket or the last submitted one if nothing was recorded
+  u64  Submit();
+  // Reclaims finished batches without blocking
+  void Poll();
+
+  u32  Completed(u64 ticket);
+  void Wait(u64 ticket);
+  void WaitIdle();
+
+  // Lets buffers written by the transfer queue be read by the graphics queue without ownership transfers
+  void ShareWithGraphics(VkBufferCreateInfo& vkBufferCreateInfo) const;
+
+private:
+  struct Batch
+  {
+    VkCommandBuffer mVkCommandBuffer{};
+    VkFence         mVkFence        {};
+    u64             mTicket         {};
+    u64             mHead           {};
+  };
+
+  u64  Reserve(u64 size);
+  u32  Begin();
+  u64  Flush();
+  u32  Reclaim(u32 wait);
+
+  VkDevice          mVkDevice          {};
+  VkAllocator*      mpVkAllocator      {};
+  VkQueue           mVkTransferQueue   {};
+  u32               mQueueFamilies[2]  {};
+  VkCommandPool     mVkCommandPool     {};
+  VkBuffer          mVkStagingBuffer   {};
+  VkAllocation      mStagingAllocation {};
+  u64               mCapacity          {};
+  u64               mHead              {};
+  u64               mTail              {};
+  u64               mTicket            {};
+  u64               mCompleted         {};
+  u32               mRecording         { VK_UPLOADER_BATCHES };
+  Batch             mBatches[VK_UPLOADER_BATCHES]{};
+  std::vector<u32>  mFree              {};
+  std::deque<u32>   mInFlight          {};
+  std::mutex        mMutex             {};
+};
+
+#endif
\ No newline at end of file
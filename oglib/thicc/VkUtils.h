@@ -13,7 +13,7 @@ namespace VkUtils
   * Vulkan helper routines.
   */
   
-  static std::vector<VkLayerProperties>     GetLayerProperties()
+  inline std::vector<VkLayerProperties>     GetLayerProperties()
   {
     u32 layerCount{};
     VK_VALIDATE(vkEnumerateInstanceLayerProperties(&layerCount, nullptr));
@@ -21,7 +21,7 @@ namespace VkUtils
     VK_VALIDATE(vkEnumerateInstanceLayerProperties(&layerCount, vkLayers.data()));
     return vkLayers;
   }
-  static std::vector<VkExtensionProperties> GetInstanceExtensionProperties(s8 const* pVkLayerName)
+  inline std::vector<VkExtensionProperties> GetInstanceExtensionProperties(s8 const* pVkLayerName)
   {
     u32 extensionCount{};
     VK_VALIDATE(vkEnumerateInstanceExtensionProperties(pVkLayerName, &extensionCount, nullptr));
@@ -29,7 +29,7 @@ namespace VkUtils
     VK_VALIDATE(vkEnumerateInstanceExtensionProperties(pVkLayerName, &extensionCount, vkExtensions.data()));
     return vkExtensions;
   }
-  static std::vector<VkExtensionProperties> GetSupportedExtensionsProperties(VkPhysicalDevice vkPhysicalDevice)
+  inline std::vector<VkExtensionProperties> GetSupportedExtensionsProperties(VkPhysicalDevice vkPhysicalDevice)
   {
     u32 extensionCount{};
     VK_VALIDATE(vkEnumerateDeviceExtensionProperties(vkPhysicalDevice, nullptr, &extensionCount, nullptr));
@@ -38,7 +38,7 @@ namespace VkUtils
     return vkExtensions;
   }
 
-  static std::vector<s8 const*>             GetLayerPropertyNames(std::vector<VkLayerProperties> const& vkLayerProperties)
+  inline std::vector<s8 const*>             GetLayerPropertyNames(std::vector<VkLayerProperties> const& vkLayerProperties)
   {
     std::vector<s8 const*> vkLayerNames{};
     for (auto const& vkLayerProperty : vkLayerProperties)
@@ -47,7 +47,7 @@ namespace VkUtils
     }
     return vkLayerNames;
   }
-  static std::vector<s8 const*>             GetExtensionPropertyNames(std::vector<VkExtensionProperties> const& vkExtensionProperties)
+  inline std::vector<s8 const*>             GetExtensionPropertyNames(std::vector<VkExtensionProperties> const& vkExtensionProperties)
   {
     std::vector<s8 const*> vkExtensionsNames{};
     for (auto const& vkExtensionProperty : vkExtensionProperties)
@@ -56,21 +56,49 @@ namespace VkUtils
     }
     return vkExtensionsNames;
   }
-  static std::vector<s8 const*>             GetRequiredExtensionNames(u32 debugEnabled)
+  inline std::vector<s8 const*>             GetRequiredExtensionNames(u32 debugEnabled, [[maybe_unused]] u32 windowed)
   {
-    u32 extensionCount{};
-    s8 const** ppVkExtensions{ glfwGetRequiredInstanceExtensions(&extensionCount) };
     std::vector<s8 const*> vkRequiredExtensions{};
-    for (u32 i{}; i < extensionCount; ++i)
+#ifndef VK_HEADLESS
+    if (windowed)
     {
-      vkRequiredExtensions.emplace_back(ppVkExtensions[i]);
+      u32 extensionCount{};
+      s8 const** ppVkExtensions{ glfwGetRequiredInstanceExtensions(&extensionCount) };
+      for (u32 i{}; i < extensionCount; ++i)
+      {
+        vkRequiredExtensions.emplace_back(ppVkExtensions[i]);
+      }
     }
+#endif
     if (debugEnabled)
     {
       vkRequiredExtensions.emplace_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
     }
     return vkRequiredExtensions;
   }
+  inline std::vector<s8 const*>             GetRequiredDeviceExtensionNames(u32 windowed)
+  {
+    std::vector<s8 const*> vkRequiredExtensions{};
+    if (windowed)
+    {
+      vkRequiredExtensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    return vkRequiredExtensions;
+  }
+
+  /*
+  * Hashing routines.
+  */
+
+  inline u64                                Hash(void const* pData, u64 size, u64 hash = 14695981039346656037ull)
+  {
+    u8 const* pBytes{ (u8 const*)pData };
+    for (u64 i{}; i < size; ++i)
+    {
+      hash = (hash ^ pBytes[i]) * 1099511628211ull;
+    }
+    return hash;
+  }
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "VkVertices.h"
+
+namespace
+{
+  /*
+  * Conversion kernels.
+  */
+
+  struct CompactKernel
+  {
+    VertexLambert const*  mpVertices{};
+    VertexLambertCompact* mpCompact {};
+
+    template<typename V>
+    __forceinline void operator () (u32 first) const noexcept
+    {
+      constexpr u32 W{ V::WIDTH };
+      constexpr u32 STRIDE{ sizeof(VertexLambert) / sizeof(r32) };
+      r32 const* pFloats{ mpVertices[first].mPosition };
+      V const sign{ V::Set(-0.0f) };
+      V const one{ V::Set(1.0f) };
+      V const zero{ V::Set(0.0f) };
+      // Positions and uvs become halves
+      alignas(32) u16 halves[5][W];
+      V::StoreHalf(halves[0], V::Load(pFloats + 0, STRIDE));
+      V::StoreHalf(halves[1], V::Load(pFloats + 1, STRIDE));
+      V::StoreHalf(halves[2], V::Load(pFloats + 2, STRIDE));
+      V::StoreHalf(halves[3], V::Load(pFloats + 6, STRIDE));
+      V::StoreHalf(halves[4], V::Load(pFloats + 7, STRIDE));
+      // Normals get projected onto the octahedron, the lower half folds over the diagonals
+      V const nx{ V::Load(pFloats + 3, STRIDE) };
+      V const ny{ V::Load(pFloats + 4, STRIDE) };
+      V const nz{ V::Load(pFloats + 5, STRIDE) };
+      V const length{ V::Max(V::AndNot(sign, nx) + V::AndNot(sign, ny) + V::AndNot(sign, nz), V::Set(1e-20f)) };
+      V const ox{ nx / length };
+      V const oy{ ny / length };
+      V const fx{ (one - V::AndNot(sign, oy)) * ((ox & sign) | one) };
+      V const fy{ (one - V::AndNot(sign, ox)) * ((oy & sign) | one) };
+      V const lower{ V::Less(nz, zero) };
+      V const ex{ (lower & fx) | V::AndNot(lower, ox) };
+      V const ey{ (lower & fy) | V::AndNot(lower, oy) };
+      alignas(32) s32 ints[6][W];
+      V::StoreInt(ints[0], V::Round(V::Min(V::Max(ex, V::Set(-1.0f)), one) * V::Set(32767.0f)));
+      V::StoreInt(ints[1], V::Round(V::Min(V::Max(ey, V::Set(-1.0f)), one) * V::Set(32767.0f)));
+      // Colors become unsigned normalized bytes
+      for (u32 i{}; i < 4; ++i)
+      {
+        V::StoreInt(ints[2 + i], V::Round(V::Min(V::Max(V::Load(pFloats + 8 + i, STRIDE), zero), one) * V::Set(255.0f)));
+      }
+      for (u32 i{}; i < W; ++i)
+      {
+        VertexLambertCompact& compact{ mpCompact[first + i] };
+        compact.mPosition[0] = { halves[0][i] };
+        compact.mPosition[1] = { halves[1][i] };
+        compact.mPosition[2] = { halves[2][i] };
+        compact.mPosition[3] = { 0x3C00 };
+        compact.mNormal[0] = { (s16)ints[0][i] };
+        compact.mNormal[1] = { (s16)ints[1][i] };
+        compact.mUv[0] = { halves[3][i] };
+        compact.mUv[1] = { halves[4][i] };
+        compact.mColor[0] = { (u8)ints[2][i] };
+        compact.mColor[1] = { (u8)ints[3][i] };
+        compact.mColor[2] = { (u8)ints[4][i] };
+        compact.mColor[3] = { (u8)ints[5][i] };
+      }
+    }
+  };
+}
+
+void VkVertex::Compact(VertexLambert const* pVertices, VertexLambertCompact* pCompact, u32 count) noexcept
+{
+  VkSimd::Batch(count, CompactKernel{ pVertices, pCompact });
+}
\ No newline at end of file
@@ -1,9 +1,49 @@
 #ifndef VK_VERTICES
 #define VK_VERTICES
 
+/*
+* Vertex formats.
+*
+* Compact lambert vertex, 20 instead of 48 bytes:
+* ---Position-------------Normal------------Uv-------------Color-------------
+*    |                    |                 |              |
+*    [x y z 1 : half4]    [oct : snorm16x2] [u v : half2]  [r g b a : unorm8x4]
+*
+* The element type of a member decides its attribute format, so the attribute
+* descriptions of a vertex type get built at compile time from the list of its
+* members, locations follow the order of that list. Float vertices are the
+* authoring format and get quantized in batches before they are uploaded.
+* Normals are octahedral encoded, the shader unfolds them from two components.
+* Half positions keep 11 bits of mantissa, meshes are expected in a local space
+* of modest extent.
+*/
+
 #include "VkCore.h"
+#include "VkSimd.h"
+
+/*
+* Element types.
+*/
+
+namespace VkVertex
+{
+  struct Half
+  {
+    u16 mBits;
+  };
+  struct Snorm16
+  {
+    s16 mValue;
+  };
+  struct Unorm8
+  {
+    u8 mValue;
+  };
+}
 
-// TODO: Create cross compilable versions
+/*
+* Vertex types.
+*/
 
 #pragma pack(push, 1)
 struct VertexLambert
@@ -13,6 +53,154 @@ struct VertexLambert
   r32 mUv[2];
   r32 mColor[4];
 };
+struct VertexLambertCompact
+{
+  VkVertex::Half    mPosition[4];
+  VkVertex::Snorm16 mNormal[2];
+  VkVertex::Half    mUv[2];
+  VkVertex::Unorm8  mColor[4];
+};
+struct VertexGizmo
+{
+  r32 mPosition[3];
+  r32 mColor[4];
+};
 #pragma pack(pop)
 
+static_assert(sizeof(VertexLambertCompact) == 20);
+
+/*
+* Attribute generation.
+*/
+
+namespace VkVertex
+{
+  struct Attribute
+  {
+    VkFormat mFormat{};
+    u32      mOffset{};
+    u32      mSize  {};
+  };
+
+  template<u32 N>
+  struct Attributes
+  {
+    std::array<VkVertexInputAttributeDescription, N> mDescriptions{};
+    u32                                              mSize        {};
+  };
+
+  // Runtime view of the attributes of a vertex type, all of them live in binding zero
+  struct Layout
+  {
+    VkVertexInputAttributeDescription const* mpDescriptions{};
+    u32                                      mCount        {};
+    u32                                      mStride       {};
+  };
+
+  // Specialized per vertex type through VK_VERTEX_LAYOUT
+  template<typename V>
+  struct Traits;
+
+  template<typename M>
+  constexpr VkFormat Format() noexcept
+  {
+    using E = std::remove_all_extents_t<M>;
+    constexpr u32 count{ std::is_array_v<M> ? (u32)std::extent_v<M> : 1 };
+    static_assert(std::rank_v<M> <= 1 && count >= 1 && count <= 4, "Attributes hold one to four elements");
+    if constexpr (std::is_same_v<E, r32>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+      return vkFormats[count - 1];
+    }
+    else if constexpr (std::is_same_v<E, Half>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R16_SFLOAT, VK_FORMAT_R16G16_SFLOAT, VK_FORMAT_R16G16B16_SFLOAT, VK_FORMAT_R16G16B16A16_SFLOAT };
+      return vkFormats[count - 1];
+    }
+    else if constexpr (std::is_same_v<E, Snorm16>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R16_SNORM, VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16B16_SNORM, VK_FORMAT_R16G16B16A16_SNORM };
+      return vkFormats[count - 1];
+    }
+    else if constexpr (std::is_same_v<E, Unorm8>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8A8_UNORM };
+      return vkFormats[count - 1];
+    }
+    else if constexpr (std::is_same_v<E, u32>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+      return vkFormats[count - 1];
+    }
+    else if constexpr (std::is_same_v<E, s32>)
+    {
+      constexpr VkFormat vkFormats[]{ VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+      return vkFormats[count - 1];
+    }
+    else
+    {
+      static_assert(sizeof(M) == 0, "Element type has no attribute format");
+    }
+  }
+
+  template<typename... A>
+  constexpr Attributes<sizeof...(A)> Describe(A const&... attributes) noexcept
+  {
+    Attributes<sizeof...(A)> result{};
+    u32 location{};
+    for (Attribute const& attribute : { attributes... })
+    {
+      result.mDescriptions[location] = VkVertexInputAttributeDescription{ location, 0, attribute.mFormat, attribute.mOffset };
+      result.mSize += attribute.mSize;
+      location++;
+    }
+    return result;
+  }
+
+  template<typename V>
+  constexpr Layout Of() noexcept
+  {
+    // Every byte of the vertex belongs to exactly one listed member
+    static_assert(Traits<V>::ATTRIBUTES.mSize == sizeof(V), "Vertex layout misses members");
+    return Layout{ Traits<V>::ATTRIBUTES.mDescriptions.data(), (u32)Traits<V>::ATTRIBUTES.mDescriptions.size(), (u32)sizeof(V) };
+  }
+
+  /*
+  * Conversion routines.
+  */
+
+  // Quantizes float vertices into compact ones, wide lanes first and the tail in scalar
+  void Compact(VertexLambert const* pVertices, VertexLambertCompact* pCompact, u32 count) noexcept;
+}
+
+#define VK_VERTEX_ATTRIBUTE(TYPE, MEMBER) \
+VkVertex::Attribute{ VkVertex::Format<decltype(TYPE::MEMBER)>(), (u32)offsetof(TYPE, MEMBER), (u32)sizeof(TYPE::MEMBER) }
+
+#define VK_VERTEX_LAYOUT(TYPE, ...)                                    \
+template<>                                                             \
+struct VkVertex::Traits<TYPE>                                          \
+{                                                                      \
+  static constexpr auto ATTRIBUTES{ VkVertex::Describe(__VA_ARGS__) }; \
+};
+
+/*
+* Vertex layouts.
+*/
+
+VK_VERTEX_LAYOUT(VertexLambert,
+  VK_VERTEX_ATTRIBUTE(VertexLambert, mPosition),
+  VK_VERTEX_ATTRIBUTE(VertexLambert, mNormal),
+  VK_VERTEX_ATTRIBUTE(VertexLambert, mUv),
+  VK_VERTEX_ATTRIBUTE(VertexLambert, mColor))
+
+VK_VERTEX_LAYOUT(VertexLambertCompact,
+  VK_VERTEX_ATTRIBUTE(VertexLambertCompact, mPosition),
+  VK_VERTEX_ATTRIBUTE(VertexLambertCompact, mNormal),
+  VK_VERTEX_ATTRIBUTE(VertexLambertCompact, mUv),
+  VK_VERTEX_ATTRIBUTE(VertexLambertCompact, mColor))
+
+VK_VERTEX_LAYOUT(VertexGizmo,
+  VK_VERTEX_ATTRIBUTE(VertexGizmo, mPosition),
+  VK_VERTEX_ATTRIBUTE(VertexGizmo, mColor))
+
 #endif
\ No newline at end of file
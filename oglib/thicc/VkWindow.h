@@ -3,22 +3,17 @@
 
 #include "VkCore.h"
 #include "VkRenderer.h"
-
-struct Sandbox
-{
-  virtual void OnUpdate(r32 time) {};
-  virtual void OnPhysic(r32 time) {};
-  virtual void OnDebug(r32 time) const {};
-};
-
-template<typename T>
-concept Sandboxable = std::is_base_of_v<Sandbox, T>;
+#include "VkAcs.h"
+#include "VkTransform.h"
+#include "VkPhysics.h"
+#include "VkCulling.h"
+#include "VkSandbox.h"
 
 template<Sandboxable S>
 class VkWindow
 {
 public:
-  VkWindow(u32 width, u32 height, std::string const& title, u32 fps = 60, u32 debug = 0)
+  VkWindow(u32 width, u32 height, std::string const& title, u32 fps = 60, u32 debug = 0, u32 frames = VK_FRAMES_IN_FLIGHT)
   {
     // Initialize GLFW
     glfwInit();
@@ -40,31 +35,36 @@ public:
     r32 time{};
     r32 timePrev{};
     r32 timeDelta{};
-    r32 timeFixed{ 1.f / fps };
-    r32 timeFixedPrev{};
-    mpVkRenderer = new VkRenderer{ width, height, mpGlfwWindow, debug };
+    u64 version{};
+    VkPhysics::Clock clock{ 1.f / fps };
+    mpVkRenderer = new VkRenderer{ width, height, mpGlfwWindow, debug, frames };
     mpSandbox = new S;
+    mpSandbox->OnCreate(*mpVkRenderer);
     while (running)
     {
       glfwPollEvents();
       time = (r32)glfwGetTime();
       timeDelta = time - timePrev;
       mpSandbox->OnUpdate(time);
-      if ((time - timeFixedPrev) >= timeFixed)
+      VkAcs::Flush();
+      clock.Advance(timeDelta);
+      while (clock.Consume())
       {
-        mpSandbox->OnPhysic(time);
-        //RenderBegin(width, height, time);
-        //DeferredRenderBegin();
-        //DeferredRender();
-        //DeferredRenderEnd();
-        //DebugRenderBegin();
-        //pSandbox->OnDebug(time);
-        //DebugRender();
-        //DebugRenderEnd();
-        //RenderEnd();
-        glfwSwapBuffers(mpGlfwWindow);
-        timeFixedPrev = time;
+        mpSandbox->OnPhysic(clock.Time());
+        VkPhysics::Step(clock.Step());
+        VkAcs::Flush();
       }
+      u64 const versionNext{ VkAcs::Version() };
+      VkTransform::Update(version);
+      VkPhysics::Interpolate(clock.Alpha());
+      version = versionNext;
+      std::optional<VkCulling::View> const view{ VkCulling::FindView(mpVkRenderer->Aspect()) };
+      mpVkRenderer->Render(view ? &*view : nullptr);
+      //DebugRenderBegin();
+      //pSandbox->OnDebug(time);
+      //DebugRender();
+      //DebugRenderEnd();
+      running = !glfwWindowShouldClose(mpGlfwWindow);
       timePrev = time;
     }
   }
@@ -1,37 +1,421 @@
 #include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
 #include <sstream>
+#include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+/*
+* Incremental shader build.
+*
+* Usage: spirv <projectDir> [--compiler <path>] [--jobs <count>] [-D<name>[=<value>] ...]
+*
+* Every shader below shaders/ gets hashed together with all of its (nested)
+* #include files, the defines and the compiler command line. Shaders whose hash
+* matches the one recorded in compiled/manifest.txt and whose output still exists
+* are skipped, all others get compiled in parallel. Outputs of shaders which no
+* longer exist are removed, nothing else inside compiled/ is touched. Files
+* without a shader stage extension are only ever compiled as includes.
+*
+* All outputs get embedded into compiled/VkShaderCode.h as constexpr arrays, the
+* header is only rewritten if its content changed so unchanged shaders never
+* trigger a rebuild of the renderer. Nothing inside compiled/ is checked in, the
+* first build compiles every shader with -V and creates the manifest.
+*
+* The compiler defaults to glslangValidator from $VULKAN_SDK, or from the PATH
+* if the variable is not set, and can be overriden through --compiler or
+* $GLSLANG_VALIDATOR.
+*/
+
+namespace fs = std::filesystem;
+
+struct Shader
+{
+  fs::path    mSource{};
+  fs::path    mOutput{};
+  std::string mName  {};
+  uint64_t    mHash  {};
+};
+
+/*
+* Hashing routines.
+*/
+
+static uint64_t Hash(std::string const& data, uint64_t hash = 14695981039346656037ull)
+{
+  for (unsigned char const c : data)
+  {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+static bool ReadFile(fs::path const& path, std::string& data)
+{
+  std::ifstream stream{ path, std::ios::binary };
+  if (!stream)
+  {
+    return false;
+  }
+  std::ostringstream oss{};
+  oss << stream.rdbuf();
+  data = oss.str();
+  return true;
+}
+// Folds the source and every file it includes into the hash, each file is visited once
+static uint64_t HashSource(fs::path const& path, std::vector<fs::path> const& includeDirs, std::set<fs::path>& visited, uint64_t hash)
+{
+  if (!visited.emplace(fs::weakly_canonical(path)).second)
+  {
+    return hash;
+  }
+  std::string source{};
+  if (!ReadFile(path, source))
+  {
+    // Missing includes are left for the compiler to report, the name keeps the hash distinct
+    return Hash("missing:" + path.generic_string(), hash);
+  }
+  hash = Hash(path.filename().string(), hash);
+  hash = Hash(source, hash);
+  std::istringstream lines{ source };
+  std::string line{};
+  while (std::getline(lines, line))
+  {
+    size_t const directive{ line.find_first_not_of(" \t") };
+    if (directive == std::string::npos || line.compare(directive, 1, "#") != 0)
+    {
+      continue;
+    }
+    size_t const keyword{ line.find_first_not_of(" \t", directive + 1) };
+    if (keyword == std::string::npos || line.compare(keyword, 7, "include") != 0)
+    {
+      continue;
+    }
+    size_t const open{ line.find_first_of("\"<", keyword + 7) };
+    size_t const close{ open == std::string::npos ? open : line.find_first_of("\">", open + 1) };
+    if (close == std::string::npos)
+    {
+      continue;
+    }
+    std::string const name{ line.substr(open + 1, close - open - 1) };
+    // Quoted includes resolve relative to the including file first, then the include directories
+    fs::path resolved{ path.parent_path() / name };
+    for (size_t i{}; i < includeDirs.size() && !fs::exists(resolved); ++i)
+    {
+      resolved = includeDirs[i] / name;
+    }
+    hash = HashSource(resolved, includeDirs, visited, hash);
+  }
+  return hash;
+}
+
+/*
+* Manifest routines.
+*/
+
+static std::map<std::string, uint64_t> ReadManifest(fs::path const& path)
+{
+  std::map<std::string, uint64_t> manifest{};
+  std::ifstream stream{ path };
+  std::string name{};
+  std::string hash{};
+  while (stream >> hash >> name)
+  {
+    manifest[name] = std::strtoull(hash.c_str(), nullptr, 16);
+  }
+  return manifest;
+}
+static bool WriteManifest(fs::path const& path, std::map<std::string, uint64_t> const& manifest)
+{
+  fs::path const temporary{ fs::path{ path }.concat(".tmp") };
+  {
+    std::ofstream stream{ temporary, std::ios::trunc };
+    for (auto const& [name, hash] : manifest)
+    {
+      char hex[17]{};
+      std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+      stream << hex << " " << name << "\n";
+    }
+    if (!stream)
+    {
+      return false;
+    }
+  }
+  std::error_code error{};
+  fs::rename(temporary, path, error);
+  return !error;
+}
+
+/*
+* Embedding routines.
+*/
+
+// Identifier of an output, gizmo.vert becomes gizmo_vert
+static std::string Identifier(std::string const& name)
+{
+  std::string identifier{ name };
+  for (char& c : identifier)
+  {
+    if (!std::isalnum((unsigned char)c))
+    {
+      c = '_';
+    }
+  }
+  return identifier;
+}
+static bool WriteEmbedded(fs::path const& path, fs::path const& outputPath, std::map<std::string, uint64_t> const& manifest)
+{
+  std::ostringstream oss{};
+  oss << "#ifndef VK_SHADER_CODE\n#define VK_SHADER_CODE\n\n";
+  oss << "/*\n* Embedded SPIR-V, generated by the spirv tool from compiled/, do not edit.\n*/\n\n";
+  oss << "#include <cstdint>\n\nnamespace VkShaderCode\n{\n";
+  oss << "  struct Entry\n  {\n    char const*          mpName;\n    std::uint32_t const* mpCode;\n    std::uint64_t        mSize;\n  };\n\n";
+  for (auto const& [name, hash] : manifest)
+  {
+    std::string code{};
+    if (!ReadFile(outputPath / name, code) || code.empty() || code.size() % 4)
+    {
+      std::cerr << "Output " << name << " is no SPIR-V module\n";
+      return false;
+    }
+    oss << "  inline constexpr std::uint32_t " << Identifier(name) << "[]\n  {";
+    for (size_t i{}; i < code.size(); i += 4)
+    {
+      uint32_t word{};
+      std::memcpy(&word, code.data() + i, 4);
+      char hex[12]{};
+      std::snprintf(hex, sizeof(hex), "0x%08x,", word);
+      oss << (i % 32 ? " " : "\n    ") << hex;
+    }
+    oss << "\n  };\n";
+  }
+  oss << "\n  inline constexpr Entry sEntries[]\n  {\n";
+  for (auto const& [name, hash] : manifest)
+  {
+    oss << "    Entry{ \"" << name << "\", " << Identifier(name) << ", sizeof(" << Identifier(name) << ") },\n";
+  }
+  oss << "  };\n\n";
+  oss << "  // Code of an output by its path below compiled/, null if there is none\n";
+  oss << "  constexpr Entry const* Find(char const* pName)\n  {\n";
+  oss << "    for (Entry const& entry : sEntries)\n    {\n";
+  oss << "      std::uint64_t i{};\n";
+  oss << "      while (entry.mpName[i] && entry.mpName[i] == pName[i])\n      {\n        ++i;\n      }\n";
+  oss << "      if (entry.mpName[i] == pName[i])\n      {\n        return &entry;\n      }\n";
+  oss << "    }\n    return nullptr;\n  }\n}\n\n#endif";
+  std::string existing{};
+  if (ReadFile(path, existing) && existing == oss.str())
+  {
+    return true;
+  }
+  fs::path const temporary{ fs::path{ path }.concat(".tmp") };
+  {
+    std::ofstream stream{ temporary, std::ios::binary | std::ios::trunc };
+    stream << oss.str();
+    if (!stream)
+    {
+      return false;
+    }
+  }
+  std::error_code error{};
+  fs::rename(temporary, path, error);
+  return !error;
+}
+
+/*
+* Compiler routines.
+*/
+
+static std::string DefaultCompiler()
+{
+  if (char const* pCompiler{ std::getenv("GLSLANG_VALIDATOR") })
+  {
+    return pCompiler;
+  }
+#ifdef _WIN32
+  std::string const executable{ "glslangValidator.exe" };
+#else
+  std::string const executable{ "glslangValidator" };
+#endif
+  if (char const* pSdk{ std::getenv("VULKAN_SDK") })
+  {
+    fs::path const path{ fs::path{ pSdk } / "Bin" / executable };
+    if (fs::exists(path))
+    {
+      return path.string();
+    }
+    fs::path const pathLower{ fs::path{ pSdk } / "bin" / executable };
+    if (fs::exists(pathLower))
+    {
+      return pathLower.string();
+    }
+  }
+  return executable;
+}
+static bool IsStage(fs::path const& path)
+{
+  static std::set<std::string> const stages{ ".vert", ".tesc", ".tese", ".geom", ".frag", ".comp" };
+  return stages.count(path.extension().string()) != 0;
+}
+static std::string Quote(std::string const& argument)
+{
+  return "\"" + argument + "\"";
+}
 
 int main(int argc, char* argv[])
 {
-  std::string projectDir{ argv[1] };
+  if (argc < 2)
+  {
+    std::cerr << "Usage: spirv <projectDir> [--compiler <path>] [--jobs <count>] [-D<name>[=<value>] ...]\n";
+    return 1;
+  }
+
+  fs::path const projectPath{ argv[1] };
+  fs::path const shaderPath{ projectPath / "shaders" };
+  fs::path const outputPath{ projectPath / "compiled" };
+  fs::path const manifestPath{ outputPath / "manifest.txt" };
+  fs::path const embeddedPath{ outputPath / "VkShaderCode.h" };
+
+  std::string compiler{ DefaultCompiler() };
+  unsigned jobs{ std::max(std::thread::hardware_concurrency(), 1u) };
+  std::vector<std::string> defines{};
+
+  for (int i{ 2 }; i < argc; ++i)
+  {
+    std::string const argument{ argv[i] };
+    if (argument == "--compiler" && i + 1 < argc)
+    {
+      compiler = argv[++i];
+    }
+    else if (argument == "--jobs" && i + 1 < argc)
+    {
+      jobs = std::max(std::atoi(argv[++i]), 1);
+    }
+    else if (argument.rfind("-D", 0) == 0)
+    {
+      defines.emplace_back(argument);
+    }
+    else
+    {
+      std::cerr << "Unknown argument " << argument << "\n";
+      return 1;
+    }
+  }
 
-  std::filesystem::path const projectPath = projectDir;
+  // Vulkan semantics, the renderer consumes the outputs as SPIR-V modules
+  std::ostringstream flags{};
+  flags << "-V";
+  for (auto const& define : defines)
+  {
+    flags << " " << Quote(define);
+  }
+  std::vector<fs::path> const includeDirs{ shaderPath };
 
-  if (std::filesystem::exists(projectPath / "compiled"))
-    std::filesystem::remove_all(projectPath / "compiled");
+  fs::create_directories(outputPath);
 
-  std::filesystem::create_directory(projectPath / "compiled");
+  std::map<std::string, uint64_t> const manifestPrev{ ReadManifest(manifestPath) };
+  std::map<std::string, uint64_t> manifest{};
+  std::vector<Shader> shaders{};
 
-  for (auto const& file : std::filesystem::recursive_directory_iterator{ projectPath / "shaders" })
+  for (auto const& file : fs::recursive_directory_iterator{ shaderPath })
   {
-    if (file.is_directory())
+    if (file.is_directory() || !IsStage(file.path()))
+      continue;
+
+    fs::path const relative{ fs::relative(file.path(), shaderPath) };
+    std::set<fs::path> visited{};
+    Shader shader{ file.path(), outputPath / relative, relative.generic_string() };
+    shader.mHash = Hash(compiler + " " + flags.str());
+    shader.mHash = HashSource(file.path(), includeDirs, visited, shader.mHash);
+
+    auto const it{ manifestPrev.find(shader.mName) };
+    if (it != manifestPrev.end() && it->second == shader.mHash && fs::exists(shader.mOutput))
+    {
+      manifest[shader.mName] = shader.mHash;
       continue;
+    }
+    shaders.emplace_back(shader);
+  }
+
+  // Outputs of removed shaders
+  for (auto const& [name, hash] : manifestPrev)
+  {
+    if (!fs::exists(shaderPath / name))
+    {
+      std::error_code error{};
+      fs::remove(outputPath / name, error);
+    }
+  }
+
+  std::cout << "Shaders " << manifest.size() + shaders.size() << ", up to date " << manifest.size() << ", compiling " << shaders.size() << std::endl;
 
-    std::string const outputDir{ projectDir + "compiled" };
+  // Compile changed shaders in parallel, every worker pulls the next one until none are left
+  std::atomic<size_t> next{};
+  std::atomic<size_t> failures{};
+  std::mutex mutex{};
+  auto const worker{ [&]()
+  {
+    for (size_t index{ next++ }; index < shaders.size(); index = next++)
+    {
+      Shader const& shader{ shaders[index] };
+      fs::create_directories(shader.mOutput.parent_path());
+
+      std::ostringstream oss{};
+      oss << Quote(compiler) << " " << flags.str() << " " << Quote(shader.mSource.string()) << " -o " << Quote(shader.mOutput.string());
+#ifdef _WIN32
+      // cmd strips the outermost quotes of the whole command line
+      std::string const command{ "\"" + oss.str() + "\"" };
+#else
+      std::string const command{ oss.str() };
+#endif
+
+      if (std::system(command.c_str()) != 0)
+      {
+        // Failed shaders stay out of the manifest and get retried on the next run
+        std::error_code error{};
+        fs::remove(shader.mOutput, error);
+        failures++;
+        std::lock_guard<std::mutex> const lock{ mutex };
+        std::cerr << "Failed to compile " << shader.mName << "\n";
+        continue;
+      }
 
-    if (!std::filesystem::exists(outputDir))
-      std::filesystem::create_directories(outputDir);
+      std::lock_guard<std::mutex> const lock{ mutex };
+      manifest[shader.mName] = shader.mHash;
+    }
+  } };
 
-    std::ostringstream oss{};
+  std::vector<std::thread> threads{};
+  for (unsigned i{ 1 }; i < std::min<size_t>(jobs, shaders.size()); ++i)
+  {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
 
-    oss << "C:\\VulkanSDK\\1.2.176.1\\Bin\\glslangValidator.exe -G100 "
-        << file.path().string()
-        << " -o " << outputDir << "\\" << file.path().filename().string();
+  if (!WriteManifest(manifestPath, manifest))
+  {
+    std::cerr << "Failed to write " << manifestPath.string() << "\n";
+    return 1;
+  }
 
-    std::system(oss.str().c_str());
+  if (!WriteEmbedded(embeddedPath, outputPath, manifest))
+  {
+    std::cerr << "Failed to write " << embeddedPath.string() << "\n";
+    return 1;
   }
 
-  return 0;
+  return failures ? 1 : 0;
 }
\ No newline at end of file
@@ -16,7 +16,7 @@ layout (binding = 0) uniform ProjectionUniform
 */
 
 layout (location = 0) in vec3 iPosition;
-layout (location = 1) in vec3 iNormal;
+layout (location = 1) in vec2 iNormal; // Octahedral, z = 1 - abs(x) - abs(y) folded back where negative
 layout (location = 2) in vec2 iUv;
 layout (location = 3) in vec4 iColor;
 
@@ -11,12 +11,21 @@ layout (binding = 0) uniform ProjectionUniform
   mat4 uModel;
 };
 
+/*
+* Storage layouts.
+*/
+
+layout (std430, binding = 1) readonly buffer InstanceStorage
+{
+  mat4 sModels[];
+};
+
 /*
 * Vertex input.
 */
 
 layout (location = 0) in vec3 iPosition;
-layout (location = 1) in vec3 iNormal;
+layout (location = 1) in vec2 iNormal; // Octahedral, z = 1 - abs(x) - abs(y) folded back where negative
 layout (location = 2) in vec2 iUv;
 layout (location = 3) in vec4 iColor;
 
@@ -36,5 +45,5 @@ layout (location = 0) out VertOut
 void main()
 {
   vertOut.color = iColor;
-  gl_Position = uProjection * uView * uModel * vec4(iPosition, 1.f);
+  gl_Position = uProjection * uView * sModels[gl_InstanceIndex] * vec4(iPosition, 1.f);
 }
\ No newline at end of file
@@ -0,0 +1,463 @@
+#include <iostream>
+#include <random>
+
+#include "VkTransform.h"
+#include "VkCulling.h"
+#include "VkLod.h"
+
+/*
+* Kernel checks.
+*
+* Usage: tests [transform] [culling] [meshlets] [lod]
+*
+* Runs the named suites, all of them without arguments, and fails if any of
+* them does. Every lane width the build supports gets instantiated on its own
+* instead of going through VkSimd::Batch, so F8, F4 and F1 are all covered on
+* an AVX2 machine.
+*
+* transform compares the matrix and quaternion kernels of VkTransform.h with
+* the glm composition they replace. Rotation errors are taken relative to the
+* scale of their column, translations have to match exactly.
+*
+* culling times the sphere test of VkCulling.h on 100k objects per lane width
+* and through the parallel Culler, all widths have to agree with a plain
+* scalar evaluation of the planes on which objects are visible.
+*
+* meshlets checks the frustum and cone test of VkCulling.h on patches of a
+* sphere, once per lane width in mesh space and once per instance through
+* CullMeshlets. The reference evaluates both in world space, meshlets closer to
+* a plane or to their cone than MESHLET_EPSILON are not compared.
+*
+* lod sweeps renderables of a mesh with doubling level errors away from the
+* eye and back through VkLod::Select. All lanes have to agree, levels may only
+* move coarser on the way out and finer on the way in, the way in has to stay
+* at least as coarse as the way out, and every switch has to happen within one
+* step of the distance the hysteresis puts it at.
+*/
+
+namespace
+{
+  /*
+  * Global parameters.
+  */
+
+  constexpr u32 TRANSFORMS      { 50000 };
+  constexpr r32 ROTATION_EPSILON{ 4e-6f };
+  constexpr u32 OBJECTS         { 100000 };
+  constexpr u32 REPEATS         { 50 };
+  constexpr u32 MESHLETS        { 1000 + 5 };
+  constexpr u32 INSTANCES       { 64 };
+  constexpr r32 MESHLET_EPSILON { 1e-3f };
+  constexpr u32 LEVELS          { 5 };
+  constexpr u32 RENDERABLES     { 8 + 4 + 1 };
+  constexpr u32 SWEEP_STEPS     { 2000 };
+
+  struct Object : VkAcs::Actor {};
+
+  /*
+  * Lane routines.
+  */
+
+  // Invokes task.template operator () <V> (name) for every lane type of the build
+  template<typename T>
+  void ForEachLane(T&& task)
+  {
+#ifdef VK_SIMD_AVX2
+    task.template operator () <VkSimd::F8> ("F8");
+#endif
+#ifdef VK_SIMD_SSE
+    task.template operator () <VkSimd::F4> ("F4");
+#endif
+    task.template operator () <VkSimd::F1> ("F1");
+  }
+
+  std::vector<acs::Transform> RandomTransforms(u32 count, r32 extent, r32 angle, r32 scaleMin, r32 scaleMax)
+  {
+    std::mt19937 random{ 42 };
+    std::uniform_real_distribution<r32> position{ -extent, extent };
+    std::uniform_real_distribution<r32> rotation{ -angle, angle };
+    std::uniform_real_distribution<r32> scale{ scaleMin, scaleMax };
+    std::vector<acs::Transform> transforms{};
+    transforms.reserve(count);
+    for (u32 i{}; i < count; ++i)
+    {
+      r32v3 const p{ position(random), position(random), position(random) };
+      r32v3 const r{ rotation(random), rotation(random), rotation(random) };
+      r32v3 const s{ scale(random), scale(random), scale(random) };
+      transforms.emplace_back(p, r, s);
+    }
+    return transforms;
+  }
+
+  /*
+  * Transform routines.
+  */
+
+  // Largest rotation error relative to the column scale, infinity once translation or the last row differ
+  r32 MatrixError(r32m4 const& matrix, r32m4 const& reference, r32v3 const& scale)
+  {
+    r32 error{};
+    for (u32 column{}; column < 3; ++column)
+    {
+      for (u32 row{}; row < 3; ++row)
+      {
+        error = std::max(error, std::abs(matrix[column][row] - reference[column][row]) / std::abs(scale[column]));
+      }
+      if (matrix[column][3] != reference[column][3])
+      {
+        return INFINITY;
+      }
+    }
+    return matrix[3] == reference[3] ? error : INFINITY;
+  }
+
+  u32 TestTransform()
+  {
+    std::vector<acs::Transform> const transforms{ RandomTransforms(TRANSFORMS, 1000.0f, 10.0f, 0.1f, 10.0f) };
+    std::vector<r32m4> references(TRANSFORMS);
+    std::vector<r32v4> orientations(TRANSFORMS);
+    for (u32 i{}; i < TRANSFORMS; ++i)
+    {
+      references[i] = VkTransform::Compose(transforms[i]);
+      glm::quat const quat{ transforms[i].mRotationEuler };
+      orientations[i] = r32v4{ quat.x, quat.y, quat.z, quat.w };
+    }
+    u32 failures{};
+    ForEachLane([&]<typename V>(s8 const* pName)
+    {
+      std::vector<r32m4> euler(TRANSFORMS);
+      std::vector<r32m4> quaternion(TRANSFORMS);
+      std::vector<r32v4> oriented(TRANSFORMS);
+      for (u32 i{}; i + V::WIDTH <= TRANSFORMS; i += V::WIDTH)
+      {
+        VkTransform::ComposeEuler<V>(transforms.data() + i, euler.data() + i);
+        VkTransform::ComposeQuaternion<V>(transforms.data() + i, orientations.data() + i, quaternion.data() + i);
+        VkTransform::OrientEuler<V>(transforms.data() + i, oriented.data() + i);
+      }
+      r32 eulerError{};
+      r32 quaternionError{};
+      r32 orientError{};
+      for (u32 i{}; i < TRANSFORMS; ++i)
+      {
+        eulerError = std::max(eulerError, MatrixError(euler[i], references[i], transforms[i].mScale));
+        quaternionError = std::max(quaternionError, MatrixError(quaternion[i], references[i], transforms[i].mScale));
+        for (u32 j{}; j < 4; ++j)
+        {
+          orientError = std::max(orientError, std::abs(oriented[i][j] - orientations[i][j]));
+        }
+      }
+      u32 const failed{ eulerError > ROTATION_EPSILON || quaternionError > ROTATION_EPSILON || orientError > ROTATION_EPSILON };
+      std::printf("Transform %s euler %.2e quaternion %.2e orient %.2e%s\n", pName, eulerError, quaternionError, orientError, failed ? " FAILED" : "");
+      failures += failed;
+    });
+    return !failures;
+  }
+
+  /*
+  * Culling routines.
+  */
+
+  // Same sphere as TestSpheres, evaluated one plane at a time without lanes
+  u32 Visible(acs::Transform const& transform, acs::Bounds const& bounds, VkCulling::Frustum const& frustum)
+  {
+    r32v3 const scale{ glm::abs(transform.mScale) };
+    r32 const radius{ bounds.mRadius * std::max(scale.x, std::max(scale.y, scale.z)) };
+    for (r32v4 const& plane : frustum.mPlanes)
+    {
+      if (glm::dot(r32v3{ plane }, transform.mPosition) + plane.w + radius < 0.0f)
+      {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  // Best time of a task over all repeats in milliseconds
+  template<typename T>
+  r64 Measure(T&& task)
+  {
+    r64 best{ INFINITY };
+    for (u32 repeat{}; repeat < REPEATS; ++repeat)
+    {
+      auto const start{ std::chrono::high_resolution_clock::now() };
+      task();
+      auto const end{ std::chrono::high_resolution_clock::now() };
+      best = std::min(best, std::chrono::duration<r64, std::milli>(end - start).count());
+    }
+    return best;
+  }
+
+  u32 BenchCulling()
+  {
+    std::vector<acs::Transform> const transforms{ RandomTransforms(OBJECTS, 200.0f, 3.14159265f, 0.5f, 2.0f) };
+    std::vector<acs::Bounds> bounds{};
+    bounds.reserve(OBJECTS);
+    std::mt19937 random{ 7 };
+    std::uniform_real_distribution<r32> radius{ 0.5f, 2.0f };
+    for (u32 i{}; i < OBJECTS; ++i)
+    {
+      bounds.emplace_back(radius(random));
+    }
+    acs::Transform const eye{ r32v3{ 0.0f }, r32v3{ 0.0f, 0.6f, 0.0f }, r32v3{ 1.0f } };
+    VkCulling::Frustum const frustum{ VkCulling::Frustum::From(eye, acs::Camera{ 60.0f, 0.1f, 150.0f }, 16.0f / 9.0f) };
+    std::vector<u32> expected{};
+    for (u32 i{}; i < OBJECTS; ++i)
+    {
+      if (Visible(transforms[i], bounds[i], frustum))
+      {
+        expected.emplace_back(i);
+      }
+    }
+    u32 failures{};
+    ForEachLane([&]<typename V>(s8 const* pName)
+    {
+      std::vector<u32> rows(OBJECTS);
+      u32 visible{};
+      r64 const time{ Measure([&]()
+      {
+        visible = 0;
+        for (u32 i{}; i + V::WIDTH <= OBJECTS; i += V::WIDTH)
+        {
+          for (u32 mask{ VkCulling::TestSpheres<V>(transforms.data() + i, bounds.data() + i, frustum) }; mask; mask &= mask - 1)
+          {
+            rows[visible++] = i + (u32)std::countr_zero(mask);
+          }
+        }
+      }) };
+      u32 const failed{ visible != expected.size() || !std::equal(expected.begin(), expected.end(), rows.begin()) };
+      std::printf("Culling %s %u objects, %u visible in %.3fms, %.2fns per object%s\n", pName, OBJECTS, visible, time, time * 1e6 / OBJECTS, failed ? " FAILED" : "");
+      failures += failed;
+    });
+    // Same objects as actors, chunks are culled on the job threads
+    for (u32 i{}; i < OBJECTS; ++i)
+    {
+      VkAcs::Handle const handle{ VkAcs::Create<Object>() };
+      VkAcs::Attach<acs::Transform>(handle, transforms[i]);
+      VkAcs::Attach<acs::Bounds>(handle, bounds[i]);
+      VkAcs::Attach<acs::Renderable>(handle, nullptr, nullptr);
+    }
+    VkAcs::Flush();
+    VkCulling::Culler culler{};
+    u64 visible{};
+    r64 const time{ Measure([&]() { visible = culler.Cull(frustum).size(); }) };
+    u32 const failed{ visible != expected.size() };
+    std::printf("Culling actors %u objects, %llu visible in %.3fms on %u threads%s\n", OBJECTS, (unsigned long long)visible, time, VkJobs::Get().Concurrency(), failed ? " FAILED" : "");
+    VkAcs::Reset();
+    return !failures && !failed;
+  }
+
+  /*
+  * Meshlet routines.
+  */
+
+  // Distances by which a meshlet clears the frustum and its cone, negative if that test culls it, evaluated in world space without lanes
+  r32v2 MeshletMargins(VkMeshlet const& meshlet, r32m4 const& model, r32 scale, VkCulling::Frustum const& frustum, r32v3 const& eye)
+  {
+    r32v3 const center{ model * r32v4{ meshlet.mCenter[0], meshlet.mCenter[1], meshlet.mCenter[2], 1.0f } };
+    r32v3 const axis{ glm::normalize(r32v3{ model * r32v4{ meshlet.mAxis[0], meshlet.mAxis[1], meshlet.mAxis[2], 0.0f } }) };
+    r32 const radius{ meshlet.mRadius * scale };
+    r32 planes{ INFINITY };
+    for (r32v4 const& plane : frustum.mPlanes)
+    {
+      planes = std::min(planes, glm::dot(r32v3{ plane }, center) + plane.w + radius);
+    }
+    r32v3 const direction{ center - eye };
+    return r32v2{ planes, meshlet.mCutoff * glm::length(direction) - glm::dot(direction, axis) + radius };
+  }
+
+  u32 TestMeshletCulling()
+  {
+    // Patches of the unit sphere facing outwards, every seventh cone never culls
+    std::mt19937 random{ 3 };
+    std::uniform_real_distribution<r32> unit{ -1.0f, 1.0f };
+    std::uniform_real_distribution<r32> radius{ 0.05f, 0.2f };
+    std::uniform_real_distribution<r32> cutoff{ 0.0f, 1.0f };
+    std::vector<VkMeshlet> meshlets(MESHLETS);
+    for (u32 i{}; i < MESHLETS; ++i)
+    {
+      r32v3 const normal{ glm::normalize(r32v3{ unit(random), unit(random), unit(random) }) };
+      VkMeshlet& meshlet{ meshlets[i] };
+      std::copy(&normal.x, &normal.x + 3, meshlet.mCenter);
+      std::copy(&normal.x, &normal.x + 3, meshlet.mAxis);
+      meshlet.mRadius = radius(random);
+      meshlet.mCutoff = i % 7 ? cutoff(random) : 1.0f;
+    }
+    acs::Transform const eye{ r32v3{ 0.0f }, r32v3{ 0.0f }, r32v3{ 1.0f } };
+    VkCulling::Frustum const frustum{ VkCulling::Frustum::From(eye, acs::Camera{ 60.0f, 0.1f, 100.0f }, 16.0f / 9.0f) };
+    // Counts the first meshlets whose visibility differs from the reference, tallies what the reference culled
+    u32 outside{};
+    u32 back{};
+    auto const mismatches{ [&](std::vector<VkMeshlet> const& source, u32 count, u32 const* pVisible, u32 visible, r32m4 const& model, r32 scale)
+    {
+      std::vector<u32> flags(count);
+      for (u32 i{}; i < visible; ++i)
+      {
+        flags[pVisible[i]] = 1;
+      }
+      u32 differ{};
+      for (u32 i{}; i < count; ++i)
+      {
+        r32v2 const margins{ MeshletMargins(source[i], model, scale, frustum, eye.mPosition) };
+        r32 const margin{ std::min(margins.x, margins.y) };
+        if (std::abs(margin) < MESHLET_EPSILON)
+        {
+          continue;
+        }
+        differ += flags[i] != (margin > 0.0f);
+        outside += margins.x < 0.0f;
+        back += margins.x > 0.0f && margins.y < 0.0f;
+      }
+      return differ;
+    } };
+    // Sphere in front of the eye in mesh space, lanes which do not fill up are left to the narrower widths
+    std::vector<VkMeshlet> front{ meshlets };
+    for (VkMeshlet& meshlet : front)
+    {
+      meshlet.mCenter[2] -= 4.0f;
+    }
+    u32 failures{};
+    ForEachLane([&]<typename V>(s8 const* pName)
+    {
+      u32 const count{ MESHLETS - MESHLETS % V::WIDTH };
+      std::vector<u32> rows(count);
+      u32 visible{};
+      for (u32 i{}; i < count; i += V::WIDTH)
+      {
+        for (u32 mask{ VkCulling::TestMeshlets<V>(front.data() + i, frustum, eye.mPosition) }; mask; mask &= mask - 1)
+        {
+          rows[visible++] = i + (u32)std::countr_zero(mask);
+        }
+      }
+      u32 const failed{ mismatches(front, count, rows.data(), visible, r32m4{ 1.0f }, 1.0f) != 0 };
+      std::printf("Meshlets %s %u meshlets, %u visible%s\n", pName, count, visible, failed ? " FAILED" : "");
+      failures += failed;
+    });
+    // Instances around the view cone and partly outside of it, under rotations and uniform scales
+    std::uniform_real_distribution<r32> angle{ -3.14159265f, 3.14159265f };
+    std::uniform_real_distribution<r32> scale{ 0.5f, 4.0f };
+    std::uniform_real_distribution<r32> depth{ -40.0f, 5.0f };
+    std::vector<u32> rows(MESHLETS);
+    u32 differ{};
+    u32 visible{};
+    for (u32 instance{}; instance < INSTANCES; ++instance)
+    {
+      r32 const s{ scale(random) };
+      acs::Transform const transform{ r32v3{ unit(random) * 15.0f, unit(random) * 10.0f, depth(random) }, r32v3{ angle(random), angle(random), angle(random) }, r32v3{ s } };
+      r32m4 const model{ VkTransform::Compose(transform) };
+      u32 const count{ VkCulling::CullMeshlets(meshlets.data(), MESHLETS, model, frustum, eye.mPosition, rows.data()) };
+      differ += mismatches(meshlets, MESHLETS, rows.data(), count, model, s);
+      visible += count;
+    }
+    // Both tests have to cull something, otherwise agreeing proves nothing
+    u32 const failed{ differ || !outside || !back };
+    std::printf("Meshlets %u instances, %u visible, %u outside, %u facing away%s\n", INSTANCES, visible, outside, back, failed ? " FAILED" : "");
+    return !failures && !failed;
+  }
+
+  /*
+  * Level routines.
+  */
+
+  u32 TestLevels()
+  {
+    // Errors double from one level to the next, the full level is exact
+    std::array<VkMeshLod, LEVELS> lods{};
+    for (u32 level{ 1 }; level < LEVELS; ++level)
+    {
+      lods[level].mError = 0.01f * (r32)(1u << level);
+    }
+    VkMesh mesh{};
+    mesh.mpLods = lods.data();
+    mesh.mLodCount = LEVELS;
+    VkLod::Projection const projection{ r32v3{ 0.0f }, 0.5f / std::tan(glm::radians(30.0f)) };
+    // Budget per unit of distance for point sized bounds, the sweep ends well past the coarsest level
+    r32 const rate{ VkLod::THRESHOLD / projection.mScale };
+    r32 const far{ 1.5f * lods[LEVELS - 1].mError / (rate * (1.0f - VkLod::HYSTERESIS)) };
+    r32 const step{ far / SWEEP_STEPS };
+    // Same distance along every axis in both directions, exact so that lanes only differ by width
+    std::vector<r32v3> directions{};
+    std::vector<acs::Transform> transforms{};
+    std::vector<acs::Bounds> bounds{};
+    std::vector<acs::Renderable> renderables{};
+    std::vector<u32> rows{};
+    for (u32 i{}; i < RENDERABLES; ++i)
+    {
+      r32v3 direction{ 0.0f };
+      direction[i % 3] = i % 6 < 3 ? 1.0f : -1.0f;
+      directions.emplace_back(direction);
+      transforms.emplace_back(r32v3{ 0.0f }, r32v3{ 0.0f }, r32v3{ 1.0f });
+      bounds.emplace_back(0.0f);
+      renderables.emplace_back(&mesh, nullptr);
+      rows.emplace_back(i);
+    }
+    // Level all renderables took at a distance, none if they disagree
+    auto const place{ [&](u32 index)
+    {
+      for (u32 i{}; i < RENDERABLES; ++i)
+      {
+        transforms[i].mPosition = directions[i] * (step * (r32)index);
+      }
+      VkLod::Select(transforms.data(), bounds.data(), renderables.data(), rows.data(), RENDERABLES, projection);
+      u32 const level{ renderables[0].mLevel };
+      return std::all_of(renderables.begin(), renderables.end(), [&](acs::Renderable const& renderable) { return renderable.mLevel == level; }) ? level : ~0u;
+    } };
+    std::vector<u32> outward(SWEEP_STEPS + 1);
+    std::vector<u32> inward(SWEEP_STEPS + 1);
+    for (u32 i{}; i <= SWEEP_STEPS; ++i)
+    {
+      outward[i] = place(i);
+    }
+    for (u32 i{ SWEEP_STEPS + 1 }; i--;)
+    {
+      inward[i] = place(i);
+    }
+    u32 failed{ outward[0] != 0 || outward[SWEEP_STEPS] != LEVELS - 1 || inward[0] != 0 };
+    u32 band{};
+    for (u32 i{}; i <= SWEEP_STEPS; ++i)
+    {
+      failed |= outward[i] == ~0u || inward[i] == ~0u || outward[i] > inward[i];
+      failed |= i && (outward[i] < outward[i - 1] || inward[i] < inward[i - 1]);
+      band += outward[i] != inward[i];
+    }
+    // Coarser once the level fits the shrunk budget, finer once it exceeds the grown one
+    for (u32 level{ 1 }; level < LEVELS; ++level)
+    {
+      u32 const out{ (u32)(std::find_if(outward.begin(), outward.end(), [&](u32 value) { return value >= level; }) - outward.begin()) };
+      u32 const in{ (u32)(std::find_if(inward.begin(), inward.end(), [&](u32 value) { return value >= level; }) - inward.begin()) };
+      r32 const outExpected{ lods[level].mError / (rate * (1.0f - VkLod::HYSTERESIS)) };
+      r32 const inExpected{ lods[level].mError / (rate * (1.0f + VkLod::HYSTERESIS)) };
+      failed |= std::abs(step * (r32)out - outExpected) > step || std::abs(step * (r32)in - inExpected) > step;
+    }
+    failed |= !band;
+    std::printf("Lod %u renderables over %u steps, levels differ by direction on %u steps%s\n", RENDERABLES, SWEEP_STEPS, band, failed ? " FAILED" : "");
+    return !failed;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::map<std::string, u32(*)()> const suites{ { "transform", TestTransform }, { "culling", BenchCulling }, { "meshlets", TestMeshletCulling }, { "lod", TestLevels } };
+  std::vector<std::string> names{};
+  for (int i{ 1 }; i < argc; ++i)
+  {
+    if (!suites.count(argv[i]))
+    {
+      std::cerr << "Usage: tests [transform] [culling] [meshlets] [lod]\n";
+      return 1;
+    }
+    names.emplace_back(argv[i]);
+  }
+  if (names.empty())
+  {
+    for (auto const& [name, suite] : suites)
+    {
+      names.emplace_back(name);
+    }
+  }
+  u32 passed{ 1 };
+  for (std::string const& name : names)
+  {
+    passed &= suites.at(name)();
+  }
+  return passed ? 0 : 1;
+}
\ No newline at end of file